@@ -4,10 +4,10 @@
  */
 
 #include <Arduino.h>
+#include "Benchmark.h" // must be before <AceTimeClock.h>
 #include <AceRoutine.h> // activate SystemClock coroutines
 #include <AceTimeClock.h>
 #include <AceWire.h> // SimpleWireInterface
-#include "Benchmark.h"
 
 using namespace ace_time::clock;
 using ace_wire::SimpleWireInterface;
@@ -48,6 +48,11 @@ void setup() {
   #endif
 #endif
 
+#if defined(EPOXY_DUINO)
+  SERIAL_PORT_MONITOR.print(F("sizeof(UnixClock): "));
+  SERIAL_PORT_MONITOR.println(sizeof(UnixClock));
+#endif
+
   SERIAL_PORT_MONITOR.print(F("sizeof(SystemClock): "));
   SERIAL_PORT_MONITOR.println(sizeof(SystemClock));
 
@@ -57,8 +62,14 @@ void setup() {
   SERIAL_PORT_MONITOR.print(F("sizeof(SystemClockCoroutine): "));
   SERIAL_PORT_MONITOR.println(sizeof(SystemClockCoroutine));
 
+  SERIAL_PORT_MONITOR.print(F("sizeof(StaticSystemClockLoop<DS3231Clock>): "));
+  SERIAL_PORT_MONITOR.println(
+      sizeof(StaticSystemClockLoop<DS3231Clock<SimpleWireInterface>>));
+
   SERIAL_PORT_MONITOR.println(F("BENCHMARKS"));
   runBenchmarks();
+  SERIAL_PORT_MONITOR.println(F("WAKEUPS"));
+  runWakeups();
   SERIAL_PORT_MONITOR.println(F("END"));
 
 #if defined(EPOXY_DUINO)
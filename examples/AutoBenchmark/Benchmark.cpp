@@ -3,13 +3,21 @@
  */
 
 #include <stdint.h>
+#include <string.h> // memcpy()
 #include <Arduino.h>
+#include "Benchmark.h" // must be before <AceTimeClock.h>
 #include <AceCommon.h> // printUint32AsFloat3To()
+#include <AceRoutine.h> // activate SystemClockCoroutine
 #include <AceTimeClock.h>
 #include <ace_time/testing/FakeClock.h>
-#include "Benchmark.h"
+#include <ace_time/testing/FakeUdpInterface.h>
+#include <ace_time/testing/FakeWireInterface.h>
+#include <ace_time/testing/TestableSystemClockLoop.h>
+#include <ace_time/testing/TestableSystemClockCoroutine.h>
 
 using ace_time::clock::SystemClockLoop;
+using ace_time::clock::SystemClockCoroutine;
+using ace_time::clock::StaticSystemClockLoop;
 using ace_time::testing::FakeClock;
 
 #if defined(ARDUINO_ARCH_AVR)
@@ -110,7 +118,607 @@ void runSystemClockLoop(const __FlashStringHelper* label) {
 
 //-----------------------------------------------------------------------------
 
+StaticSystemClockLoop<FakeClock> staticSystemClockLoop(&fakeClock, nullptr);
+
+/**
+ * Same as runSystemClockLoop(), but using a StaticSystemClockLoop whose
+ * referenceClock is called without virtual dispatch, and which has no
+ * backupClock.
+ */
+void runStaticSystemClockLoop(const __FlashStringHelper* label) {
+  fakeClock.isResponseReady(true);
+
+  yield();
+  uint32_t count = COUNT;
+  uint16_t internal = 0;
+  uint32_t startMicros = micros();
+  while (count--) {
+    if (internal == 1000) {
+      uint32_t now = fakeClock.getNow();
+      guard = now;
+      fakeClock.setNow(now + 1);
+      internal = 0;
+    }
+    internal++;
+
+    staticSystemClockLoop.loop();
+  }
+  uint32_t elapsedMicros = micros() - startMicros;
+  yield();
+  printResult(label, elapsedMicros);
+}
+
+//-----------------------------------------------------------------------------
+
+SystemClockCoroutine systemClockCoroutine(&fakeClock, nullptr);
+
+/**
+ * Call SystemClockCoroutine::runCoroutine() COUNT number of times, in the same
+ * way as runSystemClockLoop().
+ */
+void runSystemClockCoroutine(const __FlashStringHelper* label) {
+  fakeClock.isResponseReady(true);
+
+  yield();
+  uint32_t count = COUNT;
+  uint16_t internal = 0;
+  uint32_t startMicros = micros();
+  while (count--) {
+    if (internal == 1000) {
+      uint32_t now = fakeClock.getNow();
+      guard = now;
+      fakeClock.setNow(now + 1);
+      internal = 0;
+    }
+    internal++;
+
+    systemClockCoroutine.runCoroutine();
+  }
+  uint32_t elapsedMicros = micros() - startMicros;
+  yield();
+  printResult(label, elapsedMicros);
+}
+
+//-----------------------------------------------------------------------------
+
+using ace_time::acetime_t;
+using ace_time::testing::TestableClockInterface;
+using ace_time::testing::TestableSystemClockLoop;
+
+/**
+ * Call SystemClock::getNow() in the steady state, when it is called many
+ * times a second, so that it normally returns the cached seconds. Uses the
+ * systemClockLoop which was synced by runSystemClockLoop().
+ */
+void runSystemClockGetNow(const __FlashStringHelper* label) {
+  yield();
+  uint32_t count = COUNT;
+  uint32_t startMicros = micros();
+  while (count--) {
+    guard ^= systemClockLoop.getNow();
+  }
+  uint32_t elapsedMicros = micros() - startMicros;
+  yield();
+  printResult(label, elapsedMicros);
+}
+
+/**
+ * Call SystemClock::convertCapturedTicks() on the ticks captured a few
+ * seconds earlier, which is the work done in the loop() for each event
+ * timestamped by an ISR.
+ */
+void runSystemClockConvertCapturedTicks(const __FlashStringHelper* label) {
+  SystemClockLoop::tick_t ticks = SystemClockLoop::captureTicks();
+
+  yield();
+  uint32_t count = COUNT;
+  uint32_t startMicros = micros();
+  while (count--) {
+    uint32_t micros;
+    guard ^= systemClockLoop.convertCapturedTicks(ticks - count, &micros);
+    guard ^= micros;
+  }
+  uint32_t elapsedMicros = micros() - startMicros;
+  yield();
+  printResult(label, elapsedMicros);
+}
+
+TestableSystemClockLoop testableClock(nullptr, nullptr);
+
+#if ACE_TIME_CLOCK_SECONDS64
+
+/**
+ * Same as runSystemClockGetNow() using the 64-bit seconds, which is available
+ * only if ACE_TIME_CLOCK_SECONDS64 is enabled. Compare it to the
+ * SystemClock::getNow() of the same build, which converts the 64-bit seconds
+ * to acetime_t, and of the default build, which uses 32-bit seconds.
+ */
+void runSystemClockGetNow64(const __FlashStringHelper* label) {
+  yield();
+  uint32_t count = COUNT;
+  uint32_t startMicros = micros();
+  while (count--) {
+    guard ^= (uint32_t) systemClockLoop.getNow64();
+  }
+  uint32_t elapsedMicros = micros() - startMicros;
+  yield();
+  printResult(label, elapsedMicros);
+}
+
+#endif
+
+/**
+ * Call SystemClock::getNow() after 65 seconds, the longest gap allowed by the
+ * 16-bit ticks of hw::ClockInterface, so that every call takes the slow path
+ * which catches up multiple seconds with a division.
+ */
+void runSystemClockGetNowCatchUp(const __FlashStringHelper* label) {
+  TestableClockInterface::setMillis(0);
+  testableClock.setNow(700000000);
+
+  yield();
+  uint32_t count = COUNT;
+  unsigned long nowMillis = 0;
+  uint32_t startMicros = micros();
+  while (count--) {
+    nowMillis += 65000;
+    TestableClockInterface::setMillis(nowMillis);
+    guard ^= testableClock.getNow();
+  }
+  uint32_t elapsedMicros = micros() - startMicros;
+  yield();
+  printResult(label, elapsedMicros);
+}
+
+/**
+ * Call SystemClock::syncNow() through setNow(), which is the same as syncNow()
+ * when there is no referenceClock. Alternate between 2 different times so that
+ * the skew is never zero.
+ */
+void runSystemClockSyncNow(const __FlashStringHelper* label) {
+  TestableClockInterface::setMillis(0);
+
+  yield();
+  uint32_t count = COUNT;
+  uint32_t startMicros = micros();
+  while (count--) {
+    testableClock.setNow(700000000 + (count & 1));
+    guard ^= count;
+  }
+  uint32_t elapsedMicros = micros() - startMicros;
+  yield();
+  printResult(label, elapsedMicros);
+}
+
+//-----------------------------------------------------------------------------
+
+using ace_time::LocalDateTime;
+using ace_time::clock::DS3231Clock;
+using ace_time::testing::FakeWireInterface;
+
+// The time keeping registers (00h-06h) of a fake DS3231, in BCD.
+// 2022-03-14T15:26:53 Monday
+uint8_t ds3231Registers[] = {0x53, 0x26, 0x15, 0x01, 0x14, 0x03, 0x22};
+
+FakeWireInterface fakeWireInterface(ds3231Registers, sizeof(ds3231Registers));
+DS3231Clock<FakeWireInterface> ds3231Clock(fakeWireInterface);
+
+/**
+ * Call DS3231Clock::getNow() which reads the registers through the
+ * FakeWireInterface, then converts the BCD date and time into epochSeconds.
+ */
+void runDS3231ClockGetNow(const __FlashStringHelper* label) {
+  yield();
+  uint32_t count = COUNT;
+  uint32_t startMicros = micros();
+  while (count--) {
+    guard ^= ds3231Clock.getNow();
+  }
+  uint32_t elapsedMicros = micros() - startMicros;
+  yield();
+  printResult(label, elapsedMicros);
+}
+
+/**
+ * Call DS3231Clock::setNow() which converts the epochSeconds into the BCD
+ * date and time, then writes the registers through the FakeWireInterface.
+ */
+void runDS3231ClockSetNow(const __FlashStringHelper* label) {
+  yield();
+  uint32_t count = COUNT;
+  uint32_t startMicros = micros();
+  while (count--) {
+    ds3231Clock.setNow(700000000 + count);
+  }
+  uint32_t elapsedMicros = micros() - startMicros;
+  yield();
+  guard ^= ds3231Registers[0];
+  printResult(label, elapsedMicros);
+}
+
+#if defined(ARDUINO_ARCH_STM32) || defined(EPOXY_DUINO)
+
+using ace_time::clock::StmRtcClock;
+
+StmRtcClock stmRtcClock;
+
+/**
+ * Call StmRtcClock::getNow(). On EpoxyDuino, the hw::StmRtc returns a fixed
+ * date, so this measures only the conversion into epochSeconds.
+ */
+void runStmRtcClockGetNow(const __FlashStringHelper* label) {
+  yield();
+  uint32_t count = COUNT;
+  uint32_t startMicros = micros();
+  while (count--) {
+    guard ^= stmRtcClock.getNow();
+  }
+  uint32_t elapsedMicros = micros() - startMicros;
+  yield();
+  printResult(label, elapsedMicros);
+}
+
+#endif
+
+//-----------------------------------------------------------------------------
+
+using ace_time::clock::NtpClockTemplate;
+using ace_time::clock::NtpPacket;
+using ace_time::testing::FakeUdpInterface;
+
+NtpClockTemplate<FakeUdpInterface> fakeNtpClock;
+
+/**
+ * Send a request, then turn it into a matching server response which is
+ * queued in the FakeUdpInterface.
+ */
+static void respondToNtpRequest() {
+  FakeUdpInterface& udp = fakeNtpClock.getUdpInterface();
+  uint8_t packet[NtpPacket::kSize];
+  memcpy(packet, udp.getSentPacket(), NtpPacket::kSize);
+  packet[0] = (4 << 3) | NtpPacket::kModeServer;
+  packet[1] = 2; // stratum
+  memcpy(&packet[NtpPacket::kOffsetOriginateTimestamp],
+      &packet[NtpPacket::kOffsetTransmitTimestamp], 8);
+  udp.setIncomingPacket(packet, NtpPacket::kSize);
+}
+
+/** Call NtpClock::sendRequest() through the FakeUdpInterface. */
+void runNtpClockSendRequest(const __FlashStringHelper* label) {
+  fakeNtpClock.getUdpInterface().isConnected(true);
+  fakeNtpClock.connect();
+
+  yield();
+  uint32_t count = COUNT;
+  uint32_t startMicros = micros();
+  while (count--) {
+    fakeNtpClock.sendRequest();
+    guard ^= count;
+  }
+  uint32_t elapsedMicros = micros() - startMicros;
+  yield();
+  printResult(label, elapsedMicros);
+}
+
+/**
+ * Perform a full NtpClock round trip through the FakeUdpInterface:
+ * sendRequest(), creating the response packet, then isResponseReady() which
+ * parses and validates the response, and readResponse(). The difference from
+ * NtpClockSendRequest is the cost of parsing the response.
+ */
+void runNtpClockRoundTrip(const __FlashStringHelper* label) {
+  fakeNtpClock.getUdpInterface().isConnected(true);
+  fakeNtpClock.connect();
+
+  yield();
+  uint32_t count = COUNT;
+  uint32_t startMicros = micros();
+  while (count--) {
+    fakeNtpClock.sendRequest();
+    respondToNtpRequest();
+    if (fakeNtpClock.isResponseReady()) {
+      guard ^= fakeNtpClock.readResponse();
+    }
+  }
+  uint32_t elapsedMicros = micros() - startMicros;
+  yield();
+  printResult(label, elapsedMicros);
+}
+
+//-----------------------------------------------------------------------------
+
+using ace_time::Epoch;
+using ace_time::clock::EpochOffsets;
+
+// The conversion functions are wrapped in non-inlined functions to prevent the
+// compiler from hoisting the loop-invariant epoch offsets out of the loop.
+
+__attribute__((noinline))
+static acetime_t convertUnixSecondsUncached(uint32_t unixSeconds) {
+  return unixSeconds - Epoch::secondsToCurrentEpochFromUnixEpoch64();
+}
+
+__attribute__((noinline))
+static acetime_t convertUnixSecondsCached(uint32_t unixSeconds) {
+  return unixSeconds - EpochOffsets::secondsToCurrentEpochFromUnixEpoch64();
+}
+
+__attribute__((noinline))
+static acetime_t convertNtpSecondsUncached(uint32_t ntpSeconds) {
+  uint32_t offset = (uint32_t) 86400 * (uint32_t)
+      (Epoch::daysToCurrentEpochFromInternalEpoch()
+      + EpochOffsets::kDaysToInternalEpochFromNtpEpoch);
+  return (int32_t) (ntpSeconds - offset);
+}
+
+__attribute__((noinline))
+static acetime_t convertNtpSecondsCached(uint32_t ntpSeconds) {
+  return NtpClockTemplate<FakeUdpInterface>
+      ::convertNtpSecondsToAceTimeSeconds(ntpSeconds);
+}
+
+// The 64-bit conversion which resolves the NTP era using a pivot, used by
+// NtpClock::readResponse64() if ACE_TIME_CLOCK_SECONDS64 is enabled.
+__attribute__((noinline))
+static int64_t convertNtpSeconds64Cached(uint32_t ntpSeconds) {
+  return NtpClockTemplate<FakeUdpInterface>
+      ::convertNtpSecondsToAceTimeSeconds64(ntpSeconds, 0);
+}
+
+/** Measure the given conversion function. */
+void runConversion(
+    const __FlashStringHelper* label,
+    acetime_t (*convert)(uint32_t)) {
+  yield();
+  uint32_t count = COUNT;
+  uint32_t startMicros = micros();
+  while (count--) {
+    guard ^= convert(count);
+  }
+  uint32_t elapsedMicros = micros() - startMicros;
+  yield();
+  printResult(label, elapsedMicros);
+}
+
+/** Same as runConversion() for a conversion into 64-bit seconds. */
+void runConversion64(
+    const __FlashStringHelper* label,
+    int64_t (*convert)(uint32_t)) {
+  yield();
+  uint32_t count = COUNT;
+  uint32_t startMicros = micros();
+  while (count--) {
+    guard ^= (uint32_t) convert(count);
+  }
+  uint32_t elapsedMicros = micros() - startMicros;
+  yield();
+  printResult(label, elapsedMicros);
+}
+
+//-----------------------------------------------------------------------------
+
+#if defined(EPOXY_DUINO)
+
+using ace_time::clock::UnixClock;
+
+UnixClock unixClock;
+
+/**
+ * The original implementation of UnixClock::getNow(), which calls time() and
+ * computes the offset to the AceTime epoch on every call.
+ */
+void runUnixTime(const __FlashStringHelper* label) {
+  yield();
+  uint32_t count = COUNT;
+  uint32_t startMicros = micros();
+  while (count--) {
+    acetime_t now = time(nullptr)
+        - Epoch::secondsToCurrentEpochFromUnixEpoch64();
+    guard ^= now;
+  }
+  uint32_t elapsedMicros = micros() - startMicros;
+  yield();
+  printResult(label, elapsedMicros);
+}
+
+void runUnixClockGetNow(const __FlashStringHelper* label) {
+  yield();
+  uint32_t count = COUNT;
+  uint32_t startMicros = micros();
+  while (count--) {
+    guard ^= unixClock.getNow();
+  }
+  uint32_t elapsedMicros = micros() - startMicros;
+  yield();
+  printResult(label, elapsedMicros);
+}
+
+void runUnixClockGetNowMillis(const __FlashStringHelper* label) {
+  yield();
+  uint32_t count = COUNT;
+  uint32_t startMicros = micros();
+  while (count--) {
+    uint16_t millis;
+    guard ^= unixClock.getNowMillis(&millis);
+    guard ^= millis;
+  }
+  uint32_t elapsedMicros = micros() - startMicros;
+  yield();
+  printResult(label, elapsedMicros);
+}
+
+void runUnixClockMonotonicMillis(const __FlashStringHelper* label) {
+  yield();
+  uint32_t count = COUNT;
+  uint32_t startMicros = micros();
+  while (count--) {
+    guard ^= (uint32_t) UnixClock::monotonicMillis();
+  }
+  uint32_t elapsedMicros = micros() - startMicros;
+  yield();
+  printResult(label, elapsedMicros);
+}
+
+#endif
+
+//-----------------------------------------------------------------------------
+
+using ace_time::testing::TestableSystemClockCoroutine;
+
+const unsigned long MILLIS_PER_HOUR = 3600000;
+
+void printWakeups(const __FlashStringHelper* label, uint32_t wakeups) {
+  SERIAL_PORT_MONITOR.print(label);
+  SERIAL_PORT_MONITOR.print(' ');
+  SERIAL_PORT_MONITOR.println(wakeups);
+}
+
+/**
+ * Count the calls to SystemClockLoop::loop() during one simulated hour, in a
+ * tickless loop which sleeps until getMillisToNextRun() after each call, with
+ * a referenceClock which responds immediately. A loop() which spins instead
+ * is called millions of times per hour.
+ */
+void runSystemClockLoopWakeups(const __FlashStringHelper* label) {
+  FakeClock referenceClock;
+  referenceClock.setNow(700000000);
+  referenceClock.isResponseReady(true);
+  TestableClockInterface::setMillis(0);
+  TestableSystemClockLoop systemClock(&referenceClock, nullptr);
+
+  uint32_t wakeups = 0;
+  for (unsigned long t = 0; t < MILLIS_PER_HOUR; wakeups++) {
+    TestableClockInterface::setMillis(t);
+    systemClock.loop();
+    t += systemClock.getMillisToNextRun();
+  }
+  printWakeups(label, wakeups);
+}
+
+// Coroutines are inserted into a linked list by their constructor, so they
+// must not be destroyed.
+FakeClock wakeupsReferenceClock;
+TestableSystemClockCoroutine wakeupsCoroutine(&wakeupsReferenceClock, nullptr);
+
+/** Same as runSystemClockLoopWakeups() for SystemClockCoroutine. */
+void runSystemClockCoroutineWakeups(const __FlashStringHelper* label) {
+  wakeupsReferenceClock.setNow(700000000);
+  wakeupsReferenceClock.isResponseReady(true);
+  TestableClockInterface::setMillis(0);
+
+  uint32_t wakeups = 0;
+  for (unsigned long t = 0; t < MILLIS_PER_HOUR; wakeups++) {
+    TestableClockInterface::setMillis(t);
+    wakeupsCoroutine.runCoroutine();
+    t += wakeupsCoroutine.getMillisToNextRun();
+  }
+  printWakeups(label, wakeups);
+}
+
+/**
+ * A TestableSystemClockCoroutine which tells whether the next call to
+ * runCoroutine() resumes its body, instead of only checking that its
+ * COROUTINE_DELAY() has not expired.
+ */
+class ResumeCountingCoroutine: public TestableSystemClockCoroutine {
+  public:
+    explicit ResumeCountingCoroutine(FakeClock* referenceClock):
+        TestableSystemClockCoroutine(referenceClock, nullptr) {}
+
+    bool willResume() const {
+      return ! this->isDelaying() || this->isDelayExpired();
+    }
+};
+
+const uint16_t SCHEDULER_PERIOD_MILLIS = 10;
+
+FakeClock schedulerReferenceClock;
+ResumeCountingCoroutine schedulerCoroutine(&schedulerReferenceClock);
+
+/**
+ * Count the number of times that SystemClockCoroutine::runCoroutine() resumes
+ * its body during one simulated hour, when it is called every 10 millis by a
+ * CoroutineScheduler, most of which happen while it waits for the next sync
+ * attempt.
+ */
+void runSystemClockCoroutineScheduler(const __FlashStringHelper* label) {
+  schedulerReferenceClock.setNow(700000000);
+  schedulerReferenceClock.isResponseReady(true);
+
+  uint32_t wakeups = 0;
+  for (unsigned long t = 0; t < MILLIS_PER_HOUR;
+      t += SCHEDULER_PERIOD_MILLIS) {
+    TestableClockInterface::setMillis(t);
+    if (schedulerCoroutine.willResume()) wakeups++;
+    schedulerCoroutine.runCoroutine();
+  }
+  printWakeups(label, wakeups);
+}
+
+FakeClock delayingReferenceClock;
+TestableSystemClockCoroutine delayingCoroutine(
+    &delayingReferenceClock, nullptr);
+
+/**
+ * Call SystemClockCoroutine::runCoroutine() COUNT number of times, every 10
+ * simulated millis, as done by a CoroutineScheduler. Includes the cost of
+ * resuming the coroutine when its COROUTINE_DELAY() expires.
+ */
+void runSystemClockCoroutineDelaying(const __FlashStringHelper* label) {
+  delayingReferenceClock.setNow(700000000);
+  delayingReferenceClock.isResponseReady(true);
+
+  yield();
+  uint32_t count = COUNT;
+  unsigned long t = 0;
+  uint32_t startMicros = micros();
+  while (count--) {
+    TestableClockInterface::setMillis(t);
+    delayingCoroutine.runCoroutine();
+    t += SCHEDULER_PERIOD_MILLIS;
+  }
+  uint32_t elapsedMicros = micros() - startMicros;
+  yield();
+  printResult(label, elapsedMicros);
+}
+
+//-----------------------------------------------------------------------------
+
 void runBenchmarks() {
   runEmptyLoop(F("EmptyLoop"));
   runSystemClockLoop(F("SystemClockLoop"));
+  runStaticSystemClockLoop(F("StaticSystemClockLoop"));
+  runSystemClockCoroutine(F("SystemClockCoroutine"));
+  runSystemClockCoroutineDelaying(F("SystemClockCoroutine/delaying"));
+  runSystemClockGetNow(F("SystemClock::getNow()"));
+#if ACE_TIME_CLOCK_SECONDS64
+  runSystemClockGetNow64(F("SystemClock::getNow64()"));
+#endif
+  runSystemClockGetNowCatchUp(F("SystemClock::getNow()/catchUp"));
+  runSystemClockConvertCapturedTicks(F("SystemClock::convertCapturedTicks()"));
+  runSystemClockSyncNow(F("SystemClock::syncNow()"));
+  runDS3231ClockGetNow(F("DS3231Clock::getNow()"));
+  runDS3231ClockSetNow(F("DS3231Clock::setNow()"));
+#if defined(ARDUINO_ARCH_STM32) || defined(EPOXY_DUINO)
+  runStmRtcClockGetNow(F("StmRtcClock::getNow()"));
+#endif
+  runNtpClockSendRequest(F("NtpClock::sendRequest()"));
+  runNtpClockRoundTrip(F("NtpClock::roundTrip()"));
+  runConversion(F("UnixSecondsUncached"), convertUnixSecondsUncached);
+  runConversion(F("UnixSecondsCached"), convertUnixSecondsCached);
+  runConversion(F("NtpSecondsUncached"), convertNtpSecondsUncached);
+  runConversion(F("NtpSecondsCached"), convertNtpSecondsCached);
+  runConversion64(F("NtpSeconds64Cached"), convertNtpSeconds64Cached);
+#if defined(EPOXY_DUINO)
+  runUnixTime(F("time()"));
+  runUnixClockGetNow(F("UnixClock::getNow()"));
+  runUnixClockGetNowMillis(F("UnixClock::getNowMillis()"));
+  runUnixClockMonotonicMillis(F("UnixClock::monotonicMillis()"));
+#endif
+}
+
+void runWakeups() {
+  runSystemClockLoopWakeups(F("SystemClockLoop/tickless"));
+  runSystemClockCoroutineWakeups(F("SystemClockCoroutine/tickless"));
+  runSystemClockCoroutineScheduler(F("SystemClockCoroutine/scheduler"));
 }
@@ -1,6 +1,15 @@
 #ifndef AUTO_BENCHMARK_BENCHMARK_H
 #define AUTO_BENCHMARK_BENCHMARK_H
 
+// Set to 1 to measure the 64-bit seconds mode of the SystemClock. This header
+// must be included before <AceTimeClock.h> so that AutoBenchmark.ino and
+// Benchmark.cpp see the same value.
+#ifndef ACE_TIME_CLOCK_SECONDS64
+#define ACE_TIME_CLOCK_SECONDS64 0
+#endif
+
 extern void runBenchmarks();
 
+extern void runWakeups();
+
 #endif
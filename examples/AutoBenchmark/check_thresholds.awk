@@ -0,0 +1,57 @@
+#!/usr/bin/awk -f
+#
+# Usage: check_thresholds.awk epoxy_thresholds.txt epoxy.txt
+#
+# Compares the CPU benchmarks in the output of AutoBenchmark.ino (2nd file)
+# against the maximum micros per iteration in the thresholds file (1st file).
+# The wakeups per hour of the tickless loops in the WAKEUPS section are
+# checked the same way, against a maximum count.
+# Prints a line for each benchmark which is slower than its threshold, or
+# missing from the results, and exits with status 1 if there is any such
+# regression, so that it can be used in a Makefile or a CI workflow.
+
+# Read the thresholds, skipping comments and blank lines.
+FNR == NR {
+  if ($0 ~ /^#/ || NF == 0) next
+  thresholds[$1] = $2
+  next
+}
+
+/^BENCHMARKS/ || /^WAKEUPS/ {
+  collect_benchmarks = 1
+  next
+}
+
+/^END/ {
+  collect_benchmarks = 0
+  is_complete = 1
+  next
+}
+
+{
+  if (collect_benchmarks) results[$1] = $2
+}
+
+END {
+  failures = 0
+  if (! is_complete) {
+    print "ERROR: incomplete benchmark output, 'END' not found"
+    failures++
+  }
+  for (name in thresholds) {
+    if (! (name in results)) {
+      printf("MISSING: %s\n", name)
+      failures++
+    } else if (results[name] + 0 > thresholds[name] + 0) {
+      printf("REGRESSION: %s: %.3f > threshold %.3f\n",
+          name, results[name], thresholds[name])
+      failures++
+    }
+  }
+
+  if (failures > 0) {
+    printf("FAILED: %d benchmark(s) exceeded the thresholds\n", failures)
+    exit 1
+  }
+  print "PASSED: all benchmarks within thresholds"
+}
@@ -73,6 +73,46 @@ will be invoked by the following command:
 $ make README.md
 ```
 
+The same information can be printed as CSV lines, to compare the results
+across boards or versions using other tools:
+
+```
+$ ./generate_table.awk -v format=csv < nano.txt
+sizeof,DS3231Clock,7
+...
+cpu,EmptyLoop,1.107,0.000
+cpu,SystemClockLoop,9.012,7.905
+```
+
+On Linux or MacOS, the benchmarks can be run natively using EpoxyDuino, and
+compared against the regression thresholds in `epoxy_thresholds.txt`. Any
+benchmark slower than its threshold fails the command, which is run by the
+GitHub workflow:
+
+```
+$ make check_thresholds
+```
+
+To measure the cost of the 64-bit seconds mode (see
+[64-bit Seconds](../../README.md#Seconds64)), set `ACE_TIME_CLOCK_SECONDS64`
+to 1 in `Benchmark.h` and generate the `*.txt` files again. On Linux or MacOS,
+it can be set on the command line instead:
+
+```
+$ make clean
+$ make EXTRA_CPPFLAGS='-DACE_TIME_CLOCK_SECONDS64=1'
+$ ./AutoBenchmark.out
+```
+
+The `WAKEUPS` section of the output counts the number of times that the
+`SystemClockLoop` and `SystemClockCoroutine` run during one simulated hour, in
+a tickless loop which sleeps for `getMillisToNextRun()` between calls (see
+[Tickless Loop](../../README.md#SystemClockTicklessLoop)). The
+`SystemClockCoroutine/scheduler` line counts the number of times that the
+`SystemClockCoroutine` resumes from its `COROUTINE_DELAY()` during one hour,
+when a `CoroutineScheduler` calls it every 10 millis. The counts are
+independent of the processor, and are checked by `make check_thresholds`.
+
 The CPU times below are given in microseconds.
 
 ## CPU Time Changes
@@ -125,6 +165,24 @@ The CPU times below are given in microseconds.
 * Upgrade tool chains
 * Upgrade to AceTime v2.3
 
+**Unreleased**
+
+* Add benchmarks for `SystemClockCoroutine`, `SystemClock::getNow()` in the
+  steady state and in the worst-case catch up after 65 seconds,
+  `SystemClock::syncNow()`, `DS3231Clock` using a `FakeWireInterface`,
+  `StmRtcClock` (STM32 and EpoxyDuino), and the `NtpClock` request and
+  response using a `FakeUdpInterface`.
+* Add CSV output to `generate_table.awk`, and regression thresholds for the
+  EpoxyDuino run.
+* Add `StaticSystemClockLoop` benchmark, whose `FakeClock` referenceClock is
+  called without virtual dispatch, to compare against `SystemClockLoop`.
+* Add `NtpSeconds64Cached` benchmark of the 64-bit NTP conversion, and
+  `SystemClock::getNow64()` which runs only if `ACE_TIME_CLOCK_SECONDS64` is
+  set to 1 in `Benchmark.h`. The cost of the 64-bit seconds mode is the
+  difference between the `SystemClock` rows of the two builds.
+* Add `SystemClock::convertCapturedTicks()` benchmark.
+* The results of the microcontrollers below have not been regenerated yet.
+
 ## Arduino Nano
 
 * 16MHz ATmega328P
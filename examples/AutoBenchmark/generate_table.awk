@@ -1,10 +1,16 @@
 #!/usr/bin/gawk -f
 #
-# Usage: generate_table.awk < ${board}.txt
+# Usage: generate_table.awk [-v format=csv] < ${board}.txt
 #
 # Takes the *.txt file generated by AutoBenchmark.ino and generates an ASCII
 # table that can be inserted into the README.md. Collects both sizeof()
-# information as well as CPU benchmarks.
+# information as well as CPU benchmarks. With '-v format=csv', prints the same
+# information as CSV lines instead, for comparing the results across boards
+# and versions with other tools:
+#
+#   sizeof,{class},{bytes}
+#   cpu,{method},{micros},{diff}
+#   wakeups,{loop},{count}
 
 BEGIN {
   # Set to 1 when 'SIZEOF' is detected
@@ -12,6 +18,9 @@ BEGIN {
 
   # Set to 1 when 'BENCHMARKS' is detected
   collect_benchmarks = 0
+
+  # Set to 1 when 'WAKEUPS' is detected
+  collect_wakeups = 0
 }
 
 /^SIZEOF/ {
@@ -28,6 +37,14 @@ BEGIN {
   next
 }
 
+/^WAKEUPS/ {
+  collect_sizeof = 0
+  collect_benchmarks = 0
+  collect_wakeups = 1
+  wakeups_index = 0
+  next
+}
+
 !/^END/ {
   if (collect_sizeof) {
     s[sizeof_index] = $0
@@ -38,16 +55,17 @@ BEGIN {
     u[benchmark_index]["micros"] = $2
     benchmark_index++
   }
+  if (collect_wakeups) {
+    w[wakeups_index]["name"] = $1
+    w[wakeups_index]["count"] = $2
+    wakeups_index++
+  }
 }
 
 END {
   TOTAL_BENCHMARKS = benchmark_index
   TOTAL_SIZEOF = sizeof_index
-
-  printf("Sizes of Objects:\n")
-  for (i = 0; i < TOTAL_SIZEOF; i++) {
-    print s[i]
-  }
+  TOTAL_WAKEUPS = wakeups_index
 
   # Calculate the diff from baseline
   baseline = u[0]["micros"]
@@ -55,6 +73,28 @@ END {
     u[i]["diff"] = u[i]["micros"] - baseline
   }
 
+  if (format == "csv") {
+    for (i = 0; i < TOTAL_SIZEOF; i++) {
+      # "sizeof(DS3231Clock): 7" -> "sizeof,DS3231Clock,7"
+      line = s[i]
+      gsub(/^sizeof\(|\):/, "", line)
+      split(line, fields, " ")
+      printf("sizeof,%s,%s\n", fields[1], fields[2])
+    }
+    for (i = 0; i < TOTAL_BENCHMARKS; i++) {
+      printf("cpu,%s,%.3f,%.3f\n", u[i]["name"], u[i]["micros"], u[i]["diff"])
+    }
+    for (i = 0; i < TOTAL_WAKEUPS; i++) {
+      printf("wakeups,%s,%d\n", w[i]["name"], w[i]["count"])
+    }
+    exit
+  }
+
+  printf("Sizes of Objects:\n")
+  for (i = 0; i < TOTAL_SIZEOF; i++) {
+    print s[i]
+  }
+
   print ""
   print "CPU:"
 
@@ -64,6 +104,11 @@ END {
     name = u[i]["name"]
     if (name ~ /^EmptyLoop$/ \
         || name ~ /^SystemClockLoop$/ \
+        || name ~ /^SystemClock::getNow\(\)$/ \
+        || name ~ /^DS3231Clock::getNow\(\)$/ \
+        || name ~ /^NtpClock::sendRequest\(\)$/ \
+        || name ~ /^UnixSecondsUncached$/ \
+        || name ~ /^time\(\)$/ \
     ) {
       printf(\
         "|------------------------------------+-------------+----------|\n")
@@ -71,4 +116,17 @@ END {
     printf("| %-34s |    %8.3f | %8.3f |\n", name, u[i]["micros"], u[i]["diff"])
   }
   printf("+------------------------------------+-------------+----------+\n")
+
+  if (TOTAL_WAKEUPS == 0) exit
+
+  print ""
+  print "Wakeups per hour:"
+
+  printf("+------------------------------------+-------------+\n")
+  printf("| Loop                               | wakeups/hr  |\n")
+  printf("|------------------------------------+-------------|\n")
+  for (i = 0; i < TOTAL_WAKEUPS; i++) {
+    printf("| %-34s |    %8d |\n", w[i]["name"], w[i]["count"])
+  }
+  printf("+------------------------------------+-------------+\n")
 }
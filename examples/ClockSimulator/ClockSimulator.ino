@@ -0,0 +1,182 @@
+/*
+ * A program to evaluate the sync behavior of SystemClockLoop and
+ * SystemClockCoroutine on a Linux or MacOS host under EpoxyDuino, using the
+ * deterministic testing::ClockSimulator. Each scenario simulates 7 days of
+ * operation against a SimulatedOscillator and a SimulatedReferenceClock in
+ * virtual time, which takes a fraction of a second on the host. The results
+ * are identical across runs, so the table can be compared before and after a
+ * change to the sync algorithm.
+ *
+ * The last scenario replays a recorded trace of oscillator drift and network
+ * latencies. Replace the TRACE_PPMS and TRACE_LATENCIES arrays with data
+ * captured in the field.
+ *
+ * Set PRINT_CSV to 1 to print the error-vs-time samples of the first scenario
+ * as `seconds,errorMillis,syncCount` lines, which can be plotted.
+ *
+ * The output looks like this:
+ *
+ * ClockSimulator
+ * Scenario        Requests  Syncs  FirstSync(s)  Max(ms)  Rms(ms)  Last(ms)
+ * ideal-1h             168    168             0      179    102.7       178
+ * wifi-1h              169    169             0      215    104.8         0
+ * wifi-10m            1008   1008             0       36     17.5        25
+ * wifi-1h-coro         168    168             0      216    105.0       174
+ * lossy-1h             169    121             0      816    210.5      -259
+ * outage-1h            169    157             0     2610    436.9         0
+ * rtc-1h               169    169             0     1187    429.7        -2
+ * trace-1h             168    140             0      271     76.3       154
+ * END
+ */
+
+#if !defined(EPOXY_DUINO)
+  #error This sketch works only on EpoxyDuino
+#endif
+
+#include <Arduino.h>
+#include <stdio.h> // printf()
+#include <AceRoutine.h> // enable TestableSystemClockCoroutine
+#include <AceTimeClock.h>
+#include <ace_time/testing/ClockSimulator.h>
+
+using ace_time::acetime_t;
+using ace_time::testing::ClockSimulator;
+using ace_time::testing::SimulatedOscillator;
+using ace_time::testing::SimulatedReferenceClock;
+using ace_time::testing::SimulationResult;
+using ace_time::testing::TestableSystemClockCoroutine;
+using ace_time::testing::TestableSystemClockLoop;
+
+#define PRINT_CSV 0
+
+// Duration of each scenario.
+static const uint32_t DURATION_SECONDS = 7 * (uint32_t) 86400;
+
+// Interval between error samples.
+static const uint32_t SAMPLE_INTERVAL_SECONDS = 10;
+
+// 2022-03-01T00:00:00 UTC
+static const acetime_t START_SECONDS = 699408000;
+
+// Recorded oscillator drift (ppm), one sample per hour.
+static const float TRACE_PPMS[] = {
+  21.5, 22.0, 22.8, 23.9, 25.1, 26.0, 26.4, 26.1,
+  25.2, 24.0, 22.9, 22.1, 21.4, 20.9, 20.6, 20.5,
+  20.7, 21.0, 21.3, 21.5, 21.6, 21.6, 21.5, 21.4,
+};
+
+// Recorded NTP round trip latencies (millis), -1 for a lost request.
+static const int16_t TRACE_LATENCIES[] = {
+  32, 35, 31, 180, 33, -1, 34, 36, 30, 41, 33, 650, 35, 32, -1, -1, 34, 31,
+};
+
+static void printResult(const char* name, const SimulationResult& result) {
+  printf("%-15s %8u %6u %13d %8d %8.1f %9d\n",
+      name,
+      (unsigned) result.requestCount,
+      (unsigned) result.syncCount,
+      (result.firstSyncSeconds == UINT32_MAX)
+          ? -1 : (int) result.firstSyncSeconds,
+      (int) result.maxAbsErrorMillis,
+      result.rmsErrorMillis,
+      (int) result.lastErrorMillis);
+}
+
+// Simulate a SystemClockLoop or SystemClockCoroutine syncing every
+// syncPeriodSeconds.
+template <typename T_CLOCK>
+static void runScenario(
+    const char* name,
+    SimulatedOscillator& oscillator,
+    SimulatedReferenceClock& reference,
+    uint16_t syncPeriodSeconds,
+    Print* output = nullptr) {
+  T_CLOCK systemClock(&reference, nullptr, syncPeriodSeconds);
+  ClockSimulator<T_CLOCK> simulator(
+      systemClock, oscillator, &reference, START_SECONDS);
+  simulator.setOutput(output);
+  simulator.setup();
+  printResult(name,
+      simulator.run(DURATION_SECONDS, SAMPLE_INTERVAL_SECONDS));
+}
+
+void runScenarios() {
+  printf("Scenario        Requests  Syncs  FirstSync(s)  Max(ms)  Rms(ms)  "
+      "Last(ms)\n");
+
+  {
+    // Ceramic resonator, ideal network.
+    SimulatedOscillator oscillator(50.0);
+    SimulatedReferenceClock reference;
+    runScenario<TestableSystemClockLoop>("ideal-1h", oscillator, reference,
+        3600, PRINT_CSV ? &SERIAL_PORT_MONITOR : nullptr);
+  }
+  {
+    // Ceramic resonator with temperature wander, typical WiFi network.
+    SimulatedOscillator oscillator(50.0, 10.0, 86400);
+    SimulatedReferenceClock reference(20, 200);
+    runScenario<TestableSystemClockLoop>("wifi-1h", oscillator, reference,
+        3600);
+  }
+  {
+    SimulatedOscillator oscillator(50.0, 10.0, 86400);
+    SimulatedReferenceClock reference(20, 200);
+    runScenario<TestableSystemClockLoop>("wifi-10m", oscillator, reference,
+        600);
+  }
+  {
+    SimulatedOscillator oscillator(50.0, 10.0, 86400);
+    SimulatedReferenceClock reference(20, 200);
+    runScenario<TestableSystemClockCoroutine>("wifi-1h-coro", oscillator,
+        reference, 3600);
+  }
+  {
+    // Lossy network, with an uncompensated half of the latency.
+    SimulatedOscillator oscillator(50.0, 10.0, 86400);
+    SimulatedReferenceClock reference(20, 900, 30);
+    reference.setLagPercent(50);
+    runScenario<TestableSystemClockLoop>("lossy-1h", oscillator, reference,
+        3600);
+  }
+  {
+    // Network down for 12 hours on the second day.
+    SimulatedOscillator oscillator(50.0, 10.0, 86400);
+    SimulatedReferenceClock reference(20, 200);
+    reference.addOutage(86400, 86400 + 43200);
+    runScenario<TestableSystemClockLoop>("outage-1h", oscillator, reference,
+        3600);
+  }
+  {
+    // RTC reference with 1-second resolution (e.g. DS3231).
+    SimulatedOscillator oscillator(50.0, 10.0, 86400);
+    SimulatedReferenceClock reference(1, 2);
+    reference.setMillisResolution(false);
+    runScenario<TestableSystemClockLoop>("rtc-1h", oscillator, reference,
+        3600);
+  }
+  {
+    // Replay of the recorded traces.
+    SimulatedOscillator oscillator;
+    oscillator.setPpmTrace(TRACE_PPMS,
+        sizeof(TRACE_PPMS) / sizeof(TRACE_PPMS[0]), 3600);
+    SimulatedReferenceClock reference;
+    reference.setLatencyTrace(TRACE_LATENCIES,
+        sizeof(TRACE_LATENCIES) / sizeof(TRACE_LATENCIES[0]));
+    runScenario<TestableSystemClockLoop>("trace-1h", oscillator, reference,
+        3600);
+  }
+}
+
+void setup() {
+  SERIAL_PORT_MONITOR.begin(115200);
+  while (!SERIAL_PORT_MONITOR); // Wait until ready - Leonardo/Micro
+  SERIAL_PORT_MONITOR.println(F("ClockSimulator"));
+
+  runScenarios();
+
+  SERIAL_PORT_MONITOR.println(F("END"));
+  exit(0);
+}
+
+void loop() {
+}
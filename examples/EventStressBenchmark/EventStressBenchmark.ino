@@ -0,0 +1,173 @@
+/*
+ * A program to measure the throughput of timestamping high-rate events using
+ * SystemClockTemplate::captureTicks(), an EventRingBuffer, and
+ * SystemClockTemplate::convertCapturedTicks(), running on a Linux or MacOS host
+ * under EpoxyDuino. The SystemClock uses the hw::MonotonicClockInterface, so
+ * the events are stamped with a resolution of one microsecond.
+ *
+ * The interrupts are simulated in a single thread: each iteration pushes a
+ * burst of a pseudo-random number of events (like an ISR firing several times
+ * between 2 calls to the global loop()), then drains the ring buffer like the
+ * loop() would. The bursts sometimes exceed the capacity of the ring buffer,
+ * so some events are dropped.
+ *
+ * The first benchmark measures the capture and queuing of the events only.
+ * The second benchmark also converts each event into epoch seconds and
+ * microseconds, while the SystemClock is stepped forward by setNow()
+ * periodically. It verifies that the converted timestamps never go backwards.
+ *
+ * The output looks like this (numbers will vary):
+ *
+ * EventStressBenchmark
+ * Capture (events/sec): 22243994
+ * Capacity: 64; Events: 2000002; Dropped: 20021; Steps: 98; Errors: 0
+ * Capture and convert (events/sec): 11483770
+ * END
+ */
+
+#if !defined(EPOXY_DUINO)
+  #error This sketch works only on EpoxyDuino
+#endif
+
+// Remember the steps of the SystemClock, so that the events captured before a
+// step are converted using the time before the step.
+#define ACE_TIME_CLOCK_EVENT_CAPTURE 1
+
+#include <Arduino.h>
+#include <AceTime.h>
+#include <AceTimeClock.h>
+
+using ace_time::acetime_t;
+using ace_time::clock::EventRingBuffer;
+using ace_time::clock::SystemClockLoopTemplate;
+using ace_time::hw::MonotonicClockInterface;
+
+using MonotonicSystemClock = SystemClockLoopTemplate<MonotonicClockInterface>;
+using tick_t = MonotonicSystemClock::tick_t;
+
+// Number of events generated by each benchmark, including the dropped ones.
+static const uint32_t COUNT = 2000000;
+
+// Maximum number of events in a single burst, larger than the capacity of the
+// ring buffer.
+static const uint8_t MAX_BURST = 80;
+
+// Number of bursts between 2 steps of the SystemClock.
+static const uint32_t BURSTS_PER_STEP = 500;
+
+static const uint8_t CAPACITY = 64;
+
+static MonotonicSystemClock systemClock(nullptr, nullptr);
+static EventRingBuffer<tick_t, CAPACITY> events;
+
+// A simple linear congruential generator, to make the bursts reproducible.
+static uint32_t seed = 1;
+static uint8_t nextBurst() {
+  seed = seed * 1103515245 + 12345;
+  return 1 + (seed >> 16) % MAX_BURST;
+}
+
+// Simulate an ISR which fires `burst` times.
+static void captureBurst(uint8_t burst) {
+  for (uint8_t i = 0; i < burst; i++) {
+    events.push(MonotonicSystemClock::captureTicks());
+  }
+}
+
+// Return the events per second, given the elapsed micros.
+static uint32_t eventsPerSecond(uint32_t count, uint32_t elapsedMicros) {
+  return (elapsedMicros == 0)
+      ? 0
+      : (uint32_t) ((uint64_t) count * 1000000 / elapsedMicros);
+}
+
+void runCaptureBenchmark() {
+  seed = 1;
+  uint32_t count = 0;
+  tick_t ticks;
+  uint32_t startMicros = micros();
+  while (count < COUNT) {
+    uint8_t burst = nextBurst();
+    captureBurst(burst);
+    count += burst;
+    while (events.pop(ticks)) {}
+  }
+  uint32_t elapsedMicros = micros() - startMicros;
+
+  SERIAL_PORT_MONITOR.print(F("Capture (events/sec): "));
+  SERIAL_PORT_MONITOR.println(eventsPerSecond(count, elapsedMicros));
+}
+
+void runConvertBenchmark() {
+  seed = 1;
+  systemClock.setNow(700000000);
+  uint16_t startOverflows = events.getOverflowCount();
+
+  uint32_t count = 0;
+  uint32_t bursts = 0;
+  uint32_t steps = 0;
+  uint32_t errors = 0;
+  acetime_t prevSeconds = 0;
+  uint32_t prevMicros = 0;
+  tick_t ticks;
+
+  uint32_t startMicros = micros();
+  while (count < COUNT) {
+    uint8_t burst = nextBurst();
+    captureBurst(burst);
+    count += burst;
+
+    while (events.pop(ticks)) {
+      uint32_t micros;
+      acetime_t seconds = systemClock.convertCapturedTicks(ticks, &micros);
+      if (seconds < prevSeconds
+          || (seconds == prevSeconds && micros < prevMicros)) {
+        errors++;
+      }
+      prevSeconds = seconds;
+      prevMicros = micros;
+    }
+
+    // Step the SystemClock forward, like a sync with a referenceClock which
+    // is ahead, while there may still be events from before the step.
+    bursts++;
+    if (bursts % BURSTS_PER_STEP == 0) {
+      uint8_t burst = nextBurst();
+      captureBurst(burst);
+      count += burst;
+      systemClock.setNow(systemClock.getNow() + 1);
+      steps++;
+    }
+    systemClock.loop();
+  }
+  uint32_t elapsedMicros = micros() - startMicros;
+  uint16_t dropped = events.getOverflowCount() - startOverflows;
+
+  SERIAL_PORT_MONITOR.print(F("Capacity: "));
+  SERIAL_PORT_MONITOR.print(CAPACITY);
+  SERIAL_PORT_MONITOR.print(F("; Events: "));
+  SERIAL_PORT_MONITOR.print(count);
+  SERIAL_PORT_MONITOR.print(F("; Dropped: "));
+  SERIAL_PORT_MONITOR.print(dropped);
+  SERIAL_PORT_MONITOR.print(F("; Steps: "));
+  SERIAL_PORT_MONITOR.print(steps);
+  SERIAL_PORT_MONITOR.print(F("; Errors: "));
+  SERIAL_PORT_MONITOR.println(errors);
+  SERIAL_PORT_MONITOR.print(F("Capture and convert (events/sec): "));
+  SERIAL_PORT_MONITOR.println(eventsPerSecond(count, elapsedMicros));
+}
+
+void setup() {
+  SERIAL_PORT_MONITOR.begin(115200);
+  while (!SERIAL_PORT_MONITOR); // Wait until ready - Leonardo/Micro
+  SERIAL_PORT_MONITOR.println(F("EventStressBenchmark"));
+
+  runCaptureBenchmark();
+  runConvertBenchmark();
+
+  SERIAL_PORT_MONITOR.println(F("END"));
+  exit(0);
+}
+
+void loop() {
+}
@@ -5,9 +5,9 @@
  * Should print the following:
  *
  * Connecting to WiFi........ Done.
- * Configuring SNTP.. Done.
- * Now Seconds: 701798545; Paris Time: 2022-03-28T18:02:25+02:00[Europe/Paris]
- * Now Seconds: 701798550; Paris Time: 2022-03-28T18:02:30+02:00[Europe/Paris]
+ * Waiting for SNTP
+ * Now Seconds: 701798545.123; Paris Time: 2022-03-28T18:02:25+02:00[Europe/Paris]
+ * Now Seconds: 701798550.125; Paris Time: 2022-03-28T18:02:30+02:00[Europe/Paris]
  * ...
  */
 
@@ -102,13 +102,26 @@ void setup() {
   SERIAL_PORT_MONITOR.println();
 
   setupWiFi(SSID, PASSWORD, REBOOT_TIMEOUT_MILLIS);
-  sntpClock.setup();
+
+  // Non-blocking. The time becomes valid after the first SNTP response.
+  sntpClock.begin();
 }
 
 void loop() {
-  acetime_t nowSeconds = sntpClock.getNow();
+  if (! sntpClock.isSynced()) {
+    SERIAL_PORT_MONITOR.println(F("Waiting for SNTP"));
+    delay(1000);
+    return;
+  }
+
+  uint16_t millis;
+  acetime_t nowSeconds = sntpClock.getNowMillis(&millis);
   SERIAL_PORT_MONITOR.print(F("Now Seconds: "));
   SERIAL_PORT_MONITOR.print(nowSeconds);
+  SERIAL_PORT_MONITOR.print('.');
+  if (millis < 100) SERIAL_PORT_MONITOR.print('0');
+  if (millis < 10) SERIAL_PORT_MONITOR.print('0');
+  SERIAL_PORT_MONITOR.print(millis);
   SERIAL_PORT_MONITOR.print("; ");
 
   auto parisTz = TimeZone::forZoneInfo(&kZoneEurope_Paris, &parisProcessor);
@@ -1,10 +1,13 @@
 /*
- * A program to demonstrate the NtpClock where the NtpClock::setup() is used to
- * setup the WiFi stack for convenience.
+ * A program to demonstrate the NtpClock where the non-blocking
+ * NtpClock::connect() is used to setup the WiFi stack for convenience. The
+ * connection comes up in the background while loop() continues to run, and is
+ * automatically reconnected if it drops.
  * Tested on ESP8266 and ESP32.
  *
  * Should print the following:
  *
+ * Waiting for WiFi...
  * Now Seconds: 701797848; Paris Time: 2022-03-28T17:50:48+02:00[Europe/Paris]
  * Now Seconds: 701797853; Paris Time: 2022-03-28T17:50:53+02:00[Europe/Paris]
  * ...
@@ -43,7 +46,8 @@ static const char PASSWORD[] = WIFI_PASSWORD;
 static const char SSID[] = "your wifi ssid";
 static const char PASSWORD[] = "your wifi passord";
 #endif
-static const unsigned long WIFI_TIMEOUT_MILLIS = 15000;
+static const uint16_t WIFI_TIMEOUT_MILLIS = 15000;
+static const unsigned long PRINT_INTERVAL_MILLIS = 5000;
 
 static BasicZoneProcessor parisProcessor;
 static NtpClock ntpClock;
@@ -54,15 +58,17 @@ void setup() {
   while (!SERIAL_PORT_MONITOR); // Wait until Serial is ready - Leonardo/Micro
   SERIAL_PORT_MONITOR.println();
 
-  // Tell NtpClock::setup() to configure the WiFi as well.
-  ntpClock.setup(SSID, PASSWORD, WIFI_TIMEOUT_MILLIS);
+  // Tell NtpClock::connect() to configure the WiFi as well. This returns
+  // immediately, and the connection is made by NtpClock::loop().
+  ntpClock.connect(SSID, PASSWORD, WIFI_TIMEOUT_MILLIS);
+}
+
+void printNow() {
   if (!ntpClock.isSetup()) {
-    SERIAL_PORT_MONITOR.println(F("WiFi connection failed... try again."));
+    SERIAL_PORT_MONITOR.println(F("Waiting for WiFi..."));
     return;
   }
-}
 
-void loop() {
   acetime_t nowSeconds = ntpClock.getNow();
   SERIAL_PORT_MONITOR.print(F("Now Seconds: "));
   SERIAL_PORT_MONITOR.print(nowSeconds);
@@ -73,6 +79,18 @@ void loop() {
   SERIAL_PORT_MONITOR.print(F("Paris Time: "));
   parisTime.printTo(SERIAL_PORT_MONITOR);
   SERIAL_PORT_MONITOR.println();
+}
 
-  delay(5000);
+void loop() {
+  static unsigned long prevMillis = millis() - PRINT_INTERVAL_MILLIS;
+
+  // Advance the WiFi connection state machine. Other work can be done here
+  // while the connection comes up.
+  ntpClock.loop();
+
+  unsigned long nowMillis = millis();
+  if ((unsigned long) (nowMillis - prevMillis) >= PRINT_INTERVAL_MILLIS) {
+    prevMillis = nowMillis;
+    printNow();
+  }
 }
@@ -2,17 +2,20 @@
  * A program to demonstrate the use of the Stm32F1Clock class. It should print
  * the following on the SERIAL_PORT_MONITOR port every 2 seconds:
  *
- *   2022-03-22T10:11:00
- *   2022-03-22T10:11:02
- *   2022-03-22T10:11:04
+ *   2022-03-22T10:11:00.000
+ *   2022-03-22T10:11:02.000
+ *   2022-03-22T10:11:04.000
  *   ...
  *
- * On EpoxyDuino however, the Stf32F1Clock class is stubbed out, so the clock
- * does not actually increment. This program prints the following, which is good
- * enough for continuous integration:
+ * The milliseconds are read from the prescaler divider of the RTC, so they
+ * follow the LSE_CLOCK instead of millis().
  *
- *   2022-03-27T10:11:00
- *   2022-03-27T10:11:00
+ * On EpoxyDuino however, the RTC registers of the Stm32F1Clock class are
+ * emulated, and the emulated clock does not increment by itself. This program
+ * prints the following, which is good enough for continuous integration:
+ *
+ *   2022-03-27T10:11:00.000
+ *   2022-03-27T10:11:00.000
  *   ...
  */
 
@@ -33,10 +36,14 @@ using ace_time::clock::Stm32F1Clock;
 Stm32F1Clock stmClock;
 
 void printCurrentTime() {
-  acetime_t now = stmClock.getNow();
+  uint16_t millis;
+  acetime_t now = stmClock.getNowMillis(&millis);
   LocalDateTime ldt = LocalDateTime::forEpochSeconds(now);
   ldt.printTo(SERIAL_PORT_MONITOR);
-  SERIAL_PORT_MONITOR.println();
+  SERIAL_PORT_MONITOR.print('.');
+  if (millis < 100) SERIAL_PORT_MONITOR.print('0');
+  if (millis < 10) SERIAL_PORT_MONITOR.print('0');
+  SERIAL_PORT_MONITOR.println(millis);
 }
 
 //-----------------------------------------------------------------------------
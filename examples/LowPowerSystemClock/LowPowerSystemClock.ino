@@ -0,0 +1,126 @@
+/*
+ * A program to demonstrate a tickless loop() which sleeps between the calls to
+ * SystemClockLoop::loop(), instead of spinning as fast as possible. Each task
+ * reports the number of millis until it needs to run again, and the loop()
+ * sleeps until the earliest deadline. The SystemClockLoop needs to run only
+ * about once a minute to keep itself alive, briefly during each sync with the
+ * referenceClock, and once for each sync attempt.
+ *
+ * The sleepMillis() function below uses delay(), which lets the ESP8266 enter
+ * its automatic modem sleep, and the ESP32 enter its automatic light sleep if
+ * power management is enabled. Replace it with the sleep mode of your
+ * processor, as long as millis() keeps running during the sleep (e.g. the IDLE
+ * mode of the AVR).
+ *
+ * On the ESP8266 and ESP32, the time is synced to an NTP server. Elsewhere, it
+ * is set manually. Should print the following every 10 seconds:
+ *
+ *   2019-06-17T19:50:00-07:00[America/Los_Angeles]; wakeups: 1
+ *   2019-06-17T19:50:10-07:00[America/Los_Angeles]; wakeups: 2
+ *   2019-06-17T19:50:20-07:00[America/Los_Angeles]; wakeups: 3
+ *   ...
+ */
+
+#include <Arduino.h>
+#include <AceTimeClock.h>
+
+using ace_time::acetime_t;
+using ace_time::ZonedDateTime;
+using ace_time::TimeZone;
+using ace_time::BasicZoneProcessor;
+using ace_time::zonedb::kZoneAmerica_Los_Angeles;
+using ace_time::clock::SystemClockLoop;
+
+// ESP32 does not define SERIAL_PORT_MONITOR
+#ifndef SERIAL_PORT_MONITOR
+#define SERIAL_PORT_MONITOR Serial
+#endif
+
+static const unsigned long PRINT_INTERVAL_MILLIS = 10000;
+
+#if defined(ESP8266) || defined(ESP32)
+using ace_time::clock::NtpClock;
+
+// Define your WiFi SSID and password. See HelloNtpClockLazy.
+#if defined(AUNITER)
+static const char SSID[] = WIFI_SSID;
+static const char PASSWORD[] = WIFI_PASSWORD;
+#else
+static const char SSID[] = "your wifi ssid";
+static const char PASSWORD[] = "your wifi passord";
+#endif
+static const uint16_t WIFI_TIMEOUT_MILLIS = 15000;
+
+static NtpClock ntpClock;
+static SystemClockLoop systemClock(&ntpClock /*reference*/, nullptr /*backup*/);
+#else
+static SystemClockLoop systemClock(nullptr /*reference*/, nullptr /*backup*/);
+#endif
+
+// ZoneProcessor instance should be created statically at initialization time.
+static BasicZoneProcessor pacificProcessor;
+
+static unsigned long prevPrintMillis;
+static uint32_t wakeups;
+
+void printCurrentTime() {
+  acetime_t now = systemClock.getNow();
+  auto pacificTz = TimeZone::forZoneInfo(&kZoneAmerica_Los_Angeles,
+      &pacificProcessor);
+  auto pacificTime = ZonedDateTime::forEpochSeconds(now, pacificTz);
+  pacificTime.printTo(SERIAL_PORT_MONITOR);
+  SERIAL_PORT_MONITOR.print(F("; wakeups: "));
+  SERIAL_PORT_MONITOR.println(wakeups);
+}
+
+// Sleep for the given number of millis, while millis() keeps running.
+void sleepMillis(uint32_t millis) {
+  delay(millis);
+}
+
+//-----------------------------------------------------------------------------
+
+void setup() {
+#if ! defined(EPOXY_DUINO)
+  delay(1000);
+#endif
+  SERIAL_PORT_MONITOR.begin(115200);
+  while (!SERIAL_PORT_MONITOR); // Wait until ready - Leonardo/Micro
+
+#if defined(ESP8266) || defined(ESP32)
+  // The WiFi connection is made by NtpClock::loop(), which is called by the
+  // NtpClock::sendRequest() and NtpClock::isResponseReady() of each sync.
+  ntpClock.connect(SSID, PASSWORD, WIFI_TIMEOUT_MILLIS);
+  systemClock.setup();
+#else
+  systemClock.setup();
+  auto pacificTz = TimeZone::forZoneInfo(&kZoneAmerica_Los_Angeles,
+      &pacificProcessor);
+  auto pacificTime = ZonedDateTime::forComponents(
+      2019, 6, 17, 19, 50, 0, pacificTz);
+  systemClock.setNow(pacificTime.toEpochSeconds());
+#endif
+
+  prevPrintMillis = millis() - PRINT_INTERVAL_MILLIS;
+}
+
+void loop() {
+  wakeups++;
+  systemClock.loop();
+
+  // The print task, which runs every PRINT_INTERVAL_MILLIS.
+  unsigned long elapsedMillis = millis() - prevPrintMillis;
+  if (elapsedMillis >= PRINT_INTERVAL_MILLIS) {
+    prevPrintMillis += PRINT_INTERVAL_MILLIS;
+    elapsedMillis -= PRINT_INTERVAL_MILLIS;
+    printCurrentTime();
+  }
+
+  // Sleep until the earliest deadline of all tasks.
+  uint32_t sleep = systemClock.getMillisToNextRun();
+  uint32_t printSleep = (elapsedMillis >= PRINT_INTERVAL_MILLIS)
+      ? 0
+      : PRINT_INTERVAL_MILLIS - elapsedMillis;
+  if (printSleep < sleep) sleep = printSleep;
+  sleepMillis(sleep);
+}
@@ -19,6 +19,9 @@
 #define FEATURE_SYSTEM_CLOCK_COROUTINE 11
 #define FEATURE_SYSTEM_CLOCK_COROUTINE_AND_BASIC_TIME_ZONE 12
 #define FEATURE_SYSTEM_CLOCK_COROUTINE_AND_EXTENDED_TIME_ZONE 13
+#define FEATURE_SYSTEM_CLOCK_LOOP_DS3231 14
+#define FEATURE_STATIC_SYSTEM_CLOCK_LOOP_DS3231 15
+#define FEATURE_SYSTEM_CLOCK_LOOP_COMPACT 16
 
 // Select one of the FEATURE_* parameter and compile. Then look at the flash
 // and RAM usage, compared to FEATURE_BASELINE usage to determine how much
@@ -27,6 +30,10 @@
 // when modifying its format.
 #define FEATURE 0
 
+#if FEATURE == FEATURE_SYSTEM_CLOCK_LOOP_COMPACT
+  #define ACE_TIME_CLOCK_COMPACT 1
+#endif
+
 #if FEATURE != FEATURE_BASELINE
   #include <AceRoutine.h> // activates SystemClockCoroutine
   #include <AceTimeClock.h>
@@ -36,7 +43,9 @@
 
 #if FEATURE == FEATURE_DS3231_CLOCK_TWO_WIRE \
     || FEATURE == FEATURE_DS3231_CLOCK_SIMPLE_WIRE \
-    || FEATURE == FEATURE_DS3231_CLOCK_SIMPLE_WIRE_FAST
+    || FEATURE == FEATURE_DS3231_CLOCK_SIMPLE_WIRE_FAST \
+    || FEATURE == FEATURE_SYSTEM_CLOCK_LOOP_DS3231 \
+    || FEATURE == FEATURE_STATIC_SYSTEM_CLOCK_LOOP_DS3231
 
   #include <AceWire.h> // TwoWireInterface, SimpleWireInterface, etc.
   #if FEATURE == FEATURE_DS3231_CLOCK_TWO_WIRE
@@ -51,6 +60,8 @@
     #include <ESP8266WiFi.h>
   #elif defined(ESP32)
     #include <WiFi.h>
+  #elif defined(EPOXY_DUINO)
+    #include <ace_time/testing/FakeUdpInterface.h>
   #endif
 
 #elif FEATURE == FEATURE_STM_RTC_CLOCK
@@ -101,6 +112,9 @@ volatile uint32_t randomNow = 342348943;
 #elif FEATURE == FEATURE_NTP_CLOCK
   #if (defined(ESP8266) || defined(ESP32))
     NtpClock ntpClock;
+  #elif defined(EPOXY_DUINO)
+    // No WiFi on the host, so use the fake UDP interface of the unit tests.
+    NtpClockTemplate<ace_time::testing::FakeUdpInterface> ntpClock;
   #endif
 
 #elif FEATURE == FEATURE_ESP_SNTP_CLOCK
@@ -118,7 +132,8 @@ volatile uint32_t randomNow = 342348943;
     Stm32F1Clock stmClock;
   #endif
 
-#elif FEATURE == FEATURE_SYSTEM_CLOCK_LOOP
+#elif FEATURE == FEATURE_SYSTEM_CLOCK_LOOP \
+    || FEATURE == FEATURE_SYSTEM_CLOCK_LOOP_COMPACT
   SystemClockLoop systemClock(nullptr, nullptr);
 
 #elif FEATURE == FEATURE_SYSTEM_CLOCK_LOOP_AND_BASIC_TIME_ZONE
@@ -136,6 +151,21 @@ volatile uint32_t randomNow = 342348943;
 #elif FEATURE == FEATURE_SYSTEM_CLOCK_COROUTINE_AND_EXTENDED_TIME_ZONE
   SystemClockCoroutine systemClock(nullptr, nullptr);
 
+#elif FEATURE == FEATURE_SYSTEM_CLOCK_LOOP_DS3231
+  static const uint8_t DELAY_MICROS = 4;
+  using WireInterface = ace_wire::SimpleWireInterface;
+  WireInterface wireInterface(SDA, SCL, DELAY_MICROS);
+  DS3231Clock<WireInterface> dsClock(wireInterface);
+  SystemClockLoop systemClock(&dsClock, nullptr);
+
+#elif FEATURE == FEATURE_STATIC_SYSTEM_CLOCK_LOOP_DS3231
+  static const uint8_t DELAY_MICROS = 4;
+  using WireInterface = ace_wire::SimpleWireInterface;
+  WireInterface wireInterface(SDA, SCL, DELAY_MICROS);
+  DS3231Clock<WireInterface> dsClock(wireInterface);
+  StaticSystemClockLoop<DS3231Clock<WireInterface>> systemClock(
+      &dsClock, nullptr);
+
 #endif
 
 // TeensyDuino seems to pull in malloc() and free() when a class with virtual
@@ -155,6 +185,27 @@ volatile uint32_t randomNow = 342348943;
   FooClass* foo;
 #endif
 
+#if defined(EPOXY_DUINO)
+// Print the sizeof() of the clock object of the selected FEATURE, or -1 if the
+// FEATURE has no clock object on EpoxyDuino. Used by
+// validate_using_epoxy_duino.sh to record the size of each clock class.
+static void printSizeof() {
+#if FEATURE == FEATURE_DS3231_CLOCK_TWO_WIRE \
+    || FEATURE == FEATURE_DS3231_CLOCK_SIMPLE_WIRE \
+    || FEATURE == FEATURE_DS3231_CLOCK_SIMPLE_WIRE_FAST
+  printf("sizeof %d\n", (int) sizeof(dsClock));
+#elif FEATURE == FEATURE_NTP_CLOCK
+  printf("sizeof %d\n", (int) sizeof(ntpClock));
+#elif FEATURE == FEATURE_STM_RTC_CLOCK
+  printf("sizeof %d\n", (int) sizeof(stmRtcClock));
+#elif FEATURE >= FEATURE_SYSTEM_CLOCK_LOOP
+  printf("sizeof %d\n", (int) sizeof(systemClock));
+#else
+  printf("sizeof -1\n");
+#endif
+}
+#endif
+
 void setup() {
 #if defined(TEENSYDUINO)
   // Force Teensy to bring in malloc(), free() and other things for virtual
@@ -247,7 +298,8 @@ void setup() {
     #error Unsupported FEATURE on this platform
   #endif
 
-#elif FEATURE == FEATURE_SYSTEM_CLOCK_LOOP
+#elif FEATURE == FEATURE_SYSTEM_CLOCK_LOOP \
+    || FEATURE == FEATURE_SYSTEM_CLOCK_LOOP_COMPACT
   systemClock.setup();
   systemClock.setNow(randomNow);
   acetime_t now = systemClock.getNow();
@@ -306,9 +358,23 @@ void setup() {
   acetime_t epochSeconds = dt.toEpochSeconds();
   guard = epochSeconds;
 
+#elif FEATURE == FEATURE_SYSTEM_CLOCK_LOOP_DS3231 \
+    || FEATURE == FEATURE_STATIC_SYSTEM_CLOCK_LOOP_DS3231
+  wireInterface.begin();
+  dsClock.setup();
+  systemClock.setup();
+  systemClock.loop();
+  acetime_t now = systemClock.getNow();
+  guard = now;
+
 #else
   #error Unknown FEATURE
 #endif
+
+#if defined(EPOXY_DUINO)
+  printSizeof();
+  exit(0);
+#endif
 }
 
 void loop() {
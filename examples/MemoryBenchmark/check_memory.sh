@@ -0,0 +1,70 @@
+#!/usr/bin/env bash
+#
+# Compile every FEATURE of MemoryBenchmark.ino into a temporary result file,
+# then compare it against the baseline file using compare_memory.awk. Exits
+# with status 1 if the baseline file does not exist, or if the flash, static
+# RAM, or sizeof() of any FEATURE grew beyond the thresholds. A FEATURE which
+# has no entry in the baseline is reported as new.
+#
+# Usage: check_memory.sh [--cli|--ide] {board} {baseline_file}
+#
+# If {board} is 'epoxy', the FEATUREs are compiled for the host using
+# validate_using_epoxy_duino.sh. Otherwise, they are compiled for the given
+# AUniter board alias (e.g. 'nano') using collect.sh, which requires the
+# Arduino IDE or CLI, but not the board itself. The thresholds can be changed
+# using the FLASH_THRESHOLD and RAM_THRESHOLD environment variables.
+
+set -eu
+
+result_file=
+
+function usage() {
+    echo 'Usage: check_memory.sh [--cli|--ide] {board} {baseline_file}'
+    exit 1
+}
+
+function cleanup() {
+    if [[ "$result_file" != '' ]]; then
+        rm -f $result_file
+    fi
+}
+
+# Parse flags.
+cli_flag='--cli'
+while [[ $# -gt 0 ]]; do
+    case $1 in
+        --cli) cli_flag='--cli' ;;
+        --ide) cli_flag='--ide' ;;
+        --help|-h) usage ;;
+        --) shift; break ;;
+        -*) echo "Unknown flag '$1'" 1>&2; usage 1>&2 ;;
+        *) break ;;
+    esac
+    shift
+done
+if [[ $# < 2 ]]; then
+    usage
+fi
+board=$1
+baseline_file=$2
+
+trap "cleanup" EXIT
+result_file=$(mktemp /tmp/memory_benchmark.check.XXXXXX)
+
+if [[ "$board" == 'epoxy' ]]; then
+    ./validate_using_epoxy_duino.sh --collect $result_file
+else
+    ./collect.sh $cli_flag $board $result_file
+fi
+
+if [[ ! -f $baseline_file ]]; then
+    echo "ERROR: No baseline '$baseline_file' to compare against." 1>&2
+    echo "Run 'make $baseline_file' using the same compiler." 1>&2
+    exit 1
+fi
+
+echo "==== Comparing against $baseline_file"
+./compare_memory.awk \
+    -v flash_threshold=${FLASH_THRESHOLD:-64} \
+    -v ram_threshold=${RAM_THRESHOLD:-8} \
+    $baseline_file $result_file
@@ -2,7 +2,7 @@
 #
 # Shell script that runs 'auniter verify ${board} MemoryBenchmark.ino',
 # and collects the flash memory and static RAM usage for each of
-# the FEATURE (0..13).
+# the FEATURE (0..16).
 #
 # Usage: collect.sh {board} {result_file}
 #
@@ -11,12 +11,12 @@
 #  FEATURE flash max_flash ram max_ram
 #  0  aa bb cc dd
 #  ...
-#  13 aa bb cc dd
+#  16 aa bb cc dd
 
 set -eu
 
 PROGRAM_NAME='MemoryBenchmark.ino'
-NUM_FEATURES=13 # excluding the baseline
+NUM_FEATURES=16 # excluding the baseline
 
 # Assume that https://github.com/bxparks/AUniter is installed as a
 # sibling project to AceTime.
@@ -0,0 +1,85 @@
+#!/usr/bin/awk -f
+#
+# Usage: compare_memory.awk [-v flash_threshold=N] [-v ram_threshold=N]
+#   {baseline_file} {result_file}
+#
+# Compares the memory usage of each FEATURE in {result_file} against the
+# checked-in {baseline_file}, both generated by collect.sh or
+# validate_using_epoxy_duino.sh. The comparison uses the increase of each
+# FEATURE over FEATURE_BASELINE (i.e. the 'delta' columns of the README.md),
+# so that changes in the Arduino core or the compiler which affect all
+# FEATUREs equally are ignored.
+#
+# A FEATURE fails if its flash grows by more than 'flash_threshold' bytes
+# (default 64), if its static RAM grows by more than 'ram_threshold' bytes
+# (default 8), or if the sizeof() of its clock object grows at all (when the
+# 6th column is present in both files). A FEATURE which is missing from the
+# baseline is reported as NEW, but does not fail, because the baseline is
+# compiled from the parent commit, which does not have the FEATUREs added by
+# the current commit. Prints a line for every FEATURE which changed or is new,
+# and exits with status 1 if any FEATURE failed.
+
+BEGIN {
+  if (flash_threshold == "") flash_threshold = 64
+  if (ram_threshold == "") ram_threshold = 8
+}
+
+# Baseline file.
+FNR == NR {
+  base_flash[$1] = $2
+  base_ram[$1] = $4
+  base_sizeof[$1] = (NF >= 6) ? $6 : ""
+  next
+}
+
+# Result file.
+{
+  flash[$1] = $2
+  ram[$1] = $4
+  size_of[$1] = (NF >= 6) ? $6 : ""
+  if ($1 + 0 > max_feature) max_feature = $1 + 0
+}
+
+END {
+  failures = 0
+  printf("FEATURE d_flash(base->new)  d_ram(base->new)  sizeof(base->new)\n")
+  for (i = 1; i <= max_feature; i++) {
+    if (! (i in flash)) continue
+    if (! (i in base_flash)) {
+      printf("%7d %7s->%-7d %7s->%-7d %6s->%-6s NEW\n",
+          i, "", flash[i] - flash[0], "", ram[i] - ram[0], "", size_of[i])
+      continue
+    }
+    if (flash[i] == -1 || base_flash[i] == -1) continue
+
+    base_d_flash = base_flash[i] - base_flash[0]
+    base_d_ram = base_ram[i] - base_ram[0]
+    d_flash = flash[i] - flash[0]
+    d_ram = ram[i] - ram[0]
+
+    status = ""
+    if (d_flash - base_d_flash > flash_threshold) status = status " FLASH"
+    if (d_ram - base_d_ram > ram_threshold) status = status " RAM"
+    if (size_of[i] != "" && base_sizeof[i] != "" \
+        && size_of[i] + 0 > base_sizeof[i] + 0) {
+      status = status " SIZEOF"
+    }
+
+    if (d_flash == base_d_flash && d_ram == base_d_ram \
+        && size_of[i] == base_sizeof[i]) {
+      continue
+    }
+    printf("%7d %7d->%-7d %7d->%-7d %6s->%-6s%s\n",
+        i, base_d_flash, d_flash, base_d_ram, d_ram,
+        base_sizeof[i], size_of[i], (status == "") ? "" : " FAIL:" status)
+    if (status != "") failures++
+  }
+
+  if (failures > 0) {
+    printf("FAILED: %d FEATURE(s) exceeded the thresholds " \
+        "(flash %d bytes, ram %d bytes)\n",
+        failures, flash_threshold, ram_threshold)
+    exit 1
+  }
+  print "PASSED: no memory regression"
+}
@@ -54,6 +54,41 @@ generates this `README.md` file. The ASCII tables below are generated by the
 `generate_table.awk` script, which takes each `*.txt` file and converts it to an
 ASCII table.
 
+## Checking for Regressions
+
+The `*.txt` files also serve as the baselines for detecting memory regressions:
+
+```
+$ make check_epoxy
+$ make check_nano
+$ make check_micro
+```
+
+Each target compiles every `FEATURE_*` into a temporary file using the
+`check_memory.sh` script, then compares it against the checked-in `*.txt` file
+using `compare_memory.awk`. The comparison uses the increase of each
+`FEATURE_*` over `FEATURE_BASELINE`, so that changes in the Arduino core or the
+compiler which affect all features equally are ignored. The check fails if the
+flash of a feature grows by more than 64 bytes, its static RAM grows by more
+than 8 bytes, or the `sizeof()` of its clock object grows at all. The
+thresholds can be changed using the `FLASH_THRESHOLD` and `RAM_THRESHOLD`
+environment variables. The check also fails if the baseline file does not
+exist. A feature which has no entry in the baseline, because it was added
+after the baseline was generated, is reported as `NEW` and does not fail the
+check.
+
+The `make check_epoxy` target compiles the features for the Linux or MacOS host
+using EpoxyDuino, which requires no Arduino tool chain, and runs in the GitHub
+workflow. Its baseline `epoxy.txt` is generated by `make epoxy.txt`, and
+contains an extra column with the `sizeof()` of the clock object of each
+feature. The numbers of the host are much larger than on a microcontroller, but
+their changes track the changes in the library. They also depend on the
+version of the host compiler, so `epoxy.txt` is not checked in. The GitHub
+workflow compiles it from the parent commit, using the same compiler, before
+running `make check_epoxy`. The `make check_nano` and `make
+check_micro` targets compile the features for AVR using the Arduino CLI, but
+do not need the board to be connected.
+
 ## Library Size Changes
 
 **v1.0.0**
@@ -138,6 +173,39 @@ ASCII table.
 * Upgrade tool chains
 * Upgrade to AceTime v2.3
 
+**Unreleased**
+
+* Remove the 48-byte `mPacketBuffer` from `NtpClock`.
+    * The constant part of the NTP request is stored in flash (`PROGMEM`)
+      and copied into a temporary buffer on the stack when the request is
+      sent.
+    * The response is parsed incrementally from the UDP receive buffer
+      through a 12-byte scratch buffer on the stack.
+    * `sizeof(NtpClock)` decreases by 48 bytes (56 bytes on 64-bit hosts
+      due to alignment), which appears as a decrease in static RAM in the
+      `NtpClock` row on ESP8266 and ESP32 once the `*.txt` files are
+      regenerated.
+* Add `make check_epoxy`, `make check_nano` and `make check_micro` which
+  flag the flash, static RAM, or `sizeof()` growth of each feature against
+  the checked-in `*.txt` baselines.
+* Add `SystemClockLoop<DS3231Clock>` and `StaticSystemClockLoop<DS3231Clock>`
+  to compare a `SystemClockLoop` which calls its referenceClock through
+  virtual dispatch against one whose referenceClock type is fixed at compile
+  time, with a `NullClock` backupClock.
+* Add `SystemClockLoop (compact)`, the `SystemClockLoop` compiled with
+  `ACE_TIME_CLOCK_COMPACT` enabled.
+    * The compact layout packs the `isInit()` flag, the sync status code and
+      the request status into a single byte of bit fields, and removes the
+      `LatencyHistogram` pointer and the monotonic millis.
+    * `sizeof(SystemClockLoop)` on AVR, computed from the member layout
+      until `nano.txt` is regenerated:
+        * default layout: 43 bytes
+        * compact layout, request status in its own byte: 34 bytes
+        * compact layout, request status in the bit field: 33 bytes
+    * The compact layout is 10 bytes smaller than the default on AVR, 12
+      bytes on 32-bit processors (52 to 40), and 16 bytes on 64-bit hosts
+      (72 to 56).
+
 ## Arduino Nano
 
 * 16MHz ATmega328P
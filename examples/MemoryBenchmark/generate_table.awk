@@ -20,6 +20,9 @@ BEGIN {
   labels[11] = "SystemClockCoroutine"
   labels[12] = "SystemClockCoroutine+1 Basic zone"
   labels[13] = "SystemClockCoroutine+1 Extended zone"
+  labels[14] = "SystemClockLoop<DS3231Clock>"
+  labels[15] = "StaticSystemClockLoop<DS3231Clock>"
+  labels[16] = "SystemClockLoop (compact)"
   record_index = 0
 }
 {
@@ -55,7 +58,8 @@ END {
         || name ~ /^NtpClock$/ \
         || name ~ /^StmRtcClock$/ \
         || name ~ /^SystemClockLoop$/ \
-        || name ~ /^SystemClockCoroutine$/) {
+        || name ~ /^SystemClockCoroutine$/ \
+        || name ~ /^SystemClockLoop<DS3231Clock>$/) {
       printf(\
         "|----------------------------------------+--------------+--------------|\n")
     }
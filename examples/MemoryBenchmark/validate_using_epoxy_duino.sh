@@ -4,12 +4,36 @@
 # Linux/MacOS/FreeBSD host machine using EpoxyDuino. This allow us to catch
 # compile-time errors quickly and in the GitHub Actions CI using 'make' instead
 # of compiling to the target platform.
+#
+# Usage: validate_using_epoxy_duino.sh [--collect {result_file}]
+#
+# With the '--collect' flag, the flash and static RAM usage of the host
+# executable of each FEATURE is also recorded in {result_file}, using the
+# same format as collect.sh, with an additional column containing the
+# sizeof() of the clock object of the FEATURE (-1 if none):
+#
+#  FEATURE flash max_flash ram max_ram sizeof
+#  0  aa 0 cc 0 -1
+#  ...
+#  16 aa 0 cc 0 ff
+#
+# The flash is the 'text' plus 'data' segments, and the static RAM is the
+# 'data' plus 'bss' segments, as reported by the Berkeley format of the
+# 'size' command (Linux and FreeBSD). The numbers are much larger than on a
+# microcontroller, but their changes track the changes in the library.
 
 set -eu
 
 PROGRAM_NAME='MemoryBenchmark.ino'
-NUM_FEATURES=13  # excluding FEATURE_BASELINE
+EXECUTABLE='./MemoryBenchmark.out'
+NUM_FEATURES=16  # excluding FEATURE_BASELINE
 temp_out_file=
+result_file=
+
+function usage() {
+    echo 'Usage: validate_using_epoxy_duino.sh [--collect {result_file}]'
+    exit 1
+}
 
 function cleanup() {
     if [[ "$temp_out_file" != '' ]]; then
@@ -22,6 +46,15 @@ function create_temp_file() {
     temp_out_file=$(mktemp /tmp/memory_benchmark.epoxy.XXXXXX)
 }
 
+# Usage: extract_memory $feature
+# Appends the memory usage of the current executable to $result_file.
+function extract_memory() {
+    local feature=$1
+    local memory=$(size $EXECUTABLE | awk 'NR == 2 {print $1 + $2, 0, $2 + $3, 0}')
+    local sizeof=$($EXECUTABLE | awk '/^sizeof/ {print $2}')
+    echo $feature $memory $sizeof >> $result_file
+}
+
 function validate() {
     for feature in $(seq 0 $NUM_FEATURES); do
         echo "Validating FEATURE $feature using EpoxyDuino"
@@ -33,10 +66,28 @@ function validate() {
             cat $temp_out_file
             exit 1
         fi
+
+        if [[ "$result_file" != '' ]]; then
+            extract_memory $feature
+        fi
     done
 }
 
+# Parse flags.
+while [[ $# -gt 0 ]]; do
+    case $1 in
+        --collect) shift; [[ $# -gt 0 ]] || usage; result_file=$1 ;;
+        --help|-h) usage ;;
+        -*) echo "Unknown flag '$1'" 1>&2; usage 1>&2 ;;
+        *) usage ;;
+    esac
+    shift
+done
+
 trap "cleanup" EXIT
 
+if [[ "$result_file" != '' ]]; then
+    rm -f $result_file
+fi
 create_temp_file
 validate
@@ -0,0 +1,241 @@
+/*
+ * A program to measure the end-to-end latency and throughput of the NTP
+ * request/response code of NtpClockTemplate, running on a Linux or MacOS host
+ * under EpoxyDuino. The client uses the hw::PosixUdpInterface to talk to
+ * testing::LoopbackNtpServer instances on the loopback interface, so no
+ * network access is required.
+ *
+ * Each round trip consists of NtpClock::sendRequest(), then running
+ * LoopbackNtpServer::loop() and polling NtpClock::isResponseReady() until a
+ * response is selected, followed by NtpClock::readResponse().
+ *
+ * The first benchmark measures a single ideal server. The second benchmark
+ * measures the tail latency when each server drops some requests and responds
+ * with different delays, comparing a single server against 3 servers queried
+ * in parallel (Linux only, since it uses 127.0.0.1, 127.0.0.2 and 127.0.0.3).
+ * A dropped request costs a full request timeout with a single server, but is
+ * usually covered by another server when the servers are queried in parallel.
+ *
+ * The output looks like this (numbers will vary):
+ *
+ * NtpLoopbackBenchmark
+ * Single server, no loss
+ * Round trips: 10000; Errors: 0
+ * Latency min/avg/max (micros): 5/8/3668
+ * Throughput (requests/sec): 121951
+ * Tail latency, 5% loss per server, timeout 100 ms
+ * Mode          Errors  p50(us)  p90(us)  p99(us)  max(us)
+ * single-0          24        9       38   100000   100001
+ * firstValid-3       0       36       54     5018     5024
+ * best-3             0    10003    19992    24996    25000
+ * END
+ */
+
+#if !defined(EPOXY_DUINO)
+  #error This sketch works only on EpoxyDuino
+#endif
+
+#include <Arduino.h>
+#include <stdio.h> // printf()
+#include <stdlib.h> // qsort()
+#include <AceTime.h>
+#include <AceTimeClock.h>
+#include <ace_time/testing/LoopbackNtpServer.h>
+
+using ace_time::acetime_t;
+using ace_time::clock::NtpClockTemplate;
+using ace_time::hw::PosixUdpInterface;
+using ace_time::testing::LoopbackNtpServer;
+
+using LoopbackNtpClock = NtpClockTemplate<PosixUdpInterface>;
+
+// Number of request/response round trips for the throughput benchmark.
+static const uint32_t COUNT = 10000;
+
+// Number of round trips for the tail latency benchmark.
+static const uint16_t TAIL_COUNT = 500;
+
+// Number of micros to wait for a response before declaring an error.
+static const uint32_t RESPONSE_TIMEOUT_MICROS = 100000;
+
+static const char* const SERVER_NAMES[] = {
+  "127.0.0.1", "127.0.0.2", "127.0.0.3"
+};
+static const uint8_t NUM_SERVERS = 3;
+
+static LoopbackNtpServer server0(SERVER_NAMES[0]);
+static LoopbackNtpServer server1(SERVER_NAMES[1]);
+static LoopbackNtpServer server2(SERVER_NAMES[2]);
+static LoopbackNtpServer* const SERVERS[NUM_SERVERS] = {
+  &server0, &server1, &server2
+};
+
+static uint32_t latencies[TAIL_COUNT];
+
+// Perform a single round trip. Returns the elapsed micros, and sets `ok` to
+// true if the expected time was received.
+static uint32_t roundTrip(
+    LoopbackNtpClock& ntpClock, uint8_t numServers, acetime_t expected,
+    bool& ok) {
+  for (uint8_t i = 0; i < numServers; i++) SERVERS[i]->setNow(expected);
+
+  uint32_t startMicros = micros();
+  ntpClock.sendRequest();
+
+  bool ready = false;
+  uint32_t elapsedMicros;
+  while ((elapsedMicros = micros() - startMicros) < RESPONSE_TIMEOUT_MICROS) {
+    for (uint8_t i = 0; i < numServers; i++) SERVERS[i]->loop();
+    if (ntpClock.isResponseReady()) {
+      ready = true;
+      break;
+    }
+  }
+  acetime_t now = ready
+      ? ntpClock.readResponse()
+      : LoopbackNtpClock::kInvalidSeconds;
+  elapsedMicros = micros() - startMicros;
+
+  ok = (now == expected);
+
+  // Let the slower servers finish sending their responses, so that the next
+  // round trip starts from an idle network, as it would in practice.
+  for (uint8_t i = 0; i < numServers; i++) {
+    while (SERVERS[i]->getNumPending() > 0) SERVERS[i]->loop();
+  }
+
+  return elapsedMicros;
+}
+
+void runThroughputBenchmark() {
+  SERIAL_PORT_MONITOR.println(F("Single server, no loss"));
+
+  LoopbackNtpClock ntpClock(SERVER_NAMES[0], 0 /*localPort*/,
+      LoopbackNtpClock::kRequestTimeoutMillis, server0.getPort());
+  ntpClock.setup();
+
+  uint32_t minMicros = UINT32_MAX;
+  uint32_t maxMicros = 0;
+  uint32_t totalMicros = 0;
+  uint32_t errors = 0;
+
+  uint32_t startMillis = millis();
+  for (uint32_t i = 0; i < COUNT; i++) {
+    bool ok;
+    uint32_t elapsedMicros = roundTrip(ntpClock, 1, 700000000 + i, ok);
+    if (!ok) {
+      errors++;
+      continue;
+    }
+    totalMicros += elapsedMicros;
+    if (elapsedMicros < minMicros) minMicros = elapsedMicros;
+    if (elapsedMicros > maxMicros) maxMicros = elapsedMicros;
+  }
+  uint32_t elapsedMillis = millis() - startMillis;
+
+  uint32_t successes = COUNT - errors;
+  SERIAL_PORT_MONITOR.print(F("Round trips: "));
+  SERIAL_PORT_MONITOR.print(COUNT);
+  SERIAL_PORT_MONITOR.print(F("; Errors: "));
+  SERIAL_PORT_MONITOR.println(errors);
+  if (successes > 0) {
+    SERIAL_PORT_MONITOR.print(F("Latency min/avg/max (micros): "));
+    SERIAL_PORT_MONITOR.print(minMicros);
+    SERIAL_PORT_MONITOR.print('/');
+    SERIAL_PORT_MONITOR.print(totalMicros / successes);
+    SERIAL_PORT_MONITOR.print('/');
+    SERIAL_PORT_MONITOR.println(maxMicros);
+  }
+  if (elapsedMillis > 0) {
+    SERIAL_PORT_MONITOR.print(F("Throughput (requests/sec): "));
+    SERIAL_PORT_MONITOR.println(successes * 1000 / elapsedMillis);
+  }
+}
+
+static int compareUint32(const void* a, const void* b) {
+  uint32_t x = *(const uint32_t*) a;
+  uint32_t y = *(const uint32_t*) b;
+  return (x < y) ? -1 : (x > y) ? 1 : 0;
+}
+
+// Print the latency percentiles of the round trips through ntpClock.
+// Failed round trips count as the full timeout.
+void runTailLatency(
+    const char* label, LoopbackNtpClock& ntpClock, uint8_t numServers) {
+  ntpClock.setup();
+  for (uint8_t i = 0; i < NUM_SERVERS; i++) SERVERS[i]->setSeed(i + 1);
+
+  uint16_t errors = 0;
+  for (uint16_t i = 0; i < TAIL_COUNT; i++) {
+    bool ok;
+    latencies[i] = roundTrip(ntpClock, numServers, 700000000 + i, ok);
+    if (!ok) errors++;
+  }
+  qsort(latencies, TAIL_COUNT, sizeof(latencies[0]), compareUint32);
+
+  char line[80];
+  snprintf(line, sizeof(line), "%-12s %7u %8u %8u %8u %8u",
+      label,
+      (unsigned) errors,
+      (unsigned) latencies[TAIL_COUNT / 2],
+      (unsigned) latencies[TAIL_COUNT * 9 / 10],
+      (unsigned) latencies[TAIL_COUNT * 99 / 100],
+      (unsigned) latencies[TAIL_COUNT - 1]);
+  SERIAL_PORT_MONITOR.println(line);
+}
+
+void runTailLatencyBenchmark() {
+  SERIAL_PORT_MONITOR.println(
+      F("Tail latency, 5% loss per server, timeout 100 ms"));
+  SERIAL_PORT_MONITOR.println(
+      F("Mode          Errors  p50(us)  p90(us)  p99(us)  max(us)"));
+
+  // Servers with increasing response delays, each dropping 5% of requests.
+  for (uint8_t i = 0; i < NUM_SERVERS; i++) {
+    SERVERS[i]->setDropPercent(5);
+    SERVERS[i]->setResponseDelayMillis(i * 5);
+  }
+  uint16_t port = server0.getPort();
+
+  LoopbackNtpClock singleClock(SERVER_NAMES[0], 0 /*localPort*/,
+      LoopbackNtpClock::kRequestTimeoutMillis, port);
+  runTailLatency("single-0", singleClock, 1);
+
+  LoopbackNtpClock firstValidClock(SERVER_NAMES, NUM_SERVERS,
+      LoopbackNtpClock::kSelectFirstValid, 0 /*localPort*/,
+      LoopbackNtpClock::kRequestTimeoutMillis, port);
+  runTailLatency("firstValid-3", firstValidClock, NUM_SERVERS);
+
+  LoopbackNtpClock bestClock(SERVER_NAMES, NUM_SERVERS,
+      LoopbackNtpClock::kSelectBest, 0 /*localPort*/,
+      LoopbackNtpClock::kRequestTimeoutMillis, port);
+  bestClock.setSelectionWindowMillis(20);
+  runTailLatency("best-3", bestClock, NUM_SERVERS);
+}
+
+void setup() {
+  SERIAL_PORT_MONITOR.begin(115200);
+  while (!SERIAL_PORT_MONITOR); // Wait until ready - Leonardo/Micro
+  SERIAL_PORT_MONITOR.println(F("NtpLoopbackBenchmark"));
+
+  if (!server0.setup()) {
+    SERIAL_PORT_MONITOR.println(F("Unable to start LoopbackNtpServer"));
+    exit(1);
+  }
+  runThroughputBenchmark();
+
+  // The other servers listen on the same port, on different addresses.
+  uint16_t port = server0.getPort();
+  if (!server1.setup(port) || !server2.setup(port)) {
+    SERIAL_PORT_MONITOR.println(
+        F("Unable to start servers on 127.0.0.2 and 127.0.0.3"));
+  } else {
+    runTailLatencyBenchmark();
+  }
+
+  SERIAL_PORT_MONITOR.println(F("END"));
+  exit(0);
+}
+
+void loop() {
+}
@@ -23,10 +23,18 @@
 #endif
 
 #include "ace_time/clock/Clock.h"
+#include "ace_time/clock/EpochOffsets.h"
 #include "ace_time/clock/NtpClock.h"
+#include "ace_time/clock/SntpServer.h"
 #include "ace_time/clock/DS3231Clock.h"
 #include "ace_time/clock/UnixClock.h"
 #include "ace_time/clock/EspSntpClock.h"
+#include "ace_time/clock/NullClock.h"
+#include "ace_time/clock/ClockDispatcher.h"
+#include "ace_time/clock/LatencyHistogram.h"
+#include "ace_time/clock/EventRingBuffer.h"
+#include "ace_time/clock/SystemClockInstrumentation.h"
+#include "ace_time/clock/SystemClockSnapshot.h"
 #include "ace_time/clock/SystemClock.h"
 #include "ace_time/clock/SystemClockLoop.h"
 #include "ace_time/clock/SystemClockCoroutine.h"
@@ -36,6 +44,10 @@
 #include "ace_time/clock/Stm32F1Clock.h"
 #endif // #if defined(ARDUINO_ARCH_STM32) || defined(EPOXY_DUINO)
 
+#if defined(EPOXY_DUINO)
+#include "ace_time/hw/PosixUdpInterface.h"
+#endif
+
 // Version format: xxyyzz == "xx.yy.zz"
 #define ACE_TIME_CLOCK_VERSION 10300
 #define ACE_TIME_CLOCK_VERSION_STRING "1.3.0"
@@ -9,6 +9,20 @@
 #include <stdint.h>
 #include <AceTime.h> // LocalTime, acetime_t
 
+/**
+ * Set to 1 to add the 64-bit seconds API (getNow64(), setNow64(), etc) to
+ * Clock, and to store 64-bit seconds in the SystemClock, so that the time is
+ * not limited to the +/- 68 years of the 32-bit `acetime_t` around the current
+ * epoch year of the AceTime library. The default is 0, which keeps the 32-bit
+ * API only, for the smaller and faster code on 8-bit processors. This must be
+ * defined before including AceTimeClock.h, and must have the same value in
+ * every translation unit of the program, since it changes the virtual table of
+ * Clock.
+ */
+#ifndef ACE_TIME_CLOCK_SECONDS64
+#define ACE_TIME_CLOCK_SECONDS64 0
+#endif
+
 namespace ace_time {
 namespace clock {
 
@@ -24,6 +38,28 @@ class Clock {
      */
     static const acetime_t kInvalidSeconds = LocalTime::kInvalidSeconds;
 
+    /**
+     * Value of the `millis` output parameter of getNowMillis() and
+     * readResponseMillis() when the clock does not provide sub-second
+     * resolution.
+     */
+    static const uint16_t kUnknownMillis = UINT16_MAX;
+
+    /** Leap indicator: no leap second is announced. */
+    static const uint8_t kLeapIndicatorNone = 0;
+
+    /**
+     * Leap indicator: the last minute of the current UTC month has 61
+     * seconds.
+     */
+    static const uint8_t kLeapIndicatorInsert = 1;
+
+    /**
+     * Leap indicator: the last minute of the current UTC month has 59
+     * seconds.
+     */
+    static const uint8_t kLeapIndicatorDelete = 2;
+
     /** Default constructor. */
     Clock() = default;
 
@@ -57,6 +93,29 @@ class Clock {
      */
     virtual acetime_t readResponse() const { return getNow(); }
 
+    /**
+     * Same as getNow(), but also return the number of milliseconds (0-999)
+     * since the start of the current second in `*millis`. The default
+     * implementation is for clocks with a resolution of one second, and
+     * sets `*millis` to kUnknownMillis.
+     */
+    virtual acetime_t getNowMillis(uint16_t* millis) const {
+      *millis = kUnknownMillis;
+      return getNow();
+    }
+
+    /**
+     * Same as readResponse(), but also return the number of milliseconds
+     * (0-999) since the start of the returned second in `*millis`, at the
+     * time that this method is called. Allows the SystemClock to inherit the
+     * sub-second phase of the referenceClock. The default implementation sets
+     * `*millis` to kUnknownMillis.
+     */
+    virtual acetime_t readResponseMillis(uint16_t* millis) const {
+      *millis = kUnknownMillis;
+      return readResponse();
+    }
+
     /**
      * Set the time to the indicated seconds. Calling with a value of
      * kInvalidSeconds indicates an error condition, so the method should do
@@ -65,6 +124,75 @@ class Clock {
      */
     virtual void setNow(acetime_t /*epochSeconds*/) {}
 
+    /**
+     * Return the leap second announced by the most recent response, one of
+     * kLeapIndicatorNone, kLeapIndicatorInsert or kLeapIndicatorDelete. The
+     * default implementation is for clocks which do not know about leap
+     * seconds, and returns kLeapIndicatorNone.
+     */
+    virtual uint8_t getLeapIndicator() const { return kLeapIndicatorNone; }
+
+  #if ACE_TIME_CLOCK_SECONDS64
+    /**
+     * Error value returned by getNow64() and the other 64-bit methods. Same
+     * as LocalDate::kInvalidUnixSeconds64.
+     */
+    static const int64_t kInvalidSeconds64 = INT64_MIN;
+
+    /**
+     * Same as getNow(), but returns the seconds since the current AceTime
+     * epoch as a 64-bit integer, which is not limited to the range of
+     * `acetime_t`. The default implementation extends the result of getNow(),
+     * so it needs to be overridden only by the clocks which can go beyond
+     * that range.
+     */
+    virtual int64_t getNow64() const { return toSeconds64(getNow()); }
+
+    /** Same as getNowMillis() but returns 64-bit seconds. */
+    virtual int64_t getNowMillis64(uint16_t* millis) const {
+      return toSeconds64(getNowMillis(millis));
+    }
+
+    /** Same as readResponse() but returns 64-bit seconds. */
+    virtual int64_t readResponse64() const {
+      return toSeconds64(readResponse());
+    }
+
+    /** Same as readResponseMillis() but returns 64-bit seconds. */
+    virtual int64_t readResponseMillis64(uint16_t* millis) const {
+      return toSeconds64(readResponseMillis(millis));
+    }
+
+    /**
+     * Same as setNow() but takes 64-bit seconds. The default implementation
+     * calls setNow(), with kInvalidSeconds if the seconds does not fit into
+     * `acetime_t`.
+     */
+    virtual void setNow64(int64_t epochSeconds) {
+      setNow(toSeconds32(epochSeconds));
+    }
+  #endif
+
+    /**
+     * Convert 32-bit seconds to 64-bit seconds, mapping kInvalidSeconds to
+     * kInvalidSeconds64.
+     */
+    static int64_t toSeconds64(acetime_t epochSeconds) {
+      return (epochSeconds == kInvalidSeconds)
+          ? INT64_MIN
+          : (int64_t) epochSeconds;
+    }
+
+    /**
+     * Convert 64-bit seconds to 32-bit seconds. Returns kInvalidSeconds if
+     * the seconds are outside the range of `acetime_t`.
+     */
+    static acetime_t toSeconds32(int64_t epochSeconds) {
+      return (epochSeconds <= kInvalidSeconds || epochSeconds > INT32_MAX)
+          ? kInvalidSeconds
+          : (acetime_t) epochSeconds;
+    }
+
   private:
     // disable copy constructor and assignment operator
     Clock(const Clock&) = delete;
@@ -0,0 +1,181 @@
+/*
+ * MIT License
+ * Copyright (c) 2022 Brian T. Park
+ */
+
+#ifndef ACE_TIME_CLOCK_DISPATCHER_H
+#define ACE_TIME_CLOCK_DISPATCHER_H
+
+#include <stdint.h>
+#include "Clock.h"
+#include "NullClock.h"
+
+namespace ace_time {
+namespace clock {
+
+/**
+ * Holds a pointer to the referenceClock or backupClock of SystemClockTemplate
+ * and forwards the Clock methods to it, using the static type `T_CLOCK`.
+ *
+ * The methods are called with a qualified name (e.g.
+ * `mClock->T_CLOCK::sendRequest()`), which bypasses the virtual dispatch, so
+ * the compiler can inline them. `T_CLOCK` must therefore be the most derived
+ * type of the clock object. The specialization for Clock uses the normal
+ * virtual dispatch, and the specialization for NullClock stores nothing and
+ * does nothing.
+ *
+ * Methods that a `T_CLOCK` inherits from Clock without overriding (e.g.
+ * Clock::readResponse() which calls getNow()) still dispatch their inner
+ * calls virtually.
+ *
+ * @tparam T_CLOCK the concrete type of the clock, or Clock to use virtual
+ *    dispatch, or NullClock for no clock
+ */
+template <typename T_CLOCK>
+class ClockDispatcher {
+  public:
+    explicit ClockDispatcher(T_CLOCK* clock = nullptr) : mClock(clock) {}
+
+    T_CLOCK* getClock() const { return mClock; }
+    void setClock(T_CLOCK* clock) { mClock = clock; }
+    bool isNull() const { return mClock == nullptr; }
+
+    acetime_t getNow() const { return mClock->T_CLOCK::getNow(); }
+
+    acetime_t getNowMillis(uint16_t* millis) const {
+      return mClock->T_CLOCK::getNowMillis(millis);
+    }
+
+    void sendRequest() const { mClock->T_CLOCK::sendRequest(); }
+
+    bool isResponseReady() const { return mClock->T_CLOCK::isResponseReady(); }
+
+    acetime_t readResponseMillis(uint16_t* millis) const {
+      return mClock->T_CLOCK::readResponseMillis(millis);
+    }
+
+    void setNow(acetime_t epochSeconds) const {
+      mClock->T_CLOCK::setNow(epochSeconds);
+    }
+
+    uint8_t getLeapIndicator() const {
+      return mClock->T_CLOCK::getLeapIndicator();
+    }
+
+  #if ACE_TIME_CLOCK_SECONDS64
+    int64_t getNow64() const { return mClock->T_CLOCK::getNow64(); }
+
+    int64_t getNowMillis64(uint16_t* millis) const {
+      return mClock->T_CLOCK::getNowMillis64(millis);
+    }
+
+    int64_t readResponseMillis64(uint16_t* millis) const {
+      return mClock->T_CLOCK::readResponseMillis64(millis);
+    }
+
+    void setNow64(int64_t epochSeconds) const {
+      mClock->T_CLOCK::setNow64(epochSeconds);
+    }
+  #endif
+
+  private:
+    T_CLOCK* mClock;
+};
+
+/** Specialization for Clock which uses virtual dispatch. */
+template <>
+class ClockDispatcher<Clock> {
+  public:
+    explicit ClockDispatcher(Clock* clock = nullptr) : mClock(clock) {}
+
+    Clock* getClock() const { return mClock; }
+    void setClock(Clock* clock) { mClock = clock; }
+    bool isNull() const { return mClock == nullptr; }
+
+    acetime_t getNow() const { return mClock->getNow(); }
+
+    acetime_t getNowMillis(uint16_t* millis) const {
+      return mClock->getNowMillis(millis);
+    }
+
+    void sendRequest() const { mClock->sendRequest(); }
+
+    bool isResponseReady() const { return mClock->isResponseReady(); }
+
+    acetime_t readResponseMillis(uint16_t* millis) const {
+      return mClock->readResponseMillis(millis);
+    }
+
+    void setNow(acetime_t epochSeconds) const { mClock->setNow(epochSeconds); }
+
+    uint8_t getLeapIndicator() const { return mClock->getLeapIndicator(); }
+
+  #if ACE_TIME_CLOCK_SECONDS64
+    int64_t getNow64() const { return mClock->getNow64(); }
+
+    int64_t getNowMillis64(uint16_t* millis) const {
+      return mClock->getNowMillis64(millis);
+    }
+
+    int64_t readResponseMillis64(uint16_t* millis) const {
+      return mClock->readResponseMillis64(millis);
+    }
+
+    void setNow64(int64_t epochSeconds) const {
+      mClock->setNow64(epochSeconds);
+    }
+  #endif
+
+  private:
+    Clock* mClock;
+};
+
+/** Specialization for NullClock which holds nothing and does nothing. */
+template <>
+class ClockDispatcher<NullClock> {
+  public:
+    explicit ClockDispatcher(NullClock* /*clock*/ = nullptr) {}
+
+    NullClock* getClock() const { return nullptr; }
+    void setClock(NullClock* /*clock*/) {}
+    bool isNull() const { return true; }
+
+    acetime_t getNow() const { return Clock::kInvalidSeconds; }
+
+    acetime_t getNowMillis(uint16_t* millis) const {
+      *millis = Clock::kUnknownMillis;
+      return Clock::kInvalidSeconds;
+    }
+
+    void sendRequest() const {}
+
+    bool isResponseReady() const { return false; }
+
+    acetime_t readResponseMillis(uint16_t* millis) const {
+      return getNowMillis(millis);
+    }
+
+    void setNow(acetime_t /*epochSeconds*/) const {}
+
+    uint8_t getLeapIndicator() const { return Clock::kLeapIndicatorNone; }
+
+  #if ACE_TIME_CLOCK_SECONDS64
+    int64_t getNow64() const { return Clock::kInvalidSeconds64; }
+
+    int64_t getNowMillis64(uint16_t* millis) const {
+      *millis = Clock::kUnknownMillis;
+      return Clock::kInvalidSeconds64;
+    }
+
+    int64_t readResponseMillis64(uint16_t* millis) const {
+      return getNowMillis64(millis);
+    }
+
+    void setNow64(int64_t /*epochSeconds*/) const {}
+  #endif
+};
+
+}
+}
+
+#endif
@@ -0,0 +1,29 @@
+/*
+ * MIT License
+ * Copyright (c) 2022 Brian T. Park
+ */
+
+#include "EpochOffsets.h"
+
+namespace ace_time {
+namespace clock {
+
+int64_t EpochOffsets::sSecondsToCurrentEpochFromUnixEpoch64;
+uint32_t EpochOffsets::sSecondsToCurrentEpochFromNtpEpoch;
+uint32_t EpochOffsets::sSecondsToCurrentEpochFromGpsEpoch;
+int16_t EpochOffsets::sEpochYear = EpochOffsets::kInvalidYear;
+
+void EpochOffsets::recompute() {
+  int32_t days = Epoch::daysToCurrentEpochFromInternalEpoch();
+
+  sSecondsToCurrentEpochFromUnixEpoch64 =
+      (int64_t) 86400 * (days + kDaysToInternalEpochFromUnixEpoch);
+  sSecondsToCurrentEpochFromNtpEpoch =
+      (uint32_t) 86400 * (uint32_t) (days + kDaysToInternalEpochFromNtpEpoch);
+  sSecondsToCurrentEpochFromGpsEpoch =
+      (uint32_t) 86400 * (uint32_t) (days + kDaysToInternalEpochFromGpsEpoch);
+  sEpochYear = Epoch::currentEpochYear();
+}
+
+}
+}
@@ -0,0 +1,87 @@
+/*
+ * MIT License
+ * Copyright (c) 2022 Brian T. Park
+ */
+
+#ifndef ACE_TIME_EPOCH_OFFSETS_H
+#define ACE_TIME_EPOCH_OFFSETS_H
+
+#include <stdint.h>
+#include <AceTime.h> // Epoch
+
+namespace ace_time {
+namespace clock {
+
+/**
+ * A cache of the offsets from the epochs used by the various time sources
+ * (NTP, Unix, GPS) to the current epoch of the AceTime library, as defined by
+ * `Epoch::currentEpochYear()`. The offsets are computed on the first call, and
+ * recomputed only when the current epoch year changes, so that the clocks do
+ * not perform a 32-bit or 64-bit multiplication on every call to getNow(),
+ * which is slow on 8-bit AVR and noticeable on the ESP8266.
+ *
+ * The only cost on each call is the comparison of the cached epoch year with
+ * `Epoch::currentEpochYear()`.
+ */
+class EpochOffsets {
+  public:
+    /** Days from the NTP epoch (1900-01-01) to the AceTime internal epoch. */
+    static const int32_t kDaysToInternalEpochFromNtpEpoch = 36524;
+
+    /** Days from the Unix epoch (1970-01-01) to the AceTime internal epoch. */
+    static const int32_t kDaysToInternalEpochFromUnixEpoch = 10957;
+
+    /** Days from the GPS epoch (1980-01-06) to the AceTime internal epoch. */
+    static const int32_t kDaysToInternalEpochFromGpsEpoch = 7300;
+
+    /**
+     * Seconds from the NTP epoch to the current epoch, modulo 2^32. Used to
+     * convert between the 32-bit NTP seconds and AceTime seconds using
+     * modulo 2^32 arithmetic, which handles the NTP era rollovers.
+     */
+    static uint32_t secondsToCurrentEpochFromNtpEpoch() {
+      update();
+      return sSecondsToCurrentEpochFromNtpEpoch;
+    }
+
+    /** Seconds from the Unix epoch to the current epoch. */
+    static int64_t secondsToCurrentEpochFromUnixEpoch64() {
+      update();
+      return sSecondsToCurrentEpochFromUnixEpoch64;
+    }
+
+    /**
+     * Seconds from the GPS epoch to the current epoch, modulo 2^32. Note that
+     * GPS time does not include leap seconds, so the current GPS-UTC offset
+     * (18 seconds since 2017) must be subtracted by the caller.
+     */
+    static uint32_t secondsToCurrentEpochFromGpsEpoch() {
+      update();
+      return sSecondsToCurrentEpochFromGpsEpoch;
+    }
+
+    /** Force the offsets to be recomputed on the next call. For testing. */
+    static void invalidate() { sEpochYear = kInvalidYear; }
+
+  private:
+    /** Value of sEpochYear before the first computation. */
+    static const int16_t kInvalidYear = INT16_MIN;
+
+    /** Recompute the offsets if the current epoch year has changed. */
+    static void update() {
+      if (sEpochYear != Epoch::currentEpochYear()) recompute();
+    }
+
+    /** Recompute the offsets for the current epoch year. */
+    static void recompute();
+
+    static int64_t sSecondsToCurrentEpochFromUnixEpoch64;
+    static uint32_t sSecondsToCurrentEpochFromNtpEpoch;
+    static uint32_t sSecondsToCurrentEpochFromGpsEpoch;
+    static int16_t sEpochYear;
+};
+
+}
+}
+
+#endif
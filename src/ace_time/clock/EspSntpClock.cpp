@@ -3,6 +3,12 @@
 
 #if defined(ESP8266) || defined(ESP32) || defined(EPOXY_CORE_ESP8266)
 
+#if defined(ESP8266)
+  #include <coredecls.h> // settimeofday_cb()
+#elif defined(ESP32)
+  #include <esp_sntp.h> // sntp_set_time_sync_notification_cb()
+#endif
+
 namespace ace_time {
 namespace clock {
 
@@ -12,18 +18,54 @@ static const time_t EPOCH_2000_01_01 = 946684800;
 
 const char EspSntpClock::kDefaultNtpServer[] = "pool.ntp.org";
 
-bool EspSntpClock::setup(const char* ntpServer, uint32_t timeoutMillis) {
-  Serial.print(F("Configuring SNTP"));
+void (*EspSntpClock::sSyncCallback)() = nullptr;
+volatile uint16_t EspSntpClock::sSyncCount = 0;
+volatile bool EspSntpClock::sIsSynced = false;
+
+void EspSntpClock::onSync() {
+  sSyncCount = sSyncCount + 1;
+  sIsSynced = true;
+  void (*callback)() = sSyncCallback;
+  if (callback) callback();
+}
+
+#if defined(ESP32)
+void EspSntpClock::onSyncEsp32(struct timeval* /*tv*/) {
+  onSync();
+}
+#endif
+
+void EspSntpClock::begin(const char* ntpServer) {
+#if defined(ESP8266)
+  settimeofday_cb(onSync);
+#elif defined(ESP32)
+  sntp_set_time_sync_notification_cb(onSyncEsp32);
+#endif
 
   // Use UTC timezone with no STD offset and no DST offset.
   configTime(0 /*timezone*/, 0 /*dst_sec*/, ntpServer);
+}
+
+bool EspSntpClock::isSynced() {
+  if (sIsSynced) return true;
+
+  // Fallback for SNTP clients configured elsewhere, or platforms without a
+  // sync callback.
+  if (time(nullptr) >= EPOCH_2000_01_01) {
+    sIsSynced = true;
+  }
+  return sIsSynced;
+}
+
+bool EspSntpClock::setup(const char* ntpServer, uint32_t timeoutMillis) {
+  Serial.print(F("Configuring SNTP"));
+  begin(ntpServer);
 
   // Wait until SNTP stabilizes by ignoring values before year 2000.
   uint32_t startMillis = millis();
   while (true) {
     Serial.print('.'); // each '.' represents an attempt
-    time_t now = time(nullptr);
-    if (now >= EPOCH_2000_01_01) {
+    if (isSynced()) {
       Serial.println(F(" Done."));
       return true;
     }
@@ -9,8 +9,10 @@
 #if defined(ESP8266) || defined(ESP32) || defined(EPOXY_CORE_ESP8266)
 
 #include <time.h> // time()
+#include <sys/time.h> // gettimeofday()
 #include <AceTime.h> // LocalDate
 #include "Clock.h"
+#include "EpochOffsets.h"
 
 namespace ace_time {
 namespace clock {
@@ -21,6 +23,15 @@ namespace clock {
  * STD or DST offset), and uses the C-library `time()` function as the reference
  * clock. Apparently the SNTP client synchronizes the `time()` every hour. This
  * class depends on the WiFi client being configured somewhere else.
+ *
+ * The begin() method is non-blocking. It registers a sync notification
+ * callback with the SNTP client of the ESP8266 (`settimeofday_cb()`) or ESP32
+ * (`sntp_set_time_sync_notification_cb()`), so that isSynced() and
+ * isResponseReady() become true as soon as the first SNTP response is
+ * received, without polling the `time()` function. When used as the
+ * referenceClock of a SystemClockLoop or SystemClockCoroutine, the
+ * readResponseMillis() method uses `gettimeofday()` to pass the sub-second
+ * phase of the SNTP client to the SystemClock.
  */
 class EspSntpClock: public Clock {
   public:
@@ -33,8 +44,20 @@ class EspSntpClock: public Clock {
     explicit EspSntpClock() {}
 
     /**
-     * Setup the SNTP client. Assumes WiFi is already configured. This step can
-     * be skipped if the SNTP client is configured somewhere else.
+     * Configure the SNTP client and register the sync notification callback,
+     * then return immediately. Assumes WiFi is already configured, or will be
+     * configured later. Use isSynced() or isResponseReady() to determine when
+     * the SNTP client has obtained the time.
+     *
+     * @param ntpServer name of the NTP server, default "pool.ntp.org"
+     */
+    void begin(const char* ntpServer = kDefaultNtpServer);
+
+    /**
+     * Setup the SNTP client and wait until the time is valid. Assumes WiFi is
+     * already configured. This step can be skipped if the SNTP client is
+     * configured somewhere else. This is a blocking wrapper around begin() and
+     * isSynced(), retained for backwards compatibility.
      *
      * @param ntpServer name of the NTP server, default "pool.ntp.org"
      * @param timeoutMillis number of millis to wait before returning if
@@ -47,18 +70,80 @@ class EspSntpClock: public Clock {
         const char* ntpServer = kDefaultNtpServer,
         uint32_t timeoutMillis = kDefaultTimeoutMillis);
 
+    /**
+     * Return true if the SNTP client has set the time at least once, either
+     * through the sync notification callback, or (if the SNTP client was
+     * configured elsewhere, or the platform has no callback) because `time()`
+     * is after 2000-01-01. Once true, it remains true.
+     */
+    static bool isSynced();
+
+    /**
+     * Return the number of sync notifications received from the SNTP client
+     * since boot, modulo 2^16. Always 0 on platforms without a sync callback.
+     */
+    static uint16_t getSyncCount() { return sSyncCount; }
+
+    /**
+     * Set a function to be called after each sync of the SNTP client, in
+     * addition to the internal bookkeeping. The function is called from the
+     * context of the SNTP client (a separate task on the ESP32), so it
+     * should only set a flag. Set to nullptr to remove.
+     */
+    static void setSyncCallback(void (*callback)()) {
+      sSyncCallback = callback;
+    }
+
     /**
      * @copydoc Clock::getNow()
      *
      * Since `acetime_t` is a 32-bit integer, this method is valid if the
      * current SNTP time() is within about +/- 68 years of the current epoch
      * being used by the AceTime library, as defined by
-     * `Epoch::currentEpochYear()`.
+     * `Epoch::currentEpochYear()`. Returns kInvalidSeconds if the SNTP client
+     * has not synced yet.
      */
     acetime_t getNow() const override {
+      if (! isSynced()) return kInvalidSeconds;
       return time(nullptr)
-        - Epoch::secondsToCurrentEpochFromUnixEpoch64();
+        - EpochOffsets::secondsToCurrentEpochFromUnixEpoch64();
+    }
+
+    /**
+     * Same as getNow(), but uses `gettimeofday()` to also return the
+     * milliseconds since the start of the current second.
+     */
+    acetime_t getNowMillis(uint16_t* millis) const override {
+      if (! isSynced()) {
+        *millis = kUnknownMillis;
+        return kInvalidSeconds;
+      }
+      struct timeval tv;
+      gettimeofday(&tv, nullptr);
+      *millis = (uint16_t) (tv.tv_usec / 1000);
+      return tv.tv_sec
+        - EpochOffsets::secondsToCurrentEpochFromUnixEpoch64();
     }
+
+    /** Return true when the SNTP client has synced at least once. */
+    bool isResponseReady() const override { return isSynced(); }
+
+    acetime_t readResponseMillis(uint16_t* millis) const override {
+      return getNowMillis(millis);
+    }
+
+  private:
+    /** Called by the SNTP client after each sync. */
+    static void onSync();
+
+  #if defined(ESP32)
+    /** Adapter for the callback signature of the ESP32 SNTP client. */
+    static void onSyncEsp32(struct timeval* tv);
+  #endif
+
+    static void (*sSyncCallback)();
+    static volatile uint16_t sSyncCount;
+    static volatile bool sIsSynced;
 };
 
 }
@@ -0,0 +1,114 @@
+/*
+ * MIT License
+ * Copyright (c) 2022 Brian T. Park
+ */
+
+#ifndef ACE_TIME_EVENT_RING_BUFFER_H
+#define ACE_TIME_EVENT_RING_BUFFER_H
+
+#include <stdint.h>
+
+namespace ace_time {
+namespace clock {
+
+/**
+ * A fixed-size, lock-free, single-producer/single-consumer ring buffer,
+ * intended to pass the ticks captured by SystemClockTemplate::captureTicks()
+ * from an interrupt service routine (the producer) to the global loop() (the
+ * consumer), which converts them into epoch seconds using
+ * SystemClockTemplate::convertCapturedTicks().
+ *
+ * The producer writes only `mHead` and the consumer writes only `mTail`. Both
+ * are single bytes, so they are read and written atomically even on 8-bit
+ * processors, and no interrupts need to be disabled. The slot is written
+ * before `mHead` is published, and read before `mTail` is released, through
+ * volatile accesses which the compiler does not reorder. This is sufficient
+ * when the producer and consumer run on the same core, which is the case for
+ * an ISR and the loop() on a microcontroller.
+ *
+ * Example:
+ *
+ * @code
+ * SystemClockLoop systemClock(...);
+ * EventRingBuffer<SystemClockLoop::tick_t, 64> events;
+ *
+ * void onInterrupt() {
+ *   events.push(SystemClockLoop::captureTicks());
+ * }
+ *
+ * void loop() {
+ *   SystemClockLoop::tick_t ticks;
+ *   while (events.pop(ticks)) {
+ *     uint32_t micros;
+ *     acetime_t seconds = systemClock.convertCapturedTicks(ticks, &micros);
+ *     ...
+ *   }
+ *   systemClock.loop();
+ * }
+ * @endcode
+ *
+ * @tparam T type of the element, normally the `tick_t` of the SystemClock
+ * @tparam N number of elements, a power of 2 between 2 and 128
+ */
+template <typename T, uint8_t N>
+class EventRingBuffer {
+  static_assert(N >= 2 && N <= 128 && (N & (N - 1)) == 0,
+      "N must be a power of 2 between 2 and 128");
+
+  public:
+    /** Number of elements which can be stored. */
+    static const uint8_t kCapacity = N;
+
+    /**
+     * Append the value. Returns false and increments the overflow count if
+     * the buffer is full. Must be called only by the producer, normally the
+     * ISR.
+     */
+    bool push(T value) {
+      uint8_t head = mHead;
+      if ((uint8_t) (head - mTail) >= N) {
+        mOverflowCount++;
+        return false;
+      }
+      mBuffer[head & (N - 1)] = value;
+      mHead = head + 1;
+      return true;
+    }
+
+    /**
+     * Remove the oldest value into `value`. Returns false if the buffer is
+     * empty. Must be called only by the consumer, normally the loop().
+     */
+    bool pop(T& value) {
+      uint8_t tail = mTail;
+      if (tail == mHead) return false;
+      value = mBuffer[tail & (N - 1)];
+      mTail = tail + 1;
+      return true;
+    }
+
+    /** Return the number of values in the buffer. */
+    uint8_t size() const { return (uint8_t) (mHead - mTail); }
+
+    /** Return true if the buffer is empty. */
+    bool isEmpty() const { return mHead == mTail; }
+
+    /**
+     * Return the number of values dropped by push() because the buffer was
+     * full. The count wraps around after 65535. On 8-bit processors, the
+     * 2 bytes are not read atomically, so the count can be off if an
+     * interrupt occurs during the read.
+     */
+    uint16_t getOverflowCount() const { return mOverflowCount; }
+
+  private:
+    volatile T mBuffer[N];
+    volatile uint8_t mHead = 0; // written by the producer
+    volatile uint8_t mTail = 0; // written by the consumer
+    volatile uint16_t mOverflowCount = 0; // written by the producer
+};
+
+}
+}
+
+#endif
@@ -0,0 +1,146 @@
+/*
+ * MIT License
+ * Copyright (c) 2022 Brian T. Park
+ */
+
+#ifndef ACE_TIME_LATENCY_HISTOGRAM_H
+#define ACE_TIME_LATENCY_HISTOGRAM_H
+
+#include <stdint.h>
+
+namespace ace_time {
+namespace clock {
+
+/**
+ * A fixed-size histogram of the latencies of the requests made by
+ * SystemClockLoop and SystemClockCoroutine to their referenceClock, separated
+ * by the outcome of the request (ok, error, or timed out). Exactly one sample
+ * is recorded for each request, when the response is received or when the
+ * request times out.
+ *
+ * The latencies (in milliseconds) are placed in logarithmic buckets: bucket 0
+ * holds 0 ms, and bucket `i` holds latencies from `2^(i-1)` to `2^i - 1` ms,
+ * so 17 buckets cover the entire `uint16_t` range. The counts are `uint16_t`.
+ * When a bucket would overflow, all buckets of that outcome are halved, which
+ * preserves the shape of the distribution while giving more weight to recent
+ * samples.
+ *
+ * The percentiles are approximate: getPercentile() returns the upper bound of
+ * the bucket which contains the given percentile, but never more than the
+ * maximum latency seen for that outcome.
+ */
+class LatencyHistogram {
+  public:
+    /** Response received and valid. */
+    static const uint8_t kOutcomeOk = 0;
+
+    /** Response received but invalid. */
+    static const uint8_t kOutcomeError = 1;
+
+    /** Request timed out. */
+    static const uint8_t kOutcomeTimeout = 2;
+
+    /** Number of outcomes. */
+    static const uint8_t kNumOutcomes = 3;
+
+    /** Number of logarithmic buckets for each outcome. */
+    static const uint8_t kNumBuckets = 17;
+
+    /** Constructor. */
+    LatencyHistogram() { reset(); }
+
+    /** Clear all samples. */
+    void reset() {
+      for (uint8_t o = 0; o < kNumOutcomes; o++) {
+        for (uint8_t b = 0; b < kNumBuckets; b++) {
+          mCounts[o][b] = 0;
+        }
+        mMaxMillis[o] = 0;
+      }
+    }
+
+    /** Record the latency of a single request with the given outcome. */
+    void update(uint8_t outcome, uint16_t millis) {
+      if (outcome >= kNumOutcomes) return;
+
+      uint16_t* counts = mCounts[outcome];
+      uint8_t bucket = bucketIndex(millis);
+      if (counts[bucket] == UINT16_MAX) {
+        for (uint8_t b = 0; b < kNumBuckets; b++) {
+          counts[b] /= 2;
+        }
+      }
+      counts[bucket]++;
+      if (millis > mMaxMillis[outcome]) mMaxMillis[outcome] = millis;
+    }
+
+    /** Return the number of samples of the given outcome. */
+    uint32_t getCount(uint8_t outcome) const {
+      if (outcome >= kNumOutcomes) return 0;
+      uint32_t count = 0;
+      for (uint8_t b = 0; b < kNumBuckets; b++) {
+        count += mCounts[outcome][b];
+      }
+      return count;
+    }
+
+    /** Return the number of samples of the given outcome in the bucket. */
+    uint16_t getBucketCount(uint8_t outcome, uint8_t bucket) const {
+      if (outcome >= kNumOutcomes || bucket >= kNumBuckets) return 0;
+      return mCounts[outcome][bucket];
+    }
+
+    /** Return the largest latency seen for the given outcome. */
+    uint16_t getMaxMillis(uint8_t outcome) const {
+      return (outcome < kNumOutcomes) ? mMaxMillis[outcome] : 0;
+    }
+
+    /**
+     * Return the approximate latency (in milliseconds) below which `percent`
+     * (0-100) of the samples of the given outcome fall. Returns 0 if there
+     * are no samples.
+     */
+    uint16_t getPercentile(uint8_t outcome, uint8_t percent) const {
+      uint32_t count = getCount(outcome);
+      if (count == 0) return 0;
+      if (percent > 100) percent = 100;
+
+      // Rank of the sample, rounded up, at least 1.
+      uint32_t rank = (count * percent + 99) / 100;
+      if (rank == 0) rank = 1;
+
+      uint32_t sum = 0;
+      for (uint8_t b = 0; b < kNumBuckets; b++) {
+        sum += mCounts[outcome][b];
+        if (sum >= rank) {
+          uint16_t upper = bucketUpperBound(b);
+          return (upper < mMaxMillis[outcome]) ? upper : mMaxMillis[outcome];
+        }
+      }
+      return mMaxMillis[outcome];
+    }
+
+    /** Return the bucket index of the given latency. */
+    static uint8_t bucketIndex(uint16_t millis) {
+      uint8_t bucket = 0;
+      while (millis != 0) {
+        millis >>= 1;
+        bucket++;
+      }
+      return bucket;
+    }
+
+    /** Return the largest latency (inclusive) held by the given bucket. */
+    static uint16_t bucketUpperBound(uint8_t bucket) {
+      return (bucket >= 16) ? UINT16_MAX : (uint16_t) ((1U << bucket) - 1);
+    }
+
+  private:
+    uint16_t mCounts[kNumOutcomes][kNumBuckets];
+    uint16_t mMaxMillis[kNumOutcomes];
+};
+
+}
+}
+
+#endif
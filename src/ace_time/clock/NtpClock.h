@@ -6,29 +6,53 @@
 #ifndef ACE_TIME_NTP_CLOCK_H
 #define ACE_TIME_NTP_CLOCK_H
 
-#if defined(ESP8266) || defined(ESP32) || defined(EPOXY_CORE_ESP8266)
-
 #include <stdint.h>
-#if defined(ESP8266) || defined(EPOXY_CORE_ESP8266)
-  #include <ESP8266WiFi.h>
-#else
-  #include <WiFi.h>
-#endif
-#include <WiFiUdp.h>
+#include <Arduino.h> // delay()
+#include <AceTime.h>
 #include "Clock.h"
+#include "EpochOffsets.h"
+#include "NtpPacket.h"
+#include "../hw/ClockInterface.h"
+#include "../hw/WiFiUdpInterface.h"
 
 #ifndef ACE_TIME_NTP_CLOCK_DEBUG
 #define ACE_TIME_NTP_CLOCK_DEBUG 0
 #endif
 
+// ESP32 does not define SERIAL_PORT_MONITOR
+#ifndef SERIAL_PORT_MONITOR
+#define SERIAL_PORT_MONITOR Serial
+#endif
+
 namespace ace_time {
 namespace clock {
 
 /**
- * A Clock that retrieves the time from an NTP server. This class has the
- * deficiency that the DNS name resolver WiFi.hostByName() is a blocking call.
- * So every now and then, it can take 5-6 seconds for the call to return,
- * blocking everything (e.g. display refresh, button clicks) until it times out.
+ * A Clock that retrieves the time from an NTP server. The UDP transport is
+ * provided by the `T_UDPI` template parameter, which is normally
+ * `hw::WiFiUdpInterface` on the ESP8266 and ESP32 (see the `NtpClock` type
+ * alias below), or `hw::PosixUdpInterface` on a Linux or MacOS host under
+ * EpoxyDuino. The latter allows the request and response code to be tested
+ * against a local NTP server such as `testing::LoopbackNtpServer`.
+ *
+ * On the ESP8266 and ESP32, this class has the deficiency that the DNS name
+ * resolver WiFi.hostByName() is a blocking call. So every now and then, it
+ * can take 5-6 seconds for the call to return, blocking everything (e.g.
+ * display refresh, button clicks) until it times out.
+ *
+ * The clock can be given a list of up to kMaxServers NTP servers. A request is
+ * then sent to all of them at the same time from the same UDP socket. Each
+ * request carries a nonce in its transmit timestamp, which the server echoes
+ * in the originate timestamp of its response. This allows stale or spoofed
+ * responses to be rejected, and each response to be matched to its server.
+ * The selection mode determines which response is used:
+ *
+ *  * kSelectFirstValid: the first valid response, which minimizes latency
+ *    when some servers are slow or unreachable.
+ *  * kSelectBest: the response with the smallest synchronization distance
+ *    (half the round trip time, plus half the root delay, plus the root
+ *    dispersion) received before all servers have responded, or within the
+ *    selection window after the first valid response, whichever comes first.
  *
  * NTP seconds is an unsigned 32-bit integer offset from the NTP epoch of
  * 1900-01-01. It rolls over every 136 years, with the first rollover happening
@@ -64,8 +88,15 @@ namespace clock {
  * https://github.com/PaulStoffregen/Time/blob/master/examples/TimeNTP/TimeNTP.ino
  *
  * TODO: Create a version that uses a non-blocking DNS look up.
+ *
+ * @tparam T_UDPI type of the UDP interface, e.g. `hw::WiFiUdpInterface`,
+ *    `hw::PosixUdpInterface`
+ * @tparam T_CI class providing the millis() function, normally
+ *    `hw::ClockInterface`, but can be replaced by
+ *    `testing::TestableClockInterface` for testing
  */
-class NtpClock: public Clock {
+template <typename T_UDPI, typename T_CI = hw::ClockInterface>
+class NtpClockTemplate: public Clock {
   public:
     /** Default NTP Server */
     static const char kNtpServerName[];
@@ -82,24 +113,135 @@ class NtpClock: public Clock {
     /** Number of millis to wait during connect before timing out. */
     static const uint16_t kConnectTimeoutMillis = 10000;
 
+    /** Default UDP port of the NTP server. */
+    static const uint16_t kNtpServerPort = 123;
+
+    /** Neither connect() nor setup() has been called. */
+    static const uint8_t kConnectionStatusIdle = 0;
+
+    /** Waiting for the WiFi connection to come up. */
+    static const uint8_t kConnectionStatusConnecting = 1;
+
+    /** WiFi connection is up, and the UDP socket is open. */
+    static const uint8_t kConnectionStatusConnected = 2;
+
+    /** Maximum number of NTP servers. */
+    static const uint8_t kMaxServers = 8;
+
+    /** Use the first valid response. */
+    static const uint8_t kSelectFirstValid = 0;
+
+    /** Use the response with the smallest synchronization distance. */
+    static const uint8_t kSelectBest = 1;
+
+    /**
+     * Default number of millis after the first valid response to wait for
+     * other responses in kSelectBest mode.
+     */
+    static const uint16_t kSelectionWindowMillis = 200;
+
     /**
      * Constructor.
      * @param server name of the NTP server (default us.pool.ntp.org)
      * @param localPort used by the UDP client (default 8888)
      * @param requestTimeout milliseconds for a request timeout (default 1000)
+     * @param serverPort UDP port of the NTP server (default 123)
      */
-    explicit NtpClock(
+    explicit NtpClockTemplate(
             const char* server = kNtpServerName,
             uint16_t localPort = kLocalPort,
-            uint16_t requestTimeout = kRequestTimeoutMillis):
+            uint16_t requestTimeout = kRequestTimeoutMillis,
+            uint16_t serverPort = kNtpServerPort):
         mServer(server),
+        mServers(nullptr),
+        mLocalPort(localPort),
+        mRequestTimeout(requestTimeout),
+        mServerPort(serverPort),
+        mNumServers(1),
+        mSelectionMode(kSelectFirstValid) {}
+
+    /**
+     * Constructor for multiple NTP servers, which are all queried at the same
+     * time by sendRequest().
+     *
+     * @param servers array of names of the NTP servers, which must outlive
+     *    this object
+     * @param numServers number of servers, 1 to kMaxServers (larger values
+     *    are truncated to kMaxServers). If 0, `servers` is ignored, and the
+     *    default kNtpServerName is used.
+     * @param selectionMode kSelectFirstValid or kSelectBest
+     * @param localPort used by the UDP client (default 2390)
+     * @param requestTimeout milliseconds for a request timeout (default 1000)
+     * @param serverPort UDP port of the NTP servers (default 123)
+     */
+    explicit NtpClockTemplate(
+            const char* const servers[],
+            uint8_t numServers,
+            uint8_t selectionMode = kSelectFirstValid,
+            uint16_t localPort = kLocalPort,
+            uint16_t requestTimeout = kRequestTimeoutMillis,
+            uint16_t serverPort = kNtpServerPort):
+        mServer((numServers == 0) ? kNtpServerName : servers[0]),
+        mServers((numServers == 0) ? nullptr : servers),
         mLocalPort(localPort),
-        mRequestTimeout(requestTimeout) {}
+        mRequestTimeout(requestTimeout),
+        mServerPort(serverPort),
+        mNumServers((numServers == 0)
+            ? 1
+            : (numServers > kMaxServers) ? kMaxServers : numServers),
+        mSelectionMode(selectionMode) {}
+
+    /**
+     * Start the non-blocking WiFi connection state machine, and return
+     * immediately. If the `ssid` is given, the WiFi station is told to connect
+     * to the given access point. If the WiFi connection is managed elsewhere,
+     * call this method with no arguments, and the state machine will simply
+     * wait for the connection to come up.
+     *
+     * The state machine is advanced by loop(), which is also called
+     * automatically by sendRequest() and isResponseReady(). So when this
+     * object is used as the reference clock of a SystemClockLoop or
+     * SystemClockCoroutine, the WiFi connection comes up (and is reconnected
+     * if it drops) while the application continues to run. The UDP socket is
+     * opened each time the connection is established, and isSetup() returns
+     * true while the connection is up.
+     *
+     * @param ssid wireless SSID (default nullptr)
+     * @param password password of the SSID (default nullptr)
+     * @param connectTimeoutMillis how long to wait for a WiFi connection
+     *    before asking the WiFi station to connect again (default 10000 ms)
+     */
+    void connect(
+        const char* ssid = nullptr,
+        const char* password = nullptr,
+        uint16_t connectTimeoutMillis = kConnectTimeoutMillis) {
+      mSsid = ssid;
+      mPassword = password;
+      mConnectTimeoutMillis = connectTimeoutMillis;
+      startConnect();
+      runConnectionStateMachine();
+    }
+
+    /**
+     * Advance the WiFi connection state machine. Call this from the global
+     * loop() function to bring up the connection when no request is being made
+     * through sendRequest() or isResponseReady().
+     */
+    void loop() { runConnectionStateMachine(); }
 
     /**
      * Set up the WiFi connection using the given ssid and password, and
-     * prepare the UDP connection. If the WiFi connection was set up elsewhere,
-     * you can call the method with no arguments to bypass the WiFi setup.
+     * prepare the UDP connection, blocking until the connection is made or
+     * `connectTimeoutMillis` has elapsed. If the WiFi connection is managed
+     * elsewhere, call the method with no arguments to bypass the WiFi setup.
+     * It then starts the state machine and returns immediately, without
+     * waiting for the connection, so that the UDP socket is opened whenever
+     * the connection comes up.
+     *
+     * This blocking method is retained for backwards compatibility. Use the
+     * non-blocking connect() instead to avoid stalling the application. If
+     * this method times out, the state machine started by connect() continues
+     * to run, so isSetup() can become true later.
      *
      * @param ssid wireless SSID (default nullptr)
      * @param password password of the SSID (default nullptr)
@@ -109,21 +251,214 @@ class NtpClock: public Clock {
     void setup(
         const char* ssid = nullptr,
         const char* password = nullptr,
-        uint16_t connectTimeoutMillis = kConnectTimeoutMillis);
+        uint16_t connectTimeoutMillis = kConnectTimeoutMillis) {
+      connect(ssid, password, connectTimeoutMillis);
+      if (ssid == nullptr) return;
+
+      uint16_t startMillis = T_CI::millis();
+      while (!isSetup()) {
+        uint16_t elapsedMillis = T_CI::millis() - startMillis;
+        if (elapsedMillis >= connectTimeoutMillis) {
+        #if ACE_TIME_NTP_CLOCK_DEBUG >= 1
+          SERIAL_PORT_MONITOR.println(F("NtpClock::setup(): failed"));
+        #endif
+          return;
+        }
 
-    /** Return the name of the NTP server. */
+        delay(500);
+        runConnectionStateMachine();
+      }
+    }
+
+    /** Return the name of the NTP server, or the first one of the list. */
     const char* getServer() const { return mServer; }
 
-    /** Return true if setup() suceeded. */
-    bool isSetup() const { return mIsSetUp; }
+    /** Return the name of the NTP server at index i. */
+    const char* getServer(uint8_t i) const {
+      return mServers ? mServers[i] : mServer;
+    }
+
+    /** Return the number of NTP servers. */
+    uint8_t getNumServers() const { return mNumServers; }
+
+    /** Return the selection mode. */
+    uint8_t getSelectionMode() const { return mSelectionMode; }
+
+    /**
+     * Set the number of millis after the first valid response to wait for
+     * the other servers in kSelectBest mode (default 200).
+     */
+    void setSelectionWindowMillis(uint16_t millis) {
+      mSelectionWindowMillis = millis;
+    }
+
+    /**
+     * Return the index of the server whose response was selected by the
+     * last successful isResponseReady(), or -1 if there is none.
+     */
+    int8_t getSelectedServer() const {
+      return mHasSelection ? mSelectedServer : -1;
+    }
+
+    /**
+     * Return the synchronization distance, in millis, of the response selected
+     * by the last successful isResponseReady().
+     */
+    uint32_t getSelectedDistanceMillis() const {
+      return mSelectedDistanceMillis;
+    }
+
+    /**
+     * Return the leap indicator (LI) of the response selected by the last
+     * successful isResponseReady(): kLeapIndicatorInsert or
+     * kLeapIndicatorDelete if the server announced a leap second at the end of
+     * the current UTC month, otherwise kLeapIndicatorNone. Responses with the
+     * alarm indicator (unsynchronized server) are rejected.
+     */
+    uint8_t getLeapIndicator() const override {
+      return mHasSelection ? mSelectedLeapIndicator : kLeapIndicatorNone;
+    }
+
+    /** Return the UDP port of the NTP server. */
+    uint16_t getServerPort() const { return mServerPort; }
+
+    /**
+     * Return true if the WiFi connection is up and the UDP socket is open,
+     * i.e. setup() succeeded, or the state machine started by connect()
+     * reached the connected state.
+     */
+    bool isSetup() const {
+      return mConnectionStatus == kConnectionStatusConnected;
+    }
+
+    /** Return the status of the WiFi connection state machine. */
+    uint8_t getConnectionStatus() const { return mConnectionStatus; }
+
+    /** Return the underlying UDP interface. */
+    T_UDPI& getUdpInterface() const { return mUdp; }
+
+    acetime_t getNow() const override {
+      return waitForResponse() ? readResponse() : kInvalidSeconds;
+    }
+
+    void sendRequest() const override {
+      runConnectionStateMachine();
+      if (!isSetup()) {
+      #if ACE_TIME_NTP_CLOCK_DEBUG >= 1
+        SERIAL_PORT_MONITOR.println(
+            F("NtpClock::sendRequest(): not connected"));
+      #endif
+        return;
+      }
+
+      // discard any previously received packets
+      while (mUdp.parsePacket() > 0) {}
+
+      #if ACE_TIME_NTP_CLOCK_DEBUG >= 2
+        SERIAL_PORT_MONITOR.println(
+            F("NtpClock::sendRequest(): sending request"));
+      #endif
+
+      sendNtpPackets();
+    }
 
-    acetime_t getNow() const override;
+    bool isResponseReady() const override {
+    #if ACE_TIME_NTP_CLOCK_DEBUG >= 3
+      static uint8_t rateLimiter;
+    #endif
 
-    void sendRequest() const override;
+      runConnectionStateMachine();
+      if (!isSetup()) {
+      #if ACE_TIME_NTP_CLOCK_DEBUG >= 3
+        if (++rateLimiter == 0) {
+          SERIAL_PORT_MONITOR.print("F[256]");
+        }
+      #endif
+        return false;
+      }
+      #if ACE_TIME_NTP_CLOCK_DEBUG >= 3
+        if (++rateLimiter == 0) {
+          SERIAL_PORT_MONITOR.print(".[256]");
+        }
+      #endif
 
-    bool isResponseReady() const override;
+      if (mIsSelectionDone) return true;
 
-    acetime_t readResponse() const override;
+      int size;
+      while ((size = mUdp.parsePacket()) > 0) {
+        if (size < kNtpPacketSize) continue;
+        processResponse();
+        if (mHasSelection && mSelectionMode == kSelectFirstValid) break;
+      }
+
+      if (!mHasSelection) return false;
+      if (mSelectionMode == kSelectFirstValid
+          || mResponseMask == allServersMask()) {
+        mIsSelectionDone = true;
+      } else {
+        uint16_t elapsedMillis = T_CI::millis() - mFirstResponseMillis;
+        mIsSelectionDone = (elapsedMillis >= mSelectionWindowMillis);
+      }
+      return mIsSelectionDone;
+    }
+
+    /**
+     * Return the time of the response selected by isResponseReady(), which
+     * must have returned true before this is called.
+     */
+    acetime_t readResponse() const override {
+      if (!hasResponse()) return kInvalidSeconds;
+      uint32_t ntpSeconds = mSelectedNtpSeconds;
+
+      // Convert to AceTime epoch (as defined by Epoch::currentEpochYear()).
+      acetime_t epochSeconds = convertNtpSecondsToAceTimeSeconds(ntpSeconds);
+      #if ACE_TIME_NTP_CLOCK_DEBUG >= 1
+        SERIAL_PORT_MONITOR.print(F("NtpClock::readResponse(): ntpSeconds="));
+        SERIAL_PORT_MONITOR.print(ntpSeconds);
+        SERIAL_PORT_MONITOR.print(F("; epochSeconds="));
+        SERIAL_PORT_MONITOR.println(epochSeconds);
+      #endif
+
+      return epochSeconds;
+    }
+
+  #if ACE_TIME_CLOCK_SECONDS64
+    int64_t getNow64() const override {
+      return waitForResponse() ? readResponse64() : kInvalidSeconds64;
+    }
+
+    /**
+     * Same as readResponse(), but returns 64-bit seconds. The NTP era of the
+     * response is resolved so that the result is within 2^31 seconds (about
+     * 68 years) of the era pivot, which is then moved to the result. The NTP
+     * eras are therefore tracked across any number of rollovers, as long as
+     * the clock is synced at least once every 68 years.
+     */
+    int64_t readResponse64() const override {
+      if (!hasResponse()) return kInvalidSeconds64;
+      int64_t epochSeconds = convertNtpSecondsToAceTimeSeconds64(
+          mSelectedNtpSeconds, mEraPivotSeconds);
+      mEraPivotSeconds = epochSeconds;
+      return epochSeconds;
+    }
+
+    int64_t readResponseMillis64(uint16_t* millis) const override {
+      *millis = kUnknownMillis;
+      return readResponse64();
+    }
+
+    /** Return the pivot used to resolve the NTP era in readResponse64(). */
+    int64_t getEraPivotSeconds() const { return mEraPivotSeconds; }
+
+    /**
+     * Set the pivot used to resolve the NTP era in readResponse64(), for
+     * example to the time restored from an RTC. The default is 0, the current
+     * AceTime epoch, which gives the same result as readResponse().
+     */
+    void setEraPivotSeconds(int64_t epochSeconds) {
+      mEraPivotSeconds = epochSeconds;
+    }
+  #endif
 
     /**
      * Convert an NTP seconds to AceTime seconds relative to the current AceTime
@@ -140,35 +475,291 @@ class NtpClock: public Clock {
      * seconds (regardless of its NTP era) into its corresonding AceTime
      * seconds.
      */
-    static acetime_t convertNtpSecondsToAceTimeSeconds(uint32_t ntpSeconds);
+    static acetime_t convertNtpSecondsToAceTimeSeconds(uint32_t ntpSeconds) {
+      // Sometimes the NTP packet is garbage and contains 0. Mark that as
+      // invalid.
+      // NOTE: Is this necessary? Let's comment it out for now.
+      //if (ntpSeconds == 0) return kInvalidSeconds;
+
+      // Shift the NTP seconds to AceTime seconds, using uint32_t operations,
+      // which performs a shift using modulo 2^32 arithmetic. This maps the
+      // entire 32-bit range of NTP seconds to the 32-bit AceTime seconds,
+      // automatically accounting for NTP rollovers, for any AceTime
+      // currentEpochYear().
+      uint32_t epochSeconds = ntpSeconds - secondsToCurrentEpochFromNtpEpoch();
+
+      // Cast the uint32_t to an int32_t, which has the effect of mapping the
+      // upper half of the AceTime seconds 32-bit range to its lower half. In
+      // other words, `if epochSeconds > INT32_MAX: epochSeconds -= 2^32`.
+      return (int32_t) epochSeconds;
+    }
+
+    /**
+     * Convert an NTP seconds to 64-bit AceTime seconds, selecting the NTP era
+     * which places the result within -2^31 to 2^31-1 seconds of
+     * `pivotSeconds`. With a `pivotSeconds` of 0, this is the same as
+     * convertNtpSecondsToAceTimeSeconds(). Only the lower 32 bits of the
+     * offset to the NTP epoch are needed, because the offset and the era
+     * cancel out modulo 2^32.
+     */
+    static int64_t convertNtpSecondsToAceTimeSeconds64(
+        uint32_t ntpSeconds, int64_t pivotSeconds) {
+      uint32_t delta = ntpSeconds - secondsToCurrentEpochFromNtpEpoch()
+          - (uint32_t) pivotSeconds;
+      return pivotSeconds + (int32_t) delta;
+    }
+
+    /**
+     * Convert AceTime seconds to NTP seconds, the inverse of
+     * convertNtpSecondsToAceTimeSeconds(). The result is the NTP seconds
+     * modulo 2^32, without the NTP era. Used by NTP servers, such as the
+     * `testing::LoopbackNtpServer`.
+     */
+    static uint32_t convertAceTimeSecondsToNtpSeconds(acetime_t epochSeconds) {
+      return (uint32_t) epochSeconds + secondsToCurrentEpochFromNtpEpoch();
+    }
 
   private:
+    /**
+     * Send a request and wait for the response until the request timeout.
+     * Return true if a response is ready.
+     */
+    bool waitForResponse() const {
+      runConnectionStateMachine();
+      if (!isSetup()) return false;
+
+      sendRequest();
+
+      uint16_t startTime = T_CI::millis();
+      while ((uint16_t) (T_CI::millis() - startTime) < mRequestTimeout) {
+        if (isResponseReady()) return true;
+      }
+      return false;
+    }
+
+    /**
+     * Return true if the connection is up and a response was selected and
+     * validated by isResponseReady().
+     */
+    bool hasResponse() const {
+      if (!isSetup() || !mUdp.isConnected()) {
+      #if ACE_TIME_NTP_CLOCK_DEBUG >= 2
+        SERIAL_PORT_MONITOR.println(
+            F("NtpClock::readResponse(): not connected"));
+      #endif
+        return false;
+      }
+      return mHasSelection;
+    }
+
     /** NTP time is in the first 48 bytes of message. */
-    static const uint8_t kNtpPacketSize = 48;
+    static const uint8_t kNtpPacketSize = NtpPacket::kSize;
+
+    /** Ask the WiFi station to connect, and restart the connect timer. */
+    void startConnect() const {
+      if (mSsid) mUdp.connect(mSsid, mPassword);
+      mConnectStartMillis = T_CI::millis();
+      mConnectionStatus = kConnectionStatusConnecting;
+    }
 
     /**
-     * Number of days between NTP epoch (1900-01-01T00:00:00Z) and
-     * AceTime internal epoch (2000-01-01T00:00:00Z).
+     * Advance the WiFi connection state machine:
+     *
+     *  * Connecting: open the UDP socket when the WiFi connection comes up.
+     *    If it does not come up within mConnectTimeoutMillis, ask the WiFi
+     *    station to connect again.
+     *  * Connected: if the WiFi connection drops, close the UDP socket and go
+     *    back to Connecting.
      */
-    static const int32_t kDaysToInternalEpochFromNtpEpoch = 36524;
+    void runConnectionStateMachine() const {
+      if (mConnectionStatus == kConnectionStatusConnected) {
+        if (mUdp.isConnected()) return;
+
+      #if ACE_TIME_NTP_CLOCK_DEBUG >= 1
+        SERIAL_PORT_MONITOR.println(F("NtpClock: WiFi lost, reconnecting"));
+      #endif
+        mUdp.stop();
+        startConnect();
+      }
 
-    /** Send an NTP request to the time server at the given address. */
-    void sendNtpPacket(const IPAddress& address) const;
+      if (mConnectionStatus == kConnectionStatusConnecting) {
+        if (mUdp.isConnected()) {
+          if (mUdp.begin(mLocalPort)) {
+          #if ACE_TIME_NTP_CLOCK_DEBUG >= 1
+            SERIAL_PORT_MONITOR.println(F("NtpClock: connected"));
+          #endif
+            mConnectionStatus = kConnectionStatusConnected;
+            return;
+          }
+        }
+
+        uint16_t elapsedMillis = T_CI::millis() - mConnectStartMillis;
+        if (elapsedMillis >= mConnectTimeoutMillis) {
+        #if ACE_TIME_NTP_CLOCK_DEBUG >= 1
+          SERIAL_PORT_MONITOR.println(F("NtpClock: connect timed out"));
+        #endif
+          startConnect();
+        }
+      }
+    }
+
+    /**
+     * Return the number of seconds from the NTP epoch (1900-01-01) to the
+     * current AceTime epoch, modulo 2^32. AceTime v2 epoch is 2050-01-01 by
+     * default but is adjustable at runtime, so the value is cached by
+     * EpochOffsets and recomputed only when the epoch year changes.
+     */
+    static uint32_t secondsToCurrentEpochFromNtpEpoch() {
+      return EpochOffsets::secondsToCurrentEpochFromNtpEpoch();
+    }
+
+    /** Return the bit mask with one bit set for each server. */
+    uint8_t allServersMask() const {
+      return (uint8_t) ((1u << mNumServers) - 1);
+    }
+
+    /**
+     * Send an NTP request to each time server, and reset the selection state.
+     * The nonce is placed in the seconds of the transmit timestamp, and the
+     * server index in its fraction.
+     */
+    void sendNtpPackets() const {
+    #if ACE_TIME_NTP_CLOCK_DEBUG >= 2
+      uint16_t startTime = T_CI::millis();
+    #endif
+
+      mNonce = (mNonce + 0x9E3779B9) ^ (uint32_t) T_CI::millis();
+      mResponseMask = 0;
+      mHasSelection = false;
+      mIsSelectionDone = false;
+      mRequestStartMillis = T_CI::millis();
+
+      // The request is built on the stack, so that it does not consume
+      // static RAM between requests.
+      uint8_t packet[kNtpPacketSize];
+      for (uint8_t i = 0; i < mNumServers; i++) {
+        NtpPacket::fillRequest(packet, mNonce, i);
+
+        // A DNS error skips the server.
+        if (!mUdp.beginPacket(getServer(i), mServerPort)) continue;
+        mUdp.write(packet, kNtpPacketSize);
+        mUdp.endPacket();
+      }
+
+    #if ACE_TIME_NTP_CLOCK_DEBUG >= 2
+      SERIAL_PORT_MONITOR.print(F("NtpClock::sendNtpPackets(): "));
+      SERIAL_PORT_MONITOR.print(
+          (unsigned) ((uint16_t) T_CI::millis() - startTime));
+      SERIAL_PORT_MONITOR.println(" ms");
+    #endif
+    }
+
+    /**
+     * Parse the current packet, and if it is a valid response to the current
+     * request from a server that has not already responded, consider it for
+     * selection. The packet is parsed incrementally from the receive buffer of
+     * the UDP interface using a small scratch buffer on the stack, and is
+     * abandoned as soon as it is known to be invalid. The remaining bytes are
+     * discarded by the next parsePacket().
+     */
+    void processResponse() const {
+      uint8_t buf[12];
+
+      // LI, VN, Mode, Stratum, Poll, Precision, Root Delay, Root Dispersion
+      if (mUdp.read(buf, 12) < 12) return;
+      if (!NtpPacket::isValidHeader(buf)) return;
+      uint8_t leapIndicator = NtpPacket::leapIndicator(buf);
+      uint32_t rootDelayMillis = NtpPacket::shortToMillis(
+          NtpPacket::readUint32(&buf[NtpPacket::kOffsetRootDelay]));
+      uint32_t rootDispersionMillis = NtpPacket::shortToMillis(
+          NtpPacket::readUint32(&buf[NtpPacket::kOffsetRootDispersion]));
+
+      // Skip Reference Identifier, Reference Timestamp.
+      if (mUdp.read(buf, 12) < 12) return;
+
+      // Match the Originate Timestamp to the request.
+      if (mUdp.read(buf, 8) < 8) return;
+      if (NtpPacket::readUint32(buf) != mNonce) return;
+      uint32_t index = NtpPacket::readUint32(buf + 4);
+      if (index >= mNumServers) return;
+      uint8_t bit = 1 << index;
+      if (mResponseMask & bit) return;
+
+      // Skip Receive Timestamp, then read the Transmit Timestamp.
+      if (mUdp.read(buf, 8) < 8) return;
+      if (mUdp.read(buf, 8) < 8) return;
+      if (!NtpPacket::isValidTimestamp(buf)) return;
+      mResponseMask |= bit;
+
+      uint16_t nowMillis = T_CI::millis();
+      uint16_t roundTripMillis = nowMillis - mRequestStartMillis;
+      uint32_t distanceMillis = roundTripMillis / 2
+          + rootDelayMillis / 2
+          + rootDispersionMillis;
+
+      if (!mHasSelection) {
+        mFirstResponseMillis = nowMillis;
+      } else if (distanceMillis >= mSelectedDistanceMillis) {
+        return;
+      }
+
+      // The NTP seconds is an unsigned number of seconds since the NTP
+      // epoch of 1900-01-01, in the first 4 bytes (big-endian) of the 32:32
+      // fixed point Transmit Timestamp.
+      mSelectedNtpSeconds = NtpPacket::readUint32(buf);
+      mSelectedDistanceMillis = distanceMillis;
+      mSelectedServer = index;
+      mSelectedLeapIndicator = leapIndicator;
+      mHasSelection = true;
+    }
 
   private:
     const char* const mServer;
+    const char* const* const mServers;
+    const char* mSsid = nullptr;
+    const char* mPassword = nullptr;
+
+    mutable T_UDPI mUdp;
+
+    mutable uint32_t mNonce = 0;
+    mutable uint32_t mSelectedNtpSeconds = 0;
+    mutable uint32_t mSelectedDistanceMillis = 0;
+  #if ACE_TIME_CLOCK_SECONDS64
+    mutable int64_t mEraPivotSeconds = 0;
+  #endif
+
     uint16_t const mLocalPort;
     uint16_t const mRequestTimeout;
+    uint16_t const mServerPort;
+    uint16_t mConnectTimeoutMillis = kConnectTimeoutMillis;
+    uint16_t mSelectionWindowMillis = kSelectionWindowMillis;
+    mutable uint16_t mConnectStartMillis = 0;
+    mutable uint16_t mRequestStartMillis = 0;
+    mutable uint16_t mFirstResponseMillis = 0;
 
-    mutable WiFiUDP mUdp;
-    // buffer to hold incoming & outgoing packets
-    mutable uint8_t mPacketBuffer[kNtpPacketSize];
-    bool mIsSetUp = false;
+    uint8_t const mNumServers;
+    uint8_t const mSelectionMode;
+    mutable uint8_t mConnectionStatus = kConnectionStatusIdle;
+    mutable uint8_t mResponseMask = 0;
+    mutable uint8_t mSelectedServer = 0;
+    mutable uint8_t mSelectedLeapIndicator = kLeapIndicatorNone;
+    mutable bool mHasSelection = false;
+    mutable bool mIsSelectionDone = false;
 };
 
-}
-}
+template <typename T_UDPI, typename T_CI>
+const char NtpClockTemplate<T_UDPI, T_CI>::kNtpServerName[] =
+    "us.pool.ntp.org";
 
+#if defined(ESP8266) || defined(ESP32) || defined(EPOXY_CORE_ESP8266)
+/**
+ * An NtpClock that uses the WiFi stack of the ESP8266 or ESP32. Provided for
+ * backwards compatibility with the previous non-template NtpClock class.
+ */
+using NtpClock = NtpClockTemplate<hw::WiFiUdpInterface>;
 #endif
 
+}
+}
+
 #endif
@@ -0,0 +1,66 @@
+/*
+ * MIT License
+ * Copyright (c) 2022 Brian T. Park
+ */
+
+#include <Arduino.h> // PROGMEM, memcpy_P()
+#include "NtpPacket.h"
+
+namespace ace_time {
+namespace clock {
+
+/**
+ * The constant part of the client request, everything before the transmit
+ * timestamp, stored in flash memory.
+ */
+static const uint8_t kRequestHeader[NtpPacket::kOffsetTransmitTimestamp]
+    PROGMEM = {
+  0b11100011, // LI, Version, Mode
+  0, // Stratum, or type of clock
+  6, // Polling Interval
+  0xEC, // Peer Clock Precision
+  0, 0, 0, 0, // Root Delay
+  0, 0, 0, 0, // Root Dispersion
+  49, 0x4E, 49, 52, // Reference Identifier
+  0, 0, 0, 0, 0, 0, 0, 0, // Reference Timestamp
+  0, 0, 0, 0, 0, 0, 0, 0, // Originate Timestamp
+  0, 0, 0, 0, 0, 0, 0, 0, // Receive Timestamp
+};
+
+void NtpPacket::fillRequest(
+    uint8_t packet[], uint32_t nonceSeconds, uint32_t nonceFraction) {
+  memcpy_P(packet, kRequestHeader, kOffsetTransmitTimestamp);
+  writeUint32(&packet[kOffsetTransmitTimestamp], nonceSeconds);
+  writeUint32(&packet[kOffsetTransmitTimestamp + 4], nonceFraction);
+}
+
+bool NtpPacket::isValidHeader(const uint8_t header[]) {
+  uint8_t m = mode(header);
+  if (m != kModeServer && m != kModeBroadcast) return false;
+
+  uint8_t s = stratum(header);
+  if (s == 0 || s > kMaxStratum) return false;
+
+  return leapIndicator(header) != kLeapIndicatorAlarm;
+}
+
+bool NtpPacket::isValidResponse(const uint8_t packet[]) {
+  return isValidHeader(packet)
+      && isValidTimestamp(&packet[kOffsetTransmitTimestamp]);
+}
+
+bool NtpPacket::isValidTimestamp(const uint8_t timestamp[]) {
+  return readUint32(timestamp) != 0
+      || readUint32(timestamp + 4) != 0;
+}
+
+uint32_t NtpPacket::shortToMillis(uint32_t ntpShort) {
+  // Split into whole and fractional seconds to avoid overflowing 32 bits.
+  // The largest result is 65535999.
+  uint32_t seconds = ntpShort >> 16;
+  uint32_t fraction = ntpShort & 0xFFFF;
+  return seconds * 1000 + ((fraction * 1000) >> 16);
+}
+
+}
+}
@@ -0,0 +1,125 @@
+/*
+ * MIT License
+ * Copyright (c) 2022 Brian T. Park
+ */
+
+#ifndef ACE_TIME_NTP_PACKET_H
+#define ACE_TIME_NTP_PACKET_H
+
+#include <stdint.h>
+
+namespace ace_time {
+namespace clock {
+
+/**
+ * Helper functions to build and parse the 48-byte NTP packet (RFC 5905,
+ * without extension fields) used by `NtpClockTemplate` and
+ * `testing::LoopbackNtpServer`. All multi-byte fields are big-endian.
+ *
+ * The layout of the packet is:
+ *
+ *  * [0] LI (2 bits), VN (3 bits), Mode (3 bits)
+ *  * [1] Stratum
+ *  * [2] Poll
+ *  * [3] Precision
+ *  * [4-7] Root delay (16.16 fixed point seconds)
+ *  * [8-11] Root dispersion (16.16 fixed point seconds)
+ *  * [12-15] Reference identifier
+ *  * [16-23] Reference timestamp (32.32 fixed point seconds)
+ *  * [24-31] Originate timestamp, the client's transmit timestamp
+ *  * [32-39] Receive timestamp
+ *  * [40-47] Transmit timestamp
+ */
+class NtpPacket {
+  public:
+    /** Size of an NTP packet without extension fields. */
+    static const uint8_t kSize = 48;
+
+    static const uint8_t kOffsetRootDelay = 4;
+    static const uint8_t kOffsetRootDispersion = 8;
+    static const uint8_t kOffsetReferenceId = 12;
+    static const uint8_t kOffsetReferenceTimestamp = 16;
+    static const uint8_t kOffsetOriginateTimestamp = 24;
+    static const uint8_t kOffsetReceiveTimestamp = 32;
+    static const uint8_t kOffsetTransmitTimestamp = 40;
+
+    static const uint8_t kModeClient = 3;
+    static const uint8_t kModeServer = 4;
+    static const uint8_t kModeBroadcast = 5;
+
+    /** Leap indicator value meaning that the server is not synchronized. */
+    static const uint8_t kLeapIndicatorAlarm = 3;
+
+    /** Largest valid stratum. Stratum 16 means unsynchronized. */
+    static const uint8_t kMaxStratum = 15;
+
+    /**
+     * Fill `packet` with a client request. The constant part of the request
+     * is copied from flash memory. The transmit timestamp is set to
+     * (nonceSeconds, nonceFraction), which the server copies into the
+     * originate timestamp of its response, allowing the response to be
+     * matched to the request.
+     */
+    static void fillRequest(
+        uint8_t packet[], uint32_t nonceSeconds, uint32_t nonceFraction);
+
+    /**
+     * Return true if `packet` is a usable response from a synchronized server:
+     * a valid header (see isValidHeader()), and a non-zero transmit timestamp.
+     */
+    static bool isValidResponse(const uint8_t packet[]);
+
+    /**
+     * Return true if the first 4 bytes of a response indicate a synchronized
+     * server: mode server or broadcast, stratum 1-15, and leap indicator not
+     * alarm. This allows a response to be rejected after reading only its
+     * header.
+     */
+    static bool isValidHeader(const uint8_t header[]);
+
+    /** Return true if the 8-byte timestamp is not zero. */
+    static bool isValidTimestamp(const uint8_t timestamp[]);
+
+    /** Return the leap indicator (0-3). */
+    static uint8_t leapIndicator(const uint8_t packet[]) {
+      return packet[0] >> 6;
+    }
+
+    /** Return the protocol version (0-7). */
+    static uint8_t version(const uint8_t packet[]) {
+      return (packet[0] >> 3) & 0x07;
+    }
+
+    /** Return the association mode (0-7). */
+    static uint8_t mode(const uint8_t packet[]) { return packet[0] & 0x07; }
+
+    /** Return the stratum. */
+    static uint8_t stratum(const uint8_t packet[]) { return packet[1]; }
+
+    /** Read a big-endian uint32_t. */
+    static uint32_t readUint32(const uint8_t* p) {
+      return ((uint32_t) p[0] << 24)
+          | ((uint32_t) p[1] << 16)
+          | ((uint32_t) p[2] << 8)
+          | (uint32_t) p[3];
+    }
+
+    /** Write a big-endian uint32_t. */
+    static void writeUint32(uint8_t* p, uint32_t value) {
+      p[0] = value >> 24;
+      p[1] = value >> 16;
+      p[2] = value >> 8;
+      p[3] = value;
+    }
+
+    /**
+     * Convert an NTP short format value (16.16 fixed point seconds), such as
+     * the root delay or root dispersion, to milliseconds.
+     */
+    static uint32_t shortToMillis(uint32_t ntpShort);
+};
+
+}
+}
+
+#endif
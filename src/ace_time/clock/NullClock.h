@@ -0,0 +1,32 @@
+/*
+ * MIT License
+ * Copyright (c) 2022 Brian T. Park
+ */
+
+#ifndef ACE_TIME_NULL_CLOCK_H
+#define ACE_TIME_NULL_CLOCK_H
+
+#include "Clock.h"
+
+namespace ace_time {
+namespace clock {
+
+/**
+ * A Clock which represents the absence of a clock. It is intended to be used
+ * as the `T_REF` or `T_BACKUP` template parameter of SystemClockTemplate (and
+ * its subclasses) when the SystemClock has no referenceClock or no
+ * backupClock. The SystemClock then stores nothing for that clock, and the
+ * code which uses it is removed at compile time.
+ *
+ * An instance can also be used as a regular Clock, which is never
+ * initialized, and ignores setNow().
+ */
+class NullClock: public Clock {
+  public:
+    acetime_t getNow() const override { return kInvalidSeconds; }
+};
+
+}
+}
+
+#endif
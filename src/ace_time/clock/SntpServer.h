@@ -0,0 +1,319 @@
+/*
+ * MIT License
+ * Copyright (c) 2022 Brian T. Park
+ */
+
+#ifndef ACE_TIME_SNTP_SERVER_H
+#define ACE_TIME_SNTP_SERVER_H
+
+#include <stdint.h>
+#include <string.h> // memcpy(), memset()
+#include <AceTime.h>
+#include "EpochOffsets.h"
+#include "NtpPacket.h"
+#include "SystemClock.h"
+#include "../hw/ClockInterface.h"
+#include "../hw/WiFiUdpInterface.h"
+
+namespace ace_time {
+namespace clock {
+
+/**
+ * A lightweight SNTP responder (RFC 4330) which answers the NTP requests of
+ * other devices on the local network using the current time of a
+ * SystemClock. This allows a single device with a good reference clock (e.g.
+ * a GPS or DS3231 module, or an upstream NtpClock) to act as the time server
+ * of a small network.
+ *
+ * The responses contain the sub-second phase of the SystemClock (see
+ * SystemClockTemplate::getNowMillis()), so the accuracy seen by a client is
+ * limited by the millisecond resolution of the SystemClock and the drift of
+ * its local oscillator since the last sync. The advertised stratum is derived
+ * from the sync status of the SystemClock:
+ *
+ *  * not initialized: stratum 16 with leap indicator 3 (alarm), which causes
+ *    conforming clients (including NtpClock) to reject the response
+ *  * last sync within `maxSyncAgeSeconds`: the configured `stratum`
+ *  * last sync older than `maxSyncAgeSeconds`: stratum 15
+ *
+ * The root dispersion grows with the age of the last sync, at the rate of
+ * kDriftPpm, to indicate the decreasing quality of the time to the clients.
+ *
+ * The reference identifier is "LOCL" when the advertised stratum is 1, i.e.
+ * the SystemClock is treated as a primary reference. At higher strata, RFC
+ * 4330 requires the IPv4 address of the upstream server, which is set using
+ * setReferenceId() (default 0, unknown).
+ *
+ * The loop() method is non-blocking and must be called frequently from the
+ * global loop() function. It handles at most kMaxRequestsPerLoop requests per
+ * call so that a burst of requests cannot starve the rest of the application.
+ * The server does not manage the network connection. If the UDP interface
+ * reports that it is not connected, requests are ignored, and the socket is
+ * opened again when the connection comes back.
+ *
+ * @tparam T_UDPI UDP transport interface (e.g. hw::WiFiUdpInterface,
+ *    hw::PosixUdpInterface) using the methods described in WiFiUdpInterface
+ * @tparam T_SCCI the ClockInterface of the SystemClock
+ * @tparam T_SCINSTR the instrumentation policy of the SystemClock
+ * @tparam T_SCREF the referenceClock type of the SystemClock
+ * @tparam T_SCBACKUP the backupClock type of the SystemClock
+ */
+template <
+    typename T_UDPI,
+    typename T_SCCI = hw::ClockInterface,
+    typename T_SCINSTR = SystemClockNoInstrumentation,
+    typename T_SCREF = Clock,
+    typename T_SCBACKUP = Clock
+>
+class SntpServerTemplate {
+  public:
+    /** Default NTP server port. */
+    static const uint16_t kNtpServerPort = 123;
+
+    /** Default stratum advertised when the SystemClock is synced. */
+    static const uint8_t kDefaultStratum = 2;
+
+    /** Default max age of the last sync before the stratum is downgraded. */
+    static const uint32_t kMaxSyncAgeSeconds = 3600;
+
+    /** Assumed drift of the local oscillator, used for the root dispersion. */
+    static const uint16_t kDriftPpm = 15;
+
+    /** Max number of requests handled by a single call to loop(). */
+    static const uint8_t kMaxRequestsPerLoop = 4;
+
+    /** Stratum advertised when the SystemClock is not initialized. */
+    static const uint8_t kStratumUnsynchronized = 16;
+
+    /**
+     * Constructor.
+     * @param systemClock the clock which provides the time
+     * @param port UDP port of the server (default 123)
+     * @param stratum stratum advertised when the clock was recently synced,
+     *    normally one more than the stratum of the reference clock (default 2)
+     * @param maxSyncAgeSeconds age of the last sync after which the stratum
+     *    is downgraded to 15 (default 3600)
+     */
+    explicit SntpServerTemplate(
+        const SystemClockTemplate<
+            T_SCCI, T_SCINSTR, T_SCREF, T_SCBACKUP>& systemClock,
+        uint16_t port = kNtpServerPort,
+        uint8_t stratum = kDefaultStratum,
+        uint32_t maxSyncAgeSeconds = kMaxSyncAgeSeconds
+    ) :
+        mSystemClock(systemClock),
+        mMaxSyncAgeSeconds(maxSyncAgeSeconds),
+        mPort(port),
+        mStratum(stratum)
+    {}
+
+    /**
+     * Open the server socket if the network is connected. Otherwise, the
+     * socket is opened by a later call to loop().
+     */
+    void setup() {
+      mIsEnabled = true;
+      openIfConnected();
+    }
+
+    /** Stop serving requests and close the socket. */
+    void stop() {
+      mIsEnabled = false;
+      close();
+    }
+
+    /** Return true if the server socket is open. */
+    bool isOpen() const { return mIsOpen; }
+
+    /**
+     * Answer the pending requests, at most kMaxRequestsPerLoop per call.
+     * Returns the number of responses sent in this call.
+     */
+    uint8_t loop() {
+      if (! mIsEnabled) return 0;
+
+      if (! mUdp.isConnected()) {
+        close();
+        return 0;
+      }
+      if (! mIsOpen) {
+        openIfConnected();
+        if (! mIsOpen) return 0;
+      }
+
+      uint8_t count = 0;
+      for (uint8_t i = 0; i < kMaxRequestsPerLoop; i++) {
+        if (mUdp.parsePacket() <= 0) break;
+
+        uint8_t packet[kNtpPacketSize];
+        if (mUdp.read(packet, kNtpPacketSize) < (int) kNtpPacketSize) continue;
+        if (NtpPacket::mode(packet) != NtpPacket::kModeClient) continue;
+
+        fillResponse(packet);
+        mUdp.beginReply();
+        mUdp.write(packet, kNtpPacketSize);
+        if (mUdp.endPacket()) count++;
+      }
+
+      mRequestCount += count;
+      return count;
+    }
+
+    /** Return the number of requests answered since construction. */
+    uint32_t getRequestCount() const { return mRequestCount; }
+
+    /**
+     * Set the reference identifier advertised at stratum 2 and higher,
+     * normally the IPv4 address of the upstream server, with the first octet
+     * in the most significant byte (e.g. 0xC0A80001 for 192.168.0.1). The
+     * default is 0, which means unknown.
+     */
+    void setReferenceId(uint32_t referenceId) { mReferenceId = referenceId; }
+
+    /** Return the reference identifier set by setReferenceId(). */
+    uint32_t getReferenceId() const { return mReferenceId; }
+
+    /** Return the configured UDP port of the server. */
+    uint16_t getPort() const { return mPort; }
+
+    /** Return the UDP interface, mostly for testing. */
+    T_UDPI& getUdpInterface() { return mUdp; }
+
+    /**
+     * Return the stratum which would be advertised in a response now.
+     * Exposed for testing and debugging.
+     */
+    uint8_t currentStratum() const {
+      if (! mSystemClock.isInit()) return kStratumUnsynchronized;
+      return (syncAgeSeconds() <= mMaxSyncAgeSeconds)
+          ? mStratum
+          : NtpPacket::kMaxStratum;
+    }
+
+  private:
+    static const uint8_t kNtpPacketSize = NtpPacket::kSize;
+
+    /** Open the socket if enabled and the network is connected. */
+    void openIfConnected() {
+      if (mIsEnabled && ! mIsOpen && mUdp.isConnected()) {
+        mIsOpen = mUdp.begin(mPort);
+      }
+    }
+
+    /** Close the socket if open. */
+    void close() {
+      if (mIsOpen) {
+        mUdp.stop();
+        mIsOpen = false;
+      }
+    }
+
+    /** Return the number of seconds since the last sync of the clock. */
+    uint32_t syncAgeSeconds() const {
+      acetime_t now = mSystemClock.getNow();
+      acetime_t lastSync = mSystemClock.getLastSyncTime();
+      return (now > lastSync) ? (uint32_t) (now - lastSync) : 0;
+    }
+
+    /**
+     * Convert the client request in `packet` into the server response in
+     * place. The transmit timestamp of the request is copied into the
+     * originate timestamp of the response, and the receive and transmit
+     * timestamps are both set to the current time of the SystemClock.
+     */
+    void fillResponse(uint8_t packet[]) const {
+      uint8_t version = NtpPacket::version(packet);
+      memcpy(&packet[NtpPacket::kOffsetOriginateTimestamp],
+          &packet[NtpPacket::kOffsetTransmitTimestamp], 8);
+      memset(packet, 0, NtpPacket::kOffsetOriginateTimestamp);
+
+      uint16_t millis;
+      acetime_t now = mSystemClock.getNowMillis(&millis);
+      uint8_t stratum = currentStratum();
+      uint8_t leap = (stratum == kStratumUnsynchronized)
+          ? NtpPacket::kLeapIndicatorAlarm : 0;
+
+      packet[0] = (leap << 6) | (version << 3) | NtpPacket::kModeServer;
+      packet[1] = stratum;
+      packet[2] = 6; // poll, 2^6 = 64 seconds
+      packet[3] = 0xF6; // precision, 2^-10 seconds, about 1 millisecond
+
+      if (stratum == kStratumUnsynchronized) {
+        // The timestamps are left as 0, as required by RFC 4330.
+        return;
+      }
+
+      // Root dispersion, in 16.16 fixed point seconds: 1 ms for the resolution
+      // of the clock, plus the drift accumulated since the last sync.
+      uint32_t ageSeconds = syncAgeSeconds();
+      uint32_t dispersionMillis = 1 + ageSeconds / (1000 / kDriftPpm);
+      if (dispersionMillis > 65535000) dispersionMillis = 65535000;
+      NtpPacket::writeUint32(&packet[NtpPacket::kOffsetRootDispersion],
+          millisToShort(dispersionMillis));
+
+      if (stratum == 1) {
+        packet[12] = 'L'; // reference identifier
+        packet[13] = 'O';
+        packet[14] = 'C';
+        packet[15] = 'L';
+      } else {
+        NtpPacket::writeUint32(&packet[NtpPacket::kOffsetReferenceId],
+            mReferenceId);
+      }
+
+      writeTimestamp(&packet[NtpPacket::kOffsetReferenceTimestamp],
+          mSystemClock.getLastSyncTime(), 0);
+      writeTimestamp(&packet[NtpPacket::kOffsetReceiveTimestamp], now, millis);
+      writeTimestamp(&packet[NtpPacket::kOffsetTransmitTimestamp], now, millis);
+    }
+
+    /** Write an NTP timestamp (32.32 fixed point) in big-endian order. */
+    static void writeTimestamp(uint8_t* p, acetime_t seconds, uint16_t millis) {
+      NtpPacket::writeUint32(p, (uint32_t) seconds
+          + EpochOffsets::secondsToCurrentEpochFromNtpEpoch());
+      NtpPacket::writeUint32(p + 4, millisToFraction(millis));
+    }
+
+    /**
+     * Convert millis (0-999) to the 32-bit NTP fraction, i.e. millis *
+     * 2^32 / 1000 = millis * 4294967.296, without 64-bit arithmetic.
+     */
+    static uint32_t millisToFraction(uint16_t millis) {
+      return (uint32_t) millis * 4294967 + (uint32_t) millis * 296 / 1000;
+    }
+
+    /**
+     * Convert millis to the NTP short format (16.16 fixed point seconds),
+     * rounding up so that the dispersion is never understated.
+     */
+    static uint32_t millisToShort(uint32_t millis) {
+      return ((millis / 1000) << 16) + (((millis % 1000) << 16) + 999) / 1000;
+    }
+
+  private:
+    const SystemClockTemplate<T_SCCI, T_SCINSTR, T_SCREF, T_SCBACKUP>&
+        mSystemClock;
+    T_UDPI mUdp;
+    uint32_t mMaxSyncAgeSeconds;
+    uint32_t mRequestCount = 0;
+    uint32_t mReferenceId = 0;
+    uint16_t mPort;
+    uint8_t mStratum;
+    bool mIsEnabled = false;
+    bool mIsOpen = false;
+};
+
+#if defined(ESP8266) || defined(ESP32) || defined(EPOXY_CORE_ESP8266)
+
+/**
+ * An SntpServer on the ESP8266 or ESP32, serving the time of a SystemClock
+ * using the default ClockInterface.
+ */
+using SntpServer = SntpServerTemplate<hw::WiFiUdpInterface>;
+
+#endif
+
+}
+}
+
+#endif
@@ -6,13 +6,11 @@
 #ifndef ACE_TIME_STM32_F1_CLOCK_H
 #define ACE_TIME_STM32_F1_CLOCK_H
 
-// For EpoxyDuino, this class is simply stubbed out for testing purposes.
+// For EpoxyDuino, the RTC registers are emulated for testing purposes.
 #if defined(STM32F1xx) || defined(EPOXY_DUINO)
 
 #include <stdint.h>
-#if ! defined(EPOXY_DUINO)
-  #include "../hw/Stm32F1Rtc.h"
-#endif
+#include "../hw/Stm32F1Rtc.h"
 #include "Clock.h"
 
 namespace ace_time {
@@ -70,9 +68,19 @@ namespace clock {
  * which holds a single status bit to indicate whether or not the underlying RTC
  * counter has been initialized to a valid time. The selection of the `DR1`
  * register, instead of any of the other 9-10 backup registers, is currently
- * hardcoded in the `RTC_INIT_REG` macro in `Stm32F1Rtc.h`. If that causes a
+ * hardcoded in the `RTC_INIT_REG` macro in `Stm32F1Rtc.cpp`. If that causes a
  * conflict with something else, let me know, because this is fixable. We can
  * make that a configurable parameter in the Stm32F1Rtc::begin() method.
+ *
+ * The RTC counter is driven by a prescaler divider which counts the 32768
+ * ticks of the LSE_CLOCK in each second. The getNowMillis() and
+ * getNowMicros() methods read both of them consistently, so the sub-second
+ * time is available directly from the RTC, which keeps running in the
+ * standby mode of the processor, without tracking millis() in a SystemClock.
+ *
+ * Under EpoxyDuino, the RTC registers are emulated by
+ * hw::Stm32F1RtcEmulator, which advances only when its advanceTicks() method
+ * is called.
  */
 class Stm32F1Clock: public Clock {
   public:
@@ -80,34 +88,47 @@ class Stm32F1Clock: public Clock {
 
     /** Configure the clock. */
     void setup() {
-    #if ! defined(EPOXY_DUINO)
       mStm32F1Rtc.begin();
-    #endif
     }
 
     acetime_t getNow() const override {
-    #if defined(EPOXY_DUINO)
-      return mEpochSeconds;
-    #else
       return mStm32F1Rtc.getTime();
-    #endif
+    }
+
+    acetime_t getNowMillis(uint16_t* millis) const override {
+      uint16_t ticks;
+      acetime_t now = mStm32F1Rtc.getTimeTicks(&ticks);
+      // 1000 / 32768 = 125 / 4096
+      *millis = (uint16_t) (((uint32_t) ticks * 125) >> 12);
+      return now;
+    }
+
+    /**
+     * Same as getNow(), but also return the microseconds (0-999999) since the
+     * start of the current second, with a resolution of about 30.5 micros.
+     */
+    acetime_t getNowMicros(uint32_t* micros) const {
+      uint16_t ticks;
+      acetime_t now = mStm32F1Rtc.getTimeTicks(&ticks);
+      // 1000000 / 32768 = 15625 / 512
+      *micros = ((uint32_t) ticks * 15625) >> 9;
+      return now;
+    }
+
+    acetime_t readResponseMillis(uint16_t* millis) const override {
+      return getNowMillis(millis);
     }
 
     void setNow(acetime_t epochSeconds) override {
       if (epochSeconds == kInvalidSeconds) return;
-    #if defined(EPOXY_DUINO)
-      mEpochSeconds = epochSeconds;
-    #else
       mStm32F1Rtc.setTime(epochSeconds);
-    #endif
     }
 
   private:
-  #if defined(EPOXY_DUINO)
-    uint32_t mEpochSeconds;
-  #else
+    static_assert(hw::Stm32F1Rtc::kTicksPerSecond == 32768,
+        "The conversion of the ticks assumes a 32768 Hz prescaler");
+
     mutable hw::Stm32F1Rtc mStm32F1Rtc;
-  #endif
 };
 
 } // clock
@@ -8,22 +8,75 @@
 
 #include <stdint.h>
 #include "Clock.h"
+#include "ClockDispatcher.h"
+#include "SystemClockInstrumentation.h"
+#include "SystemClockSnapshot.h"
 #include "../hw/ClockInterface.h"
 
+/**
+ * Set to 1 to select the compact memory layout of SystemClockTemplate,
+ * SystemClockLoopTemplate and SystemClockCoroutineTemplate, intended for 8-bit
+ * processors. The status flags and the request status of the subclass are
+ * packed into a single byte, and the optional LatencyHistogram pointer (along
+ * with the constructor parameter) is removed. The monotonic millis API of
+ * SystemClockTemplate (e.g. getMonotonicMillis()) is also removed. The
+ * behavior of the rest of the public API is unchanged. This must be defined
+ * before including AceTimeClock.h.
+ */
+#ifndef ACE_TIME_CLOCK_COMPACT
+#define ACE_TIME_CLOCK_COMPACT 0
+#endif
+
+/**
+ * Set to 1 to remember the most recent step of the time in
+ * SystemClockTemplate, so that convertCapturedTicks() converts the ticks
+ * captured before the step using the time before the step. This adds 9 bytes
+ * to the SystemClock on AVR. Otherwise, the captured ticks are always
+ * converted using the current time. This must be defined before including
+ * AceTimeClock.h.
+ */
+#ifndef ACE_TIME_CLOCK_EVENT_CAPTURE
+#define ACE_TIME_CLOCK_EVENT_CAPTURE 0
+#endif
+
+/**
+ * Set to 1 to enable the leap second handling of SystemClockTemplate (see
+ * SystemClockTemplate::setLeapMode()). This adds 11 bytes to the SystemClock
+ * on AVR. Otherwise, the leap seconds are ignored, and appear as a 1-second
+ * step at the next sync with the referenceClock. This must be defined before
+ * including AceTimeClock.h.
+ */
+#ifndef ACE_TIME_CLOCK_LEAP_SECONDS
+#define ACE_TIME_CLOCK_LEAP_SECONDS 0
+#endif
+
+/**
+ * Set to 1 to enable the setSyncJitter() method of SystemClockLoopTemplate and
+ * SystemClockCoroutineTemplate, which varies the sync periods
+ * pseudo-randomly. This adds 5 bytes to the SystemClock on AVR. Otherwise,
+ * the sync periods are exact. This must be defined before including
+ * AceTimeClock.h.
+ */
+#ifndef ACE_TIME_CLOCK_SYNC_JITTER
+#define ACE_TIME_CLOCK_SYNC_JITTER 0
+#endif
+
 class SystemClockCoroutineTest;
 class SystemClockLoopTest;
 class SystemClockLoopTest_loop;
 class SystemClockLoopTest_setup;
 class SystemClockLoopTest_backupNow;
 class SystemClockLoopTest_syncNow;
+class SystemClockLoopTest_syncNowMillis;
 class SystemClockLoopTest_getNow;
 
 namespace ace_time {
 namespace clock {
 
 /**
- * A Clock that uses the Arduino millis() function to advance the time
- * returned to the user. It has 2 major features:
+ * A Clock that uses the Arduino millis() function (or another tick source
+ * provided by the ClockInterface) to advance the time returned to the user.
+ * It has 2 major features:
  *
  *    1) The built-in millis() is not accurate, so this class allows a periodic
  *    sync using the (presumably) more accurate referenceClock.
@@ -34,12 +87,14 @@ namespace clock {
  *
  * There are 2 maintenance tasks which this class must perform peridicallly:
  *
- *    1) The value of the previous system time millis() is stored internally as
- *    a uint16_t. That has 2 advantages: 1) it saves memory, 2) the upper bound
- *    of the execution time of getNow() limited to 65 iterations. The
- *    disadvantage is the that internal counter will rollover within 65.535
- *    milliseconds. To prevent that, keepAlive() must be called more frequently
- *    than every 65.536 seconds.
+ *    1) The value of the previous ticks of the ClockInterface is stored
+ *    internally as a `T_CI::tick_t`. For the default hw::ClockInterface, that
+ *    is the lower 16 bits of millis(), which saves memory, but the internal
+ *    counter will rollover within 65.535 seconds. To prevent that,
+ *    keepAlive() must be called more frequently than every 65.536 seconds.
+ *    The hw::MicrosClockInterface uses 32-bit micros() which rolls over every
+ *    71.6 minutes. The hw::MonotonicClockInterface on EpoxyDuino uses 64-bit
+ *    micros which does not roll over.
  *    2) The current time can be synchronized to the referenceClock peridically.
  *    Some reference clocks can take hundreds or thousands of milliseconds to
  *    return, so it's important that the non-block methods of Clock are
@@ -54,11 +109,60 @@ namespace clock {
  *    function.
  *
  * @tparam T_CI class name of the ClockInterface, normally
- *    ace_time::ClockInterface
+ *    ace_time::hw::ClockInterface, which provides `millis()`, `ticks()`, the
+ *    `tick_t` type and `kTicksPerSecond`
+ * @tparam T_INSTR the instrumentation policy, SystemClockNoInstrumentation
+ *    by default which compiles to nothing, or
+ *    SystemClockStatsInstrumentation to collect SystemClockStats. It is an
+ *    empty base class when it has no state, so it does not increase the
+ *    sizeof() of this class.
+ * @tparam T_REF type of the referenceClock. The default Clock calls its
+ *    methods through virtual dispatch. A concrete type (e.g.
+ *    `DS3231Clock<T_WIREI>`) calls them directly, allowing the compiler to
+ *    inline them, and NullClock removes the referenceClock at compile time.
+ *    See ClockDispatcher.
+ * @tparam T_BACKUP type of the backupClock, same as T_REF
  */
-template <typename T_CI>
-class SystemClockTemplate: public Clock {
+template <
+    typename T_CI,
+    typename T_INSTR = SystemClockNoInstrumentation,
+    typename T_REF = Clock,
+    typename T_BACKUP = Clock
+>
+class SystemClockTemplate: public Clock, private T_INSTR {
   public:
+    /** Type of the ticks of the ClockInterface. */
+    typedef typename T_CI::tick_t tick_t;
+
+  #if ACE_TIME_CLOCK_SECONDS64
+    /** Type of the epoch seconds stored by this class. */
+    typedef int64_t seconds_t;
+
+    /** Invalid value of seconds_t. */
+    static const seconds_t kInvalidEpochSeconds = kInvalidSeconds64;
+  #else
+    /** Type of the epoch seconds stored by this class. */
+    typedef acetime_t seconds_t;
+
+    /** Invalid value of seconds_t. */
+    static const seconds_t kInvalidEpochSeconds = kInvalidSeconds;
+  #endif
+
+  #if ! ACE_TIME_CLOCK_COMPACT
+    /** Error value returned by convertEpochSecondsToMonotonicMillis(). */
+    static const uint64_t kInvalidMonotonicMillis = UINT64_MAX;
+  #endif
+
+    /** Maximum value returned by getMillisToKeepAlive(), about 24.8 days. */
+    static const uint32_t kMaxMillisToKeepAlive = INT32_MAX;
+
+    /**
+     * Maximum number of millis returned by getMillisToNextRun() of the
+     * subclasses while waiting for the response of the referenceClock, so that
+     * the response is read promptly.
+     */
+    static const uint16_t kResponsePollMillis = 10;
+
     /** Sync was successful. */
     static const uint8_t kSyncStatusOk = 0;
 
@@ -73,8 +177,12 @@ class SystemClockTemplate: public Clock {
 
     /** Attempt to retrieve the time from the backupClock if it exists. */
     void setup() {
-      if (mBackupClock != nullptr) {
-        setNow(mBackupClock->getNow());
+      if (! mBackupClock.isNull()) {
+      #if ACE_TIME_CLOCK_SECONDS64
+        setNow64(mBackupClock.getNow64());
+      #else
+        setNow(mBackupClock.getNow());
+      #endif
       }
     }
 
@@ -87,31 +195,46 @@ class SystemClockTemplate: public Clock {
      * (sendRequest(), isResponseReady(), and readResponse()) instead.
      */
     acetime_t getNow() const override {
-      if (!mIsInit) return kInvalidSeconds;
+    #if ACE_TIME_CLOCK_SECONDS64
+      return toSeconds32(readEpochSeconds(nullptr));
+    #else
+      return readEpochSeconds(nullptr);
+    #endif
+    }
 
-      // Update mEpochSeconds by the number of seconds elapsed according to the
-      // millis(). This method is expected to be called multiple times a second,
-      // so the while() loop below will normally execute 0 times, until the
-      // millis() clock goes past the mPrevKeepAliveMillis by 1 second.
-      //
-      // There are 2 reasons why this method will be called multiple times a
-      // second:
-      //
-      // 1) A physical clock with an external display will want to refresh
-      // its display 5-10 times a second, so that it can capture the transition
-      // from one second to the next without too much jitter. So it will call
-      // this method multiple times a second to check if one second has passed.
-      //
-      // 2) If the SystemClockCoroutine or SystemClockLoop classes is used,
-      // then the keepAlive() method will be called perhaps 100's times per
-      // second, as fast as the iteration speed of the global loop() function.
-      while ((uint16_t) ((uint16_t) clockMillis() - mPrevKeepAliveMillis)
-          >= 1000) {
-        mPrevKeepAliveMillis += 1000;
-        mEpochSeconds += 1;
-      }
+    /**
+     * Same as getNow(), but also return the number of milliseconds (0-999)
+     * elapsed since the start of the current second in `*millis`. The
+     * sub-second phase is defined by the ticks of the ClockInterface at the
+     * time of the last setNow() or syncNow(). If the clock is not initialized,
+     * returns kInvalidSeconds and sets `*millis` to 0.
+     */
+    acetime_t getNowMillis(uint16_t* millis) const override {
+      tick_t ticks;
+      seconds_t now = readEpochSeconds(&ticks);
+      *millis = ticksToMillis(ticks);
+    #if ACE_TIME_CLOCK_SECONDS64
+      return toSeconds32(now);
+    #else
+      return now;
+    #endif
+    }
 
-      return mEpochSeconds;
+    /**
+     * Same as getNowMillis(), but returns the microseconds (0-999999) elapsed
+     * since the start of the current second. The resolution is limited by
+     * `T_CI::kTicksPerSecond`, e.g. 1000 microseconds for the default
+     * hw::ClockInterface.
+     */
+    acetime_t getNowMicros(uint32_t* micros) const {
+      tick_t ticks;
+      seconds_t now = readEpochSeconds(&ticks);
+      *micros = ticksToMicros(ticks);
+    #if ACE_TIME_CLOCK_SECONDS64
+      return toSeconds32(now);
+    #else
+      return now;
+    #endif
     }
 
     /**
@@ -121,13 +244,47 @@ class SystemClockTemplate: public Clock {
      * GPS clocks and this method will be a no-op.
      */
     void setNow(acetime_t epochSeconds) override {
+    #if ACE_TIME_CLOCK_SECONDS64
+      setNow64(toSeconds64(epochSeconds));
+    #else
+      syncNow(epochSeconds);
+
+      // Also set the reference clock if possible.
+      if (! mReferenceClock.isNull()) {
+        mReferenceClock.setNow(epochSeconds);
+      }
+    #endif
+    }
+
+  #if ACE_TIME_CLOCK_SECONDS64
+    /** Same as getNow() but returns 64-bit seconds. */
+    int64_t getNow64() const override { return readEpochSeconds(nullptr); }
+
+    /** Same as getNowMillis() but returns 64-bit seconds. */
+    int64_t getNowMillis64(uint16_t* millis) const override {
+      tick_t ticks;
+      int64_t now = readEpochSeconds(&ticks);
+      *millis = ticksToMillis(ticks);
+      return now;
+    }
+
+    int64_t readResponse64() const override { return getNow64(); }
+
+    int64_t readResponseMillis64(uint16_t* millis) const override {
+      *millis = kUnknownMillis;
+      return readResponse64();
+    }
+
+    /** Same as setNow() but takes 64-bit seconds. */
+    void setNow64(int64_t epochSeconds) override {
       syncNow(epochSeconds);
 
       // Also set the reference clock if possible.
-      if (mReferenceClock != nullptr) {
-        mReferenceClock->setNow(epochSeconds);
+      if (! mReferenceClock.isNull()) {
+        mReferenceClock.setNow64(epochSeconds);
       }
     }
+  #endif
 
     /**
      * Manually force a sync with the referenceClock if it exists. Intended to
@@ -143,9 +300,15 @@ class SystemClockTemplate: public Clock {
      * Clock::isResponseReady(), Clock::readResponse()) on the reference clock.
      */
     void forceSync() {
-      if (mReferenceClock) {
-        acetime_t nowSeconds = mReferenceClock->getNow();
-        syncNow(nowSeconds);
+      if (! mReferenceClock.isNull()) {
+        uint16_t millis;
+      #if ACE_TIME_CLOCK_SECONDS64
+        seconds_t nowSeconds = mReferenceClock.getNowMillis64(&millis);
+      #else
+        seconds_t nowSeconds = mReferenceClock.getNowMillis(&millis);
+      #endif
+        updateLeapSecond(nowSeconds);
+        syncNow(nowSeconds, millis);
       }
     }
 
@@ -154,11 +317,28 @@ class SystemClockTemplate: public Clock {
      * call. Returns kInvalidSeconds if never synced.
      */
     acetime_t getLastSyncTime() const {
+    #if ACE_TIME_CLOCK_SECONDS64
+      return toSeconds32(mLastSyncTime);
+    #else
       return mLastSyncTime;
+    #endif
     }
 
+  #if ACE_TIME_CLOCK_SECONDS64
+    /** Same as getLastSyncTime() but returns 64-bit seconds. */
+    int64_t getLastSyncTime64() const { return mLastSyncTime; }
+  #endif
+
     /** Get sync status code. */
-    uint8_t getSyncStatusCode() const { return mSyncStatusCode; }
+    uint8_t getSyncStatusCode() const {
+    #if ACE_TIME_CLOCK_COMPACT
+      return (mSyncStatusCode == kPackedSyncStatusUnknown)
+          ? kSyncStatusUnknown
+          : mSyncStatusCode;
+    #else
+      return mSyncStatusCode;
+    #endif
+    }
 
     /**
      * Return the number of seconds since the previous sync attempt, successful
@@ -187,6 +367,27 @@ class SystemClockTemplate: public Clock {
       return (int32_t) (mNextSyncAttemptMillis - clockMillis()) / 1000;
     }
 
+    /**
+     * Return the number of millis until keepAlive() (or getNow()) must be
+     * called again, before the `tick_t` of the ClockInterface rolls over,
+     * with a margin of one second. For the default hw::ClockInterface, this is
+     * a little less than 64.5 seconds after the last call. The result is at
+     * most kMaxMillisToKeepAlive, which keeps the 64-bit getMonotonicMillis()
+     * correct across the rollovers of the 32-bit millis().
+     */
+    uint32_t getMillisToKeepAlive() const {
+      if (! mIsInit) return kMaxMillisToKeepAlive;
+      tick_t elapsed = subSecondTicks();
+      if (elapsed >= kMaxKeepAliveTicks) return 0;
+      tick_t remaining = (tick_t) (kMaxKeepAliveTicks - elapsed);
+      if (T_CI::kTicksPerSecond != 1000) {
+        remaining /= (tick_t) (T_CI::kTicksPerSecond / 1000);
+      }
+      return ((uint64_t) remaining > kMaxMillisToKeepAlive)
+          ? kMaxMillisToKeepAlive
+          : (uint32_t) remaining;
+    }
+
     /**
      * Difference between this clock compared to reference at last sync. A
      * negative value means that the SystemClock was slower than the
@@ -204,11 +405,242 @@ class SystemClockTemplate: public Clock {
     /** Return true if initialized by setNow() or syncNow(). */
     bool isInit() const { return mIsInit; }
 
+  #if ACE_TIME_CLOCK_SYNC_JITTER
+    /** Maximum jitter of the sync periods, see setSyncJitter(). */
+    static const uint8_t kMaxSyncJitterPercent = 50;
+
+    /** Return the jitter of the sync periods in percent, 0 if disabled. */
+    uint8_t getSyncJitterPercent() const { return mSyncJitterPercent; }
+  #endif
+
+  #if ACE_TIME_CLOCK_LEAP_SECONDS
+    /**
+     * Leap seconds are ignored (default). An inserted or deleted leap second
+     * appears as a 1-second step at the next sync with the referenceClock.
+     */
+    static const uint8_t kLeapModeIgnore = 0;
+
+    /**
+     * A leap second is applied as an exact 1-second step at the end of the
+     * UTC month. An inserted second repeats 23:59:59, and a deleted second
+     * skips 23:59:59.
+     */
+    static const uint8_t kLeapModeStep = 1;
+
+    /**
+     * A leap second is spread over a window centered on the end of the UTC
+     * month, during which the clock runs slower (inserted) or faster
+     * (deleted) by 1 second over the width of the window, so that the time
+     * returned by getNow() never jumps.
+     */
+    static const uint8_t kLeapModeSmear = 2;
+
+    /** Default width of the smear window, 24 hours. */
+    static const uint32_t kDefaultLeapSmearSeconds = 86400;
+
+    /** Smallest width of the smear window. */
+    static const uint32_t kMinLeapSmearSeconds = 2;
+
+    /** Largest width of the smear window, 2 days. */
+    static const uint32_t kMaxLeapSmearSeconds = 172800;
+
+    /**
+     * Select how the leap seconds are applied, one of kLeapModeIgnore,
+     * kLeapModeStep or kLeapModeSmear. In kLeapModeSmear, `smearSeconds` is
+     * the width of the smear window, clamped to kMinLeapSmearSeconds and
+     * kMaxLeapSmearSeconds. Should be called in the global setup(), since
+     * changing the mode while a leap second is in progress causes a step.
+     * Selecting kLeapModeIgnore cancels the pending leap second.
+     *
+     * In kLeapModeStep and kLeapModeSmear, the leap second is scheduled
+     * automatically when the referenceClock announces it through
+     * Clock::getLeapIndicator() (e.g. NtpClock), or manually using
+     * setLeapSecond().
+     */
+    void setLeapMode(uint8_t mode,
+        uint32_t smearSeconds = kDefaultLeapSmearSeconds) {
+      mLeapMode = mode;
+      if (mode == kLeapModeSmear) {
+        if (smearSeconds < kMinLeapSmearSeconds) {
+          smearSeconds = kMinLeapSmearSeconds;
+        } else if (smearSeconds > kMaxLeapSmearSeconds) {
+          smearSeconds = kMaxLeapSmearSeconds;
+        }
+        mLeapSmearSeconds = smearSeconds;
+      } else {
+        mLeapSmearSeconds = 0;
+        if (mode == kLeapModeIgnore) mLeapDirection = 0;
+      }
+    }
+
+    /** Return the leap mode selected by setLeapMode(). */
+    uint8_t getLeapMode() const { return mLeapMode; }
+
+    /**
+     * Schedule a leap second manually, e.g. from a GPS receiver or a table of
+     * leap seconds, for a referenceClock which does not announce them.
+     * `boundarySeconds` is the start of the UTC month (normally January 1 or
+     * July 1) which follows the leap second. `direction` is +1 for an
+     * inserted second, -1 for a deleted second, or 0 to cancel the pending
+     * leap second. Does nothing in kLeapModeIgnore.
+     */
+    void setLeapSecond(acetime_t boundarySeconds, int8_t direction) {
+      if (mLeapMode == kLeapModeIgnore) return;
+    #if ACE_TIME_CLOCK_SECONDS64
+      scheduleLeapSecond(toSeconds64(boundarySeconds), direction);
+    #else
+      scheduleLeapSecond(boundarySeconds, direction);
+    #endif
+      mIsLeapAnnounced = false;
+    }
+
+    /**
+     * Return the start of the UTC month which follows the pending leap
+     * second, and its direction (+1 inserted, -1 deleted) in `*direction`.
+     * Returns kInvalidSeconds and sets `*direction` to 0 if no leap second is
+     * pending. The leap second remains pending for a minute after the end of
+     * its window.
+     */
+    acetime_t getPendingLeapSecond(int8_t* direction) const {
+      *direction = mLeapDirection;
+      if (mLeapDirection == 0) return kInvalidSeconds;
+    #if ACE_TIME_CLOCK_SECONDS64
+      return toSeconds32(mLeapBoundarySeconds);
+    #else
+      return mLeapBoundarySeconds;
+    #endif
+    }
+  #endif
+
+  #if ! ACE_TIME_CLOCK_COMPACT
+    /**
+     * Return the number of milliseconds since boot (more precisely, since the
+     * start of `T_CI::millis()`), extended to 64 bits so that it never rolls
+     * over. Unlike getNow(), this timeline is never stepped by setNow() or a
+     * sync with the referenceClock, so it is the one to use for measuring
+     * intervals, rates and timeouts. The rollover of the 32-bit millis() is
+     * detected as long as this method or keepAlive() is called at least once
+     * every 49.7 days, which is always true when SystemClockLoop::loop() or
+     * SystemClockCoroutine::runCoroutine() is running. Not available if
+     * ACE_TIME_CLOCK_COMPACT is enabled.
+     */
+    uint64_t getMonotonicMillis() const {
+      uint32_t nowMillis = (uint32_t) clockMillis();
+      if (nowMillis < mMonotonicLowMillis) mMonotonicHighMillis++;
+      mMonotonicLowMillis = nowMillis;
+      return ((uint64_t) mMonotonicHighMillis << 32) | nowMillis;
+    }
+
+    /**
+     * Convert the monotonic millis returned by getMonotonicMillis() into the
+     * epoch seconds and the milliseconds (0-999) within that second, using the
+     * current mapping between the monotonic timeline and the wall time. The
+     * mapping changes when the clock is stepped, so the result for a past
+     * monotonic time is the time that the clock would show now for that
+     * instant, not necessarily the time it showed back then. Returns
+     * kInvalidSeconds and sets `*millis` to 0 if the clock is not initialized.
+     */
+    acetime_t convertMonotonicMillis(uint64_t monotonicMillis,
+        uint16_t* millis) const {
+    #if ACE_TIME_CLOCK_SECONDS64
+      return toSeconds32(monotonicToEpochSeconds(monotonicMillis, millis));
+    #else
+      return monotonicToEpochSeconds(monotonicMillis, millis);
+    #endif
+    }
+
+    /**
+     * Convert the epoch seconds and milliseconds (0-999) into the monotonic
+     * millis, using the current mapping, e.g. to wait until a given wall time
+     * using a timeout which is not affected by later syncs. A time before boot
+     * returns 0. Returns kInvalidMonotonicMillis if the clock is not
+     * initialized, or if epochSeconds is kInvalidSeconds.
+     */
+    uint64_t convertEpochSecondsToMonotonicMillis(acetime_t epochSeconds,
+        uint16_t millis = 0) const {
+    #if ACE_TIME_CLOCK_SECONDS64
+      return epochSecondsToMonotonic(toSeconds64(epochSeconds), millis);
+    #else
+      return epochSecondsToMonotonic(epochSeconds, millis);
+    #endif
+    }
+
+  #if ACE_TIME_CLOCK_SECONDS64
+    /** Same as convertMonotonicMillis() but returns 64-bit seconds. */
+    int64_t convertMonotonicMillis64(uint64_t monotonicMillis,
+        uint16_t* millis) const {
+      return monotonicToEpochSeconds(monotonicMillis, millis);
+    }
+
+    /**
+     * Same as convertEpochSecondsToMonotonicMillis() but takes 64-bit
+     * seconds.
+     */
+    uint64_t convertEpochSeconds64ToMonotonicMillis(int64_t epochSeconds,
+        uint16_t millis = 0) const {
+      return epochSecondsToMonotonic(epochSeconds, millis);
+    }
+  #endif
+  #endif
+
+    /**
+     * Return the current ticks of the ClockInterface, to be converted later
+     * into epoch seconds using convertCapturedTicks(). This reads only the
+     * hardware counter and does not touch the state of the SystemClock, so it
+     * is safe to call from an interrupt service routine (as long as
+     * `T_CI::ticks()` is, which is true for `millis()` and `micros()`), e.g.
+     * to timestamp external events into an EventRingBuffer.
+     */
+    static tick_t captureTicks() { return T_CI::ticks(); }
+
+    /**
+     * Convert the ticks returned by captureTicks() into the epoch seconds and
+     * the microseconds (0-999999) since the start of that second, as they
+     * would have been returned by getNowMicros() at the time of the capture.
+     * Must be called from the same context as syncNow() (normally the global
+     * loop()), not from an ISR.
+     *
+     * If the time was stepped by setNow() or syncNow() after the capture, the
+     * ticks are converted using the time before the step, so that each event
+     * is stamped with the time shown by the clock when it was captured. The
+     * ticks captured during the same tick as the step are considered to be
+     * after the step. Only the most recent step is remembered, and it is
+     * forgotten by keepAlive() after half of the rollover period of `tick_t`
+     * (32.7 seconds for the default hw::ClockInterface), so the captured ticks
+     * should be converted soon after they are captured. The steps are
+     * remembered only if ACE_TIME_CLOCK_EVENT_CAPTURE is enabled. Otherwise,
+     * the ticks are always converted using the current time.
+     *
+     * Returns kInvalidSeconds and sets `*micros` to 0 if the clock was not
+     * initialized at the time of the capture.
+     */
+    acetime_t convertCapturedTicks(tick_t ticks, uint32_t* micros) const {
+    #if ACE_TIME_CLOCK_SECONDS64
+      return toSeconds32(convertTicksToEpochSeconds(ticks, micros));
+    #else
+      return convertTicksToEpochSeconds(ticks, micros);
+    #endif
+    }
+
+  #if ACE_TIME_CLOCK_SECONDS64
+    /** Same as convertCapturedTicks() but returns 64-bit seconds. */
+    int64_t convertCapturedTicks64(tick_t ticks, uint32_t* micros) const {
+      return convertTicksToEpochSeconds(ticks, micros);
+    }
+  #endif
+
+    /** Return the instrumentation policy object, e.g. to read its stats. */
+    const T_INSTR& getInstrumentation() const { return *this; }
+
+    /** Return the mutable instrumentation policy object, e.g. to reset it. */
+    T_INSTR& getInstrumentation() { return *this; }
+
   protected:
     friend class ::SystemClockLoopTest;
     friend class ::SystemClockCoroutineTest;
     friend class ::SystemClockLoopTest_loop;
     friend class ::SystemClockLoopTest_syncNow;
+    friend class ::SystemClockLoopTest_syncNowMillis;
     friend class ::SystemClockLoopTest_setup;
     friend class ::SystemClockLoopTest_backupNow;
     friend class ::SystemClockLoopTest_getNow;
@@ -235,36 +667,74 @@ class SystemClockTemplate: public Clock {
      *    parameter can be null.
      */
     explicit SystemClockTemplate(
-        Clock* referenceClock /* nullable */,
-        Clock* backupClock /* nullable */
+        T_REF* referenceClock /* nullable */,
+        T_BACKUP* backupClock /* nullable */
     ) :
         mReferenceClock(referenceClock),
-        mBackupClock(backupClock) {}
+        mBackupClock(backupClock) {
+      initFlags();
+    }
 
     /**
      * Empty constructor primarily for tests. The init() must be called before
      * using the object.
      */
-    explicit SystemClockTemplate() {}
+    explicit SystemClockTemplate() {
+      initFlags();
+    }
 
     /** Same as constructor but allows delayed initialization, e.g. in tests. */
     void initSystemClock(
-        Clock* referenceClock /* nullable */,
-        Clock* backupClock /* nullable */
+        T_REF* referenceClock /* nullable */,
+        T_BACKUP* backupClock /* nullable */
     ) {
-      mReferenceClock = referenceClock;
-      mBackupClock = backupClock;
+      mReferenceClock.setClock(referenceClock);
+      mBackupClock.setClock(backupClock);
 
-      mEpochSeconds = kInvalidSeconds;
+      mEpochSeconds = kInvalidEpochSeconds;
       mPrevSyncAttemptMillis = 0;
       mNextSyncAttemptMillis = 0;
-      mPrevKeepAliveMillis = 0;
+      mPrevKeepAliveTicks = 0;
       mIsInit = false;
-      mSyncStatusCode = kSyncStatusUnknown;
+      setSyncStatusCode(kSyncStatusUnknown);
+    #if ACE_TIME_CLOCK_EVENT_CAPTURE
+      mIsStepPending = false;
+    #endif
+    #if ACE_TIME_CLOCK_LEAP_SECONDS
+      mLeapDirection = 0;
+      mIsLeapAnnounced = false;
+    #endif
     }
 
     /** Get referenceClock. */
-    Clock* getReferenceClock() const { return mReferenceClock; }
+    T_REF* getReferenceClock() const { return mReferenceClock.getClock(); }
+
+    /** Return the millis of the prev sync attempt. */
+    uint32_t getPrevSyncAttemptMillis() const {
+      return mPrevSyncAttemptMillis;
+    }
+
+    /** Return the millis of the next sync attempt. */
+    uint32_t getNextSyncAttemptMillis() const {
+      return mNextSyncAttemptMillis;
+    }
+
+    /**
+     * Return the response of the referenceClock as seconds_t, after
+     * isResponseReady() returned true.
+     */
+    seconds_t readReferenceResponseMillis(uint16_t* millis) const {
+    #if ACE_TIME_CLOCK_SECONDS64
+      return mReferenceClock.readResponseMillis64(millis);
+    #else
+      return mReferenceClock.readResponseMillis(millis);
+    #endif
+    }
+
+    /** Get the dispatcher which calls the methods of the referenceClock. */
+    const ClockDispatcher<T_REF>& getReferenceDispatcher() const {
+      return mReferenceClock;
+    }
 
     /**
      * Return the Arduino millis(). Override for unit testing. Named
@@ -272,14 +742,77 @@ class SystemClockTemplate: public Clock {
      */
     unsigned long clockMillis() const { return T_CI::millis(); }
 
+    /** Return the ticks of the ClockInterface. */
+    tick_t clockTicks() const { return T_CI::ticks(); }
+
     /**
-     * Call this (or getNow() every 65.535 seconds or faster to keep the
-     * internal counter in sync with millis(). This will normally happen through
-     * the SystemClockCoroutine::runCoroutine() or SystemClockLoop::loop()
-     * methods.
+     * Call this (or getNow() more often than the rollover period of
+     * `T_CI::tick_t`, i.e. every 65.535 seconds or faster for the default
+     * hw::ClockInterface) to keep the internal counter in sync with ticks().
+     * This will normally happen through the
+     * SystemClockCoroutine::runCoroutine() or SystemClockLoop::loop() methods.
      */
     void keepAlive() {
-      getNow();
+      updateEpochSeconds();
+    #if ACE_TIME_CLOCK_EVENT_CAPTURE
+      // Forget the step before the age of the step is ambiguous.
+      if (mIsStepPending
+          && (tick_t) (clockTicks() - mStepTicks) > kMaxStepAgeTicks) {
+        mIsStepPending = false;
+      }
+    #endif
+    #if ! ACE_TIME_CLOCK_COMPACT
+      getMonotonicMillis();
+    #endif
+    #if ACE_TIME_CLOCK_LEAP_SECONDS
+      // Fold the leap second into mEpochSeconds a minute after the end of its
+      // window, when the correction is exactly 1 second, so the time does not
+      // change. The delay allows the ticks captured before the end of the
+      // window to be converted with the correction.
+      if (mLeapDirection != 0 && mEpochSeconds != kInvalidEpochSeconds
+          && mEpochSeconds >= leapWindowStart()
+              + (seconds_t) (mLeapSmearSeconds + kLeapFoldDelaySeconds)) {
+        mEpochSeconds -= mLeapDirection;
+      #if ACE_TIME_CLOCK_EVENT_CAPTURE
+        if (mIsStepPending && mStepAnchorSeconds != kInvalidEpochSeconds) {
+          mStepAnchorSeconds -= mLeapDirection;
+        }
+      #endif
+        mLeapDirection = 0;
+      }
+    #endif
+    }
+
+    /**
+     * Schedule or cancel the leap second announced by the referenceClock in
+     * the response which returned `referenceSeconds`. Called by the
+     * subclasses after each successful request, before syncNow(). The
+     * announced leap second occurs at the end of the current UTC month. If
+     * the referenceClock withdraws its announcement before the window of the
+     * leap second starts, the leap second is cancelled. Does nothing in
+     * kLeapModeIgnore, or if ACE_TIME_CLOCK_LEAP_SECONDS is disabled.
+     */
+    void updateLeapSecond(seconds_t referenceSeconds) {
+    #if ! ACE_TIME_CLOCK_LEAP_SECONDS
+      (void) referenceSeconds;
+    #else
+      if (mLeapMode == kLeapModeIgnore) return;
+      if (referenceSeconds == kInvalidEpochSeconds) return;
+
+      // Never reschedule a leap second in progress.
+      bool isStarted = mLeapDirection != 0
+          && referenceSeconds >= leapWindowStart();
+      uint8_t indicator = mReferenceClock.getLeapIndicator();
+      if (indicator == kLeapIndicatorInsert
+          || indicator == kLeapIndicatorDelete) {
+        if (isStarted) return;
+        scheduleLeapSecond(nextMonthSeconds(referenceSeconds),
+            (indicator == kLeapIndicatorInsert) ? 1 : -1);
+        mIsLeapAnnounced = true;
+      } else if (mIsLeapAnnounced && mLeapDirection != 0 && ! isStarted) {
+        mLeapDirection = 0;
+      }
+    #endif
     }
 
     /**
@@ -288,9 +821,13 @@ class SystemClockTemplate: public Clock {
      * and time during power loss, then we don't need a backupClock and this
      * method does not need to be called.
      */
-    void backupNow(acetime_t nowSeconds) {
-      if (mBackupClock != nullptr) {
-        mBackupClock->setNow(nowSeconds);
+    void backupNow(seconds_t nowSeconds) {
+      if (! mBackupClock.isNull()) {
+      #if ACE_TIME_CLOCK_SECONDS64
+        mBackupClock.setNow64(nowSeconds);
+      #else
+        mBackupClock.setNow(nowSeconds);
+      #endif
       }
     }
 
@@ -313,23 +850,49 @@ class SystemClockTemplate: public Clock {
      * we would probably see drifting of the referenceClock due to the 1-second
      * granularity of many RTC clocks.
      *
+     * If `millis` is known (i.e. not kUnknownMillis), it is the number of
+     * milliseconds since the start of `epochSeconds`, normally obtained from
+     * Clock::readResponseMillis(). The sub-second phase of this clock is then
+     * aligned to the referenceClock even if the seconds are already equal.
+     * Otherwise, the phase is reset only if the seconds differ.
+     *
      * TODO: Implement a more graceful syncNow() algorithm which shifts only a
      * few milliseconds per iteration, and which guarantees that the clock
      * never goes backwards in time.
      */
-    void syncNow(acetime_t epochSeconds) {
-      if (epochSeconds == kInvalidSeconds) return;
+    void syncNow(seconds_t epochSeconds, uint16_t millis = kUnknownMillis) {
+      if (epochSeconds == kInvalidEpochSeconds) return;
 
       mLastSyncTime = epochSeconds;
-      acetime_t skew = mEpochSeconds - epochSeconds;
+
+      // The time of mEpochSeconds, which does not include the pending leap
+      // second.
+      seconds_t counterSeconds = epochSeconds;
+    #if ACE_TIME_CLOCK_LEAP_SECONDS
+      if (mLeapDirection != 0) {
+        counterSeconds = removeLeapSecond(epochSeconds);
+      }
+    #endif
+
+      seconds_t skew = mEpochSeconds - counterSeconds;
       mClockSkew = skew;
+      if (millis < 1000) {
+        recordStep();
+        mPrevKeepAliveTicks = (tick_t) (clockTicks() - millisToTicks(millis));
+        mEpochSeconds = counterSeconds;
+        mIsInit = true;
+      }
       if (skew == 0) return;
 
-      mEpochSeconds = epochSeconds;
-      mPrevKeepAliveMillis = clockMillis();
-      mIsInit = true;
+      if (millis >= 1000) {
+        recordStep();
+        mEpochSeconds = counterSeconds;
+        mPrevKeepAliveTicks = clockTicks();
+        mIsInit = true;
+      }
 
-      if (mBackupClock != mReferenceClock) {
+      if (static_cast<const Clock*>(mBackupClock.getClock())
+          != static_cast<const Clock*>(mReferenceClock.getClock())) {
         backupNow(epochSeconds);
       }
     }
@@ -346,21 +909,538 @@ class SystemClockTemplate: public Clock {
 
     /** Set the status code of most recent sync attempt. */
     void setSyncStatusCode(uint8_t code) {
+    #if ACE_TIME_CLOCK_COMPACT
+      mSyncStatusCode = (code == kSyncStatusUnknown)
+          ? kPackedSyncStatusUnknown
+          : code;
+    #else
       mSyncStatusCode = code;
+    #endif
+    }
+
+  #if ACE_TIME_CLOCK_COMPACT
+    /**
+     * Get the state of the request state machine of the subclass, one of its
+     * kStatusXxx constants. The compact layout stores it here, in the bit
+     * field of mIsInit and mSyncStatusCode. Otherwise the subclass stores it
+     * in its own member variable.
+     */
+    uint8_t getRequestStatusCode() const { return mRequestStatusCode; }
+
+    /** Set the state of the request state machine of the subclass. */
+    void setRequestStatusCode(uint8_t code) { mRequestStatusCode = code; }
+  #endif
+
+  #if ACE_TIME_CLOCK_SYNC_JITTER
+    /**
+     * Set the jitter of the sync periods to `jitterPercent` (clamped to
+     * kMaxSyncJitterPercent), and seed its pseudo-random sequence from
+     * `deviceId`. Return the phase offset of the first sync attempt, a
+     * pseudo-random number of millis less than `initialSyncPeriodSeconds`,
+     * which depends only on `deviceId`. Used by the setSyncJitter() of the
+     * subclasses.
+     */
+    uint32_t seedSyncJitter(uint32_t deviceId, uint8_t jitterPercent,
+        uint16_t initialSyncPeriodSeconds) {
+      mSyncJitterPercent = (jitterPercent > kMaxSyncJitterPercent)
+          ? kMaxSyncJitterPercent
+          : jitterPercent;
+
+      // Mix the bits of the deviceId (the finalizer of MurmurHash3), so that
+      // consecutive device IDs produce unrelated sequences. The state of the
+      // xorshift generator must not be 0.
+      uint32_t x = deviceId;
+      x ^= x >> 16;
+      x *= 0x85ebca6b;
+      x ^= x >> 13;
+      x *= 0xc2b2ae35;
+      x ^= x >> 16;
+      mSyncJitterState = (x == 0) ? 1 : x;
+
+      if (initialSyncPeriodSeconds == 0) return 0;
+      return nextSyncJitterRandom()
+          % (initialSyncPeriodSeconds * (uint32_t) 1000);
+    }
+  #endif
+
+    /**
+     * Return the number of millis until the next sync attempt for the given
+     * sync period, varied pseudo-randomly by up to +/- getSyncJitterPercent()
+     * of the period. Returns exactly `periodSeconds` converted to millis if
+     * the jitter is 0, or if ACE_TIME_CLOCK_SYNC_JITTER is disabled.
+     */
+    uint32_t jitterSyncPeriodMillis(uint16_t periodSeconds) {
+      uint32_t periodMillis = periodSeconds * (uint32_t) 1000;
+    #if ACE_TIME_CLOCK_SYNC_JITTER
+      if (mSyncJitterPercent != 0) {
+        uint32_t spanMillis = periodMillis / 100 * mSyncJitterPercent;
+        periodMillis = periodMillis - spanMillis
+            + nextSyncJitterRandom() % (2 * spanMillis + 1);
+      }
+    #endif
+      return periodMillis;
+    }
+
+    /**
+     * Save the sync state of this clock into `snapshot`, along with the
+     * current sync period of the subclass. The time of the next sync attempt
+     * is saved only if the clock is initialized and a sync was attempted.
+     */
+    void saveSyncState(SystemClockSnapshot* snapshot,
+        uint16_t syncPeriodSeconds) const {
+      uint8_t code = getSyncStatusCode();
+      acetime_t now = getNow();
+      snapshot->version = SystemClockSnapshot::kVersion;
+      snapshot->syncStatusCode = code;
+      snapshot->syncPeriodSeconds = syncPeriodSeconds;
+      snapshot->clockSkew = mClockSkew;
+      snapshot->lastSyncTime = getLastSyncTime();
+      snapshot->nextSyncTime = (now == kInvalidSeconds
+              || code == kSyncStatusUnknown)
+          ? kInvalidSeconds
+          : now + getSecondsToSyncAttempt();
+      snapshot->checksum = snapshot->computeChecksum();
+    }
+
+    /**
+     * Restore the sync state saved by saveSyncState(). Returns false if the
+     * snapshot is invalid, and changes nothing. Otherwise, returns in
+     * `*delaySeconds` the number of seconds until the saved time of the next
+     * sync attempt, from 0 to `maxDelaySeconds`. The delay is 0 if this
+     * clock is not initialized (e.g. from the backupClock), since the time
+     * since the snapshot is then unknown. The subclass restores its sync
+     * period and schedules the next sync attempt.
+     */
+    bool restoreSyncState(const SystemClockSnapshot& snapshot,
+        uint16_t maxDelaySeconds, uint16_t* delaySeconds) {
+      if (! snapshot.isValid()) return false;
+
+      setSyncStatusCode(snapshot.syncStatusCode);
+      mClockSkew = snapshot.clockSkew;
+    #if ACE_TIME_CLOCK_SECONDS64
+      mLastSyncTime = toSeconds64(snapshot.lastSyncTime);
+    #else
+      mLastSyncTime = snapshot.lastSyncTime;
+    #endif
+
+      *delaySeconds = 0;
+      acetime_t now = getNow();
+      if (now != kInvalidSeconds && snapshot.nextSyncTime != kInvalidSeconds) {
+        int64_t delay = (int64_t) snapshot.nextSyncTime - now;
+        if (delay > maxDelaySeconds) {
+          *delaySeconds = maxDelaySeconds;
+        } else if (delay > 0) {
+          *delaySeconds = (uint16_t) delay;
+        }
+      }
+      return true;
     }
 
   private:
-    Clock* mReferenceClock;
-    Clock* mBackupClock;
+    /**
+     * Advance mEpochSeconds by the seconds elapsed according to the ticks()
+     * of the ClockInterface, and return it.
+     */
+    seconds_t updateEpochSeconds() const {
+      getInstrumentation().onGetNow();
+      if (!mIsInit) return kInvalidEpochSeconds;
+
+      // Update mEpochSeconds by the number of seconds elapsed according to the
+      // ticks(). This method is expected to be called multiple times a second,
+      // so the code below will normally do nothing, until the ticks() clock
+      // goes past the mPrevKeepAliveTicks by 1 second.
+      //
+      // There are 2 reasons why this method will be called multiple times a
+      // second:
+      //
+      // 1) A physical clock with an external display will want to refresh
+      // its display 5-10 times a second, so that it can capture the transition
+      // from one second to the next without too much jitter. So it will call
+      // this method multiple times a second to check if one second has passed.
+      //
+      // 2) If the SystemClockCoroutine or SystemClockLoop classes is used,
+      // then the keepAlive() method will be called perhaps 100's times per
+      // second, as fast as the iteration speed of the global loop() function.
+      //
+      // The division is needed only if this method was not called for more
+      // than 2 seconds, so the common path uses only an addition.
+      tick_t elapsed = (tick_t) (clockTicks() - mPrevKeepAliveTicks);
+      if (elapsed >= 2 * T_CI::kTicksPerSecond) {
+        tick_t seconds = elapsed / T_CI::kTicksPerSecond;
+        mPrevKeepAliveTicks += seconds * T_CI::kTicksPerSecond;
+        mEpochSeconds += seconds;
+        getInstrumentation().onCatchUp(seconds);
+      } else if (elapsed >= T_CI::kTicksPerSecond) {
+        mPrevKeepAliveTicks += T_CI::kTicksPerSecond;
+        mEpochSeconds += 1;
+      }
+
+      return mEpochSeconds;
+    }
+
+    /**
+     * Return the current epoch seconds, and the ticks since the start of that
+     * second in `*subTicks` (0 if not initialized) unless it is null, with the
+     * pending leap second applied.
+     */
+    seconds_t readEpochSeconds(tick_t* subTicks) const {
+      seconds_t seconds = updateEpochSeconds();
+    #if ACE_TIME_CLOCK_LEAP_SECONDS
+      if (mLeapDirection != 0 && seconds != kInvalidEpochSeconds) {
+        tick_t ticks = subSecondTicks();
+        seconds = applyLeapSecond(seconds, &ticks);
+        if (subTicks != nullptr) *subTicks = ticks;
+        return seconds;
+      }
+    #endif
+      if (subTicks != nullptr) *subTicks = mIsInit ? subSecondTicks() : 0;
+      return seconds;
+    }
+
+    /**
+     * Convert the captured ticks into epoch seconds using the anchor of the
+     * time before the most recent step if the ticks were captured before it,
+     * otherwise using the current anchor.
+     */
+    seconds_t convertTicksToEpochSeconds(tick_t ticks, uint32_t* micros)
+        const {
+      // The anchor (mPrevKeepAliveTicks, mEpochSeconds) does not need to be
+      // advanced by updateEpochSeconds(), since a stale anchor still defines
+      // the same mapping from ticks to seconds.
+      *micros = 0;
+      tick_t nowTicks = clockTicks();
+      tick_t age = (tick_t) (nowTicks - ticks);
+      tick_t anchorTicks = mPrevKeepAliveTicks;
+      seconds_t anchorSeconds = mIsInit ? mEpochSeconds : kInvalidEpochSeconds;
+
+    #if ACE_TIME_CLOCK_EVENT_CAPTURE
+      if (mIsStepPending && age > (tick_t) (nowTicks - mStepTicks)) {
+        anchorTicks = mStepAnchorTicks;
+        anchorSeconds = mStepAnchorSeconds;
+      }
+    #endif
+      seconds_t seconds = ticksToEpochSeconds(
+          anchorTicks, anchorSeconds, nowTicks, age, micros);
+
+    #if ACE_TIME_CLOCK_LEAP_SECONDS
+      if (mLeapDirection != 0 && seconds != kInvalidEpochSeconds) {
+        tick_t subTicks =
+            (tick_t) (*micros / (1000000 / T_CI::kTicksPerSecond));
+        seconds = applyLeapSecond(seconds, &subTicks);
+        *micros = ticksToMicros(subTicks);
+      }
+    #endif
+      return seconds;
+    }
+
+    /**
+     * Convert the ticks captured `age` ticks before `nowTicks` into epoch
+     * seconds, given that `anchorTicks` was the start of `anchorSeconds`. The
+     * ticks can be before or after the anchor.
+     */
+    static seconds_t ticksToEpochSeconds(
+        tick_t anchorTicks, seconds_t anchorSeconds,
+        tick_t nowTicks, tick_t age, uint32_t* micros) {
+      if (anchorSeconds == kInvalidEpochSeconds) return kInvalidEpochSeconds;
+
+      tick_t sinceAnchor = (tick_t) (nowTicks - anchorTicks);
+      if (age <= sinceAnchor) {
+        tick_t offset = sinceAnchor - age;
+        *micros = ticksToMicros(offset % T_CI::kTicksPerSecond);
+        return anchorSeconds + (seconds_t) (offset / T_CI::kTicksPerSecond);
+      } else {
+        tick_t before = age - sinceAnchor;
+        tick_t seconds = (before + T_CI::kTicksPerSecond - 1)
+            / T_CI::kTicksPerSecond;
+        *micros = ticksToMicros(
+            (tick_t) (seconds * T_CI::kTicksPerSecond - before));
+        return anchorSeconds - (seconds_t) seconds;
+      }
+    }
+
+    /**
+     * Remember the current time as the time before a step, for
+     * convertCapturedTicks().
+     */
+    void recordStep() {
+    #if ACE_TIME_CLOCK_EVENT_CAPTURE
+      mStepTicks = clockTicks();
+      mStepAnchorTicks = mPrevKeepAliveTicks;
+      mStepAnchorSeconds = mIsInit ? mEpochSeconds : kInvalidEpochSeconds;
+      mIsStepPending = true;
+    #endif
+    }
+
+  #if ! ACE_TIME_CLOCK_COMPACT
+    /**
+     * Return the number of millis between the monotonic millis and the
+     * current wall time in millis since the epoch. Returns false if the clock
+     * is not initialized.
+     */
+    bool getMonotonicOffsetMillis(int64_t* offsetMillis) const {
+      uint64_t nowMonotonic = getMonotonicMillis();
+      tick_t ticks;
+      seconds_t nowSeconds = readEpochSeconds(&ticks);
+      if (nowSeconds == kInvalidEpochSeconds) return false;
+      int64_t nowEpochMillis = (int64_t) nowSeconds * 1000
+          + ticksToMillis(ticks);
+      *offsetMillis = nowEpochMillis - (int64_t) nowMonotonic;
+      return true;
+    }
+
+    /** Convert the monotonic millis into epoch seconds and millis. */
+    seconds_t monotonicToEpochSeconds(uint64_t monotonicMillis,
+        uint16_t* millis) const {
+      *millis = 0;
+      int64_t offsetMillis;
+      if (!getMonotonicOffsetMillis(&offsetMillis)) {
+        return kInvalidEpochSeconds;
+      }
+
+      // Floor division, since the epoch millis can be negative.
+      int64_t epochMillis = (int64_t) monotonicMillis + offsetMillis;
+      int64_t seconds = epochMillis / 1000;
+      int16_t remainder = (int16_t) (epochMillis - seconds * 1000);
+      if (remainder < 0) {
+        remainder += 1000;
+        seconds--;
+      }
+      *millis = (uint16_t) remainder;
+      return (seconds_t) seconds;
+    }
+
+    /** Convert the epoch seconds and millis into monotonic millis. */
+    uint64_t epochSecondsToMonotonic(seconds_t epochSeconds, uint16_t millis)
+        const {
+      if (epochSeconds == kInvalidEpochSeconds) return kInvalidMonotonicMillis;
+      int64_t offsetMillis;
+      if (!getMonotonicOffsetMillis(&offsetMillis)) {
+        return kInvalidMonotonicMillis;
+      }
+      int64_t monotonicMillis = (int64_t) epochSeconds * 1000 + millis
+          - offsetMillis;
+      return (monotonicMillis < 0) ? 0 : (uint64_t) monotonicMillis;
+    }
+  #endif
+
+  #if ACE_TIME_CLOCK_LEAP_SECONDS
+    /**
+     * Set the pending leap second at the end of the UTC month before
+     * `boundarySeconds`, with `direction` +1 (inserted), -1 (deleted), or 0
+     * (cancelled).
+     */
+    void scheduleLeapSecond(seconds_t boundarySeconds, int8_t direction) {
+      mLeapBoundarySeconds = boundarySeconds;
+      mLeapDirection = (boundarySeconds == kInvalidEpochSeconds)
+          ? 0
+          : (direction > 0) ? 1 : (direction < 0) ? -1 : 0;
+    }
+
+    /**
+     * Return the start of the window of the pending leap second, as the time
+     * of mEpochSeconds. The window is centered on the instant when the 1-second
+     * step occurs in kLeapModeStep: when mEpochSeconds reaches the boundary for
+     * an inserted second, or 1 second before the boundary for a deleted
+     * second. The window is empty in kLeapModeStep.
+     */
+    seconds_t leapWindowStart() const {
+      seconds_t jump = (mLeapDirection > 0)
+          ? mLeapBoundarySeconds
+          : mLeapBoundarySeconds - 1;
+      return jump - (seconds_t) (mLeapSmearSeconds / 2);
+    }
+
+    /**
+     * Apply the pending leap second to the seconds and sub-second ticks of
+     * mEpochSeconds. The correction is 0 before the window, grows linearly
+     * inside the window, and is exactly 1 second after the window.
+     */
+    seconds_t applyLeapSecond(seconds_t seconds, tick_t* subTicks) const {
+      seconds_t start = leapWindowStart();
+      if (seconds < start) return seconds;
+      if (seconds >= start + (seconds_t) mLeapSmearSeconds) {
+        return seconds - mLeapDirection;
+      }
+
+      // Inside the window, the clock runs slower (inserted) or faster
+      // (deleted) by 1 part in mLeapSmearSeconds.
+      int64_t ticks = (int64_t) (seconds - start) * T_CI::kTicksPerSecond
+          + *subTicks;
+      ticks -= mLeapDirection * (ticks / (int64_t) mLeapSmearSeconds);
+      *subTicks = (tick_t) (ticks % T_CI::kTicksPerSecond);
+      return start + (seconds_t) (ticks / T_CI::kTicksPerSecond);
+    }
+
+    /**
+     * Convert the seconds returned by the referenceClock into the seconds of
+     * mEpochSeconds. The referenceClock (e.g. NtpClock) is assumed to report
+     * the stepped UTC even in kLeapModeSmear, so the seconds are shifted by
+     * the leap second after the step, and the smear is applied only by
+     * applyLeapSecond(). A sync inside the smear window therefore does not
+     * step the smeared time. The 23:59:59 repeated by an inserted leap second
+     * is assumed to be the one before the step, unless mEpochSeconds is
+     * already past the step.
+     */
+    seconds_t removeLeapSecond(seconds_t seconds) const {
+      if (mLeapDirection < 0) {
+        // The skipped 23:59:59 is never reported.
+        return (seconds < mLeapBoundarySeconds - 1) ? seconds : seconds - 1;
+      }
+      if (seconds < mLeapBoundarySeconds - 1) return seconds;
+      if (seconds >= mLeapBoundarySeconds) return seconds + 1;
+      return (updateEpochSeconds() >= mLeapBoundarySeconds)
+          ? mLeapBoundarySeconds
+          : seconds;
+    }
+
+    /** Return the start of the UTC month after the given epoch seconds. */
+    static seconds_t nextMonthSeconds(seconds_t epochSeconds) {
+      LocalDateTime ldt = LocalDateTime::forEpochSeconds(
+          toSeconds32(epochSeconds));
+      if (ldt.isError()) return kInvalidEpochSeconds;
+
+      int16_t year = ldt.year();
+      uint8_t month = ldt.month() + 1;
+      if (month > 12) {
+        month = 1;
+        year++;
+      }
+      acetime_t seconds = LocalDateTime::forComponents(year, month, 1, 0, 0, 0)
+          .toEpochSeconds();
+    #if ACE_TIME_CLOCK_SECONDS64
+      return toSeconds64(seconds);
+    #else
+      return seconds;
+    #endif
+    }
+
+    /**
+     * Number of seconds after the end of the window of the pending leap
+     * second before it is folded into mEpochSeconds by keepAlive().
+     */
+    static const uint8_t kLeapFoldDelaySeconds = 60;
+  #endif
+
+  #if ACE_TIME_CLOCK_SYNC_JITTER
+    /** Return the next number of the xorshift32 generator of the jitter. */
+    uint32_t nextSyncJitterRandom() {
+      uint32_t x = mSyncJitterState;
+      x ^= x << 13;
+      x ^= x >> 17;
+      x ^= x << 5;
+      mSyncJitterState = x;
+      return x;
+    }
+  #endif
+
+  #if ACE_TIME_CLOCK_EVENT_CAPTURE
+    /**
+     * Maximum age of the most recent step, half of the rollover period of
+     * tick_t, beyond which the captured ticks can no longer be ordered
+     * relative to the step.
+     */
+    static const tick_t kMaxStepAgeTicks = ((tick_t) -1) / 2;
+  #endif
+
+    /**
+     * Maximum number of ticks between two calls to keepAlive(), one second
+     * less than the rollover period of tick_t, see getMillisToKeepAlive().
+     */
+    static const tick_t kMaxKeepAliveTicks =
+        (tick_t) (((tick_t) -1) - (tick_t) T_CI::kTicksPerSecond);
+
+  #if ACE_TIME_CLOCK_COMPACT
+    /** The kSyncStatusUnknown (128) as stored in the 2-bit mSyncStatusCode. */
+    static const uint8_t kPackedSyncStatusUnknown = 3;
+  #endif
+
+    /**
+     * Initialize the flags which are bit fields in the compact layout, since
+     * bit fields cannot have default member initializers before C++20.
+     */
+    void initFlags() {
+    #if ACE_TIME_CLOCK_COMPACT
+      mIsInit = false;
+      setSyncStatusCode(kSyncStatusUnknown);
+      mRequestStatusCode = 0;
+    #endif
+    }
+
+    /** Ticks elapsed since the start of the current second. */
+    tick_t subSecondTicks() const {
+      return (tick_t) (clockTicks() - mPrevKeepAliveTicks);
+    }
+
+    /** Convert sub-second ticks to millis. */
+    static uint16_t ticksToMillis(tick_t ticks) {
+      return (T_CI::kTicksPerSecond == 1000)
+          ? (uint16_t) ticks
+          : (uint16_t) (ticks / (T_CI::kTicksPerSecond / 1000));
+    }
+
+    /** Convert sub-second ticks to micros. */
+    static uint32_t ticksToMicros(tick_t ticks) {
+      return (uint32_t) ticks * (1000000 / T_CI::kTicksPerSecond);
+    }
+
+    /** Convert millis (0-999) to ticks. */
+    static tick_t millisToTicks(uint16_t millis) {
+      return (tick_t) millis * (tick_t) (T_CI::kTicksPerSecond / 1000);
+    }
+
+    ClockDispatcher<T_REF> mReferenceClock;
+    ClockDispatcher<T_BACKUP> mBackupClock;
 
-    mutable acetime_t mEpochSeconds = kInvalidSeconds;
-    acetime_t mLastSyncTime = kInvalidSeconds; // time when last synced
+    mutable seconds_t mEpochSeconds = kInvalidEpochSeconds;
+    seconds_t mLastSyncTime = kInvalidEpochSeconds; // time when last synced
+  #if ACE_TIME_CLOCK_EVENT_CAPTURE
+    seconds_t mStepAnchorSeconds = kInvalidEpochSeconds; // see recordStep()
+  #endif
+  #if ACE_TIME_CLOCK_LEAP_SECONDS
+    // start of the UTC month after the pending leap second
+    seconds_t mLeapBoundarySeconds = kInvalidEpochSeconds;
+  #endif
     uint32_t mPrevSyncAttemptMillis = 0;
     uint32_t mNextSyncAttemptMillis = 0;
-    mutable uint16_t mPrevKeepAliveMillis = 0; // lower 16-bits of clockMillis()
+  #if ! ACE_TIME_CLOCK_COMPACT
+    mutable uint32_t mMonotonicLowMillis = 0; // clockMillis() at last update
+  #endif
+  #if ACE_TIME_CLOCK_SYNC_JITTER
+    uint32_t mSyncJitterState = 1; // state of the xorshift32 generator
+  #endif
+  #if ACE_TIME_CLOCK_LEAP_SECONDS
+    uint32_t mLeapSmearSeconds = 0; // width of the window, 0 in step mode
+  #endif
+    mutable tick_t mPrevKeepAliveTicks = 0; // clockTicks() at start of second
+  #if ACE_TIME_CLOCK_EVENT_CAPTURE
+    // The time before the most recent step, for convertCapturedTicks().
+    tick_t mStepAnchorTicks = 0; // clockTicks() at start of mStepAnchorSeconds
+    tick_t mStepTicks = 0; // clockTicks() at the step
+  #endif
     int16_t mClockSkew = 0; // diff between reference and this clock
+  #if ! ACE_TIME_CLOCK_COMPACT
+    mutable uint16_t mMonotonicHighMillis = 0; // rollovers of clockMillis()
+  #endif
+  #if ACE_TIME_CLOCK_COMPACT
+    // Packed into a single byte.
+    uint8_t mIsInit : 1; // true if setNow() or syncNow() was successful
+    uint8_t mSyncStatusCode : 2; // kSyncStatusUnknown is stored as 3
+    uint8_t mRequestStatusCode : 2; // kStatusXxx of the subclass
+  #else
     bool mIsInit = false; // true if setNow() or syncNow() was successful
     uint8_t mSyncStatusCode = kSyncStatusUnknown;
+  #endif
+  #if ACE_TIME_CLOCK_SYNC_JITTER
+    uint8_t mSyncJitterPercent = 0; // see setSyncJitter()
+  #endif
+  #if ACE_TIME_CLOCK_LEAP_SECONDS
+    uint8_t mLeapMode = kLeapModeIgnore;
+    int8_t mLeapDirection = 0; // pending leap second: +1, -1, or 0 if none
+    bool mIsLeapAnnounced = false; // true if scheduled by updateLeapSecond()
+  #endif
+  #if ACE_TIME_CLOCK_EVENT_CAPTURE
+    bool mIsStepPending = false; // true if mStepTicks is valid
+  #endif
 };
 
 /** Base class of SystemClockLoop and SystemClockCoroutine. */
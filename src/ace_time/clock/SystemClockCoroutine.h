@@ -10,8 +10,8 @@
 #ifdef ACE_ROUTINE_VERSION
 
 #include <stdint.h>
-#include <AceCommon.h> // TimingStats
 #include <AceRoutine.h>
+#include "LatencyHistogram.h"
 #include "SystemClock.h"
 
 class SystemClockCoroutineTest;
@@ -45,13 +45,41 @@ namespace clock {
  *
  * @tparam T_SCCI the SystemClock ClockInterface
  * @tparam T_CRCI the Coroutine ClockInterface
+ * @tparam T_INSTR the instrumentation policy (see SystemClockTemplate)
+ * @tparam T_REF type of the referenceClock (see SystemClockTemplate)
+ * @tparam T_BACKUP type of the backupClock (see SystemClockTemplate)
  */
-template <typename T_SCCI, typename T_CRCI>
+template <
+    typename T_SCCI,
+    typename T_CRCI,
+    typename T_INSTR = SystemClockNoInstrumentation,
+    typename T_REF = Clock,
+    typename T_BACKUP = Clock
+>
 class SystemClockCoroutineTemplate :
-    public SystemClockTemplate<T_SCCI>,
+    public SystemClockTemplate<T_SCCI, T_INSTR, T_REF, T_BACKUP>,
     public ace_routine::CoroutineTemplate<T_CRCI, uint16_t> {
 
   public:
+    /** Type of the epoch seconds, acetime_t or int64_t. */
+    typedef typename SystemClockTemplate<T_SCCI, T_INSTR, T_REF, T_BACKUP>
+        ::seconds_t seconds_t;
+
+    // The request states of runCoroutine(), which also index the
+    // stateCounts, stateTicks and maxStateTicks of SystemClockStats.
+
+    /** Request state unknown or request error. */
+    static const uint8_t kStatusUnknown = 0;
+
+    /** Request has been sent and waiting for response. */
+    static const uint8_t kStatusSent = 1;
+
+    /** Request received and valid. */
+    static const uint8_t kStatusOk = 2;
+
+    /** Request timed out. */
+    static const uint8_t kStatusTimedOut = 3;
+
     /**
      * Constructor.
      *
@@ -66,20 +94,28 @@ class SystemClockCoroutineTemplate :
      *    the systemClock is not initialized (default 5)
      * @param requestTimeoutMillis number of milliseconds before the request to
      *    referenceClock times out
-     * @param timingStats internal statistics (nullable)
+     * @param latencyHistogram records the latency and outcome of each
+     *    request to the referenceClock (nullable). Not available if
+     *    ACE_TIME_CLOCK_COMPACT is enabled.
      */
     explicit SystemClockCoroutineTemplate(
-        Clock* referenceClock /* nullable */,
-        Clock* backupClock /* nullable */,
+        T_REF* referenceClock /* nullable */,
+        T_BACKUP* backupClock /* nullable */,
         uint16_t syncPeriodSeconds = 3600,
         uint16_t initialSyncPeriodSeconds = 5,
-        uint16_t requestTimeoutMillis = 1000,
-        ace_common::TimingStats* timingStats = nullptr):
-      SystemClockTemplate<T_SCCI>(referenceClock, backupClock),
+        uint16_t requestTimeoutMillis = 1000
+      #if ! ACE_TIME_CLOCK_COMPACT
+        , LatencyHistogram* latencyHistogram = nullptr
+      #endif
+    ):
+      SystemClockTemplate<T_SCCI, T_INSTR, T_REF, T_BACKUP>(
+          referenceClock, backupClock),
       ace_routine::CoroutineTemplate<T_CRCI, uint16_t>(),
       mSyncPeriodSeconds(syncPeriodSeconds),
       mRequestTimeoutMillis(requestTimeoutMillis),
-      mTimingStats(timingStats),
+    #if ! ACE_TIME_CLOCK_COMPACT
+      mLatencyHistogram(latencyHistogram),
+    #endif
       mCurrentSyncPeriodSeconds(initialSyncPeriodSeconds) {}
 
     /**
@@ -100,23 +136,149 @@ class SystemClockCoroutineTemplate :
      */
     int runCoroutine() override {
       this->keepAlive();
-      if (this->getReferenceClock() == nullptr) return 0;
+      if (this->getReferenceDispatcher().isNull()) return 0;
+
+      uint8_t state = this->getRequestStatusCode();
+      uint32_t startTicks = this->getInstrumentation().beginState();
+      int result = runStateMachine();
+      this->getInstrumentation().endState(state, startTicks);
+      return result;
+    }
+
+    /** Return the current request status. Mostly for debugging. */
+    uint8_t getRequestStatus() const { return this->getRequestStatusCode(); }
+
+    /**
+     * Return the number of millis until runCoroutine() needs to be called
+     * again, so that a tickless global loop() can sleep until the earliest
+     * deadline of all its tasks. See SystemClockLoop::getMillisToNextRun().
+     */
+    uint32_t getMillisToNextRun() const {
+      uint32_t keepAliveMillis = this->getMillisToKeepAlive();
+      if (this->getReferenceDispatcher().isNull()) return keepAliveMillis;
+
+      uint32_t millis;
+      if (this->isDelaying()) {
+        int32_t remainingMillis = (int32_t) (this->getNextSyncAttemptMillis()
+            - this->clockMillis());
+        millis = (remainingMillis <= 0) ? 0 : (uint32_t) remainingMillis;
+      } else if (this->getRequestStatusCode() == kStatusSent) {
+        uint16_t waitMillis =
+            (uint16_t) this->coroutineMillis() - mRequestStartMillis;
+        millis = (waitMillis >= mRequestTimeoutMillis)
+            ? 0
+            : mRequestTimeoutMillis - waitMillis;
+        if (millis > this->kResponsePollMillis) {
+          millis = this->kResponsePollMillis;
+        }
+      } else {
+        millis = 0;
+      }
+      return (millis < keepAliveMillis) ? millis : keepAliveMillis;
+    }
+
+    /**
+     * Save the sync state (the sync status, the clock skew, the last sync
+     * time, the current sync period including its exponential backoff, and
+     * the time of the next sync attempt) into `snapshot`, to be restored by
+     * restoreSnapshot() after a reboot. See SystemClockSnapshot.
+     */
+    void saveSnapshot(SystemClockSnapshot* snapshot) const {
+      this->saveSyncState(snapshot, mCurrentSyncPeriodSeconds);
+    }
+
+    /**
+     * Restore the sync state saved by saveSnapshot(), in the global setup()
+     * after setup() has restored the time from the backupClock. The next sync
+     * attempt is scheduled at its saved time, but no later than one sync
+     * period from now, and the exponential backoff continues from the saved
+     * sync period. If the time is not known, the next sync attempt is made
+     * immediately. Must be called before the first runCoroutine(). Returns
+     * false if the snapshot is invalid, and changes nothing.
+     */
+    bool restoreSnapshot(const SystemClockSnapshot& snapshot) {
+      uint16_t periodSeconds = (snapshot.syncPeriodSeconds < mSyncPeriodSeconds)
+          ? snapshot.syncPeriodSeconds
+          : mSyncPeriodSeconds;
+      uint16_t delaySeconds;
+      if (! this->restoreSyncState(snapshot, periodSeconds, &delaySeconds)) {
+        return false;
+      }
 
+      uint32_t nowMillis = this->clockMillis();
+      mCurrentSyncPeriodSeconds = periodSeconds;
+      this->setPrevSyncAttemptMillis(nowMillis
+          - (periodSeconds - delaySeconds) * (uint32_t) 1000);
+      this->setNextSyncAttemptMillis(nowMillis
+          + delaySeconds * (uint32_t) 1000);
+      mIsStartDelayed = true;
+      return true;
+    }
+
+  #if ACE_TIME_CLOCK_SYNC_JITTER
+    /**
+     * Spread the requests of a fleet of devices which boot at the same time.
+     * See SystemClockLoop::setSyncJitter(). Must be called before the first
+     * runCoroutine(). Available only if ACE_TIME_CLOCK_SYNC_JITTER is
+     * enabled.
+     */
+    void setSyncJitter(uint32_t deviceId, uint8_t jitterPercent) {
+      uint32_t phaseMillis = this->seedSyncJitter(
+          deviceId, jitterPercent, mCurrentSyncPeriodSeconds);
+      if (! mIsStartDelayed) {
+        this->setNextSyncAttemptMillis(this->clockMillis() + phaseMillis);
+        mIsStartDelayed = true;
+      }
+    }
+  #endif
+
+  protected:
+    /** Empty constructor used for testing. */
+    SystemClockCoroutineTemplate() {}
+
+  private:
+    friend class ::SystemClockCoroutineTest;
+    friend class ::SystemClockCoroutineTest_runCoroutine;
+
+  #if ! ACE_TIME_CLOCK_COMPACT
+    /** Get the request status, see SystemClock::getRequestStatusCode(). */
+    uint8_t getRequestStatusCode() const { return mRequestStatus; }
+
+    /** Set the request status. */
+    void setRequestStatusCode(uint8_t code) { mRequestStatus = code; }
+  #endif
+
+    /**
+     * The body of runCoroutine(), separated so that the instrumentation can
+     * bracket every iteration, including the ones which return through
+     * COROUTINE_YIELD() or COROUTINE_DELAY().
+     */
+    int runStateMachine() {
       uint32_t nowMillis = this->clockMillis();
 
       COROUTINE_LOOP() {
+        // Wait for the first sync attempt delayed by restoreSnapshot() or
+        // setSyncJitter().
+        if (mIsStartDelayed) {
+          while (getSyncDelayMillis() > 0) {
+            COROUTINE_DELAY(getSyncDelayMillis());
+          }
+          mIsStartDelayed = false;
+        }
+
         // Send request
-        this->getReferenceClock()->sendRequest();
+        this->getReferenceDispatcher().sendRequest();
+        this->getInstrumentation().onRequest();
         mRequestStartMillis = this->coroutineMillis();
-        mRequestStatus = kStatusSent;
+        this->setRequestStatusCode(kStatusSent);
         this->setPrevSyncAttemptMillis(nowMillis);
-        this->setNextSyncAttemptMillis(
-            nowMillis + mCurrentSyncPeriodSeconds * (uint32_t) 1000);
+        this->setNextSyncAttemptMillis(nowMillis
+            + this->jitterSyncPeriodMillis(mCurrentSyncPeriodSeconds));
 
         // Wait for request until mRequestTimeoutMillis.
         while (true) {
-          if (this->getReferenceClock()->isResponseReady()) {
-            mRequestStatus = kStatusOk;
+          if (this->getReferenceDispatcher().isResponseReady()) {
+            this->setRequestStatusCode(kStatusOk);
             break;
           }
 
@@ -127,8 +289,10 @@ class SystemClockCoroutineTemplate :
             uint16_t waitMillis =
                 (uint16_t) this->coroutineMillis() - mRequestStartMillis;
             if (waitMillis >= mRequestTimeoutMillis) {
-              mRequestStatus = kStatusTimedOut;
+              this->setRequestStatusCode(kStatusTimedOut);
               this->setSyncStatusCode(this->kSyncStatusTimedOut);
+              this->getInstrumentation().onSyncTimeout();
+              updateLatency(LatencyHistogram::kOutcomeTimeout, waitMillis);
               break;
             }
           }
@@ -137,39 +301,52 @@ class SystemClockCoroutineTemplate :
         }
 
         // Process the response
-        if (mRequestStatus == kStatusOk) {
-          acetime_t nowSeconds = this->getReferenceClock()->readResponse();
-          if (mTimingStats != nullptr) {
-            uint16_t elapsedMillis =
-                (uint16_t) this->coroutineMillis() - mRequestStartMillis;
-            mTimingStats->update(elapsedMillis);
-          }
+        if (this->getRequestStatusCode() == kStatusOk) {
+          uint16_t millis;
+          seconds_t nowSeconds = this->readReferenceResponseMillis(&millis);
+          uint16_t elapsedMillis =
+              (uint16_t) this->coroutineMillis() - mRequestStartMillis;
 
-          if (nowSeconds == this->kInvalidSeconds) {
+          if (nowSeconds == this->kInvalidEpochSeconds) {
             this->setSyncStatusCode(this->kSyncStatusError);
-            // Clobber the mRequestStatus to trigger the exponential backoff
-            mRequestStatus = kStatusUnknown;
+            this->getInstrumentation().onSyncError();
+            updateLatency(LatencyHistogram::kOutcomeError, elapsedMillis);
+            // Clobber the request status to trigger the exponential backoff
+            this->setRequestStatusCode(kStatusUnknown);
           } else {
-            this->syncNow(nowSeconds);
-            mCurrentSyncPeriodSeconds = mSyncPeriodSeconds;
+            this->updateLeapSecond(nowSeconds);
+            this->syncNow(nowSeconds, millis);
+            // A success after a failure ends the backoff, so the next sync
+            // attempt is rescheduled. Otherwise, the one set when the request
+            // was sent is kept.
+            if (mCurrentSyncPeriodSeconds != mSyncPeriodSeconds) {
+              mCurrentSyncPeriodSeconds = mSyncPeriodSeconds;
+              this->setNextSyncAttemptMillis(this->getPrevSyncAttemptMillis()
+                  + this->jitterSyncPeriodMillis(mCurrentSyncPeriodSeconds));
+            }
             this->setSyncStatusCode(this->kSyncStatusOk);
+            this->getInstrumentation().onSyncOk();
+            updateLatency(LatencyHistogram::kOutcomeOk, elapsedMillis);
           }
         }
 
-        // Wait for mCurrentSyncPeriodSeconds
-        this->setNextSyncAttemptMillis(
-            nowMillis + mCurrentSyncPeriodSeconds * (uint32_t) 1000);
-        for (mWaitCount = 0;
-            mWaitCount < mCurrentSyncPeriodSeconds;
-            mWaitCount++
-        ) {
-          COROUTINE_DELAY(1000);
+        // After a failure, the retry is measured from the timeout or the
+        // error, instead of from the request. The jittered period drawn when
+        // the request was sent is kept.
+        if (this->getRequestStatusCode() != kStatusOk) {
+          this->setNextSyncAttemptMillis(this->getNextSyncAttemptMillis()
+              + (nowMillis - this->getPrevSyncAttemptMillis()));
+        }
+
+        // Wait until the next sync attempt.
+        while (getSyncDelayMillis() > 0) {
+          COROUTINE_DELAY(getSyncDelayMillis());
         }
 
         // Determine the retry delay time based on success or failure. If
         // failure, retry with exponential backoff, until the delay becomes
         // mSyncPeriodSeconds.
-        if (mRequestStatus != kStatusOk) {
+        if (this->getRequestStatusCode() != kStatusOk) {
           if (mCurrentSyncPeriodSeconds >= mSyncPeriodSeconds / 2) {
             mCurrentSyncPeriodSeconds = mSyncPeriodSeconds;
           } else {
@@ -179,28 +356,45 @@ class SystemClockCoroutineTemplate :
       }
     }
 
-    /** Return the current request status. Mostly for debugging. */
-    uint8_t getRequestStatus() const { return mRequestStatus; }
-
-  protected:
-    /** Empty constructor used for testing. */
-    SystemClockCoroutineTemplate() {}
-
-  private:
-    friend class ::SystemClockCoroutineTest;
-    friend class ::SystemClockCoroutineTest_runCoroutine;
-
-    /** Request state unknown or request error. */
-    static const uint8_t kStatusUnknown = 0;
+    /**
+     * Return the number of millis until the next sync attempt, or 0 if the
+     * next sync attempt is due. The delay is limited to kMaxDelayMillis,
+     * and to getMillisToKeepAlive() so that the tick_t of the ClockInterface
+     * does not roll over. The latter is never 0 here, because runCoroutine()
+     * has just called keepAlive().
+     */
+    uint16_t getSyncDelayMillis() const {
+      int32_t remainingMillis = (int32_t) (this->getNextSyncAttemptMillis()
+          - this->clockMillis());
+      if (remainingMillis <= 0) return 0;
 
-    /** Request has been sent and waiting for response. */
-    static const uint8_t kStatusSent = 1;
+      uint32_t delayMillis = (remainingMillis > kMaxDelayMillis)
+          ? kMaxDelayMillis
+          : (uint32_t) remainingMillis;
+      uint32_t keepAliveMillis = this->getMillisToKeepAlive();
+      return (uint16_t) ((delayMillis < keepAliveMillis)
+          ? delayMillis
+          : keepAliveMillis);
+    }
 
-    /** Request received and valid. */
-    static const uint8_t kStatusOk = 2;
+    /**
+     * Maximum duration of a single COROUTINE_DELAY(). The 16-bit delay of the
+     * Coroutine is limited to half of its range (UINT16_MAX / 2), so a longer
+     * wait for the next sync attempt is split into several delays.
+     */
+    static const uint16_t kMaxDelayMillis = UINT16_MAX / 2;
 
-    /** Request timed out. */
-    static const uint8_t kStatusTimedOut = 3;
+    /** Record one sample per request into the LatencyHistogram. */
+    void updateLatency(uint8_t outcome, uint16_t elapsedMillis) {
+    #if ACE_TIME_CLOCK_COMPACT
+      (void) outcome;
+      (void) elapsedMillis;
+    #else
+      if (mLatencyHistogram != nullptr) {
+        mLatencyHistogram->update(outcome, elapsedMillis);
+      }
+    #endif
+    }
 
     // disable copy constructor and assignment operator
     SystemClockCoroutineTemplate(const SystemClockCoroutineTemplate&) = delete;
@@ -209,12 +403,21 @@ class SystemClockCoroutineTemplate :
 
     uint16_t const mSyncPeriodSeconds = 3600;
     uint16_t const mRequestTimeoutMillis = 1000;
-    ace_common::TimingStats* const mTimingStats = nullptr;
+  #if ! ACE_TIME_CLOCK_COMPACT
+    LatencyHistogram* const mLatencyHistogram = nullptr;
+  #endif
 
     uint16_t mRequestStartMillis; // lower 16-bit of millis()
     uint16_t mCurrentSyncPeriodSeconds = 5;
-    uint16_t mWaitCount;
+  #if ! ACE_TIME_CLOCK_COMPACT
     uint8_t mRequestStatus = kStatusUnknown;
+  #endif
+    // In the compact layout, the request status is in the bit field of
+    // SystemClock, where its initial 0 is kStatusUnknown.
+
+    // true if the first sync attempt is delayed by restoreSnapshot() or
+    // setSyncJitter()
+    bool mIsStartDelayed = false;
 };
 
 /**
@@ -259,6 +462,16 @@ using SystemClockCoroutine = SystemClockCoroutineTemplate<
     hw::ClockInterface, ace_routine::ClockInterface
 >;
 
+/**
+ * A SystemClockCoroutine whose referenceClock and backupClock types are fixed
+ * at compile time, so that their methods are called without virtual dispatch.
+ * See StaticSystemClockLoop.
+ */
+template <typename T_REF, typename T_BACKUP = NullClock>
+using StaticSystemClockCoroutine = SystemClockCoroutineTemplate<
+    hw::ClockInterface, ace_routine::ClockInterface,
+    SystemClockNoInstrumentation, T_REF, T_BACKUP>;
+
 }
 }
 
@@ -0,0 +1,178 @@
+/*
+ * MIT License
+ * Copyright (c) 2022 Brian T. Park
+ */
+
+#ifndef ACE_TIME_SYSTEM_CLOCK_INSTRUMENTATION_H
+#define ACE_TIME_SYSTEM_CLOCK_INSTRUMENTATION_H
+
+#include <stdint.h>
+#include "../hw/ClockInterface.h"
+
+namespace ace_time {
+namespace clock {
+
+/**
+ * The default instrumentation policy of SystemClockTemplate,
+ * SystemClockLoopTemplate and SystemClockCoroutineTemplate which does nothing.
+ * All methods are empty inline functions which are optimized away by the
+ * compiler, and the class is an empty base class, so it adds no flash, no
+ * static RAM, and nothing to the sizeof() of the SystemClock.
+ *
+ * A custom instrumentation policy must provide the same methods. See
+ * SystemClockStatsInstrumentation.
+ */
+class SystemClockNoInstrumentation {
+  public:
+    /** Called on every SystemClock::getNow(). */
+    void onGetNow() const {}
+
+    /**
+     * Called when getNow() advances the clock by 2 or more seconds, because
+     * it was not called for more than 2 seconds.
+     */
+    void onCatchUp(uint32_t /*seconds*/) const {}
+
+    /** Called when a request is sent to the referenceClock. */
+    void onRequest() {}
+
+    /** Called when the response from the referenceClock was synced. */
+    void onSyncOk() {}
+
+    /** Called when the response from the referenceClock was invalid. */
+    void onSyncError() {}
+
+    /** Called when the request to the referenceClock timed out. */
+    void onSyncTimeout() {}
+
+    /** Called at the start of each iteration of the request state machine. */
+    uint32_t beginState() { return 0; }
+
+    /**
+     * Called at the end of each iteration of the request state machine, with
+     * the request status at the start of the iteration, and the value returned
+     * by beginState().
+     */
+    void endState(uint8_t /*state*/, uint32_t /*startTicks*/) {}
+};
+
+/** The counters and timings collected by SystemClockStatsInstrumentation. */
+struct SystemClockStats {
+  /** Number of request states of SystemClockLoop and SystemClockCoroutine. */
+  static const uint8_t kNumStates = 4;
+
+  /** Reset all counters to 0. */
+  void reset() { *this = SystemClockStats(); }
+
+  /** Number of calls to getNow(), including the internal keepAlive(). */
+  uint32_t getNowCount = 0;
+
+  /** Number of getNow() calls which advanced the clock by 2 or more seconds. */
+  uint32_t catchUpCount = 0;
+
+  /** Total number of seconds advanced by those catch ups. */
+  uint32_t catchUpSeconds = 0;
+
+  /** Largest number of seconds advanced by a single catch up. */
+  uint32_t maxCatchUpSeconds = 0;
+
+  /** Number of requests sent to the referenceClock. */
+  uint32_t requestCount = 0;
+
+  /** Number of successful syncs. */
+  uint32_t syncCount = 0;
+
+  /** Number of invalid responses from the referenceClock. */
+  uint32_t errorCount = 0;
+
+  /** Number of requests which timed out. */
+  uint32_t timeoutCount = 0;
+
+  /**
+   * Number of iterations of SystemClockLoop::loop() or
+   * SystemClockCoroutine::runCoroutine() in each request state, indexed by
+   * the `kStatusXxx` constant of the class. The same index is a different
+   * state in each class:
+   *
+   *  * SystemClockLoop: kStatusReady, kStatusSent, kStatusOk,
+   *    kStatusWaitForRetry
+   *  * SystemClockCoroutine: kStatusUnknown, kStatusSent, kStatusOk,
+   *    kStatusTimedOut
+   */
+  uint32_t stateCounts[kNumStates] = {0};
+
+  /** Total ticks spent in each request state. */
+  uint32_t stateTicks[kNumStates] = {0};
+
+  /** Largest ticks spent in a single iteration in each request state. */
+  uint32_t maxStateTicks[kNumStates] = {0};
+};
+
+/**
+ * An instrumentation policy which collects the SystemClockStats, for profiling
+ * the SystemClock on a device. The durations of the request states are
+ * measured using `T_TCI::ticks()`, which are microseconds using the default
+ * hw::MicrosClockInterface.
+ *
+ * Example:
+ *
+ * @code
+ * using ProfiledSystemClock = SystemClockLoopTemplate<
+ *     hw::ClockInterface,
+ *     SystemClockStatsInstrumentation<>
+ * >;
+ * ProfiledSystemClock systemClock(&ntpClock, nullptr);
+ * ...
+ * const SystemClockStats& stats = systemClock.getInstrumentation().getStats();
+ * @endcode
+ *
+ * @tparam T_TCI the ClockInterface used to time the request states
+ */
+template <typename T_TCI = hw::MicrosClockInterface>
+class SystemClockStatsInstrumentation {
+  public:
+    /** Return the collected stats. */
+    const SystemClockStats& getStats() const { return mStats; }
+
+    /** Reset the collected stats. */
+    void reset() { mStats.reset(); }
+
+    void onGetNow() const { mStats.getNowCount++; }
+
+    void onCatchUp(uint32_t seconds) const {
+      mStats.catchUpCount++;
+      mStats.catchUpSeconds += seconds;
+      if (seconds > mStats.maxCatchUpSeconds) {
+        mStats.maxCatchUpSeconds = seconds;
+      }
+    }
+
+    void onRequest() { mStats.requestCount++; }
+
+    void onSyncOk() { mStats.syncCount++; }
+
+    void onSyncError() { mStats.errorCount++; }
+
+    void onSyncTimeout() { mStats.timeoutCount++; }
+
+    uint32_t beginState() { return (uint32_t) T_TCI::ticks(); }
+
+    void endState(uint8_t state, uint32_t startTicks) {
+      if (state >= SystemClockStats::kNumStates) return;
+      uint32_t elapsed = (uint32_t) T_TCI::ticks() - startTicks;
+      mStats.stateCounts[state]++;
+      mStats.stateTicks[state] += elapsed;
+      if (elapsed > mStats.maxStateTicks[state]) {
+        mStats.maxStateTicks[state] = elapsed;
+      }
+    }
+
+  private:
+    // Mutable because getNow() is a const method.
+    mutable SystemClockStats mStats;
+};
+
+}
+}
+
+#endif
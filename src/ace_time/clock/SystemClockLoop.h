@@ -7,7 +7,7 @@
 #define ACE_TIME_SYSTEM_CLOCK_LOOP_H
 
 #include <stdint.h>
-#include <AceCommon.h> // TimingStats
+#include "LatencyHistogram.h"
 #include "SystemClock.h"
 
 class SystemClockLoopTest;
@@ -43,10 +43,38 @@ namespace clock {
  * they are equivalent.
  *
  * @tparam T_SCCI the SystemClock ClockInterface
+ * @tparam T_INSTR the instrumentation policy (see SystemClockTemplate)
+ * @tparam T_REF type of the referenceClock (see SystemClockTemplate)
+ * @tparam T_BACKUP type of the backupClock (see SystemClockTemplate)
  */
-template <typename T_SCCI>
-class SystemClockLoopTemplate : public SystemClockTemplate<T_SCCI> {
+template <
+    typename T_SCCI,
+    typename T_INSTR = SystemClockNoInstrumentation,
+    typename T_REF = Clock,
+    typename T_BACKUP = Clock
+>
+class SystemClockLoopTemplate :
+    public SystemClockTemplate<T_SCCI, T_INSTR, T_REF, T_BACKUP> {
   public:
+    /** Type of the epoch seconds, acetime_t or int64_t. */
+    typedef typename SystemClockTemplate<T_SCCI, T_INSTR, T_REF, T_BACKUP>
+        ::seconds_t seconds_t;
+
+    // The request states of loop(), which also index the stateCounts,
+    // stateTicks and maxStateTicks of SystemClockStats.
+
+    /** Ready to send request. */
+    static const uint8_t kStatusReady = 0;
+
+    /** Request sent, waiting for response. */
+    static const uint8_t kStatusSent = 1;
+
+    /** Request received and is valid. */
+    static const uint8_t kStatusOk = 2;
+
+    /** Request received but is invalid, so retry with exponential backoff. */
+    static const uint8_t kStatusWaitForRetry = 3;
+
     /**
      * Constructor.
      *
@@ -62,19 +90,27 @@ class SystemClockLoopTemplate : public SystemClockTemplate<T_SCCI> {
      *    increasing (2X) at each attempt until syncPeriodSeconds is reached
      * @param requestTimeoutMillis number of milliseconds before the request to
      *    referenceClock times out
-     * @param timingStats internal statistics (nullable)
+     * @param latencyHistogram records the latency and outcome of each
+     *    request to the referenceClock (nullable). Not available if
+     *    ACE_TIME_CLOCK_COMPACT is enabled.
      */
     explicit SystemClockLoopTemplate(
-        Clock* referenceClock /* nullable */,
-        Clock* backupClock /* nullable */,
+        T_REF* referenceClock /* nullable */,
+        T_BACKUP* backupClock /* nullable */,
         uint16_t syncPeriodSeconds = 3600,
         uint16_t initialSyncPeriodSeconds = 5,
-        uint16_t requestTimeoutMillis = 1000,
-        ace_common::TimingStats* timingStats = nullptr):
-      SystemClockTemplate<T_SCCI>(referenceClock, backupClock),
+        uint16_t requestTimeoutMillis = 1000
+      #if ! ACE_TIME_CLOCK_COMPACT
+        , LatencyHistogram* latencyHistogram = nullptr
+      #endif
+    ):
+      SystemClockTemplate<T_SCCI, T_INSTR, T_REF, T_BACKUP>(
+          referenceClock, backupClock),
+    #if ! ACE_TIME_CLOCK_COMPACT
+      mLatencyHistogram(latencyHistogram),
+    #endif
       mSyncPeriodSeconds(syncPeriodSeconds),
       mRequestTimeoutMillis(requestTimeoutMillis),
-      mTimingStats(timingStats),
       mCurrentSyncPeriodSeconds(initialSyncPeriodSeconds) {}
 
     /**
@@ -88,77 +124,212 @@ class SystemClockLoopTemplate : public SystemClockTemplate<T_SCCI> {
      */
     void loop() {
       this->keepAlive();
-      if (this->getReferenceClock() == nullptr) return;
+      if (this->getReferenceDispatcher().isNull()) return;
 
       uint32_t nowMillis = this->clockMillis();
+      uint8_t state = this->getRequestStatusCode();
+      uint32_t startTicks = this->getInstrumentation().beginState();
 
-      // Finite state machine based on mRequestStatus
-      switch (mRequestStatus) {
+      // Finite state machine based on the request status
+      switch (this->getRequestStatusCode()) {
         case kStatusReady:
-          this->getReferenceClock()->sendRequest();
-          mRequestStartMillis = nowMillis;
-          mRequestStatus = kStatusSent;
+          this->getReferenceDispatcher().sendRequest();
+          this->getInstrumentation().onRequest();
+          this->setRequestStatusCode(kStatusSent);
           this->setPrevSyncAttemptMillis(nowMillis);
           this->setNextSyncAttemptMillis(nowMillis
-              + mCurrentSyncPeriodSeconds * (uint32_t) 1000);
+              + this->jitterSyncPeriodMillis(mCurrentSyncPeriodSeconds));
           break;
 
         case kStatusSent: {
-          uint32_t elapsedMillis = nowMillis - mRequestStartMillis;
-          if (mTimingStats) mTimingStats->update((uint16_t) elapsedMillis);
+          uint32_t elapsedMillis = nowMillis - this->getPrevSyncAttemptMillis();
 
-          if (this->getReferenceClock()->isResponseReady()) {
-            acetime_t nowSeconds = this->getReferenceClock()->readResponse();
+          if (this->getReferenceDispatcher().isResponseReady()) {
+            uint16_t millis;
+            seconds_t nowSeconds = this->readReferenceResponseMillis(&millis);
 
-            if (nowSeconds == this->kInvalidSeconds) {
+            if (nowSeconds == this->kInvalidEpochSeconds) {
               // If response came back but was invalid, reschedule.
-              mRequestStatus = kStatusWaitForRetry;
+              this->setRequestStatusCode(kStatusWaitForRetry);
               this->setSyncStatusCode(this->kSyncStatusError);
+              this->getInstrumentation().onSyncError();
+              updateLatency(LatencyHistogram::kOutcomeError, elapsedMillis);
             } else {
               // Request succeeded.
-              this->syncNow(nowSeconds);
-              mCurrentSyncPeriodSeconds = mSyncPeriodSeconds;
-              mRequestStatus = this->kStatusOk;
+              this->updateLeapSecond(nowSeconds);
+              this->syncNow(nowSeconds, millis);
+              // A success after a failure ends the backoff, so the next sync
+              // attempt is rescheduled. Otherwise, the one set when the
+              // request was sent is kept.
+              if (mCurrentSyncPeriodSeconds != mSyncPeriodSeconds) {
+                mCurrentSyncPeriodSeconds = mSyncPeriodSeconds;
+                this->setNextSyncAttemptMillis(
+                    this->getPrevSyncAttemptMillis()
+                    + this->jitterSyncPeriodMillis(mCurrentSyncPeriodSeconds));
+              }
+              this->setRequestStatusCode(this->kStatusOk);
               this->setSyncStatusCode(this->kSyncStatusOk);
+              this->getInstrumentation().onSyncOk();
+              updateLatency(LatencyHistogram::kOutcomeOk, elapsedMillis);
             }
           } else {
             // If timed out, reschedule.
             if (elapsedMillis >= mRequestTimeoutMillis) {
-              mRequestStatus = this->kStatusWaitForRetry;
+              this->setRequestStatusCode(this->kStatusWaitForRetry);
               this->setSyncStatusCode(this->kSyncStatusTimedOut);
+              this->getInstrumentation().onSyncTimeout();
+              updateLatency(LatencyHistogram::kOutcomeTimeout, elapsedMillis);
             }
           }
           break;
         }
 
-        // The previous request succeeded, so wait until the next sync attempt.
-        case kStatusOk: {
-          uint32_t elapsedMillis = nowMillis - mRequestStartMillis;
-          if (elapsedMillis >= mCurrentSyncPeriodSeconds * (uint32_t) 1000) {
-            mRequestStatus = kStatusReady;
+        // The previous request succeeded (or the first request is delayed by
+        // setSyncJitter()), so wait until the next sync attempt.
+        case kStatusOk:
+          if (isSyncAttemptDue(nowMillis)) {
+            this->setRequestStatusCode(kStatusReady);
           }
           break;
-        }
 
         // Previous request failed, so update timing parameters so that
         // subsequent loop() retries with an exponential backoff, until a
         // maximum of mSyncPeriodSeconds is reached.
-        case kStatusWaitForRetry: {
-          uint32_t elapsedMillis = nowMillis - mRequestStartMillis;
+        case kStatusWaitForRetry:
           // Adjust mCurrentSyncPeriodSeconds using exponential backoff.
-          if (elapsedMillis >= mCurrentSyncPeriodSeconds * (uint32_t) 1000) {
+          if (isSyncAttemptDue(nowMillis)) {
             if (mCurrentSyncPeriodSeconds >= mSyncPeriodSeconds / 2) {
               mCurrentSyncPeriodSeconds = mSyncPeriodSeconds;
             } else {
               mCurrentSyncPeriodSeconds *= 2;
             }
-            mRequestStatus = kStatusReady;
+            this->setRequestStatusCode(kStatusReady);
+          }
+          break;
+      }
+
+      this->getInstrumentation().endState(state, startTicks);
+    }
+
+    /**
+     * Return the number of millis until loop() needs to be called again, so
+     * that a tickless global loop() can sleep (e.g. in a light sleep mode of
+     * the processor) until the earliest deadline of all its tasks, instead of
+     * spinning. This is the earliest of:
+     *
+     * - 0 if a request is ready to be sent,
+     * - the time until the pending request times out, but at most
+     *   kResponsePollMillis, so that the response is read promptly,
+     * - the time until the next sync attempt,
+     * - getMillisToKeepAlive(), a little less than 64.5 seconds for the default
+     *   hw::ClockInterface.
+     *
+     * Calling loop() earlier is always allowed.
+     */
+    uint32_t getMillisToNextRun() const {
+      uint32_t keepAliveMillis = this->getMillisToKeepAlive();
+      if (this->getReferenceDispatcher().isNull()) return keepAliveMillis;
+
+      uint32_t nowMillis = this->clockMillis();
+      uint32_t millis;
+      switch (this->getRequestStatusCode()) {
+        case kStatusSent: {
+          uint32_t elapsedMillis = nowMillis - this->getPrevSyncAttemptMillis();
+          millis = (elapsedMillis >= mRequestTimeoutMillis)
+              ? 0
+              : mRequestTimeoutMillis - elapsedMillis;
+          if (millis > this->kResponsePollMillis) {
+            millis = this->kResponsePollMillis;
           }
           break;
         }
+
+        case kStatusOk:
+        case kStatusWaitForRetry:
+          millis = isSyncAttemptDue(nowMillis)
+              ? 0
+              : this->getNextSyncAttemptMillis() - nowMillis;
+          break;
+
+        default:
+          millis = 0;
+          break;
       }
+      return (millis < keepAliveMillis) ? millis : keepAliveMillis;
     }
 
+    /**
+     * Save the sync state (the sync status, the clock skew, the last sync
+     * time, the current sync period including its exponential backoff, and
+     * the time of the next sync attempt) into `snapshot`, to be restored by
+     * restoreSnapshot() after a reboot. See SystemClockSnapshot.
+     */
+    void saveSnapshot(SystemClockSnapshot* snapshot) const {
+      this->saveSyncState(snapshot, mCurrentSyncPeriodSeconds);
+    }
+
+    /**
+     * Restore the sync state saved by saveSnapshot(), in the global setup()
+     * after setup() has restored the time from the backupClock. The next sync
+     * attempt is scheduled at its saved time, but no later than one sync
+     * period from now, and the exponential backoff continues from the saved
+     * sync period. If the time is not known, the next sync attempt is made
+     * immediately. Returns false if the snapshot is
+     * invalid, and changes nothing.
+     */
+    bool restoreSnapshot(const SystemClockSnapshot& snapshot) {
+      uint16_t periodSeconds = (snapshot.syncPeriodSeconds < mSyncPeriodSeconds)
+          ? snapshot.syncPeriodSeconds
+          : mSyncPeriodSeconds;
+      uint16_t delaySeconds;
+      if (! this->restoreSyncState(snapshot, periodSeconds, &delaySeconds)) {
+        return false;
+      }
+
+      uint32_t nowMillis = this->clockMillis();
+      mCurrentSyncPeriodSeconds = periodSeconds;
+      this->setPrevSyncAttemptMillis(nowMillis
+          - (periodSeconds - delaySeconds) * (uint32_t) 1000);
+      this->setNextSyncAttemptMillis(nowMillis
+          + delaySeconds * (uint32_t) 1000);
+      if (delaySeconds == 0) {
+        this->setRequestStatusCode(kStatusReady);
+      } else if (snapshot.syncStatusCode == this->kSyncStatusOk) {
+        this->setRequestStatusCode(kStatusOk);
+      } else {
+        this->setRequestStatusCode(kStatusWaitForRetry);
+      }
+      return true;
+    }
+
+  #if ACE_TIME_CLOCK_SYNC_JITTER
+    /**
+     * Spread the requests of a fleet of devices which boot at the same time
+     * (e.g. after a power outage), so that they do not hit the referenceClock
+     * (e.g. an NTP server) in synchronized bursts. Every sync period (the
+     * initialSyncPeriodSeconds, its exponential backoff, and the
+     * syncPeriodSeconds) is varied pseudo-randomly by up to +/- `jitterPercent`
+     * (at most kMaxSyncJitterPercent), and the first request is delayed by a
+     * per-device phase offset of less than initialSyncPeriodSeconds. The
+     * pseudo-random sequence is seeded from `deviceId` (e.g. derived from the
+     * MAC address or the chip ID), which should be different on each device.
+     * A `jitterPercent` of 0 applies only the phase offset.
+     *
+     * Call this in the global setup(), after setup() and restoreSnapshot(),
+     * before the first loop(). The phase offset is not applied if
+     * restoreSnapshot() has already delayed the next request. Available only
+     * if ACE_TIME_CLOCK_SYNC_JITTER is enabled.
+     */
+    void setSyncJitter(uint32_t deviceId, uint8_t jitterPercent) {
+      uint32_t phaseMillis = this->seedSyncJitter(
+          deviceId, jitterPercent, mCurrentSyncPeriodSeconds);
+      if (this->getRequestStatusCode() == kStatusReady) {
+        this->setNextSyncAttemptMillis(this->clockMillis() + phaseMillis);
+        this->setRequestStatusCode(kStatusOk);
+      }
+    }
+  #endif
+
   protected:
     /** Empty constructor used for testing. */
     SystemClockLoopTemplate() {}
@@ -175,25 +346,46 @@ class SystemClockLoopTemplate : public SystemClockTemplate<T_SCCI> {
     friend class ::SystemClockLoopTest_backupNow;
     friend class ::SystemClockLoopTest_getNow;
 
-    /** Ready to send request. */
-    static const uint8_t kStatusReady = 0;
+  #if ! ACE_TIME_CLOCK_COMPACT
+    /** Get the request status, see SystemClock::getRequestStatusCode(). */
+    uint8_t getRequestStatusCode() const { return mRequestStatus; }
 
-    /** Request sent, waiting for response. */
-    static const uint8_t kStatusSent = 1;
+    /** Set the request status. */
+    void setRequestStatusCode(uint8_t code) { mRequestStatus = code; }
+  #endif
 
-    /** Request received and is valid. */
-    static const uint8_t kStatusOk = 2;
+    /** Return true if the time of the next sync attempt has been reached. */
+    bool isSyncAttemptDue(uint32_t nowMillis) const {
+      return (int32_t) (nowMillis - this->getNextSyncAttemptMillis()) >= 0;
+    }
 
-    /** Request received but is invalid, so retry with exponential backoff. */
-    static const uint8_t kStatusWaitForRetry = 3;
+    /** Record one sample per request into the LatencyHistogram. */
+    void updateLatency(uint8_t outcome, uint32_t elapsedMillis) {
+    #if ACE_TIME_CLOCK_COMPACT
+      (void) outcome;
+      (void) elapsedMillis;
+    #else
+      if (mLatencyHistogram != nullptr) {
+        mLatencyHistogram->update(outcome, (elapsedMillis > UINT16_MAX)
+            ? (uint16_t) UINT16_MAX : (uint16_t) elapsedMillis);
+      }
+    #endif
+    }
 
+  #if ! ACE_TIME_CLOCK_COMPACT
+    LatencyHistogram* const mLatencyHistogram = nullptr;
+  #endif
     uint16_t const mSyncPeriodSeconds = 3600;
     uint16_t const mRequestTimeoutMillis = 1000;
-    ace_common::TimingStats* const mTimingStats = nullptr;
 
-    uint32_t mRequestStartMillis;
+    // The start of the current request is the prev sync attempt millis of
+    // the SystemClock, so it is not stored again here.
     uint16_t mCurrentSyncPeriodSeconds = 5;
+  #if ! ACE_TIME_CLOCK_COMPACT
     uint8_t mRequestStatus = kStatusReady;
+  #endif
+    // In the compact layout, the request status is in the bit field of
+    // SystemClock, where its initial 0 is kStatusReady.
 };
 
 /**
@@ -204,6 +396,17 @@ class SystemClockLoopTemplate : public SystemClockTemplate<T_SCCI> {
  */
 using SystemClockLoop = SystemClockLoopTemplate<hw::ClockInterface>;
 
+/**
+ * A SystemClockLoop whose referenceClock and backupClock types are fixed at
+ * compile time, so that their methods are called without virtual dispatch.
+ * Use NullClock for a missing clock. For example,
+ * `StaticSystemClockLoop<DS3231Clock<WireInterface>>` syncs to a DS3231 and
+ * has no backupClock.
+ */
+template <typename T_REF, typename T_BACKUP = NullClock>
+using StaticSystemClockLoop = SystemClockLoopTemplate<
+    hw::ClockInterface, SystemClockNoInstrumentation, T_REF, T_BACKUP>;
+
 
 }
 }
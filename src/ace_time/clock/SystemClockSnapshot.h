@@ -0,0 +1,87 @@
+/*
+ * MIT License
+ * Copyright (c) 2022 Brian T. Park
+ */
+
+#ifndef ACE_TIME_SYSTEM_CLOCK_SNAPSHOT_H
+#define ACE_TIME_SYSTEM_CLOCK_SNAPSHOT_H
+
+#include <stddef.h> // offsetof()
+#include <stdint.h>
+#include <AceTime.h> // acetime_t
+
+namespace ace_time {
+namespace clock {
+
+/**
+ * The sync state of a SystemClockLoop or SystemClockCoroutine, saved by
+ * saveSnapshot() and restored by restoreSnapshot(), so that a device which
+ * reboots (e.g. after an ESP deep sleep, or a watchdog reset) resumes its
+ * sync schedule where it left off, instead of starting again at the
+ * initialSyncPeriodSeconds with an exponential backoff.
+ *
+ * The struct is 16 bytes without padding on all platforms, and is intended to
+ * be copied as raw bytes into memory which survives the reboot, for example
+ * the RTC memory of the ESP8266 or ESP32, the backup registers of the STM32,
+ * or an EEPROM. The snapshot is versioned and checksummed, so that
+ * restoreSnapshot() rejects the uninitialized memory after a power loss, or a
+ * snapshot saved by an incompatible version of the library.
+ *
+ * The times are seconds since the current AceTime epoch, so the snapshot must
+ * be restored using the same epoch year.
+ */
+struct SystemClockSnapshot {
+  /** Version of the layout of this struct. */
+  static const uint8_t kVersion = 1;
+
+  /** Return the Fletcher-16 checksum of all fields except `checksum`. */
+  uint16_t computeChecksum() const {
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(this);
+    uint16_t sum1 = 0;
+    uint16_t sum2 = 0;
+    const uint8_t skip = offsetof(SystemClockSnapshot, checksum);
+    for (uint8_t i = 0; i < sizeof(SystemClockSnapshot); i++) {
+      if (i >= skip && i < skip + sizeof(checksum)) continue;
+      sum1 = (sum1 + bytes[i]) % 255;
+      sum2 = (sum2 + sum1) % 255;
+    }
+    return (sum2 << 8) | sum1;
+  }
+
+  /** Return true if the version and the checksum are correct. */
+  bool isValid() const {
+    return version == kVersion && checksum == computeChecksum();
+  }
+
+  /** Version of the layout, kVersion. */
+  uint8_t version;
+
+  /** The SystemClock::getSyncStatusCode(). */
+  uint8_t syncStatusCode;
+
+  /** The current sync period, including the exponential backoff. */
+  uint16_t syncPeriodSeconds;
+
+  /** The SystemClock::getClockSkew(). */
+  int16_t clockSkew;
+
+  /** Checksum of the other fields, see computeChecksum(). */
+  uint16_t checksum;
+
+  /** The SystemClock::getLastSyncTime(). */
+  acetime_t lastSyncTime;
+
+  /**
+   * The time of the next sync attempt, or kInvalidSeconds if the time was not
+   * known, or if no sync was attempted.
+   */
+  acetime_t nextSyncTime;
+};
+
+static_assert(sizeof(SystemClockSnapshot) == 16,
+    "SystemClockSnapshot must be 16 bytes without padding");
+
+}
+}
+
+#endif
@@ -8,15 +8,26 @@
 
 #if defined(EPOXY_DUINO)
 
-#include <time.h> // time()
+#include <stdint.h>
+#include <time.h> // clock_gettime()
 #include <AceTime.h> // LocalDate
 #include "Clock.h"
+#include "EpochOffsets.h"
 
 namespace ace_time {
 namespace clock {
 
 /**
  * An implementation of Clock that works on Unix using EpoxyDuino.
+ *
+ * The wall clock time is read from `clock_gettime(CLOCK_REALTIME)`, which
+ * provides sub-second resolution through getNowMillis() and getNowMicros().
+ * The offset between the Unix epoch and the current AceTime epoch is cached
+ * by EpochOffsets, instead of being computed on every call.
+ *
+ * The wall clock can jump when the system time is adjusted, so intervals
+ * should be measured with monotonicMillis() and monotonicMicros(), which read
+ * `clock_gettime(CLOCK_MONOTONIC)`.
  */
 class UnixClock: public Clock {
   public:
@@ -31,10 +42,89 @@ class UnixClock: public Clock {
      * Since `acetime_t` is a 32-bit integer, this method is valid if the
      * current Unix time() is within about +/- 68 years of the current epoch
      * being used by the AceTime library, as defined by
-     * `Epoch::currentEpochYear()`.
+     * `Epoch::currentEpochYear()`. Use getNow64() with
+     * ACE_TIME_CLOCK_SECONDS64 beyond that range.
      */
     acetime_t getNow() const override {
-      return time(nullptr) - Epoch::secondsToCurrentEpochFromUnixEpoch64();
+      struct timespec ts;
+      clock_gettime(CLOCK_REALTIME, &ts);
+      return toAceTimeSeconds(ts.tv_sec);
+    }
+
+    /**
+     * Same as getNow(), but also return the milliseconds (0-999) since the
+     * start of the current second.
+     */
+    acetime_t getNowMillis(uint16_t* millis) const override {
+      struct timespec ts;
+      clock_gettime(CLOCK_REALTIME, &ts);
+      *millis = (uint16_t) (ts.tv_nsec / 1000000);
+      return toAceTimeSeconds(ts.tv_sec);
+    }
+
+    /**
+     * Same as getNow(), but also return the microseconds (0-999999) since the
+     * start of the current second.
+     */
+    acetime_t getNowMicros(uint32_t* micros) const {
+      struct timespec ts;
+      clock_gettime(CLOCK_REALTIME, &ts);
+      *micros = (uint32_t) (ts.tv_nsec / 1000);
+      return toAceTimeSeconds(ts.tv_sec);
+    }
+
+    acetime_t readResponseMillis(uint16_t* millis) const override {
+      return getNowMillis(millis);
+    }
+
+  #if ACE_TIME_CLOCK_SECONDS64
+    int64_t getNow64() const override {
+      struct timespec ts;
+      clock_gettime(CLOCK_REALTIME, &ts);
+      return toAceTimeSeconds64(ts.tv_sec);
+    }
+
+    int64_t getNowMillis64(uint16_t* millis) const override {
+      struct timespec ts;
+      clock_gettime(CLOCK_REALTIME, &ts);
+      *millis = (uint16_t) (ts.tv_nsec / 1000000);
+      return toAceTimeSeconds64(ts.tv_sec);
+    }
+
+    int64_t readResponse64() const override { return getNow64(); }
+
+    int64_t readResponseMillis64(uint16_t* millis) const override {
+      return getNowMillis64(millis);
+    }
+  #endif
+
+    /**
+     * Return the milliseconds of the monotonic clock, which is not affected
+     * by adjustments of the system time. The starting point is unspecified.
+     */
+    static uint64_t monotonicMillis() {
+      struct timespec ts;
+      clock_gettime(CLOCK_MONOTONIC, &ts);
+      return (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+    }
+
+    /** Return the microseconds of the monotonic clock. */
+    static uint64_t monotonicMicros() {
+      struct timespec ts;
+      clock_gettime(CLOCK_MONOTONIC, &ts);
+      return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+    }
+
+  private:
+    /** Convert Unix seconds to AceTime seconds. */
+    static acetime_t toAceTimeSeconds(time_t unixSeconds) {
+      return unixSeconds - EpochOffsets::secondsToCurrentEpochFromUnixEpoch64();
+    }
+
+    /** Convert Unix seconds to 64-bit AceTime seconds. */
+    static int64_t toAceTimeSeconds64(time_t unixSeconds) {
+      return (int64_t) unixSeconds
+          - EpochOffsets::secondsToCurrentEpochFromUnixEpoch64();
     }
 };
 
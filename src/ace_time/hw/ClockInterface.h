@@ -14,20 +14,108 @@ namespace hw {
 
 /**
  * A utility class that provides a layer of indirection to the Arduino clock
- * functions (millis() and potentially micros() in the future). Not to be
- * confused with the `ace_clock::clock::Clock` base class.
+ * functions. Not to be confused with the `ace_clock::clock::Clock` base class.
  *
  * This indirection allows injection of a different ClockInterface for testing
  * purposes. Since this class uses non-virtual, static functions, the compiler
  * will optimize away the function call.
+ *
+ * A ClockInterface provides 2 time sources:
+ *
+ *  * `millis()` is used for the scheduling of the sync requests to the
+ *    referenceClock, with millisecond resolution.
+ *  * `ticks()` is used by SystemClockTemplate to advance its seconds and to
+ *    keep track of the sub-second phase. The `tick_t` type is the unsigned
+ *    integer which stores the ticks, and `kTicksPerSecond` (1000 or 1000000)
+ *    is the rate of the ticks. The SystemClock must be kept alive more
+ *    often than the rollover period of `tick_t`.
+ *
+ * This class uses `millis()` for both, and stores the ticks in a 16-bit
+ * integer to save memory, so the keep alive period is 65.535 seconds. See
+ * MicrosClockInterface and MonotonicClockInterface for other resolutions.
  */
 class ClockInterface {
   public:
+    /** Type of the ticks stored by SystemClock. */
+    typedef uint16_t tick_t;
+
+    /** Number of ticks per second. */
+    static const uint32_t kTicksPerSecond = 1000;
+
     /** Get the current millis. */
     static unsigned long millis() { return ::millis(); }
+
+    /** Get the current ticks, the lower 16-bits of millis(). */
+    static tick_t ticks() { return (tick_t) ::millis(); }
+};
+
+/**
+ * A ClockInterface which uses the 32-bit `micros()` as the ticks of the
+ * SystemClock, allowing it to track the sub-second phase with a resolution of
+ * one microsecond (or the resolution of `micros()` on the given board, which
+ * is 4 microseconds on a 16 MHz AVR). The ticks roll over every 71.6 minutes,
+ * which is the maximum keep alive period of the SystemClock.
+ */
+class MicrosClockInterface {
+  public:
+    /** Type of the ticks stored by SystemClock. */
+    typedef uint32_t tick_t;
+
+    /** Number of ticks per second. */
+    static const uint32_t kTicksPerSecond = 1000000;
+
+    /** Get the current millis. */
+    static unsigned long millis() { return ::millis(); }
+
+    /** Get the current micros. */
+    static tick_t ticks() { return ::micros(); }
+};
+
+}
+}
+
+#if defined(EPOXY_DUINO)
+
+#include <time.h> // clock_gettime()
+
+namespace ace_time {
+namespace hw {
+
+/**
+ * A ClockInterface for Linux or MacOS under EpoxyDuino, based on
+ * `clock_gettime(CLOCK_MONOTONIC)`. The ticks are 64-bit microseconds which
+ * never roll over in practice, so the SystemClock does not need to be kept
+ * alive, and is not affected by adjustments of the system time.
+ */
+class MonotonicClockInterface {
+  public:
+    /** Type of the ticks stored by SystemClock. */
+    typedef uint64_t tick_t;
+
+    /** Number of ticks per second. */
+    static const uint32_t kTicksPerSecond = 1000000;
+
+    /** Get the current monotonic millis, truncated to unsigned long. */
+    static unsigned long millis() { return (unsigned long) millis64(); }
+
+    /** Get the current monotonic millis as a 64-bit integer. */
+    static uint64_t millis64() {
+      struct timespec ts;
+      clock_gettime(CLOCK_MONOTONIC, &ts);
+      return (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+    }
+
+    /** Get the current monotonic micros. */
+    static tick_t ticks() {
+      struct timespec ts;
+      clock_gettime(CLOCK_MONOTONIC, &ts);
+      return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+    }
 };
 
 }
 }
 
+#endif // #if defined(EPOXY_DUINO)
+
 #endif
@@ -0,0 +1,153 @@
+/*
+ * MIT License
+ * Copyright (c) 2022 Brian T. Park
+ */
+
+#if defined(EPOXY_DUINO)
+
+#include <string.h> // memcpy()
+#include <unistd.h> // close()
+#include <fcntl.h> // fcntl()
+#include <netdb.h> // getaddrinfo()
+#include <arpa/inet.h> // inet_pton(), htons()
+#include <netinet/in.h> // sockaddr_in
+#include <sys/socket.h>
+#include "PosixUdpInterface.h"
+
+namespace ace_time {
+namespace hw {
+
+bool PosixUdpInterface::begin(uint16_t localPort) {
+  stop();
+
+  int fd = socket(AF_INET, SOCK_DGRAM, 0);
+  if (fd < 0) return false;
+
+  int flags = fcntl(fd, F_GETFL, 0);
+  if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+    close(fd);
+    return false;
+  }
+
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(localPort);
+  if (inet_pton(AF_INET, mBindAddress, &addr.sin_addr) != 1
+      || bind(fd, (const sockaddr*) &addr, sizeof(addr)) < 0) {
+    close(fd);
+    return false;
+  }
+
+  mSocket = fd;
+  mRxSize = 0;
+  mRxPos = 0;
+  mTxSize = 0;
+  return true;
+}
+
+void PosixUdpInterface::stop() {
+  if (mSocket >= 0) {
+    close(mSocket);
+    mSocket = -1;
+  }
+}
+
+uint16_t PosixUdpInterface::localPort() const {
+  if (mSocket < 0) return 0;
+
+  sockaddr_in addr;
+  socklen_t len = sizeof(addr);
+  if (getsockname(mSocket, (sockaddr*) &addr, &len) < 0) return 0;
+  return ntohs(addr.sin_port);
+}
+
+int PosixUdpInterface::parsePacket() {
+  mRxSize = 0;
+  mRxPos = 0;
+  if (mSocket < 0) return 0;
+
+  sockaddr_in addr;
+  socklen_t len = sizeof(addr);
+  ssize_t n = recvfrom(mSocket, mRxBuffer, kBufferSize, 0,
+      (sockaddr*) &addr, &len);
+  if (n <= 0) return 0;
+
+  mRemoteAddress = addr.sin_addr.s_addr;
+  mRemotePort = addr.sin_port;
+  mRxSize = (uint16_t) n;
+  return n;
+}
+
+int PosixUdpInterface::read(uint8_t* buf, size_t size) {
+  size_t remaining = mRxSize - mRxPos;
+  if (size > remaining) size = remaining;
+  memcpy(buf, mRxBuffer + mRxPos, size);
+  mRxPos += size;
+  return size;
+}
+
+bool PosixUdpInterface::beginPacket(const char* host, uint16_t port) {
+  in_addr inaddr;
+  if (inet_pton(AF_INET, host, &inaddr) == 1) {
+    mDestAddress = inaddr.s_addr;
+  } else {
+    addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+    addrinfo* result;
+    if (getaddrinfo(host, nullptr, &hints, &result) != 0) return false;
+    mDestAddress = ((const sockaddr_in*) result->ai_addr)->sin_addr.s_addr;
+    freeaddrinfo(result);
+  }
+
+  mDestPort = htons(port);
+  mTxSize = 0;
+  return true;
+}
+
+bool PosixUdpInterface::beginPacket(uint32_t address, uint16_t port) {
+  mDestAddress = address;
+  mDestPort = htons(port);
+  mTxSize = 0;
+  return true;
+}
+
+uint16_t PosixUdpInterface::remotePort() const {
+  return ntohs(mRemotePort);
+}
+
+bool PosixUdpInterface::beginReply() {
+  if (mRemotePort == 0) return false;
+  mDestAddress = mRemoteAddress;
+  mDestPort = mRemotePort;
+  mTxSize = 0;
+  return true;
+}
+
+size_t PosixUdpInterface::write(const uint8_t* buf, size_t size) {
+  size_t remaining = kBufferSize - mTxSize;
+  if (size > remaining) size = remaining;
+  memcpy(mTxBuffer + mTxSize, buf, size);
+  mTxSize += size;
+  return size;
+}
+
+bool PosixUdpInterface::endPacket() {
+  if (mSocket < 0) return false;
+
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = mDestPort;
+  addr.sin_addr.s_addr = mDestAddress;
+  ssize_t n = sendto(mSocket, mTxBuffer, mTxSize, 0,
+      (const sockaddr*) &addr, sizeof(addr));
+  return n == (ssize_t) mTxSize;
+}
+
+}
+}
+
+#endif
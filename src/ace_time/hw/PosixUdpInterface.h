@@ -0,0 +1,134 @@
+/*
+ * MIT License
+ * Copyright (c) 2022 Brian T. Park
+ */
+
+#ifndef ACE_TIME_HW_POSIX_UDP_INTERFACE_H
+#define ACE_TIME_HW_POSIX_UDP_INTERFACE_H
+
+#if defined(EPOXY_DUINO)
+
+#include <stdint.h>
+#include <stddef.h> // size_t
+
+namespace ace_time {
+namespace hw {
+
+/**
+ * An implementation of the UDP transport interface used by `NtpClockTemplate`
+ * (see `WiFiUdpInterface` for the list of methods) on top of a non-blocking
+ * POSIX socket. Available only under EpoxyDuino, so that the NTP request and
+ * response code can be exercised on a Linux or MacOS host, for example against
+ * the `testing::LoopbackNtpServer`.
+ *
+ * The host is always considered to be connected to the network, so
+ * `connect()` does nothing and `isConnected()` returns true.
+ *
+ * This class owns a file descriptor, so it cannot be copied.
+ */
+class PosixUdpInterface {
+  public:
+    /** Size of the incoming and outgoing packet buffers. */
+    static const uint16_t kBufferSize = 128;
+
+    /**
+     * Constructor.
+     * @param bindAddress dotted-quad IPv4 address of the local interface used
+     *    by begin() (default "0.0.0.0", all interfaces)
+     */
+    explicit PosixUdpInterface(const char* bindAddress = "0.0.0.0") :
+        mBindAddress(bindAddress)
+    {}
+
+    /** Destructor. Closes the socket. */
+    ~PosixUdpInterface() { stop(); }
+
+    /** Do nothing. The host is assumed to be on the network. */
+    void connect(const char* /*ssid*/, const char* /*password*/) {}
+
+    /** Always return true. */
+    bool isConnected() const { return true; }
+
+    /**
+     * Open a non-blocking UDP socket bound to the given local port. If
+     * `localPort` is 0, the operating system selects an ephemeral port, which
+     * can be retrieved using localPort().
+     */
+    bool begin(uint16_t localPort);
+
+    /** Close the socket. */
+    void stop();
+
+    /** Return the local port of the socket, or 0 if not open. */
+    uint16_t localPort() const;
+
+    /**
+     * Receive the next incoming datagram, if any. Return its size in bytes,
+     * or 0 if no packet is available.
+     */
+    int parsePacket();
+
+    /** Read up to `size` bytes of the current packet into `buf`. */
+    int read(uint8_t* buf, size_t size);
+
+    /**
+     * Start an outgoing packet to the given host and port. The host is
+     * resolved using getaddrinfo(), which returns immediately for numerical
+     * addresses like "127.0.0.1".
+     */
+    bool beginPacket(const char* host, uint16_t port);
+
+    /**
+     * Start an outgoing packet to the given IPv4 address (in network byte
+     * order, as returned by remoteAddress()) and port.
+     */
+    bool beginPacket(uint32_t address, uint16_t port);
+
+    /** Start an outgoing packet to the sender of the last received packet. */
+    bool beginReply();
+
+    /**
+     * Return the IPv4 address of the sender of the last received packet, in
+     * network byte order.
+     */
+    uint32_t remoteAddress() const { return mRemoteAddress; }
+
+    /** Return the port of the sender of the last received packet. */
+    uint16_t remotePort() const;
+
+    /** Append `size` bytes to the outgoing packet. */
+    size_t write(const uint8_t* buf, size_t size);
+
+    /** Send the outgoing packet. */
+    bool endPacket();
+
+  private:
+    // disable copy constructor and assignment operator
+    PosixUdpInterface(const PosixUdpInterface&) = delete;
+    PosixUdpInterface& operator=(const PosixUdpInterface&) = delete;
+
+    const char* const mBindAddress;
+    int mSocket = -1;
+
+    /** Address and port of the sender of the last packet, network order. */
+    uint32_t mRemoteAddress = 0;
+    uint16_t mRemotePort = 0;
+
+    /** Address and port of the outgoing packet, network order. */
+    uint32_t mDestAddress = 0;
+    uint16_t mDestPort = 0;
+
+    uint8_t mRxBuffer[kBufferSize];
+    uint16_t mRxSize = 0;
+    uint16_t mRxPos = 0;
+
+    uint8_t mTxBuffer[kBufferSize];
+    uint16_t mTxSize = 0;
+};
+
+}
+}
+
+#endif
+
+#endif
@@ -8,11 +8,114 @@
 
 #include "Stm32F1Rtc.h"
 
-#if defined(STM32F1xx)
+#if defined(STM32F1xx) || defined(EPOXY_DUINO)
+
+#if defined(EPOXY_DUINO)
+
+#include "Stm32F1RtcEmulator.h"
+
+#define ACE_TIME_STM32_F1_RTC_EMULATOR \
+    ace_time::hw::Stm32F1RtcEmulator::getInstance()
+
+#define RTC_CRH  ACE_TIME_STM32_F1_RTC_EMULATOR.rtcCrh
+#define RTC_CRL  ACE_TIME_STM32_F1_RTC_EMULATOR.rtcCrl
+#define RTC_PRLH ACE_TIME_STM32_F1_RTC_EMULATOR.rtcPrlh
+#define RTC_PRLL ACE_TIME_STM32_F1_RTC_EMULATOR.rtcPrll
+#define RTC_DIVH ACE_TIME_STM32_F1_RTC_EMULATOR.rtcDivh
+#define RTC_DIVL ACE_TIME_STM32_F1_RTC_EMULATOR.rtcDivl
+#define RTC_CNTH ACE_TIME_STM32_F1_RTC_EMULATOR.rtcCnth
+#define RTC_CNTL ACE_TIME_STM32_F1_RTC_EMULATOR.rtcCntl
+
+#define RCC_APB1ENR ACE_TIME_STM32_F1_RTC_EMULATOR.rccApb1enr
+#define RCC_BDCR    ACE_TIME_STM32_F1_RTC_EMULATOR.rccBdcr
+#define PWR_CR      ACE_TIME_STM32_F1_RTC_EMULATOR.pwrCr
+
+#define RTC_CRL_RSF   ace_time::hw::Stm32F1RtcEmulator::kRtcCrlRsf
+#define RTC_CRL_CNF   ace_time::hw::Stm32F1RtcEmulator::kRtcCrlCnf
+#define RTC_CRL_RTOFF ace_time::hw::Stm32F1RtcEmulator::kRtcCrlRtoff
+#define RCC_APB1ENR_BKPEN ace_time::hw::Stm32F1RtcEmulator::kRccApb1enrBkpen
+#define RCC_APB1ENR_PWREN ace_time::hw::Stm32F1RtcEmulator::kRccApb1enrPwren
+#define RCC_BDCR_LSEON ace_time::hw::Stm32F1RtcEmulator::kRccBdcrLseon
+#define RCC_BDCR_LSERDY ace_time::hw::Stm32F1RtcEmulator::kRccBdcrLserdy
+#define RCC_BDCR_RTCSEL_LSE ace_time::hw::Stm32F1RtcEmulator::kRccBdcrRtcselLse
+#define RCC_BDCR_RTCEN ace_time::hw::Stm32F1RtcEmulator::kRccBdcrRtcen
+#define RCC_BDCR_BDRST ace_time::hw::Stm32F1RtcEmulator::kRccBdcrBdrst
+#define PWR_CR_DBP ace_time::hw::Stm32F1RtcEmulator::kPwrCrDbp
+
+#else
+
+#include <Arduino.h> // RTC, RCC, PWR, BKP
+
+#define RTC_CRH  RTC->CRH
+#define RTC_CRL  RTC->CRL
+#define RTC_PRLH RTC->PRLH
+#define RTC_PRLL RTC->PRLL
+#define RTC_DIVH RTC->DIVH
+#define RTC_DIVL RTC->DIVL
+#define RTC_CNTH RTC->CNTH
+#define RTC_CNTL RTC->CNTL
+
+#define RCC_APB1ENR RCC->APB1ENR
+#define RCC_BDCR    RCC->BDCR
+#define PWR_CR      PWR->CR
+
+#endif
+
+// Set the RTC_INIT_REG to to hold the 'init' bit, indicating that the RTC
+// counter has been set to a valid epochSeconds value.
+//
+// If the default DR1 register causes conflicts with some other library, we can
+// make this a configurable parameter in the begin() method. But that would
+// require a bit hacking. Currently, the DR registers are accessible only
+// through the `BKP` pointer which points to the `BKP_TypeDef` struct. If we
+// want to refer to the backup registers using a numeric index (e.g. 1, 2), we
+// would need to do some pointer casting. In other words, cast the `BKP` to a
+// `__IO uint32_t* drp = (__IO uint32*) BKP`, then use `drp[index]` to get to
+// the specific `DR{index}` register.
+#if defined(EPOXY_DUINO)
+  #define RTC_INIT_REG  ACE_TIME_STM32_F1_RTC_EMULATOR.bkpDr1
+#else
+  #define RTC_INIT_REG  BKP->DR1
+#endif
+#define RTC_INIT_BIT  0
+#define RTC_INIT_FLAG (1 << RTC_INIT_BIT)
 
 namespace ace_time {
 namespace hw {
 
+bool Stm32F1Rtc::isInitialized() {
+  return (RTC_INIT_REG & RTC_INIT_FLAG) == RTC_INIT_FLAG;
+}
+
+void Stm32F1Rtc::waitSync() {
+  RTC_CRL &= ~RTC_CRL_RSF;
+  while ((RTC_CRL & RTC_CRL_RSF) == 0);
+}
+
+void Stm32F1Rtc::waitFinished() {
+  while ((RTC_CRL & RTC_CRL_RTOFF) == 0);
+}
+
+void Stm32F1Rtc::enableBackupWrites() {
+  PWR_CR |= PWR_CR_DBP;
+}
+
+void Stm32F1Rtc::disableBackupWrites() {
+  PWR_CR &= ~PWR_CR_DBP;
+}
+
+void Stm32F1Rtc::enterConfigMode() {
+  RTC_CRL |= RTC_CRL_CNF;
+}
+
+void Stm32F1Rtc::exitConfigMode() {
+  RTC_CRL &= ~RTC_CRL_CNF;
+}
+
+void Stm32F1Rtc::enableClockInterface() {
+  RCC_APB1ENR |= RCC_APB1ENR_PWREN | RCC_APB1ENR_BKPEN;
+}
+
 bool Stm32F1Rtc::begin() {
   bool isInit = isInitialized();
   enableClockInterface();
@@ -35,7 +138,7 @@ void Stm32F1Rtc::init() {
   waitSync();
   waitFinished();
   enterConfigMode();
-  RTC_PRLL = 0x7FFF;
+  RTC_PRLL = kPrescaler;
   exitConfigMode();
   waitFinished();
   RTC_INIT_REG |= RTC_INIT_FLAG; // Signals that RTC initilized
@@ -57,7 +160,39 @@ uint32_t Stm32F1Rtc::getTime() {
     high1 = high2;
   }
 
-  return (high1 << 16) | low;
+  return ((uint32_t) high1 << 16) | low;
+}
+
+// The divider is a 20-bit down counter spread over 2 registers, so it is read
+// in the same way as the counter.
+uint32_t Stm32F1Rtc::readDivider() {
+  uint16_t high1 = RTC_DIVH;
+  uint16_t low = RTC_DIVL;
+  uint16_t high2 = RTC_DIVH;
+
+  if (high1 != high2) {
+    low = RTC_DIVL;
+    high1 = high2;
+  }
+
+  return ((uint32_t) (high1 & 0x000F) << 16) | low;
+}
+
+// The counter increments on the same tick of the LSE_CLOCK which reloads the
+// divider, so a divider read just before or after that tick could be paired
+// with the wrong second. Read the counter before and after the divider, and
+// read the divider again if the counter has changed in between.
+uint32_t Stm32F1Rtc::getTimeTicks(uint16_t* ticks) {
+  uint32_t time = getTime();
+  while (true) {
+    uint32_t divider = readDivider();
+    uint32_t time2 = getTime();
+    if (time2 == time) {
+      *ticks = (divider > kPrescaler) ? 0 : (uint16_t) (kPrescaler - divider);
+      return time;
+    }
+    time = time2;
+  }
 }
 
 void Stm32F1Rtc::setTime(uint32_t time) {
@@ -76,4 +211,4 @@ void Stm32F1Rtc::setTime(uint32_t time) {
 } // hw
 } // ace_time
 
-#endif // defined(STM32F1xx)
+#endif // defined(STM32F1xx) || defined(EPOXY_DUINO)
@@ -0,0 +1,159 @@
+/*
+ * MIT License
+ * Copyright (c) 2022 Brian T. Park
+ */
+
+#if defined(EPOXY_DUINO)
+
+#include "Stm32F1RtcEmulator.h"
+
+namespace ace_time {
+namespace hw {
+
+Stm32F1RtcEmulator& Stm32F1RtcEmulator::getInstance() {
+  static Stm32F1RtcEmulator instance;
+  return instance;
+}
+
+Stm32F1RtcEmulator::Stm32F1RtcEmulator() :
+    rtcCrh(this, kRtcCrh),
+    rtcCrl(this, kRtcCrl),
+    rtcPrlh(this, kRtcPrlh),
+    rtcPrll(this, kRtcPrll),
+    rtcDivh(this, kRtcDivh),
+    rtcDivl(this, kRtcDivl),
+    rtcCnth(this, kRtcCnth),
+    rtcCntl(this, kRtcCntl),
+    rccApb1enr(this, kRccApb1enr),
+    rccBdcr(this, kRccBdcr),
+    pwrCr(this, kPwrCr),
+    bkpDr1(this, kBkpDr1) {
+  reset();
+}
+
+void Stm32F1RtcEmulator::reset() {
+  resetBackupDomain();
+  mRccApb1enr = 0;
+  mPwrCr = 0;
+  mTicksPerRead = 0;
+  mNumCounterReads = 0;
+}
+
+void Stm32F1RtcEmulator::resetBackupDomain() {
+  mRtcCrh = 0;
+  mRtcCrl = 0;
+  mPrescaler = kResetPrescaler;
+  mDivider = kResetPrescaler;
+  mCounter = 0;
+  mRccBdcr = 0;
+  mBkpDr1 = 0;
+}
+
+void Stm32F1RtcEmulator::advanceTicks(uint32_t ticks) {
+  const uint32_t kRunning = kRccBdcrLseon | kRccBdcrRtcen;
+  if ((mRccBdcr & kRunning) != kRunning || isConfigMode()) return;
+
+  // The divider reaches 0 after mDivider ticks, and the next tick reloads it
+  // and increments the counter.
+  if (ticks <= mDivider) {
+    mDivider -= ticks;
+    return;
+  }
+  ticks -= mDivider + 1;
+  uint32_t period = mPrescaler + 1;
+  mCounter += 1 + ticks / period;
+  mDivider = mPrescaler - ticks % period;
+}
+
+uint32_t Stm32F1RtcEmulator::read(RegisterIndex index) {
+  switch (index) {
+    case kRtcCrh: return mRtcCrh;
+    // The registers are always synchronized, and the writes finish instantly.
+    case kRtcCrl: return mRtcCrl | kRtcCrlRsf | kRtcCrlRtoff;
+    // The prescaler registers are write-only.
+    case kRtcPrlh: return 0;
+    case kRtcPrll: return 0;
+    case kRccApb1enr: return mRccApb1enr;
+    case kRccBdcr:
+      // The LSE oscillator is ready as soon as it is turned on.
+      return ((mRccBdcr & kRccBdcrLseon) != 0)
+          ? mRccBdcr | kRccBdcrLserdy
+          : mRccBdcr;
+    case kPwrCr: return mPwrCr;
+    case kBkpDr1: return mBkpDr1;
+    default: break;
+  }
+
+  // The time registers, which may tick between consecutive reads.
+  uint32_t value;
+  switch (index) {
+    case kRtcDivh: value = (mDivider >> 16) & 0x000F; break;
+    case kRtcDivl: value = mDivider & 0xFFFF; break;
+    case kRtcCnth: value = mCounter >> 16; mNumCounterReads++; break;
+    case kRtcCntl: value = mCounter & 0xFFFF; mNumCounterReads++; break;
+    default: value = 0; break;
+  }
+  if (mTicksPerRead > 0) advanceTicks(mTicksPerRead);
+  return value;
+}
+
+void Stm32F1RtcEmulator::write(RegisterIndex index, uint32_t value) {
+  switch (index) {
+    case kRccApb1enr: mRccApb1enr = value; return;
+    case kPwrCr: mPwrCr = value; return;
+    default: break;
+  }
+
+  // The backup domain is write protected.
+  if (! isBackupWritable()) return;
+
+  switch (index) {
+    case kRtcCrh:
+      mRtcCrh = value & 0x0007;
+      break;
+    case kRtcCrl:
+      mRtcCrl = value & (kRtcCrlCnf | kRtcCrlRsf);
+      break;
+    case kRtcPrlh:
+      if (isConfigMode()) {
+        mPrescaler = ((value & 0x000F) << 16) | (mPrescaler & 0xFFFF);
+      }
+      break;
+    case kRtcPrll:
+      if (isConfigMode()) {
+        mPrescaler = (mPrescaler & 0xF0000) | (value & 0xFFFF);
+      }
+      break;
+    case kRtcCnth:
+      if (isConfigMode()) {
+        mCounter = ((value & 0xFFFF) << 16) | (mCounter & 0xFFFF);
+        mDivider = mPrescaler;
+      }
+      break;
+    case kRtcCntl:
+      if (isConfigMode()) {
+        mCounter = (mCounter & 0xFFFF0000) | (value & 0xFFFF);
+        mDivider = mPrescaler;
+      }
+      break;
+    case kRccBdcr:
+      if ((value & kRccBdcrBdrst) != 0) {
+        resetBackupDomain();
+        mRccBdcr = kRccBdcrBdrst;
+      } else {
+        mRccBdcr = value & (kRccBdcrLseon | kRccBdcrRtcselLse | kRccBdcrRtcen);
+      }
+      break;
+    case kBkpDr1:
+      mBkpDr1 = value & 0xFFFF;
+      break;
+    default:
+      // The divider registers are read-only.
+      break;
+  }
+}
+
+} // hw
+} // ace_time
+
+#endif // #if defined(EPOXY_DUINO)
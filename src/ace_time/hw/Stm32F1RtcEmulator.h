@@ -0,0 +1,190 @@
+/*
+ * MIT License
+ * Copyright (c) 2022 Brian T. Park
+ */
+
+#ifndef ACE_TIME_HW_STM32_F1_RTC_EMULATOR_H
+#define ACE_TIME_HW_STM32_F1_RTC_EMULATOR_H
+
+#if defined(EPOXY_DUINO)
+
+#include <stdint.h>
+
+namespace ace_time {
+namespace hw {
+
+/**
+ * A register-level emulation of the RTC of the STM32F1, and of the few RCC,
+ * PWR and BKP registers used by `Stm32F1Rtc`. Available only under
+ * EpoxyDuino, where `Stm32F1Rtc.h` maps the `RTC_CNTH`, `RTC_DIVL`, etc.
+ * register macros to the registers of the singleton returned by
+ * getInstance(), so that the same `Stm32F1Rtc` code which runs on the Blue
+ * Pill can be tested on Linux or MacOS.
+ *
+ * The emulated 32.768 kHz LSE oscillator runs only when advanceTicks() is
+ * called. Each tick decrements the 20-bit prescaler divider (RTC_DIVH and
+ * RTC_DIVL). When the divider is 0, the next tick reloads it from the
+ * prescaler (RTC_PRLH and RTC_PRLL), and increments the 32-bit counter
+ * (RTC_CNTH and RTC_CNTL). Writes to the RTC registers, RCC_BDCR and the BKP
+ * registers are ignored unless PWR_CR_DBP is set, and writes to the
+ * prescaler and the counter are ignored outside of the configuration mode
+ * (RTC_CRL_CNF), as on the hardware. In this emulation, writing the counter
+ * also reloads the divider, so that the new second starts at the time of the
+ * write.
+ *
+ * Setting setTicksPerRead() advances the oscillator on every read of an RTC
+ * register, so that a tick can happen between the reads of the 16-bit halves
+ * of the counter and the divider, to test that they are read consistently.
+ */
+class Stm32F1RtcEmulator {
+  public:
+    /** Index of each emulated register. */
+    enum RegisterIndex : uint8_t {
+      kRtcCrh,
+      kRtcCrl,
+      kRtcPrlh,
+      kRtcPrll,
+      kRtcDivh,
+      kRtcDivl,
+      kRtcCnth,
+      kRtcCntl,
+      kRccApb1enr,
+      kRccBdcr,
+      kPwrCr,
+      kBkpDr1,
+    };
+
+    /**
+     * An emulated memory-mapped register, which supports the operations used
+     * on a `volatile uint32_t` register by `Stm32F1Rtc`. Every read and write
+     * goes through the Stm32F1RtcEmulator.
+     */
+    class Register {
+      public:
+        Register(Stm32F1RtcEmulator* emulator, RegisterIndex index) :
+            mEmulator(emulator),
+            mIndex(index)
+        {}
+
+        operator uint32_t() const { return mEmulator->read(mIndex); }
+
+        Register& operator=(uint32_t value) {
+          mEmulator->write(mIndex, value);
+          return *this;
+        }
+
+        Register& operator|=(uint32_t value) {
+          return *this = mEmulator->read(mIndex) | value;
+        }
+
+        Register& operator&=(uint32_t value) {
+          return *this = mEmulator->read(mIndex) & value;
+        }
+
+      private:
+        // disable copy constructor and assignment operator
+        Register(const Register&) = delete;
+        Register& operator=(const Register&) = delete;
+
+        Stm32F1RtcEmulator* const mEmulator;
+        RegisterIndex const mIndex;
+    };
+
+    // Bits of the registers, with the same values as the CMSIS header of the
+    // STM32F1.
+    static const uint32_t kRtcCrlRsf = 0x0008;
+    static const uint32_t kRtcCrlCnf = 0x0010;
+    static const uint32_t kRtcCrlRtoff = 0x0020;
+    static const uint32_t kRccApb1enrBkpen = 0x08000000;
+    static const uint32_t kRccApb1enrPwren = 0x10000000;
+    static const uint32_t kRccBdcrLseon = 0x00000001;
+    static const uint32_t kRccBdcrLserdy = 0x00000002;
+    static const uint32_t kRccBdcrRtcselLse = 0x00000100;
+    static const uint32_t kRccBdcrRtcen = 0x00008000;
+    static const uint32_t kRccBdcrBdrst = 0x00010000;
+    static const uint32_t kPwrCrDbp = 0x00000100;
+
+    /** Prescaler value after a reset of the backup domain. */
+    static const uint32_t kResetPrescaler = 0x8000;
+
+    /** Return the singleton instance used by the register macros. */
+    static Stm32F1RtcEmulator& getInstance();
+
+    /** Constructor. The backup domain is in its reset state. */
+    Stm32F1RtcEmulator();
+
+    /**
+     * Simulate a power-on reset with no backup battery, which resets the
+     * backup domain and all the other emulated registers.
+     */
+    void reset();
+
+    /**
+     * Advance the LSE oscillator by the given number of 32.768 kHz ticks. Does
+     * nothing if the RTC is not enabled, or is in configuration mode.
+     */
+    void advanceTicks(uint32_t ticks);
+
+    /** Advance the oscillator by `ticks` on every read of an RTC register. */
+    void setTicksPerRead(uint32_t ticks) { mTicksPerRead = ticks; }
+
+    /** Return the 32-bit counter, without advancing the oscillator. */
+    uint32_t getCounter() const { return mCounter; }
+
+    /** Return the 20-bit divider, without advancing the oscillator. */
+    uint32_t getDivider() const { return mDivider; }
+
+    /** Return the 20-bit prescaler. */
+    uint32_t getPrescaler() const { return mPrescaler; }
+
+    /** Return the number of reads of the RTC_CNTH and RTC_CNTL registers. */
+    uint32_t getNumCounterReads() const { return mNumCounterReads; }
+
+    // The emulated registers, referenced by the register macros.
+    Register rtcCrh;
+    Register rtcCrl;
+    Register rtcPrlh;
+    Register rtcPrll;
+    Register rtcDivh;
+    Register rtcDivl;
+    Register rtcCnth;
+    Register rtcCntl;
+    Register rccApb1enr;
+    Register rccBdcr;
+    Register pwrCr;
+    Register bkpDr1;
+
+  private:
+    // disable copy constructor and assignment operator
+    Stm32F1RtcEmulator(const Stm32F1RtcEmulator&) = delete;
+    Stm32F1RtcEmulator& operator=(const Stm32F1RtcEmulator&) = delete;
+
+    uint32_t read(RegisterIndex index);
+    void write(RegisterIndex index, uint32_t value);
+
+    /** Reset the RTC and the BKP registers. */
+    void resetBackupDomain();
+
+    bool isBackupWritable() const { return (mPwrCr & kPwrCrDbp) != 0; }
+
+    bool isConfigMode() const { return (mRtcCrl & kRtcCrlCnf) != 0; }
+
+    uint32_t mRtcCrh;
+    uint32_t mRtcCrl;
+    uint32_t mPrescaler;
+    uint32_t mDivider;
+    uint32_t mCounter;
+    uint32_t mRccApb1enr;
+    uint32_t mRccBdcr;
+    uint32_t mPwrCr;
+    uint32_t mBkpDr1;
+    uint32_t mTicksPerRead;
+    uint32_t mNumCounterReads;
+};
+
+} // hw
+} // ace_time
+
+#endif // #if defined(EPOXY_DUINO)
+
+#endif // #ifndef ACE_TIME_HW_STM32_F1_RTC_EMULATOR_H
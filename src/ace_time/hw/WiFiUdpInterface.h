@@ -0,0 +1,97 @@
+/*
+ * MIT License
+ * Copyright (c) 2022 Brian T. Park
+ */
+
+#ifndef ACE_TIME_HW_WIFI_UDP_INTERFACE_H
+#define ACE_TIME_HW_WIFI_UDP_INTERFACE_H
+
+#if defined(ESP8266) || defined(ESP32) || defined(EPOXY_CORE_ESP8266)
+
+#include <stdint.h>
+#if defined(ESP8266) || defined(EPOXY_CORE_ESP8266)
+  #include <ESP8266WiFi.h>
+#else
+  #include <WiFi.h>
+#endif
+#include <WiFiUdp.h>
+
+namespace ace_time {
+namespace hw {
+
+/**
+ * A thin wrapper around the `WiFi` object and a `WiFiUDP` socket on the
+ * ESP8266 and ESP32, providing the UDP transport interface expected by
+ * `NtpClockTemplate`. Since all methods are non-virtual, the compiler is able
+ * to inline them into the calling code.
+ *
+ * The UDP interface consists of the following methods:
+ *
+ *  * `void connect(const char* ssid, const char* password)`
+ *  * `bool isConnected() const`
+ *  * `bool begin(uint16_t localPort)`
+ *  * `void stop()`
+ *  * `int parsePacket()`
+ *  * `int read(uint8_t* buf, size_t size)`
+ *  * `bool beginPacket(const char* host, uint16_t port)`
+ *  * `bool beginReply()`
+ *  * `size_t write(const uint8_t* buf, size_t size)`
+ *  * `bool endPacket()`
+ *
+ * The `beginPacket()` method resolves the host name using the blocking
+ * `WiFi.hostByName()` inside `WiFiUDP`.
+ */
+class WiFiUdpInterface {
+  public:
+    /** Start connecting the WiFi station to the given access point. */
+    void connect(const char* ssid, const char* password) {
+      WiFi.mode(WIFI_STA);
+      WiFi.begin(ssid, password);
+    }
+
+    /** Return true if the WiFi station is connected. */
+    bool isConnected() const { return WiFi.status() == WL_CONNECTED; }
+
+    /** Open the UDP socket on the given local port. */
+    bool begin(uint16_t localPort) { return mUdp.begin(localPort) != 0; }
+
+    /** Close the UDP socket. */
+    void stop() { mUdp.stop(); }
+
+    /**
+     * Check for the next incoming packet. Return its size in bytes, or 0 if
+     * no packet is available.
+     */
+    int parsePacket() { return mUdp.parsePacket(); }
+
+    /** Read up to `size` bytes of the current packet into `buf`. */
+    int read(uint8_t* buf, size_t size) { return mUdp.read(buf, size); }
+
+    /** Start an outgoing packet to the given host and port. */
+    bool beginPacket(const char* host, uint16_t port) {
+      return mUdp.beginPacket(host, port) != 0;
+    }
+
+    /** Start an outgoing packet to the sender of the last received packet. */
+    bool beginReply() {
+      return mUdp.beginPacket(mUdp.remoteIP(), mUdp.remotePort()) != 0;
+    }
+
+    /** Append `size` bytes to the outgoing packet. */
+    size_t write(const uint8_t* buf, size_t size) {
+      return mUdp.write(buf, size);
+    }
+
+    /** Send the outgoing packet. */
+    bool endPacket() { return mUdp.endPacket() != 0; }
+
+  private:
+    WiFiUDP mUdp;
+};
+
+}
+}
+
+#endif
+
+#endif
@@ -0,0 +1,259 @@
+/*
+ * MIT License
+ * Copyright (c) 2022 Brian T. Park
+ */
+
+#ifndef ACE_TIME_CLOCK_SIMULATOR_H
+#define ACE_TIME_CLOCK_SIMULATOR_H
+
+#if defined(EPOXY_DUINO)
+
+#include <stdint.h>
+#include <math.h> // sqrt()
+#include <Print.h>
+#include "TestableClockInterface.h"
+#include "TestableSystemClockLoop.h"
+#include "SimulatedOscillator.h"
+#include "SimulatedReferenceClock.h"
+
+// activate the SystemClockCoroutine support only if <AceRoutine.h> is
+// included before this header
+#if defined(ACE_ROUTINE_VERSION)
+  #include "TestableSystemClockCoroutine.h"
+#endif
+
+namespace ace_time {
+namespace testing {
+
+/** Run one iteration of a TestableSystemClockLoop. */
+inline void runSystemClock(TestableSystemClockLoop& systemClock) {
+  systemClock.loop();
+}
+
+#if defined(ACE_ROUTINE_VERSION)
+/** Run one iteration of a TestableSystemClockCoroutine. */
+inline void runSystemClock(TestableSystemClockCoroutine& systemClock) {
+  systemClock.runCoroutine();
+}
+#endif
+
+/** Summary of the error of the SystemClock over a simulation. */
+struct SimulationResult {
+  /** Simulated seconds since the start of the simulation. */
+  uint32_t elapsedSeconds;
+
+  /** Number of error samples taken while the SystemClock was initialized. */
+  uint32_t numSamples;
+
+  /** Seconds until the first successful sync, or UINT32_MAX. */
+  uint32_t firstSyncSeconds;
+
+  /** Number of requests sent to the reference clock. */
+  uint32_t requestCount;
+
+  /** Number of successful syncs with the reference clock. */
+  uint32_t syncCount;
+
+  /** Error (SystemClock - true time) of the last sample in millis. */
+  int32_t lastErrorMillis;
+
+  /** Max absolute error of all samples in millis. */
+  int32_t maxAbsErrorMillis;
+
+  /** Root mean square error of all samples in millis. */
+  float rmsErrorMillis;
+};
+
+/**
+ * A deterministic discrete-event simulator which runs a
+ * TestableSystemClockLoop or a TestableSystemClockCoroutine against a
+ * SimulatedOscillator and an optional SimulatedReferenceClock on virtual time.
+ * Days of operation can be simulated in a few seconds of host time, so
+ * changes to the sync algorithm can be evaluated without waiting in real time
+ * or stepping TestableClockInterface::setMillis() manually.
+ *
+ * At each step, the true time is advanced, the oscillator converts it into
+ * the local millis() of TestableClockInterface, and the SystemClock is run
+ * once. The step is `stepMillis` normally, and 1 millisecond for a few seconds
+ * after each request to the reference clock, so that the latency of the
+ * response is resolved accurately. Every `sampleIntervalSeconds`, the error of
+ * SystemClock::getNowMillis() against the true time is sampled, and written
+ * as a CSV line `seconds,errorMillis,syncCount` to the optional Print
+ * output.
+ *
+ * The results depend only on the parameters of the simulation (including the
+ * seed of the reference clock), so a recorded trace of oscillator ppm and
+ * network latencies replays identically across runs.
+ *
+ * Since TestableClockInterface is a static class, only a single simulation
+ * can run at a time.
+ *
+ * @tparam T_CLOCK TestableSystemClockLoop or TestableSystemClockCoroutine
+ */
+template <typename T_CLOCK>
+class ClockSimulator {
+  public:
+    /** Duration of the 1 millisecond steps after a request. */
+    static const uint32_t kFineWindowMillis = 3000;
+
+    /**
+     * Constructor.
+     * @param systemClock the clock under test, whose referenceClock should be
+     *    `referenceClock`
+     * @param oscillator model of the local oscillator
+     * @param referenceClock simulated reference clock (nullable)
+     * @param startSeconds true epochSeconds at the start of the simulation
+     * @param stepMillis normal step of the simulation (default 100)
+     */
+    ClockSimulator(
+        T_CLOCK& systemClock,
+        SimulatedOscillator& oscillator,
+        SimulatedReferenceClock* referenceClock /* nullable */,
+        acetime_t startSeconds,
+        uint16_t stepMillis = 100
+    ) :
+        mSystemClock(systemClock),
+        mOscillator(oscillator),
+        mReferenceClock(referenceClock),
+        mStartSeconds(startSeconds),
+        mStepMicros((uint32_t) stepMillis * 1000)
+    {}
+
+    /** Write a CSV line for every sample to `printer` (nullable). */
+    void setOutput(Print* printer) { mPrinter = printer; }
+
+    /**
+     * Reset the virtual time, then call SystemClock::setup(). Must be called
+     * before run().
+     */
+    void setup() {
+      mElapsedMicros = 0;
+      mFineUntilMicros = 0;
+      mNextSampleSeconds = 0;
+      mLastRequestCount = 0;
+      mSumSquares = 0.0;
+      mResult = SimulationResult{0, 0, UINT32_MAX, 0, 0, 0, 0, 0.0};
+      mOscillator.reset();
+      updateClocks();
+      mSystemClock.setup();
+    }
+
+    /**
+     * Advance the virtual time by `durationSeconds`, sampling the error every
+     * `sampleIntervalSeconds`. Can be called multiple times to continue the
+     * simulation, e.g. to change the conditions in between.
+     */
+    const SimulationResult& run(
+        uint32_t durationSeconds, uint32_t sampleIntervalSeconds = 60) {
+      uint64_t endMicros = mElapsedMicros + durationSeconds * (uint64_t) 1000000;
+      while (mElapsedMicros < endMicros) {
+        uint32_t stepMicros = (mElapsedMicros < mFineUntilMicros)
+            ? 1000 : mStepMicros;
+        mOscillator.advance(mElapsedMicros / 1e6, stepMicros);
+        mElapsedMicros += stepMicros;
+        updateClocks();
+        runSystemClock(mSystemClock);
+        checkRequests();
+
+        uint32_t elapsedSeconds = (uint32_t) (mElapsedMicros / 1000000);
+        if (elapsedSeconds >= mNextSampleSeconds) {
+          sample(elapsedSeconds);
+          mNextSampleSeconds = elapsedSeconds + sampleIntervalSeconds;
+        }
+      }
+      mResult.elapsedSeconds = (uint32_t) (mElapsedMicros / 1000000);
+      return mResult;
+    }
+
+    /** Return the results accumulated since setup(). */
+    const SimulationResult& getResult() const { return mResult; }
+
+    /** Return the true micros since the start of the simulation. */
+    uint64_t getElapsedMicros() const { return mElapsedMicros; }
+
+    /**
+     * Return the current error of the SystemClock against the true time in
+     * millis. Valid only if the SystemClock is initialized.
+     */
+    int32_t errorMillis() const {
+      uint16_t millis;
+      acetime_t seconds = mSystemClock.getNowMillis(&millis);
+      int64_t trueMillis = mElapsedMicros / 1000;
+      int64_t clockMillis = (int64_t) (seconds - mStartSeconds) * 1000 + millis;
+      return (int32_t) (clockMillis - trueMillis);
+    }
+
+  private:
+    /** Propagate the virtual time to the local millis and reference clock. */
+    void updateClocks() {
+      TestableClockInterface::setMillis(mOscillator.localMillis());
+      if (mReferenceClock) {
+        mReferenceClock->setTrueTime(mStartSeconds, mElapsedMicros);
+      }
+    }
+
+    /** Switch to fine steps after a new request, and count the syncs. */
+    void checkRequests() {
+      if (mReferenceClock == nullptr) return;
+
+      uint32_t requestCount = mReferenceClock->getRequestCount();
+      if (requestCount != mLastRequestCount) {
+        mLastRequestCount = requestCount;
+        mFineUntilMicros = mElapsedMicros + kFineWindowMillis * 1000;
+      }
+      mResult.requestCount = requestCount;
+
+      uint32_t syncCount = mReferenceClock->getResponseCount();
+      if (syncCount != mResult.syncCount) {
+        mResult.syncCount = syncCount;
+        if (mResult.firstSyncSeconds == UINT32_MAX) {
+          mResult.firstSyncSeconds = (uint32_t) (mElapsedMicros / 1000000);
+        }
+      }
+    }
+
+    /** Sample the error if the SystemClock is initialized. */
+    void sample(uint32_t elapsedSeconds) {
+      if (! mSystemClock.isInit()) return;
+
+      int32_t error = errorMillis();
+      int32_t absError = (error < 0) ? -error : error;
+      mResult.numSamples++;
+      mResult.lastErrorMillis = error;
+      if (absError > mResult.maxAbsErrorMillis) {
+        mResult.maxAbsErrorMillis = absError;
+      }
+      mSumSquares += (double) error * error;
+      mResult.rmsErrorMillis = sqrt(mSumSquares / mResult.numSamples);
+
+      if (mPrinter) {
+        mPrinter->print(elapsedSeconds);
+        mPrinter->print(',');
+        mPrinter->print(error);
+        mPrinter->print(',');
+        mPrinter->println(mResult.syncCount);
+      }
+    }
+
+  private:
+    T_CLOCK& mSystemClock;
+    SimulatedOscillator& mOscillator;
+    SimulatedReferenceClock* const mReferenceClock;
+    Print* mPrinter = nullptr;
+    acetime_t const mStartSeconds;
+    uint32_t const mStepMicros;
+
+    uint64_t mElapsedMicros = 0;
+    uint64_t mFineUntilMicros = 0;
+    uint32_t mNextSampleSeconds = 0;
+    uint32_t mLastRequestCount = 0;
+    double mSumSquares = 0.0;
+    SimulationResult mResult;
+};
+
+}
+}
+
+#endif // #if defined(EPOXY_DUINO)
+
+#endif
@@ -19,22 +19,77 @@ class FakeClock: public clock::Clock {
 
     void init() {
       mEpochSeconds = 0;
+      mMillis = kUnknownMillis;
       mIsResponseReady = false;
+      mLeapIndicator = kLeapIndicatorNone;
     }
 
+  #if ACE_TIME_CLOCK_SECONDS64
+    void setNow(acetime_t epochSeconds) override {
+      mEpochSeconds = toSeconds64(epochSeconds);
+    }
+
+    acetime_t getNow() const override { return toSeconds32(mEpochSeconds); }
+
+    acetime_t getNowMillis(uint16_t* millis) const override {
+      *millis = mMillis;
+      return getNow();
+    }
+
+    void setNow64(int64_t epochSeconds) override {
+      mEpochSeconds = epochSeconds;
+    }
+
+    int64_t getNow64() const override { return mEpochSeconds; }
+
+    int64_t getNowMillis64(uint16_t* millis) const override {
+      *millis = mMillis;
+      return mEpochSeconds;
+    }
+
+    int64_t readResponse64() const override { return mEpochSeconds; }
+
+    int64_t readResponseMillis64(uint16_t* millis) const override {
+      return getNowMillis64(millis);
+    }
+  #else
     void setNow(acetime_t epochSeconds) override {
       mEpochSeconds = epochSeconds;
     }
 
     acetime_t getNow() const override { return mEpochSeconds; }
 
+    acetime_t getNowMillis(uint16_t* millis) const override {
+      *millis = mMillis;
+      return mEpochSeconds;
+    }
+  #endif
+
+    acetime_t readResponseMillis(uint16_t* millis) const override {
+      return getNowMillis(millis);
+    }
+
+    /** Set the sub-second millis returned by getNowMillis(). */
+    void setMillis(uint16_t millis) { mMillis = millis; }
+
     bool isResponseReady() const override { return mIsResponseReady; }
 
     void isResponseReady(bool ready) { mIsResponseReady = ready; }
 
+    uint8_t getLeapIndicator() const override { return mLeapIndicator; }
+
+    /** Set the leap indicator returned by getLeapIndicator(). */
+    void setLeapIndicator(uint8_t indicator) { mLeapIndicator = indicator; }
+
   private:
+  #if ACE_TIME_CLOCK_SECONDS64
+    int64_t mEpochSeconds;
+  #else
     acetime_t mEpochSeconds;
+  #endif
+    uint16_t mMillis;
     bool mIsResponseReady;
+    uint8_t mLeapIndicator;
 };
 
 }
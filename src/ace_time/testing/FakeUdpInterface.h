@@ -0,0 +1,120 @@
+/*
+ * MIT License
+ * Copyright (c) 2022 Brian T. Park
+ */
+
+#ifndef ACE_TIME_FAKE_UDP_INTERFACE_H
+#define ACE_TIME_FAKE_UDP_INTERFACE_H
+
+#include <stdint.h>
+#include <string.h> // memcpy()
+
+namespace ace_time {
+namespace testing {
+
+/**
+ * An implementation of the UDP transport interface used by `NtpClockTemplate`
+ * whose network connection and incoming packets are controlled by the test.
+ * Calls to connect(), begin() and endPacket() are counted so that the test can
+ * verify the behavior of the connection state machine.
+ */
+class FakeUdpInterface {
+  public:
+    /** Size of the incoming and outgoing packet buffers. */
+    static const uint8_t kBufferSize = 48;
+
+    void connect(const char* /*ssid*/, const char* /*password*/) {
+      mConnectCount++;
+    }
+
+    bool isConnected() const { return mIsConnected; }
+
+    bool begin(uint16_t /*localPort*/) {
+      mBeginCount++;
+      mIsOpen = true;
+      return true;
+    }
+
+    void stop() { mIsOpen = false; }
+
+    int parsePacket() {
+      int size = mRxSize;
+      mRxPos = 0;
+      mRxSize = 0;
+      mRxAvailable = size;
+      return size;
+    }
+
+    int read(uint8_t* buf, size_t size) {
+      if (size > (size_t) (mRxAvailable - mRxPos)) size = mRxAvailable - mRxPos;
+      memcpy(buf, mRxBuffer + mRxPos, size);
+      mRxPos += size;
+      return size;
+    }
+
+    bool beginPacket(const char* /*host*/, uint16_t /*port*/) {
+      mTxSize = 0;
+      return true;
+    }
+
+    bool beginReply() {
+      mTxSize = 0;
+      return true;
+    }
+
+    size_t write(const uint8_t* buf, size_t size) {
+      if (size > (size_t) (kBufferSize - mTxSize)) size = kBufferSize - mTxSize;
+      memcpy(mTxBuffer + mTxSize, buf, size);
+      mTxSize += size;
+      return size;
+    }
+
+    bool endPacket() {
+      mSentCount++;
+      return true;
+    }
+
+    //-----------------------------------------------------------------------
+    // Methods used by the test.
+    //-----------------------------------------------------------------------
+
+    /** Set the state of the simulated network connection. */
+    void isConnected(bool connected) { mIsConnected = connected; }
+
+    /** Return true if the socket is open. */
+    bool isOpen() const { return mIsOpen; }
+
+    /** Queue an incoming packet, replacing any unread packet. */
+    void setIncomingPacket(const uint8_t* buf, uint8_t size) {
+      if (size > kBufferSize) size = kBufferSize;
+      memcpy(mRxBuffer, buf, size);
+      mRxSize = size;
+    }
+
+    /** Return the last packet sent by endPacket(). */
+    const uint8_t* getSentPacket() const { return mTxBuffer; }
+
+    uint16_t getConnectCount() const { return mConnectCount; }
+    uint16_t getBeginCount() const { return mBeginCount; }
+    uint16_t getSentCount() const { return mSentCount; }
+
+  private:
+    bool mIsConnected = false;
+    bool mIsOpen = false;
+    uint16_t mConnectCount = 0;
+    uint16_t mBeginCount = 0;
+    uint16_t mSentCount = 0;
+
+    uint8_t mRxBuffer[kBufferSize];
+    uint8_t mRxSize = 0;
+    uint8_t mRxAvailable = 0;
+    uint8_t mRxPos = 0;
+
+    uint8_t mTxBuffer[kBufferSize];
+    uint8_t mTxSize = 0;
+};
+
+}
+}
+
+#endif
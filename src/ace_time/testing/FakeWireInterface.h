@@ -0,0 +1,79 @@
+/*
+ * MIT License
+ * Copyright (c) 2022 Brian T. Park
+ */
+
+#ifndef ACE_TIME_FAKE_WIRE_INTERFACE_H
+#define ACE_TIME_FAKE_WIRE_INTERFACE_H
+
+#include <stdint.h>
+
+namespace ace_time {
+namespace testing {
+
+/**
+ * An implementation of the AceWire interface (e.g.
+ * ace_wire::SimpleWireInterface) which reads and writes an array of registers
+ * in memory instead of an I2C device, for testing and benchmarking
+ * hw::DS3231 and DS3231Clock without the hardware.
+ *
+ * The first byte written after beginTransmission() sets the register pointer,
+ * and subsequent bytes are written to consecutive registers, like most I2C
+ * RTC chips. read() returns consecutive registers from the register pointer.
+ * The device address is ignored.
+ *
+ * The register array is owned by the caller, so that the copies of this
+ * object held by hw::DS3231 share the same registers. The methods are const
+ * because the AceWire interface objects are held as const members.
+ */
+class FakeWireInterface {
+  public:
+    /**
+     * Constructor.
+     * @param registers array of registers emulating the device
+     * @param numRegisters size of the array
+     */
+    FakeWireInterface(uint8_t* registers, uint8_t numRegisters) :
+        mRegisters(registers),
+        mNumRegisters(numRegisters)
+    {}
+
+    void begin() const {}
+
+    void beginTransmission(uint8_t /*addr*/) const {
+      mIsAddressPending = true;
+    }
+
+    uint8_t write(uint8_t data) const {
+      if (mIsAddressPending) {
+        mPointer = data;
+        mIsAddressPending = false;
+      } else {
+        if (mPointer < mNumRegisters) mRegisters[mPointer] = data;
+        mPointer++;
+      }
+      return 1;
+    }
+
+    uint8_t endTransmission(bool /*sendStop*/ = true) const { return 0; }
+
+    uint8_t requestFrom(
+        uint8_t /*addr*/, uint8_t quantity, bool /*sendStop*/ = true) const {
+      return quantity;
+    }
+
+    uint8_t read() const {
+      return (mPointer < mNumRegisters) ? mRegisters[mPointer++] : 0;
+    }
+
+  private:
+    uint8_t* const mRegisters;
+    uint8_t const mNumRegisters;
+    mutable uint8_t mPointer = 0;
+    mutable bool mIsAddressPending = false;
+};
+
+}
+}
+
+#endif
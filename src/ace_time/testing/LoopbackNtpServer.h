@@ -0,0 +1,223 @@
+/*
+ * MIT License
+ * Copyright (c) 2022 Brian T. Park
+ */
+
+#ifndef ACE_TIME_LOOPBACK_NTP_SERVER_H
+#define ACE_TIME_LOOPBACK_NTP_SERVER_H
+
+#if defined(EPOXY_DUINO)
+
+#include <stdint.h>
+#include <string.h> // memcpy(), memset()
+#include <Arduino.h> // millis()
+#include "../hw/PosixUdpInterface.h"
+#include "../clock/NtpPacket.h"
+#include "../clock/NtpClock.h"
+
+namespace ace_time {
+namespace testing {
+
+/**
+ * A minimal stand-in for an NTP server listening on the loopback interface,
+ * used for testing `NtpClockTemplate<hw::PosixUdpInterface>` on a Linux or
+ * MacOS host without touching the network. It answers every valid client
+ * request with a stratum 1 server response containing the time given by
+ * setNow().
+ *
+ * Network conditions can be simulated by delaying each response by a fixed
+ * number of millis, dropping a percentage of the requests, and advertising a
+ * root delay.
+ *
+ * The server is single-threaded. The caller must call loop() to process
+ * pending requests, between the client's sendRequest() and
+ * isResponseReady().
+ */
+class LoopbackNtpServer {
+  public:
+    /** Size of an NTP packet without extension fields. */
+    static const uint8_t kNtpPacketSize = clock::NtpPacket::kSize;
+
+    /** Maximum number of delayed responses waiting to be sent. */
+    static const uint8_t kMaxPending = 8;
+
+    /**
+     * Constructor.
+     * @param bindAddress loopback address of the server (default
+     *    "127.0.0.1"). On Linux, any address in 127.0.0.0/8 can be used to run
+     *    several servers on the same port.
+     */
+    explicit LoopbackNtpServer(const char* bindAddress = "127.0.0.1") :
+        mUdp(bindAddress)
+    {}
+
+    /**
+     * Open the server socket on the loopback interface. If `port` is 0, the
+     * operating system selects an ephemeral port, which can be retrieved
+     * using getPort().
+     */
+    bool setup(uint16_t port = 0) {
+      mRequestCount = 0;
+      mNumPending = 0;
+      return mUdp.begin(port);
+    }
+
+    /** Return the UDP port of the server. */
+    uint16_t getPort() const { return mUdp.localPort(); }
+
+    /** Set the time returned in the responses. */
+    void setNow(acetime_t epochSeconds) {
+      mNtpSeconds = clock::NtpClockTemplate<hw::PosixUdpInterface>
+          ::convertAceTimeSecondsToNtpSeconds(epochSeconds);
+    }
+
+    /** Delay each response by the given number of millis (default 0). */
+    void setResponseDelayMillis(uint16_t millis) {
+      mResponseDelayMillis = millis;
+    }
+
+    /** Drop the given percentage (0-100) of requests (default 0). */
+    void setDropPercent(uint8_t percent) { mDropPercent = percent; }
+
+    /** Set the root delay advertised in the responses (default 0). */
+    void setRootDelayMillis(uint16_t millis) { mRootDelayMillis = millis; }
+
+    /** Set the seed of the pseudo-random generator used for drops. */
+    void setSeed(uint32_t seed) { mRandom = seed ? seed : 1; }
+
+    /** Return the number of delayed responses waiting to be sent. */
+    uint8_t getNumPending() const { return mNumPending; }
+
+    /** Return the number of requests answered so far. */
+    uint32_t getRequestCount() const { return mRequestCount; }
+
+    /**
+     * Receive all pending requests, and send the responses whose delay has
+     * elapsed. Return the number of responses sent in this call.
+     */
+    uint16_t loop() {
+      uint16_t nowMillis = millis();
+      uint16_t count = 0;
+
+      while (mUdp.parsePacket() > 0) {
+        uint8_t packet[kNtpPacketSize];
+        if (mUdp.read(packet, kNtpPacketSize) < kNtpPacketSize) continue;
+
+        // Only mode 3 (client) requests are answered.
+        if (clock::NtpPacket::mode(packet) != clock::NtpPacket::kModeClient) {
+          continue;
+        }
+        if (nextRandom() % 100 < mDropPercent) continue;
+
+        fillResponse(packet);
+        if (mResponseDelayMillis == 0) {
+          sendResponse(packet);
+          count++;
+        } else if (mNumPending < kMaxPending) {
+          // If the queue is full, the request is dropped.
+          Pending& pending = mPending[mNumPending++];
+          memcpy(pending.packet, packet, kNtpPacketSize);
+          pending.address = mUdp.remoteAddress();
+          pending.port = mUdp.remotePort();
+          pending.receivedMillis = nowMillis;
+        }
+      }
+
+      uint8_t i = 0;
+      while (i < mNumPending) {
+        Pending& pending = mPending[i];
+        if ((uint16_t) (nowMillis - pending.receivedMillis)
+            < mResponseDelayMillis) {
+          i++;
+          continue;
+        }
+        mUdp.beginPacket(pending.address, pending.port);
+        mUdp.write(pending.packet, kNtpPacketSize);
+        mUdp.endPacket();
+        count++;
+        mPending[i] = mPending[--mNumPending];
+      }
+
+      mRequestCount += count;
+      return count;
+    }
+
+  private:
+    /** A response waiting for its delay to elapse. */
+    struct Pending {
+      uint8_t packet[kNtpPacketSize];
+      uint32_t address;
+      uint16_t port;
+      uint16_t receivedMillis;
+    };
+
+    /** Send the response to the sender of the current request. */
+    void sendResponse(const uint8_t packet[]) {
+      mUdp.beginReply();
+      mUdp.write(packet, kNtpPacketSize);
+      mUdp.endPacket();
+    }
+
+    /**
+     * Convert the client request in `packet` into the server response in
+     * place. The transmit timestamp of the request is copied into the
+     * originate timestamp of the response.
+     */
+    void fillResponse(uint8_t packet[]) const {
+      using clock::NtpPacket;
+
+      uint8_t version = NtpPacket::version(packet);
+      memcpy(&packet[NtpPacket::kOffsetOriginateTimestamp],
+          &packet[NtpPacket::kOffsetTransmitTimestamp], 8);
+      memset(packet, 0, NtpPacket::kOffsetOriginateTimestamp);
+
+      // LI=0, VN=version, Mode=4 (server)
+      packet[0] = (version << 3) | NtpPacket::kModeServer;
+      packet[1] = 1; // stratum
+      packet[2] = 6; // poll
+      packet[3] = 0xEC; // precision
+      NtpPacket::writeUint32(&packet[NtpPacket::kOffsetRootDelay],
+          ((uint32_t) mRootDelayMillis << 16) / 1000);
+      packet[12] = 'L'; // reference identifier
+      packet[13] = 'O';
+      packet[14] = 'C';
+      packet[15] = 'L';
+
+      writeTimestamp(&packet[NtpPacket::kOffsetReferenceTimestamp]);
+      writeTimestamp(&packet[NtpPacket::kOffsetReceiveTimestamp]);
+      writeTimestamp(&packet[NtpPacket::kOffsetTransmitTimestamp]);
+    }
+
+    /** Write mNtpSeconds in big-endian order, with 0 fraction. */
+    void writeTimestamp(uint8_t* p) const {
+      clock::NtpPacket::writeUint32(p, mNtpSeconds);
+      clock::NtpPacket::writeUint32(p + 4, 0);
+    }
+
+    /** Return the next value of a xorshift32 generator. */
+    uint32_t nextRandom() {
+      mRandom ^= mRandom << 13;
+      mRandom ^= mRandom >> 17;
+      mRandom ^= mRandom << 5;
+      return mRandom;
+    }
+
+  private:
+    hw::PosixUdpInterface mUdp;
+    uint32_t mNtpSeconds = 0;
+    uint32_t mRequestCount = 0;
+    uint32_t mRandom = 1;
+    uint16_t mResponseDelayMillis = 0;
+    uint16_t mRootDelayMillis = 0;
+    uint8_t mDropPercent = 0;
+
+    Pending mPending[kMaxPending];
+    uint8_t mNumPending = 0;
+};
+
+}
+}
+
+#endif
+
+#endif
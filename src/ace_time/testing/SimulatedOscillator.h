@@ -0,0 +1,117 @@
+/*
+ * MIT License
+ * Copyright (c) 2022 Brian T. Park
+ */
+
+#ifndef ACE_TIME_SIMULATED_OSCILLATOR_H
+#define ACE_TIME_SIMULATED_OSCILLATOR_H
+
+#if defined(EPOXY_DUINO)
+
+#include <stdint.h>
+#include <math.h> // sin()
+
+namespace ace_time {
+namespace testing {
+
+/**
+ * A model of the local oscillator of a microcontroller, used by ClockSimulator
+ * to convert the true (virtual) elapsed time into the local millis() seen by
+ * the SystemClock. The frequency error in parts per million is the sum of:
+ *
+ *  * a constant drift (e.g. +20 ppm for a typical ceramic resonator),
+ *  * a sinusoidal temperature wander with the given amplitude and period
+ *    (e.g. 5 ppm over 86400 seconds for a day/night cycle),
+ *  * an optional recorded trace of ppm samples taken every
+ *    `intervalSeconds`, which is replayed in a loop. The trace can be
+ *    captured in the field by comparing millis() against a good reference.
+ *
+ * A positive ppm means that the local clock runs fast. The local time is
+ * accumulated in floating point micros, so there is no rounding drift even
+ * when the simulator advances the time in small steps.
+ */
+class SimulatedOscillator {
+  public:
+    /**
+     * Constructor.
+     * @param driftPpm constant frequency error in ppm
+     * @param wanderPpm amplitude of the sinusoidal temperature wander in ppm
+     * @param wanderPeriodSeconds period of the temperature wander
+     */
+    explicit SimulatedOscillator(
+        float driftPpm = 0.0,
+        float wanderPpm = 0.0,
+        uint32_t wanderPeriodSeconds = 86400
+    ) :
+        mDriftPpm(driftPpm),
+        mWanderPpm(wanderPpm),
+        mWanderPeriodSeconds(wanderPeriodSeconds)
+    {}
+
+    /**
+     * Replay a recorded trace of ppm errors, added to the constant drift and
+     * the wander. The array is not copied, so it must outlive this object.
+     * Pass nullptr to clear the trace.
+     */
+    void setPpmTrace(
+        const float* ppms, uint16_t numSamples, uint32_t intervalSeconds) {
+      mPpmTrace = ppms;
+      mPpmTraceSize = numSamples;
+      mPpmTraceIntervalSeconds = intervalSeconds;
+    }
+
+    /** Reset the local time to 0. */
+    void reset() { mLocalMicros = 0.0; }
+
+    /** Return the frequency error in ppm at the given true time. */
+    double ppmAt(double trueSeconds) const {
+      double ppm = mDriftPpm;
+      if (mWanderPpm != 0 && mWanderPeriodSeconds != 0) {
+        ppm += mWanderPpm * sin(2 * M_PI * trueSeconds / mWanderPeriodSeconds);
+      }
+      if (mPpmTrace != nullptr && mPpmTraceSize > 0
+          && mPpmTraceIntervalSeconds > 0) {
+        uint32_t index = (uint32_t) (trueSeconds / mPpmTraceIntervalSeconds);
+        ppm += mPpmTrace[index % mPpmTraceSize];
+      }
+      return ppm;
+    }
+
+    /**
+     * Advance the oscillator by `trueMicros`, starting at `trueSeconds`.
+     * The ppm is evaluated once per step, so the step should be short
+     * compared to the wander period and the trace interval.
+     */
+    void advance(double trueSeconds, uint32_t trueMicros) {
+      mLocalMicros += trueMicros * (1.0 + ppmAt(trueSeconds) * 1e-6);
+    }
+
+    /** Return the elapsed local time in micros. */
+    double localMicros() const { return mLocalMicros; }
+
+    /**
+     * Return the local millis(), truncated to 32 bits to reproduce the
+     * rollover of millis() every 49.7 days on the microcontroller.
+     */
+    uint32_t localMillis() const {
+      return (uint32_t) (uint64_t) (mLocalMicros / 1000);
+    }
+
+  private:
+    float const mDriftPpm;
+    float const mWanderPpm;
+    uint32_t const mWanderPeriodSeconds;
+
+    const float* mPpmTrace = nullptr;
+    uint16_t mPpmTraceSize = 0;
+    uint32_t mPpmTraceIntervalSeconds = 0;
+
+    double mLocalMicros = 0.0;
+};
+
+}
+}
+
+#endif // #if defined(EPOXY_DUINO)
+
+#endif
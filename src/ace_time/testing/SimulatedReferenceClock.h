@@ -0,0 +1,224 @@
+/*
+ * MIT License
+ * Copyright (c) 2022 Brian T. Park
+ */
+
+#ifndef ACE_TIME_SIMULATED_REFERENCE_CLOCK_H
+#define ACE_TIME_SIMULATED_REFERENCE_CLOCK_H
+
+#if defined(EPOXY_DUINO)
+
+#include <stdint.h>
+#include "../clock/Clock.h"
+
+namespace ace_time {
+namespace testing {
+
+/**
+ * A reference clock (e.g. an NtpClock or a DS3231Clock) driven by the virtual
+ * time of ClockSimulator. It implements the non-blocking Clock API used by
+ * SystemClockLoop and SystemClockCoroutine, and models the following network
+ * conditions:
+ *
+ *  * latency: each response becomes ready after a latency drawn uniformly
+ *    from [minLatencyMillis, maxLatencyMillis], using a deterministic
+ *    pseudo-random generator seeded by setSeed()
+ *  * loss: a percentage of the requests never receive a response
+ *  * outages: up to kMaxOutages windows of simulated time during which all
+ *    requests are lost
+ *  * latency trace: a recorded sequence of latencies replayed in a loop,
+ *    instead of the random latencies (a negative entry is a lost request)
+ *
+ * The returned timestamp is the true time when the response becomes ready,
+ * minus `lagPercent` of the latency. A lag of 0 models a reference which
+ * compensates perfectly for the network delay (e.g. NTP over a symmetric
+ * path), a lag of 50 models a reference which stamps the time when it
+ * receives the request, without compensation. If millis resolution is
+ * disabled, the timestamp is truncated to whole seconds and readResponseMillis()
+ * returns kUnknownMillis, like a DS3231 RTC.
+ */
+class SimulatedReferenceClock: public clock::Clock {
+  public:
+    /** Max number of outage windows. */
+    static const uint8_t kMaxOutages = 4;
+
+    /** Constructor. */
+    explicit SimulatedReferenceClock(
+        uint16_t minLatencyMillis = 0,
+        uint16_t maxLatencyMillis = 0,
+        uint8_t lossPercent = 0
+    ) :
+        mMinLatencyMillis(minLatencyMillis),
+        mMaxLatencyMillis(maxLatencyMillis),
+        mLossPercent(lossPercent)
+    {}
+
+    /** Set the seed of the pseudo-random generator. Must not be 0. */
+    void setSeed(uint32_t seed) { mRandom = seed ? seed : 1; }
+
+    /** Set the percentage of the latency subtracted from the timestamp. */
+    void setLagPercent(uint8_t lagPercent) { mLagPercent = lagPercent; }
+
+    /** Return millis in readResponseMillis() (default true). */
+    void setMillisResolution(bool enable) { mMillisResolution = enable; }
+
+    /**
+     * Replay a recorded sequence of latencies in millis, instead of the
+     * random latencies. A negative entry indicates a lost request. The array
+     * is not copied. Pass nullptr to clear the trace.
+     */
+    void setLatencyTrace(const int16_t* latencies, uint16_t numSamples) {
+      mLatencyTrace = latencies;
+      mLatencyTraceSize = numSamples;
+      mLatencyTraceIndex = 0;
+    }
+
+    /**
+     * Add an outage window of simulated time [startSeconds, endSeconds),
+     * relative to the start of the simulation. Returns false if there are
+     * already kMaxOutages windows.
+     */
+    bool addOutage(uint32_t startSeconds, uint32_t endSeconds) {
+      if (mNumOutages >= kMaxOutages) return false;
+      mOutages[mNumOutages].startSeconds = startSeconds;
+      mOutages[mNumOutages].endSeconds = endSeconds;
+      mNumOutages++;
+      return true;
+    }
+
+    /**
+     * Set the current true time. Called by ClockSimulator at every step.
+     * @param startSeconds true epochSeconds at the start of the simulation
+     * @param elapsedMicros true micros since the start of the simulation
+     */
+    void setTrueTime(acetime_t startSeconds, uint64_t elapsedMicros) {
+      mStartSeconds = startSeconds;
+      mElapsedMicros = elapsedMicros;
+    }
+
+    acetime_t getNow() const override {
+      return toEpochSeconds(mElapsedMicros, nullptr);
+    }
+
+    acetime_t getNowMillis(uint16_t* millis) const override {
+      return toEpochSeconds(mElapsedMicros, millis);
+    }
+
+    void sendRequest() const override {
+      mRequestCount++;
+      mRequestMicros = mElapsedMicros;
+      mIsResponseRead = false;
+
+      int32_t latencyMillis = nextLatencyMillis();
+      mIsLost = latencyMillis < 0 || isOutage(mElapsedMicros);
+      mLatencyMicros = (latencyMillis < 0) ? 0 : latencyMillis * 1000;
+    }
+
+    bool isResponseReady() const override {
+      if (mRequestCount == 0 || mIsLost || mIsResponseRead) return false;
+      return mElapsedMicros - mRequestMicros >= mLatencyMicros;
+    }
+
+    acetime_t readResponse() const override {
+      uint16_t millis;
+      return readResponseMillis(&millis);
+    }
+
+    acetime_t readResponseMillis(uint16_t* millis) const override {
+      mIsResponseRead = true;
+      mResponseCount++;
+      uint64_t lagMicros = mLatencyMicros * mLagPercent / 100;
+      uint64_t stampMicros = mRequestMicros + mLatencyMicros - lagMicros;
+      return toEpochSeconds(stampMicros, millis);
+    }
+
+    /** Number of requests received. */
+    uint32_t getRequestCount() const { return mRequestCount; }
+
+    /** Number of responses read by the client. */
+    uint32_t getResponseCount() const { return mResponseCount; }
+
+  private:
+    struct Outage {
+      uint32_t startSeconds;
+      uint32_t endSeconds;
+    };
+
+    /**
+     * Convert the elapsed micros to epochSeconds and millis. If millis
+     * resolution is disabled, `*millis` is set to kUnknownMillis.
+     */
+    acetime_t toEpochSeconds(uint64_t elapsedMicros, uint16_t* millis) const {
+      if (millis) {
+        *millis = mMillisResolution
+            ? (uint16_t) (elapsedMicros / 1000 % 1000)
+            : kUnknownMillis;
+      }
+      return mStartSeconds + (acetime_t) (elapsedMicros / 1000000);
+    }
+
+    /** Return true if the given time is inside an outage window. */
+    bool isOutage(uint64_t elapsedMicros) const {
+      uint32_t seconds = (uint32_t) (elapsedMicros / 1000000);
+      for (uint8_t i = 0; i < mNumOutages; i++) {
+        if (mOutages[i].startSeconds <= seconds
+            && seconds < mOutages[i].endSeconds) {
+          return true;
+        }
+      }
+      return false;
+    }
+
+    /** Return the latency of the next request, or -1 if it is lost. */
+    int32_t nextLatencyMillis() const {
+      if (mLatencyTrace != nullptr && mLatencyTraceSize > 0) {
+        int16_t latency = mLatencyTrace[mLatencyTraceIndex];
+        mLatencyTraceIndex = (mLatencyTraceIndex + 1) % mLatencyTraceSize;
+        return latency;
+      }
+
+      if (mLossPercent > 0 && nextRandom() % 100 < mLossPercent) return -1;
+      uint16_t range = mMaxLatencyMillis - mMinLatencyMillis;
+      return mMinLatencyMillis + ((range == 0) ? 0 : nextRandom() % (range + 1));
+    }
+
+    /** Xorshift32 pseudo-random generator, deterministic for a given seed. */
+    uint32_t nextRandom() const {
+      mRandom ^= mRandom << 13;
+      mRandom ^= mRandom >> 17;
+      mRandom ^= mRandom << 5;
+      return mRandom;
+    }
+
+    uint16_t const mMinLatencyMillis;
+    uint16_t const mMaxLatencyMillis;
+    uint8_t const mLossPercent;
+    uint8_t mLagPercent = 0;
+    bool mMillisResolution = true;
+
+    Outage mOutages[kMaxOutages];
+    uint8_t mNumOutages = 0;
+
+    const int16_t* mLatencyTrace = nullptr;
+    uint16_t mLatencyTraceSize = 0;
+    mutable uint16_t mLatencyTraceIndex = 0;
+
+    acetime_t mStartSeconds = 0;
+    uint64_t mElapsedMicros = 0;
+
+    // The Clock API is const, so the request state is mutable.
+    mutable uint32_t mRandom = 1;
+    mutable uint64_t mRequestMicros = 0;
+    mutable uint64_t mLatencyMicros = 0;
+    mutable uint32_t mRequestCount = 0;
+    mutable uint32_t mResponseCount = 0;
+    mutable bool mIsLost = false;
+    mutable bool mIsResponseRead = false;
+};
+
+}
+}
+
+#endif // #if defined(EPOXY_DUINO)
+
+#endif
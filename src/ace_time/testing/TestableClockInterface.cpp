@@ -9,6 +9,7 @@ namespace ace_time {
 namespace testing{
 
 unsigned long TestableClockInterface::TestableClockInterface::sMillis;
+uint32_t TestableMicrosClockInterface::sMicros;
 
 }
 }
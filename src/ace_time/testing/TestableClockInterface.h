@@ -17,9 +17,18 @@ namespace testing {
  */
 class TestableClockInterface {
   public:
+    /** Type of the ticks stored by SystemClock. */
+    typedef uint16_t tick_t;
+
+    /** Number of ticks per second. */
+    static const uint32_t kTicksPerSecond = 1000;
+
     /** Get the current millis. */
     static unsigned long millis() { return sMillis; }
 
+    /** Get the current ticks, the lower 16-bits of millis(). */
+    static tick_t ticks() { return (tick_t) sMillis; }
+
     /** Set the current millis. */
     static void setMillis(unsigned long ms) { sMillis = ms; }
 
@@ -27,6 +36,31 @@ class TestableClockInterface {
     static unsigned long sMillis;
 };
 
+/**
+ * A version of ace_time::hw::MicrosClockInterface whose micros can be set
+ * manually for testing purposes. The millis() are derived from the micros.
+ */
+class TestableMicrosClockInterface {
+  public:
+    /** Type of the ticks stored by SystemClock. */
+    typedef uint32_t tick_t;
+
+    /** Number of ticks per second. */
+    static const uint32_t kTicksPerSecond = 1000000;
+
+    /** Get the current millis. */
+    static unsigned long millis() { return sMicros / 1000; }
+
+    /** Get the current micros. */
+    static tick_t ticks() { return sMicros; }
+
+    /** Set the current micros. */
+    static void setMicros(uint32_t us) { sMicros = us; }
+
+  public:
+    static uint32_t sMicros;
+};
+
 }
 }
 
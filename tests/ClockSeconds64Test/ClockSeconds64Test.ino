@@ -0,0 +1,151 @@
+#line 2 "ClockSeconds64Test.ino"
+
+// Verify the 64-bit seconds API of the Clock and SystemClock. This must be
+// defined before including AceTimeClock.h.
+#define ACE_TIME_CLOCK_SECONDS64 1
+
+#include <AUnitVerbose.h>
+#include <AceTimeClock.h>
+#include <ace_time/testing/FakeClock.h>
+#include <ace_time/testing/TestableSystemClockLoop.h>
+
+using namespace aunit;
+using namespace ace_time;
+using namespace ace_time::clock;
+using namespace ace_time::testing;
+
+// 2150-01-01 relative to the 2050 epoch, which does not fit in acetime_t.
+static const int64_t kSeconds2150 = (int64_t) 36524 * 86400;
+
+//---------------------------------------------------------------------------
+
+test(ClockSeconds64Test, toSeconds64) {
+  assertEqual(Clock::kInvalidSeconds64,
+      Clock::toSeconds64(Clock::kInvalidSeconds));
+  assertEqual((int64_t) 0, Clock::toSeconds64(0));
+  assertEqual((int64_t) -1, Clock::toSeconds64(-1));
+  assertEqual((int64_t) INT32_MAX, Clock::toSeconds64(INT32_MAX));
+}
+
+test(ClockSeconds64Test, toSeconds32) {
+  assertEqual(Clock::kInvalidSeconds,
+      Clock::toSeconds32(Clock::kInvalidSeconds64));
+  assertEqual((acetime_t) 0, Clock::toSeconds32(0));
+  assertEqual((acetime_t) INT32_MAX, Clock::toSeconds32(INT32_MAX));
+  assertEqual((acetime_t) (INT32_MIN + 1), Clock::toSeconds32(INT32_MIN + 1));
+
+  // Out of range of acetime_t.
+  assertEqual(Clock::kInvalidSeconds, Clock::toSeconds32(INT32_MIN));
+  assertEqual(Clock::kInvalidSeconds,
+      Clock::toSeconds32((int64_t) INT32_MAX + 1));
+  assertEqual(Clock::kInvalidSeconds, Clock::toSeconds32(kSeconds2150));
+}
+
+test(ClockSeconds64Test, fakeClock) {
+  FakeClock clock;
+  clock.setNow64(kSeconds2150);
+  assertEqual(kSeconds2150, clock.getNow64());
+  assertEqual(Clock::kInvalidSeconds, clock.getNow());
+
+  clock.setNow(42);
+  assertEqual((int64_t) 42, clock.getNow64());
+  assertEqual((acetime_t) 42, clock.getNow());
+}
+
+test(ClockSeconds64Test, syncBeyond32Bits) {
+  TestableClockInterface::setMillis(0);
+  FakeClock referenceClock;
+  FakeClock backupClock;
+  TestableSystemClockLoop systemClock(&referenceClock, &backupClock);
+
+  referenceClock.setNow64(kSeconds2150);
+  referenceClock.isResponseReady(true);
+  systemClock.loop(); // send request
+  systemClock.loop(); // read response
+  assertEqual(SystemClock::kSyncStatusOk, systemClock.getSyncStatusCode());
+  assertTrue(systemClock.isInit());
+  assertEqual(kSeconds2150, systemClock.getNow64());
+  assertEqual(kSeconds2150, systemClock.getLastSyncTime64());
+  assertEqual(kSeconds2150, backupClock.getNow64());
+
+  // The 32-bit API cannot represent the time.
+  assertEqual(Clock::kInvalidSeconds, systemClock.getNow());
+  assertEqual(Clock::kInvalidSeconds, systemClock.getLastSyncTime());
+
+  // The clock advances past the 32-bit boundary.
+  TestableClockInterface::setMillis(2500);
+  assertEqual(kSeconds2150 + 2, systemClock.getNow64());
+}
+
+test(ClockSeconds64Test, setNow64) {
+  TestableClockInterface::setMillis(0);
+  FakeClock backupClock;
+  TestableSystemClockLoop systemClock(nullptr, &backupClock);
+
+  systemClock.setNow64(kSeconds2150);
+  assertTrue(systemClock.isInit());
+  assertEqual(kSeconds2150, systemClock.getNow64());
+  assertEqual(kSeconds2150, backupClock.getNow64());
+
+  // An invalid 32-bit value is ignored.
+  systemClock.setNow(Clock::kInvalidSeconds);
+  assertEqual(kSeconds2150, systemClock.getNow64());
+
+  // The 32-bit API is the same as before within its range.
+  systemClock.setNow(100);
+  assertEqual((acetime_t) 100, systemClock.getNow());
+  assertEqual((int64_t) 100, systemClock.getNow64());
+}
+
+test(ClockSeconds64Test, setupFromBackup) {
+  TestableClockInterface::setMillis(0);
+  FakeClock backupClock;
+  backupClock.setNow64(kSeconds2150);
+  TestableSystemClockLoop systemClock(nullptr, &backupClock);
+  systemClock.setup();
+  assertTrue(systemClock.isInit());
+  assertEqual(kSeconds2150, systemClock.getNow64());
+}
+
+test(ClockSeconds64Test, monotonicMillis) {
+  uint16_t millis;
+  TestableClockInterface::setMillis(1000);
+  TestableSystemClockLoop systemClock(nullptr, nullptr);
+  systemClock.setNow64(kSeconds2150);
+
+  TestableClockInterface::setMillis(3500);
+  uint64_t now = systemClock.getMonotonicMillis();
+  assertEqual(kSeconds2150 + 2,
+      systemClock.convertMonotonicMillis64(now, &millis));
+  assertEqual(500, millis);
+  assertEqual(Clock::kInvalidSeconds,
+      systemClock.convertMonotonicMillis(now, &millis));
+  assertEqual((uint64_t) 1000,
+      systemClock.convertEpochSeconds64ToMonotonicMillis(kSeconds2150));
+}
+
+#if defined(EPOXY_DUINO)
+test(ClockSeconds64Test, unixClock) {
+  UnixClock unixClock;
+  int64_t now64 = unixClock.getNow64();
+  acetime_t now = unixClock.getNow();
+  assertNotEqual(Clock::kInvalidSeconds64, now64);
+  // Allow a tick of the real clock between the two calls.
+  assertLessOrEqual(now64, (int64_t) now);
+  assertLessOrEqual((int64_t) now, now64 + 1);
+}
+#endif
+
+//---------------------------------------------------------------------------
+
+void setup() {
+#if ! defined(EPOXY_DUINO)
+  delay(1000); // wait to prevent garbage on SERIAL_PORT_MONITOR
+#endif
+  SERIAL_PORT_MONITOR.begin(115200);
+  while (!SERIAL_PORT_MONITOR); // Leonardo/Micro
+}
+
+void loop() {
+  TestRunner::run();
+}
@@ -0,0 +1,157 @@
+#line 2 "ClockSimulatorTest.ino"
+
+#include <AUnit.h>
+#include <AceCommon.h> // PrintStr
+#include <AceRoutine.h> // enable TestableSystemClockCoroutine
+#include <AceTimeClock.h>
+#include <ace_time/testing/ClockSimulator.h>
+
+using namespace aunit;
+using ace_time::acetime_t;
+using ace_time::testing::ClockSimulator;
+using ace_time::testing::SimulatedOscillator;
+using ace_time::testing::SimulatedReferenceClock;
+using ace_time::testing::SimulationResult;
+using ace_time::testing::TestableSystemClockLoop;
+using ace_time::testing::TestableSystemClockCoroutine;
+
+static const acetime_t kStartSeconds = 700000000;
+static const uint32_t kOneDay = 86400;
+
+test(ClockSimulatorTest, noDrift) {
+  SimulatedOscillator oscillator;
+  SimulatedReferenceClock reference;
+  TestableSystemClockLoop systemClock(&reference, nullptr, 600);
+  ClockSimulator<TestableSystemClockLoop> simulator(
+      systemClock, oscillator, &reference, kStartSeconds);
+  ace_common::PrintStr<100> output;
+  simulator.setOutput(&output);
+  simulator.setup();
+
+  simulator.run(120, 60);
+  // The response is read 1 ms after it was stamped by the reference clock.
+  assertEqual("60,-1,1\r\n120,-1,1\r\n", output.cstr());
+
+  simulator.setOutput(nullptr);
+  const SimulationResult& result = simulator.run(kOneDay);
+  assertEqual(kOneDay + 120, result.elapsedSeconds);
+  assertEqual((uint32_t) 0, result.firstSyncSeconds);
+  assertEqual((uint32_t) 1 + kOneDay / 600, result.syncCount);
+  assertLessOrEqual(result.maxAbsErrorMillis, 1);
+}
+
+test(ClockSimulatorTest, freeRunningDrift) {
+  // +100 ppm without a reference clock drifts by 100 ms every 1000 s.
+  SimulatedOscillator oscillator(100.0);
+  TestableSystemClockLoop systemClock(nullptr, nullptr);
+  ClockSimulator<TestableSystemClockLoop> simulator(
+      systemClock, oscillator, nullptr, kStartSeconds);
+  simulator.setup();
+  systemClock.setNow(kStartSeconds);
+
+  const SimulationResult& result = simulator.run(10000, 1000);
+  assertNear(result.lastErrorMillis, (int32_t) 1000, (int32_t) 1);
+  assertEqual((uint32_t) 0, result.syncCount);
+}
+
+test(ClockSimulatorTest, syncBoundsError) {
+  // Syncing every 600 s bounds the error to 100 ppm * 600 s = 60 ms.
+  SimulatedOscillator oscillator(100.0, 20.0, 3600);
+  SimulatedReferenceClock reference(10, 50);
+  reference.setSeed(42);
+  TestableSystemClockLoop systemClock(&reference, nullptr, 600);
+  ClockSimulator<TestableSystemClockLoop> simulator(
+      systemClock, oscillator, &reference, kStartSeconds);
+  simulator.setup();
+
+  const SimulationResult& result = simulator.run(kOneDay, 10);
+  assertEqual((uint32_t) 0, result.firstSyncSeconds);
+  assertEqual(kOneDay / 600, result.syncCount);
+  assertLessOrEqual(result.maxAbsErrorMillis, 75);
+  assertMore(result.maxAbsErrorMillis, 50);
+}
+
+test(ClockSimulatorTest, coroutine) {
+  SimulatedOscillator oscillator(100.0);
+  SimulatedReferenceClock reference(10, 50);
+  TestableSystemClockCoroutine systemClock(&reference, nullptr, 600);
+  ClockSimulator<TestableSystemClockCoroutine> simulator(
+      systemClock, oscillator, &reference, kStartSeconds);
+  simulator.setup();
+
+  const SimulationResult& result = simulator.run(kOneDay, 10);
+  assertEqual(kOneDay / 600, result.syncCount);
+  assertLessOrEqual(result.maxAbsErrorMillis, 65);
+}
+
+test(ClockSimulatorTest, deterministic) {
+  SimulationResult results[2];
+  for (uint8_t i = 0; i < 2; i++) {
+    SimulatedOscillator oscillator(-50.0, 10.0, 7200);
+    SimulatedReferenceClock reference(5, 500, 20);
+    reference.setSeed(1234);
+    TestableSystemClockLoop systemClock(&reference, nullptr, 300);
+    ClockSimulator<TestableSystemClockLoop> simulator(
+        systemClock, oscillator, &reference, kStartSeconds);
+    simulator.setup();
+    results[i] = simulator.run(kOneDay);
+  }
+
+  assertMore(results[0].requestCount, results[0].syncCount);
+  assertEqual(results[0].requestCount, results[1].requestCount);
+  assertEqual(results[0].syncCount, results[1].syncCount);
+  assertEqual(results[0].maxAbsErrorMillis, results[1].maxAbsErrorMillis);
+  assertEqual(results[0].lastErrorMillis, results[1].lastErrorMillis);
+}
+
+test(ClockSimulatorTest, outage) {
+  SimulatedOscillator oscillator(100.0);
+  SimulatedReferenceClock reference(10, 20);
+  assertTrue(reference.addOutage(3600, 3600 + 7200));
+  TestableSystemClockLoop systemClock(&reference, nullptr, 600);
+  ClockSimulator<TestableSystemClockLoop> simulator(
+      systemClock, oscillator, &reference, kStartSeconds);
+  simulator.setup();
+
+  // The error grows by 100 ppm for the 2 hours of the outage.
+  const SimulationResult& result = simulator.run(kOneDay, 10);
+  assertMore(result.maxAbsErrorMillis, 700);
+  assertLess(result.maxAbsErrorMillis, 800);
+  assertEqual(result.requestCount, result.syncCount + 12);
+  assertLess(result.lastErrorMillis, 65);
+}
+
+test(ClockSimulatorTest, replayTraces) {
+  // Every third request is lost, the others take 20 and 300 ms.
+  static const int16_t kLatencies[] = {20, -1, 300};
+  // The oscillator alternates between +10 and +30 ppm every hour.
+  static const float kPpms[] = {10.0, 30.0};
+
+  SimulatedOscillator oscillator;
+  oscillator.setPpmTrace(kPpms, 2, 3600);
+  SimulatedReferenceClock reference;
+  reference.setLatencyTrace(kLatencies, 3);
+  TestableSystemClockLoop systemClock(&reference, nullptr, 600);
+  ClockSimulator<TestableSystemClockLoop> simulator(
+      systemClock, oscillator, &reference, kStartSeconds);
+  simulator.setup();
+
+  // Every 2 responses cost 3 requests, the lost request is retried after 600 s.
+  const SimulationResult& result = simulator.run(kOneDay);
+  assertEqual(result.requestCount, (result.syncCount * 3 + 1) / 2);
+  assertLessOrEqual(result.maxAbsErrorMillis, 40);
+}
+
+//---------------------------------------------------------------------------
+
+void setup() {
+#if ! defined(EPOXY_DUINO)
+  delay(1000); // wait to prevent garbage on SERIAL_PORT_MONITOR
+#endif
+  SERIAL_PORT_MONITOR.begin(115200);
+  while (!SERIAL_PORT_MONITOR); // Leonardo/Micro
+}
+
+void loop() {
+  TestRunner::run();
+}
@@ -0,0 +1,73 @@
+#line 2 "DS3231ClockTest.ino"
+
+#include <AUnit.h>
+#include <AceTimeClock.h>
+#include <ace_time/testing/FakeWireInterface.h>
+
+using namespace aunit;
+using ace_time::acetime_t;
+using ace_time::LocalDateTime;
+using ace_time::clock::DS3231Clock;
+using ace_time::testing::FakeWireInterface;
+
+// The 7 time keeping registers (00h-06h) of the DS3231, in BCD.
+static const uint8_t kNumRegisters = 7;
+
+test(DS3231ClockTest, getNow) {
+  // 2022-03-14T15:26:53 Monday
+  uint8_t registers[kNumRegisters] = {
+    0x53, 0x26, 0x15, 0x01, 0x14, 0x03, 0x22
+  };
+  FakeWireInterface wireInterface(registers, kNumRegisters);
+  DS3231Clock<FakeWireInterface> dsClock(wireInterface);
+
+  acetime_t expected =
+      LocalDateTime::forComponents(2022, 3, 14, 15, 26, 53).toEpochSeconds();
+  assertEqual(expected, dsClock.getNow());
+}
+
+test(DS3231ClockTest, setNow) {
+  uint8_t registers[kNumRegisters] = {0};
+  FakeWireInterface wireInterface(registers, kNumRegisters);
+  DS3231Clock<FakeWireInterface> dsClock(wireInterface);
+
+  // 2021-12-31T23:59:58 Friday
+  acetime_t epochSeconds =
+      LocalDateTime::forComponents(2021, 12, 31, 23, 59, 58).toEpochSeconds();
+  dsClock.setNow(epochSeconds);
+
+  assertEqual(0x58, registers[0]);
+  assertEqual(0x59, registers[1]);
+  assertEqual(0x23, registers[2]);
+  assertEqual(0x05, registers[3]);
+  assertEqual(0x31, registers[4]);
+  assertEqual(0x12, registers[5]);
+  assertEqual(0x21, registers[6]);
+  assertEqual(epochSeconds, dsClock.getNow());
+}
+
+test(DS3231ClockTest, setNow_invalidSecondsIgnored) {
+  uint8_t registers[kNumRegisters] = {
+    0x53, 0x26, 0x15, 0x01, 0x14, 0x03, 0x22
+  };
+  FakeWireInterface wireInterface(registers, kNumRegisters);
+  DS3231Clock<FakeWireInterface> dsClock(wireInterface);
+
+  dsClock.setNow(DS3231Clock<FakeWireInterface>::kInvalidSeconds);
+  assertEqual(0x53, registers[0]);
+  assertEqual(0x22, registers[6]);
+}
+
+//---------------------------------------------------------------------------
+
+void setup() {
+#if ! defined(EPOXY_DUINO)
+  delay(1000); // wait to prevent garbage on SERIAL_PORT_MONITOR
+#endif
+  SERIAL_PORT_MONITOR.begin(115200);
+  while (!SERIAL_PORT_MONITOR); // Leonardo/Micro
+}
+
+void loop() {
+  TestRunner::run();
+}
@@ -0,0 +1,68 @@
+#line 2 "EpochOffsetsTest.ino"
+
+#include <AUnit.h>
+#include <AceTimeClock.h>
+
+using namespace aunit;
+using ace_time::Epoch;
+using ace_time::clock::EpochOffsets;
+
+// Seconds from 1900-01-01, 1970-01-01 and 1980-01-06 to 2000-01-01
+static const int64_t kSecondsTo2000FromNtpEpoch = 3155673600;
+static const int64_t kSecondsTo2000FromUnixEpoch = 946684800;
+static const int64_t kSecondsTo2000FromGpsEpoch = 630720000;
+
+// Seconds from 2000-01-01 to 2050-01-01
+static const int64_t kSecondsTo2050From2000 = 1577923200;
+
+test(EpochOffsetsTest, epoch2000) {
+  int16_t savedYear = Epoch::currentEpochYear();
+  Epoch::currentEpochYear(2000);
+
+  assertEqual((uint32_t) kSecondsTo2000FromNtpEpoch,
+      EpochOffsets::secondsToCurrentEpochFromNtpEpoch());
+  assertEqual(kSecondsTo2000FromUnixEpoch,
+      EpochOffsets::secondsToCurrentEpochFromUnixEpoch64());
+  assertEqual((uint32_t) kSecondsTo2000FromGpsEpoch,
+      EpochOffsets::secondsToCurrentEpochFromGpsEpoch());
+
+  Epoch::currentEpochYear(savedYear);
+}
+
+// Changing the current epoch year invalidates the cached offsets.
+test(EpochOffsetsTest, epochYearChange) {
+  int16_t savedYear = Epoch::currentEpochYear();
+
+  Epoch::currentEpochYear(2000);
+  assertEqual(kSecondsTo2000FromUnixEpoch,
+      EpochOffsets::secondsToCurrentEpochFromUnixEpoch64());
+
+  Epoch::currentEpochYear(2050);
+  assertEqual(kSecondsTo2000FromUnixEpoch + kSecondsTo2050From2000,
+      EpochOffsets::secondsToCurrentEpochFromUnixEpoch64());
+  assertEqual(Epoch::secondsToCurrentEpochFromUnixEpoch64(),
+      EpochOffsets::secondsToCurrentEpochFromUnixEpoch64());
+  // Modulo 2^32
+  assertEqual(
+      (uint32_t) (kSecondsTo2000FromNtpEpoch + kSecondsTo2050From2000),
+      EpochOffsets::secondsToCurrentEpochFromNtpEpoch());
+  assertEqual(
+      (uint32_t) (kSecondsTo2000FromGpsEpoch + kSecondsTo2050From2000),
+      EpochOffsets::secondsToCurrentEpochFromGpsEpoch());
+
+  Epoch::currentEpochYear(savedYear);
+}
+
+//---------------------------------------------------------------------------
+
+void setup() {
+#if ! defined(EPOXY_DUINO)
+  delay(1000); // wait to prevent garbage on SERIAL_PORT_MONITOR
+#endif
+  SERIAL_PORT_MONITOR.begin(115200);
+  while (!SERIAL_PORT_MONITOR); // Leonardo/Micro
+}
+
+void loop() {
+  TestRunner::run();
+}
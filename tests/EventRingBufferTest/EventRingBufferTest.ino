@@ -0,0 +1,84 @@
+#line 2 "EventRingBufferTest.ino"
+
+#include <AUnit.h>
+#include <AceTimeClock.h>
+
+using namespace aunit;
+using ace_time::clock::EventRingBuffer;
+
+test(EventRingBufferTest, pushAndPop) {
+  EventRingBuffer<uint16_t, 4> events;
+  uint16_t value;
+  assertTrue(events.isEmpty());
+  assertEqual(0, events.size());
+  assertFalse(events.pop(value));
+
+  assertTrue(events.push(1));
+  assertTrue(events.push(2));
+  assertFalse(events.isEmpty());
+  assertEqual(2, events.size());
+
+  assertTrue(events.pop(value));
+  assertEqual(1, value);
+  assertTrue(events.pop(value));
+  assertEqual(2, value);
+  assertFalse(events.pop(value));
+  assertTrue(events.isEmpty());
+}
+
+test(EventRingBufferTest, overflow) {
+  EventRingBuffer<uint32_t, 4> events;
+  for (uint32_t i = 0; i < 4; i++) {
+    assertTrue(events.push(i));
+  }
+  assertEqual(4, events.size());
+  assertEqual((uint16_t) 0, events.getOverflowCount());
+
+  // Full, so the new values are dropped.
+  assertFalse(events.push(100));
+  assertFalse(events.push(101));
+  assertEqual((uint16_t) 2, events.getOverflowCount());
+
+  // The oldest values are preserved.
+  uint32_t value;
+  assertTrue(events.pop(value));
+  assertEqual((uint32_t) 0, value);
+  assertTrue(events.push(4));
+  for (uint32_t i = 1; i <= 4; i++) {
+    assertTrue(events.pop(value));
+    assertEqual(i, value);
+  }
+  assertTrue(events.isEmpty());
+}
+
+// The 8-bit head and tail indexes wrap around many times.
+test(EventRingBufferTest, wrapAround) {
+  EventRingBuffer<uint16_t, 128> events;
+  uint16_t expected = 0;
+  uint16_t next = 0;
+  uint16_t value;
+  for (uint16_t round = 0; round < 20; round++) {
+    for (uint8_t i = 0; i < 100; i++) {
+      assertTrue(events.push(next++));
+    }
+    while (events.pop(value)) {
+      assertEqual(expected++, value);
+    }
+  }
+  assertEqual(next, expected);
+  assertEqual((uint16_t) 0, events.getOverflowCount());
+}
+
+//---------------------------------------------------------------------------
+
+void setup() {
+#if ! defined(EPOXY_DUINO)
+  delay(1000); // wait to prevent garbage on SERIAL_PORT_MONITOR
+#endif
+  SERIAL_PORT_MONITOR.begin(115200);
+  while (!SERIAL_PORT_MONITOR); // Leonardo/Micro
+}
+
+void loop() {
+  TestRunner::run();
+}
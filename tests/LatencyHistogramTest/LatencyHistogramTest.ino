@@ -0,0 +1,95 @@
+#line 2 "LatencyHistogramTest.ino"
+
+#include <AUnit.h>
+#include <AceTimeClock.h>
+
+using namespace aunit;
+using ace_time::clock::LatencyHistogram;
+
+test(LatencyHistogramTest, bucketIndex) {
+  assertEqual(0, LatencyHistogram::bucketIndex(0));
+  assertEqual(1, LatencyHistogram::bucketIndex(1));
+  assertEqual(2, LatencyHistogram::bucketIndex(2));
+  assertEqual(2, LatencyHistogram::bucketIndex(3));
+  assertEqual(3, LatencyHistogram::bucketIndex(4));
+  assertEqual(10, LatencyHistogram::bucketIndex(1000));
+  assertEqual(16, LatencyHistogram::bucketIndex(65535));
+
+  assertEqual(0, LatencyHistogram::bucketUpperBound(0));
+  assertEqual(3, LatencyHistogram::bucketUpperBound(2));
+  assertEqual(1023, LatencyHistogram::bucketUpperBound(10));
+  assertEqual(65535, LatencyHistogram::bucketUpperBound(16));
+}
+
+test(LatencyHistogramTest, update) {
+  LatencyHistogram histogram;
+  histogram.update(LatencyHistogram::kOutcomeOk, 30);
+  histogram.update(LatencyHistogram::kOutcomeOk, 40);
+  histogram.update(LatencyHistogram::kOutcomeError, 50);
+  histogram.update(LatencyHistogram::kOutcomeTimeout, 1000);
+
+  assertEqual((uint32_t) 2, histogram.getCount(LatencyHistogram::kOutcomeOk));
+  assertEqual((uint32_t) 1,
+      histogram.getCount(LatencyHistogram::kOutcomeError));
+  assertEqual((uint32_t) 1,
+      histogram.getCount(LatencyHistogram::kOutcomeTimeout));
+
+  // 30 is in [16, 31], 40 is in [32, 63]
+  assertEqual(1, histogram.getBucketCount(LatencyHistogram::kOutcomeOk, 5));
+  assertEqual(1, histogram.getBucketCount(LatencyHistogram::kOutcomeOk, 6));
+  assertEqual(40, histogram.getMaxMillis(LatencyHistogram::kOutcomeOk));
+
+  histogram.reset();
+  assertEqual((uint32_t) 0, histogram.getCount(LatencyHistogram::kOutcomeOk));
+  assertEqual(0, histogram.getMaxMillis(LatencyHistogram::kOutcomeOk));
+}
+
+test(LatencyHistogramTest, getPercentile) {
+  LatencyHistogram histogram;
+  assertEqual(0, histogram.getPercentile(LatencyHistogram::kOutcomeOk, 50));
+
+  // 90 samples of 20 ms [16, 31], 10 samples of 100 ms [64, 127].
+  for (uint8_t i = 0; i < 90; i++) {
+    histogram.update(LatencyHistogram::kOutcomeOk, 20);
+  }
+  for (uint8_t i = 0; i < 10; i++) {
+    histogram.update(LatencyHistogram::kOutcomeOk, 100);
+  }
+
+  assertEqual(31, histogram.getPercentile(LatencyHistogram::kOutcomeOk, 0));
+  assertEqual(31, histogram.getPercentile(LatencyHistogram::kOutcomeOk, 50));
+  assertEqual(31, histogram.getPercentile(LatencyHistogram::kOutcomeOk, 90));
+  // Clamped to the maximum latency instead of the bucket bound of 127.
+  assertEqual(100, histogram.getPercentile(LatencyHistogram::kOutcomeOk, 91));
+  assertEqual(100, histogram.getPercentile(LatencyHistogram::kOutcomeOk, 100));
+}
+
+test(LatencyHistogramTest, overflowHalvesBuckets) {
+  LatencyHistogram histogram;
+  histogram.update(LatencyHistogram::kOutcomeOk, 100);
+  histogram.update(LatencyHistogram::kOutcomeOk, 100);
+  for (uint32_t i = 0; i < UINT16_MAX; i++) {
+    histogram.update(LatencyHistogram::kOutcomeOk, 10);
+  }
+  assertEqual(UINT16_MAX,
+      histogram.getBucketCount(LatencyHistogram::kOutcomeOk, 4));
+
+  histogram.update(LatencyHistogram::kOutcomeOk, 10);
+  assertEqual(32767 + 1,
+      histogram.getBucketCount(LatencyHistogram::kOutcomeOk, 4));
+  assertEqual(1, histogram.getBucketCount(LatencyHistogram::kOutcomeOk, 7));
+}
+
+//---------------------------------------------------------------------------
+
+void setup() {
+#if ! defined(EPOXY_DUINO)
+  delay(1000); // wait to prevent garbage on SERIAL_PORT_MONITOR
+#endif
+  SERIAL_PORT_MONITOR.begin(115200);
+  while (!SERIAL_PORT_MONITOR); // Leonardo/Micro
+}
+
+void loop() {
+  TestRunner::run();
+}
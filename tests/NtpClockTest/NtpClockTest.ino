@@ -2,10 +2,20 @@
 
 #include <AUnit.h>
 #include <AceTimeClock.h>
+#include <ace_time/testing/FakeUdpInterface.h>
+#include <ace_time/testing/TestableClockInterface.h>
+#include <ace_time/testing/LoopbackNtpServer.h>
 
 using namespace aunit;
+using ace_time::acetime_t;
 using ace_time::LocalDate;
 using ace_time::clock::NtpClock;
+using ace_time::clock::NtpClockTemplate;
+using ace_time::clock::NtpPacket;
+using ace_time::hw::PosixUdpInterface;
+using ace_time::testing::FakeUdpInterface;
+using ace_time::testing::TestableClockInterface;
+using ace_time::testing::LoopbackNtpServer;
 
 static const int64_t kSecondsTo1900From1970 = -2208988800;
 static const int64_t kSecondsTo2000From1970 = 946684800;
@@ -60,6 +70,414 @@ test(NtpClockTest, convertNtpSecondsToAceTimeSeconds) {
           (kSecondsTo2100From1970 - kSecondsTo1900From1970)));
 }
 
+test(NtpClockTest, convertAceTimeSecondsToNtpSeconds) {
+  assertEqual((uint32_t) (kSecondsTo2050From1970 - kSecondsTo1900From1970),
+      NtpClock::convertAceTimeSecondsToNtpSeconds(0));
+
+  // Round trip across the NTP era 0 rollover.
+  assertEqual((acetime_t) -473904000,
+      NtpClock::convertNtpSecondsToAceTimeSeconds(
+          NtpClock::convertAceTimeSecondsToNtpSeconds(-473904000)));
+  assertEqual((acetime_t) 1000000,
+      NtpClock::convertNtpSecondsToAceTimeSeconds(
+          NtpClock::convertAceTimeSecondsToNtpSeconds(1000000)));
+}
+
+test(NtpClockTest, convertNtpSecondsToAceTimeSeconds64) {
+  // With a pivot of 0, the result is the same as the 32-bit conversion.
+  assertEqual((int64_t) NtpClock::convertNtpSecondsToAceTimeSeconds(1),
+      NtpClock::convertNtpSecondsToAceTimeSeconds64(1, 0));
+  assertEqual(
+      (int64_t) NtpClock::convertNtpSecondsToAceTimeSeconds(UINT32_MAX),
+      NtpClock::convertNtpSecondsToAceTimeSeconds64(UINT32_MAX, 0));
+
+  // 2150-01-01 is beyond the range of acetime_t. The 32-bit conversion maps
+  // it to the previous NTP era, but a pivot of 2100-01-01 selects NTP era 2.
+  int64_t seconds2150 = kSecondsTo2100From1970 + (int64_t) 50 * 365 * 86400
+      + 12 * 86400 - kSecondsTo2050From1970;
+  uint32_t ntpSeconds = (uint32_t) (seconds2150 + kSecondsTo2050From1970
+      - kSecondsTo1900From1970);
+  int64_t pivot = kSecondsTo2100From1970 - kSecondsTo2050From1970;
+  assertEqual(seconds2150,
+      NtpClock::convertNtpSecondsToAceTimeSeconds64(ntpSeconds, pivot));
+  assertEqual(seconds2150 - ((int64_t) 1 << 32),
+      NtpClock::convertNtpSecondsToAceTimeSeconds64(ntpSeconds, 0));
+
+  // A pivot in 1950 maps 2000-01-01 to NTP era 0.
+  int64_t seconds2000 = kSecondsTo2000From1970 - kSecondsTo2050From1970;
+  assertEqual(seconds2000, NtpClock::convertNtpSecondsToAceTimeSeconds64(
+      (uint32_t) (kSecondsTo2000From1970 - kSecondsTo1900From1970),
+      -(int64_t) 100 * 365 * 86400));
+}
+
+test(NtpPacketTest, fillRequest) {
+  uint8_t packet[NtpPacket::kSize];
+  memset(packet, 0xFF, sizeof(packet));
+  NtpPacket::fillRequest(packet, 0x01020304, 0x05060708);
+
+  assertEqual(0b11100011, packet[0]);
+  assertEqual(NtpPacket::kModeClient, NtpPacket::mode(packet));
+  assertEqual(6, packet[2]);
+  assertEqual(0xEC, packet[3]);
+  assertEqual(49, packet[12]);
+  assertEqual(0x4E, packet[13]);
+  assertEqual(49, packet[14]);
+  assertEqual(52, packet[15]);
+  for (uint8_t i = 16; i < NtpPacket::kOffsetTransmitTimestamp; i++) {
+    assertEqual(0, packet[i]);
+  }
+  assertEqual((uint32_t) 0x01020304, NtpPacket::readUint32(
+      &packet[NtpPacket::kOffsetTransmitTimestamp]));
+  assertEqual((uint32_t) 0x05060708, NtpPacket::readUint32(
+      &packet[NtpPacket::kOffsetTransmitTimestamp + 4]));
+}
+
+test(NtpPacketTest, shortToMillis) {
+  assertEqual((uint32_t) 0, NtpPacket::shortToMillis(0));
+  assertEqual((uint32_t) 500, NtpPacket::shortToMillis(0x8000));
+  assertEqual((uint32_t) 1500, NtpPacket::shortToMillis(0x18000));
+  assertEqual((uint32_t) 65535999, NtpPacket::shortToMillis(0xFFFFFFFF));
+}
+
+//---------------------------------------------------------------------------
+// Non-blocking connection state machine, using FakeUdpInterface.
+//---------------------------------------------------------------------------
+
+using FakeNtpClock = NtpClockTemplate<FakeUdpInterface, TestableClockInterface>;
+
+test(NtpClockConnectionTest, connect_isNonBlocking_andRetries) {
+  TestableClockInterface::setMillis(0);
+  FakeNtpClock ntpClock;
+  FakeUdpInterface& udp = ntpClock.getUdpInterface();
+  assertEqual(FakeNtpClock::kConnectionStatusIdle,
+      ntpClock.getConnectionStatus());
+
+  ntpClock.connect("ssid", "password", 5000);
+  assertEqual(FakeNtpClock::kConnectionStatusConnecting,
+      ntpClock.getConnectionStatus());
+  assertFalse(ntpClock.isSetup());
+  assertEqual(1, udp.getConnectCount());
+
+  // Not timed out yet.
+  TestableClockInterface::setMillis(4999);
+  ntpClock.loop();
+  assertEqual(1, udp.getConnectCount());
+
+  // Timed out, so ask the WiFi station to connect again.
+  TestableClockInterface::setMillis(5000);
+  ntpClock.loop();
+  assertEqual(2, udp.getConnectCount());
+  assertEqual(0, udp.getBeginCount());
+
+  // Connection comes up.
+  TestableClockInterface::setMillis(6000);
+  udp.isConnected(true);
+  ntpClock.loop();
+  assertTrue(ntpClock.isSetup());
+  assertEqual(1, udp.getBeginCount());
+  assertTrue(udp.isOpen());
+}
+
+test(NtpClockConnectionTest, connect_withoutSsid_waitsForExternalWiFi) {
+  TestableClockInterface::setMillis(0);
+  FakeNtpClock ntpClock;
+  FakeUdpInterface& udp = ntpClock.getUdpInterface();
+
+  ntpClock.connect();
+  TestableClockInterface::setMillis(20000);
+  ntpClock.loop();
+  assertFalse(ntpClock.isSetup());
+  assertEqual(0, udp.getConnectCount());
+
+  udp.isConnected(true);
+  ntpClock.loop();
+  assertTrue(ntpClock.isSetup());
+}
+
+test(NtpClockConnectionTest, setup_withoutSsid_doesNotBlock) {
+  TestableClockInterface::setMillis(0);
+  FakeNtpClock ntpClock;
+  FakeUdpInterface& udp = ntpClock.getUdpInterface();
+
+  // The millis() does not advance, so a blocking setup() would never return.
+  ntpClock.setup();
+  assertFalse(ntpClock.isSetup());
+  assertEqual(0, udp.getConnectCount());
+
+  udp.isConnected(true);
+  ntpClock.loop();
+  assertTrue(ntpClock.isSetup());
+}
+
+test(NtpClockConnectionTest, noServers_usesDefaultServer) {
+  static const char* const kServers[] = {"unused.example.com"};
+  FakeNtpClock ntpClock(kServers, 0);
+  assertEqual(1, ntpClock.getNumServers());
+  assertEqual(FakeNtpClock::kNtpServerName, ntpClock.getServer());
+  assertEqual(FakeNtpClock::kNtpServerName, ntpClock.getServer(0));
+}
+
+test(NtpClockConnectionTest, reconnect_drivenByRequests) {
+  TestableClockInterface::setMillis(0);
+  FakeNtpClock ntpClock;
+  FakeUdpInterface& udp = ntpClock.getUdpInterface();
+  udp.isConnected(true);
+  ntpClock.connect("ssid", "password");
+  assertTrue(ntpClock.isSetup());
+
+  ntpClock.sendRequest();
+  assertEqual(1, udp.getSentCount());
+
+  // WiFi drops. The next request notices, closes the socket, and asks the
+  // WiFi station to reconnect, without sending anything.
+  udp.isConnected(false);
+  ntpClock.sendRequest();
+  assertFalse(ntpClock.isSetup());
+  assertFalse(udp.isOpen());
+  assertEqual(2, udp.getConnectCount());
+  assertEqual(1, udp.getSentCount());
+  assertFalse(ntpClock.isResponseReady());
+
+  // WiFi comes back. Polling the response reopens the socket.
+  udp.isConnected(true);
+  assertFalse(ntpClock.isResponseReady());
+  assertTrue(ntpClock.isSetup());
+  assertEqual(2, udp.getBeginCount());
+
+  ntpClock.sendRequest();
+  assertEqual(2, udp.getSentCount());
+}
+
+// Convert the last request sent through `udp` into a server response with the
+// given NTP seconds, originate timestamp and leap indicator, and queue it as
+// the incoming packet.
+static void respond(FakeUdpInterface& udp, uint32_t ntpSeconds,
+    uint32_t originateSeconds, uint32_t originateFraction,
+    uint8_t stratum = 2, uint8_t leapIndicator = 0) {
+  uint8_t packet[NtpPacket::kSize];
+  memcpy(packet, udp.getSentPacket(), NtpPacket::kSize);
+  packet[0] = (leapIndicator << 6) | (4 << 3) | NtpPacket::kModeServer;
+  packet[1] = stratum;
+  NtpPacket::writeUint32(&packet[NtpPacket::kOffsetOriginateTimestamp],
+      originateSeconds);
+  NtpPacket::writeUint32(&packet[NtpPacket::kOffsetOriginateTimestamp + 4],
+      originateFraction);
+  NtpPacket::writeUint32(&packet[NtpPacket::kOffsetTransmitTimestamp],
+      ntpSeconds);
+  udp.setIncomingPacket(packet, NtpPacket::kSize);
+}
+
+test(NtpClockConnectionTest, response_matchedToRequest) {
+  TestableClockInterface::setMillis(0);
+  FakeNtpClock ntpClock;
+  FakeUdpInterface& udp = ntpClock.getUdpInterface();
+  udp.isConnected(true);
+  ntpClock.connect();
+
+  ntpClock.sendRequest();
+  const uint8_t* request = udp.getSentPacket();
+  uint32_t nonce = NtpPacket::readUint32(
+      &request[NtpPacket::kOffsetTransmitTimestamp]);
+  uint32_t ntpSeconds = NtpClock::convertAceTimeSecondsToNtpSeconds(1000);
+
+  // Response to a different request is rejected.
+  respond(udp, ntpSeconds, nonce + 1, 0);
+  assertFalse(ntpClock.isResponseReady());
+
+  // Response from a server index that does not exist is rejected.
+  respond(udp, ntpSeconds, nonce, 1);
+  assertFalse(ntpClock.isResponseReady());
+
+  // Kiss-o'-death (stratum 0) and unsynchronized (stratum 16) responses are
+  // rejected.
+  respond(udp, ntpSeconds, nonce, 0, 0 /*stratum*/);
+  assertFalse(ntpClock.isResponseReady());
+  respond(udp, ntpSeconds, nonce, 0, 16 /*stratum*/);
+  assertFalse(ntpClock.isResponseReady());
+
+  // Matching response is accepted.
+  respond(udp, ntpSeconds, nonce, 0);
+  assertTrue(ntpClock.isResponseReady());
+  assertEqual((acetime_t) 1000, ntpClock.readResponse());
+  assertEqual(0, ntpClock.getSelectedServer());
+}
+
+test(NtpClockConnectionTest, response_leapIndicator) {
+  TestableClockInterface::setMillis(0);
+  FakeNtpClock ntpClock;
+  FakeUdpInterface& udp = ntpClock.getUdpInterface();
+  udp.isConnected(true);
+  ntpClock.connect();
+  assertEqual(NtpClock::kLeapIndicatorNone, ntpClock.getLeapIndicator());
+
+  ntpClock.sendRequest();
+  uint32_t nonce = NtpPacket::readUint32(
+      &udp.getSentPacket()[NtpPacket::kOffsetTransmitTimestamp]);
+  uint32_t ntpSeconds = NtpClock::convertAceTimeSecondsToNtpSeconds(1000);
+
+  // The alarm indicator means that the server is not synchronized.
+  respond(udp, ntpSeconds, nonce, 0, 2, NtpPacket::kLeapIndicatorAlarm);
+  assertFalse(ntpClock.isResponseReady());
+
+  respond(udp, ntpSeconds, nonce, 0, 2, NtpClock::kLeapIndicatorInsert);
+  assertTrue(ntpClock.isResponseReady());
+  assertEqual(NtpClock::kLeapIndicatorInsert, ntpClock.getLeapIndicator());
+
+  // The indicator of the next request replaces the previous one.
+  ntpClock.sendRequest();
+  assertEqual(NtpClock::kLeapIndicatorNone, ntpClock.getLeapIndicator());
+  nonce = NtpPacket::readUint32(
+      &udp.getSentPacket()[NtpPacket::kOffsetTransmitTimestamp]);
+  respond(udp, ntpSeconds, nonce, 0, 2, NtpClock::kLeapIndicatorDelete);
+  assertTrue(ntpClock.isResponseReady());
+  assertEqual(NtpClock::kLeapIndicatorDelete, ntpClock.getLeapIndicator());
+}
+
+//---------------------------------------------------------------------------
+// NtpClockTemplate<PosixUdpInterface> against a LoopbackNtpServer.
+//---------------------------------------------------------------------------
+
+using LoopbackNtpClock = NtpClockTemplate<PosixUdpInterface>;
+
+// Poll the client for up to 1 second. Returns true if a response is ready.
+static bool waitForResponse(const LoopbackNtpClock& ntpClock) {
+  unsigned long startMillis = millis();
+  while ((unsigned long) (millis() - startMillis) < 1000) {
+    if (ntpClock.isResponseReady()) return true;
+  }
+  return false;
+}
+
+test(NtpClockLoopbackTest, requestResponse) {
+  LoopbackNtpServer server;
+  assertTrue(server.setup());
+
+  LoopbackNtpClock ntpClock("127.0.0.1", 0 /*localPort*/,
+      LoopbackNtpClock::kRequestTimeoutMillis, server.getPort());
+  ntpClock.setup();
+  assertTrue(ntpClock.isSetup());
+
+  const acetime_t now = 700000000;
+  server.setNow(now);
+
+  ntpClock.sendRequest();
+  assertEqual(1, server.loop());
+  assertTrue(waitForResponse(ntpClock));
+  assertEqual(now, ntpClock.readResponse());
+
+  // A second request gets the new time.
+  server.setNow(now + 10);
+  ntpClock.sendRequest();
+  assertEqual(1, server.loop());
+  assertTrue(waitForResponse(ntpClock));
+  assertEqual(now + 10, ntpClock.readResponse());
+  assertEqual((uint32_t) 2, server.getRequestCount());
+}
+
+test(NtpClockLoopbackTest, noResponse) {
+  LoopbackNtpServer server;
+  assertTrue(server.setup());
+
+  LoopbackNtpClock ntpClock("127.0.0.1", 0 /*localPort*/,
+      LoopbackNtpClock::kRequestTimeoutMillis, server.getPort());
+  ntpClock.setup();
+
+  // Server never calls loop(), so no response arrives.
+  ntpClock.sendRequest();
+  assertFalse(ntpClock.isResponseReady());
+
+  // Blocking getNow() times out.
+  assertEqual(LoopbackNtpClock::kInvalidSeconds, ntpClock.getNow());
+}
+
+// Multiple servers on 127.0.0.1-3, all on the same port. Requires Linux, which
+// routes the whole 127.0.0.0/8 block to the loopback interface.
+static const char* const kLoopbackServers[] = {
+  "127.0.0.1", "127.0.0.2", "127.0.0.3"
+};
+
+// Poll the client for up to 1 second, running the given servers.
+static bool waitForResponse(const LoopbackNtpClock& ntpClock,
+    LoopbackNtpServer* const servers[], uint8_t numServers) {
+  unsigned long startMillis = millis();
+  while ((unsigned long) (millis() - startMillis) < 1000) {
+    for (uint8_t i = 0; i < numServers; i++) servers[i]->loop();
+    if (ntpClock.isResponseReady()) return true;
+  }
+  return false;
+}
+
+class NtpClockMultiServerTest: public TestOnce {
+  protected:
+    void setup() override {
+      assertTrue(server0.setup());
+      uint16_t port = server0.getPort();
+      assertTrue(server1.setup(port));
+      assertTrue(server2.setup(port));
+      for (uint8_t i = 0; i < 3; i++) servers[i]->setNow(now);
+    }
+
+    const acetime_t now = 700000000;
+    LoopbackNtpServer server0{kLoopbackServers[0]};
+    LoopbackNtpServer server1{kLoopbackServers[1]};
+    LoopbackNtpServer server2{kLoopbackServers[2]};
+    LoopbackNtpServer* const servers[3] = {&server0, &server1, &server2};
+};
+
+testF(NtpClockMultiServerTest, firstValid_skipsDeadServer) {
+  LoopbackNtpClock ntpClock(kLoopbackServers, 3,
+      LoopbackNtpClock::kSelectFirstValid, 0 /*localPort*/,
+      LoopbackNtpClock::kRequestTimeoutMillis, server0.getPort());
+  ntpClock.setup();
+  assertTrue(ntpClock.isSetup());
+
+  // Server 0 is dead, server 1 is slow.
+  server0.setDropPercent(100);
+  server1.setResponseDelayMillis(50);
+
+  unsigned long startMillis = millis();
+  ntpClock.sendRequest();
+  assertTrue(waitForResponse(ntpClock, servers, 3));
+  assertLess(millis() - startMillis, 50UL);
+  assertEqual(now, ntpClock.readResponse());
+  assertEqual(2, ntpClock.getSelectedServer());
+}
+
+testF(NtpClockMultiServerTest, best_selectsSmallestDistance) {
+  LoopbackNtpClock ntpClock(kLoopbackServers, 3,
+      LoopbackNtpClock::kSelectBest, 0 /*localPort*/,
+      LoopbackNtpClock::kRequestTimeoutMillis, server0.getPort());
+  ntpClock.setup();
+
+  server0.setRootDelayMillis(300);
+  server1.setRootDelayMillis(100);
+  server2.setRootDelayMillis(200);
+
+  ntpClock.sendRequest();
+  assertTrue(waitForResponse(ntpClock, servers, 3));
+  assertEqual(now, ntpClock.readResponse());
+  assertEqual(1, ntpClock.getSelectedServer());
+  assertLess(ntpClock.getSelectedDistanceMillis(), (uint32_t) 100);
+}
+
+testF(NtpClockMultiServerTest, best_waitsForSelectionWindow) {
+  LoopbackNtpClock ntpClock(kLoopbackServers, 3,
+      LoopbackNtpClock::kSelectBest, 0 /*localPort*/,
+      LoopbackNtpClock::kRequestTimeoutMillis, server0.getPort());
+  ntpClock.setup();
+  ntpClock.setSelectionWindowMillis(50);
+
+  // Server 2 is dead, so the selection completes when the window closes.
+  server2.setDropPercent(100);
+  server0.setRootDelayMillis(100);
+
+  unsigned long startMillis = millis();
+  ntpClock.sendRequest();
+  assertTrue(waitForResponse(ntpClock, servers, 3));
+  assertMoreOrEqual(millis() - startMillis, 50UL);
+  assertEqual(1, ntpClock.getSelectedServer());
+}
+
 //---------------------------------------------------------------------------
 
 void setup() {
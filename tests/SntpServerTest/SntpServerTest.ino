@@ -0,0 +1,244 @@
+#line 2 "SntpServerTest.ino"
+
+#include <AUnit.h>
+#include <AceTimeClock.h>
+#include <ace_time/testing/FakeUdpInterface.h>
+#include <ace_time/testing/TestableClockInterface.h>
+#include <ace_time/testing/TestableSystemClockLoop.h>
+
+using namespace aunit;
+using ace_time::acetime_t;
+using ace_time::clock::NtpClockTemplate;
+using ace_time::clock::NtpPacket;
+using ace_time::clock::SntpServerTemplate;
+using ace_time::hw::PosixUdpInterface;
+using ace_time::testing::FakeUdpInterface;
+using ace_time::testing::TestableClockInterface;
+using ace_time::testing::TestableSystemClockLoop;
+
+using LoopbackSntpServer =
+    SntpServerTemplate<PosixUdpInterface, TestableClockInterface>;
+using LoopbackNtpClock = NtpClockTemplate<PosixUdpInterface>;
+using FakeSntpServer =
+    SntpServerTemplate<FakeUdpInterface, TestableClockInterface>;
+
+static uint8_t request[NtpPacket::kSize];
+static uint8_t response[NtpPacket::kSize];
+
+//---------------------------------------------------------------------------
+// SntpServerTemplate<PosixUdpInterface> on the loopback interface, queried
+// by a raw PosixUdpInterface client.
+//---------------------------------------------------------------------------
+
+class SntpServerLoopbackTest: public TestOnce {
+  protected:
+    void setup() override {
+      TestableClockInterface::setMillis(0);
+      server.setup();
+      client.begin(0);
+    }
+
+    // Send a request with the given transmit timestamp, let the server
+    // answer it, and read the response into `response`. Returns true if a
+    // full response was received.
+    bool query(uint32_t nonceSeconds, uint32_t nonceFraction) {
+      NtpPacket::fillRequest(request, nonceSeconds, nonceFraction);
+      client.beginPacket("127.0.0.1", server.getUdpInterface().localPort());
+      client.write(request, NtpPacket::kSize);
+      client.endPacket();
+      if (server.loop() != 1) return false;
+
+      unsigned long startMillis = millis();
+      while ((unsigned long) (millis() - startMillis) < 1000) {
+        if (client.parsePacket() > 0) {
+          return client.read(response, NtpPacket::kSize)
+              == (int) NtpPacket::kSize;
+        }
+      }
+      return false;
+    }
+
+    TestableSystemClockLoop systemClock{nullptr, nullptr};
+    LoopbackSntpServer server{systemClock, 0 /*port*/, 1 /*stratum*/,
+        30 /*maxSyncAgeSeconds*/};
+    PosixUdpInterface client;
+};
+
+testF(SntpServerLoopbackTest, notInitialized) {
+  assertTrue(server.isOpen());
+  assertTrue(query(0x12345678, 0x9abcdef0));
+
+  assertEqual(NtpPacket::kLeapIndicatorAlarm,
+      NtpPacket::leapIndicator(response));
+  assertEqual(NtpPacket::kModeServer, NtpPacket::mode(response));
+  assertEqual(4, NtpPacket::version(response));
+  assertEqual(16, NtpPacket::stratum(response));
+  assertFalse(NtpPacket::isValidResponse(response));
+
+  // The originate timestamp echoes the transmit timestamp of the request.
+  assertEqual((uint32_t) 0x12345678, NtpPacket::readUint32(
+      &response[NtpPacket::kOffsetOriginateTimestamp]));
+  assertEqual((uint32_t) 0x9abcdef0, NtpPacket::readUint32(
+      &response[NtpPacket::kOffsetOriginateTimestamp + 4]));
+  assertEqual((uint32_t) 1, server.getRequestCount());
+}
+
+testF(SntpServerLoopbackTest, synced) {
+  const acetime_t now = 700000000;
+  const uint32_t ntpNow =
+      LoopbackNtpClock::convertAceTimeSecondsToNtpSeconds(now);
+  TestableClockInterface::setMillis(1000);
+  systemClock.setNow(now);
+
+  // 10.5 seconds later
+  TestableClockInterface::setMillis(11500);
+  assertTrue(query(1, 2));
+
+  assertTrue(NtpPacket::isValidResponse(response));
+  assertEqual(0, NtpPacket::leapIndicator(response));
+  assertEqual(1, NtpPacket::stratum(response));
+  assertEqual(0, memcmp(&response[NtpPacket::kOffsetReferenceId], "LOCL", 4));
+  assertEqual((uint32_t) ntpNow, NtpPacket::readUint32(
+      &response[NtpPacket::kOffsetReferenceTimestamp]));
+  assertEqual((uint32_t) (ntpNow + 10), NtpPacket::readUint32(
+      &response[NtpPacket::kOffsetReceiveTimestamp]));
+  assertEqual((uint32_t) (ntpNow + 10), NtpPacket::readUint32(
+      &response[NtpPacket::kOffsetTransmitTimestamp]));
+
+  // 500 millis = 0x80000000 fraction
+  assertEqual((uint32_t) 0x80000000, NtpPacket::readUint32(
+      &response[NtpPacket::kOffsetTransmitTimestamp + 4]));
+
+  // Root dispersion of 1 ms in 16.16 format
+  assertEqual((uint32_t) 1, NtpPacket::shortToMillis(NtpPacket::readUint32(
+      &response[NtpPacket::kOffsetRootDispersion])));
+}
+
+testF(SntpServerLoopbackTest, stale) {
+  TestableClockInterface::setMillis(0);
+  systemClock.setNow(1000);
+
+  // Still within maxSyncAgeSeconds
+  TestableClockInterface::setMillis(30000);
+  assertTrue(query(1, 2));
+  assertEqual(1, NtpPacket::stratum(response));
+
+  // Older than maxSyncAgeSeconds
+  TestableClockInterface::setMillis(31000);
+  assertTrue(query(1, 2));
+  assertTrue(NtpPacket::isValidResponse(response));
+  assertEqual(NtpPacket::kMaxStratum, NtpPacket::stratum(response));
+  assertEqual((uint32_t) 0, NtpPacket::readUint32(
+      &response[NtpPacket::kOffsetReferenceId]));
+}
+
+testF(SntpServerLoopbackTest, ntpClock) {
+  TestableClockInterface::setMillis(0);
+  systemClock.setNow(700000000);
+
+  LoopbackNtpClock ntpClock("127.0.0.1", 0 /*localPort*/,
+      LoopbackNtpClock::kRequestTimeoutMillis,
+      server.getUdpInterface().localPort());
+  ntpClock.setup();
+  ntpClock.sendRequest();
+  assertEqual(1, server.loop());
+
+  unsigned long startMillis = millis();
+  while ((unsigned long) (millis() - startMillis) < 1000) {
+    if (ntpClock.isResponseReady()) break;
+  }
+  assertEqual((acetime_t) 700000000, ntpClock.readResponse());
+}
+
+//---------------------------------------------------------------------------
+// SntpServerTemplate<FakeUdpInterface> to verify the handling of the network
+// connection.
+//---------------------------------------------------------------------------
+
+test(SntpServerConnectionTest, reopenAfterReconnect) {
+  TestableSystemClockLoop systemClock(nullptr, nullptr);
+  FakeSntpServer server(systemClock);
+  FakeUdpInterface& udp = server.getUdpInterface();
+
+  udp.isConnected(false);
+  server.setup();
+  assertFalse(server.isOpen());
+  assertEqual(0, server.loop());
+  assertEqual(0, udp.getBeginCount());
+
+  udp.isConnected(true);
+  server.loop();
+  assertTrue(server.isOpen());
+  assertEqual(1, udp.getBeginCount());
+
+  udp.isConnected(false);
+  server.loop();
+  assertFalse(server.isOpen());
+  assertFalse(udp.isOpen());
+
+  udp.isConnected(true);
+  server.loop();
+  assertTrue(server.isOpen());
+  assertEqual(2, udp.getBeginCount());
+}
+
+test(SntpServerConnectionTest, ignoreNonClientPackets) {
+  TestableSystemClockLoop systemClock(nullptr, nullptr);
+  FakeSntpServer server(systemClock);
+  FakeUdpInterface& udp = server.getUdpInterface();
+  udp.isConnected(true);
+  server.setup();
+
+  NtpPacket::fillRequest(request, 1, 2);
+  request[0] = (request[0] & ~0x07) | NtpPacket::kModeServer;
+  udp.setIncomingPacket(request, NtpPacket::kSize);
+  assertEqual(0, server.loop());
+  assertEqual(0, udp.getSentCount());
+
+  NtpPacket::fillRequest(request, 1, 2);
+  udp.setIncomingPacket(request, NtpPacket::kSize);
+  assertEqual(1, server.loop());
+  assertEqual(1, udp.getSentCount());
+}
+
+test(SntpServerConnectionTest, referenceId) {
+  TestableClockInterface::setMillis(0);
+  TestableSystemClockLoop systemClock(nullptr, nullptr);
+  systemClock.setNow(700000000);
+  FakeSntpServer server(systemClock);
+  FakeUdpInterface& udp = server.getUdpInterface();
+  udp.isConnected(true);
+  server.setup();
+
+  // Stratum 2 with an unknown upstream server
+  NtpPacket::fillRequest(request, 1, 2);
+  udp.setIncomingPacket(request, NtpPacket::kSize);
+  assertEqual(1, server.loop());
+  const uint8_t* sent = udp.getSentPacket();
+  assertEqual(2, NtpPacket::stratum(sent));
+  assertEqual((uint32_t) 0, NtpPacket::readUint32(
+      &sent[NtpPacket::kOffsetReferenceId]));
+
+  // Stratum 2 with the IPv4 address of the upstream server, 192.168.0.1
+  server.setReferenceId(0xC0A80001);
+  udp.setIncomingPacket(request, NtpPacket::kSize);
+  assertEqual(1, server.loop());
+  assertEqual(192, sent[NtpPacket::kOffsetReferenceId]);
+  assertEqual(168, sent[NtpPacket::kOffsetReferenceId + 1]);
+  assertEqual(0, sent[NtpPacket::kOffsetReferenceId + 2]);
+  assertEqual(1, sent[NtpPacket::kOffsetReferenceId + 3]);
+}
+
+//---------------------------------------------------------------------------
+
+void setup() {
+#if ! defined(EPOXY_DUINO)
+  delay(1000); // wait to prevent garbage on SERIAL_PORT_MONITOR
+#endif
+  SERIAL_PORT_MONITOR.begin(115200);
+  while (!SERIAL_PORT_MONITOR); // Leonardo/Micro
+}
+
+void loop() {
+  TestRunner::run();
+}
@@ -0,0 +1,173 @@
+#line 2 "Stm32F1ClockTest.ino"
+
+#include <AUnit.h>
+#include <AceTimeClock.h>
+#include <ace_time/hw/Stm32F1RtcEmulator.h>
+
+using namespace aunit;
+using ace_time::acetime_t;
+using ace_time::clock::Stm32F1Clock;
+using ace_time::hw::Stm32F1Rtc;
+using ace_time::hw::Stm32F1RtcEmulator;
+
+static Stm32F1RtcEmulator& emulator = Stm32F1RtcEmulator::getInstance();
+
+// Return the time of the emulated RTC in ticks of the LSE_CLOCK.
+static uint64_t emulatorTicks() {
+  return (uint64_t) emulator.getCounter() * Stm32F1Rtc::kTicksPerSecond
+      + (Stm32F1Rtc::kPrescaler - emulator.getDivider());
+}
+
+//---------------------------------------------------------------------------
+
+test(Stm32F1RtcTest, begin) {
+  emulator.reset();
+  Stm32F1Rtc rtc;
+  assertFalse(rtc.isInitialized());
+
+  // The first begin() initializes the RTC, and write-protects it again.
+  assertFalse(rtc.begin());
+  assertTrue(rtc.isInitialized());
+  assertEqual((uint32_t) Stm32F1Rtc::kPrescaler, emulator.getPrescaler());
+  assertEqual((uint32_t) 0, rtc.getTime());
+  rtc.setTime(1000);
+  emulator.advanceTicks(Stm32F1Rtc::kTicksPerSecond);
+  assertEqual((uint32_t) 1001, rtc.getTime());
+
+  // After a reset of the processor, begin() preserves the counter.
+  Stm32F1Rtc rtc2;
+  assertTrue(rtc2.begin());
+  assertEqual((uint32_t) 1001, rtc2.getTime());
+}
+
+test(Stm32F1RtcTest, getTimeTicks) {
+  emulator.reset();
+  Stm32F1Rtc rtc;
+  rtc.begin();
+  rtc.setTime(1000);
+
+  uint16_t ticks;
+  assertEqual((uint32_t) 1000, rtc.getTimeTicks(&ticks));
+  assertEqual(0, ticks);
+
+  emulator.advanceTicks(16384);
+  assertEqual((uint32_t) 1000, rtc.getTimeTicks(&ticks));
+  assertEqual(16384, ticks);
+
+  emulator.advanceTicks(16383);
+  assertEqual((uint32_t) 1000, rtc.getTimeTicks(&ticks));
+  assertEqual(32767, ticks);
+
+  emulator.advanceTicks(1);
+  assertEqual((uint32_t) 1001, rtc.getTimeTicks(&ticks));
+  assertEqual(0, ticks);
+
+  emulator.advanceTicks(3 * Stm32F1Rtc::kTicksPerSecond + 5);
+  assertEqual((uint32_t) 1004, rtc.getTimeTicks(&ticks));
+  assertEqual(5, ticks);
+}
+
+// The high and low words of the counter are read consistently when the low
+// word rolls over between the reads.
+test(Stm32F1RtcTest, getTimeRollover) {
+  for (uint16_t offset = 32760; offset < 32768; offset++) {
+    emulator.reset();
+    Stm32F1Rtc rtc;
+    rtc.begin();
+    rtc.setTime(0xFFFF);
+    emulator.advanceTicks(offset);
+    emulator.setTicksPerRead(1);
+
+    uint32_t time = rtc.getTime();
+    assertTrue(time == 0xFFFF || time == 0x10000);
+  }
+}
+
+// The counter and the divider are read consistently when the counter
+// increments between the reads, which happens when every register read takes
+// one tick of the LSE_CLOCK near the end of the second.
+test(Stm32F1RtcTest, getTimeTicksConsistency) {
+  bool retried = false;
+  for (uint16_t offset = 32756; offset < 32768; offset++) {
+    emulator.reset();
+    Stm32F1Rtc rtc;
+    rtc.begin();
+    rtc.setTime(0xFFFF);
+    emulator.advanceTicks(offset);
+    emulator.setTicksPerRead(1);
+    uint32_t startReads = emulator.getNumCounterReads();
+    uint64_t startTicks = emulatorTicks();
+
+    uint16_t ticks;
+    uint32_t time = rtc.getTimeTicks(&ticks);
+    uint64_t readTicks =
+        (uint64_t) time * Stm32F1Rtc::kTicksPerSecond + ticks;
+    assertMoreOrEqual(readTicks, startTicks);
+    assertLessOrEqual(readTicks, emulatorTicks());
+    if (emulator.getNumCounterReads() - startReads > 6) retried = true;
+  }
+  assertTrue(retried);
+}
+
+//---------------------------------------------------------------------------
+
+test(Stm32F1ClockTest, getNow) {
+  emulator.reset();
+  Stm32F1Clock clock;
+  clock.setup();
+  clock.setNow(100000);
+  assertEqual((acetime_t) 100000, clock.getNow());
+
+  // Ignore an invalid time.
+  clock.setNow(Stm32F1Clock::kInvalidSeconds);
+  assertEqual((acetime_t) 100000, clock.getNow());
+
+  emulator.advanceTicks(2 * Stm32F1Rtc::kTicksPerSecond);
+  assertEqual((acetime_t) 100002, clock.getNow());
+}
+
+test(Stm32F1ClockTest, getNowMillisAndMicros) {
+  emulator.reset();
+  Stm32F1Clock clock;
+  clock.setup();
+  clock.setNow(100000);
+
+  uint16_t millis;
+  uint32_t micros;
+  assertEqual((acetime_t) 100000, clock.getNowMillis(&millis));
+  assertEqual(0, millis);
+  assertEqual((acetime_t) 100000, clock.getNowMicros(&micros));
+  assertEqual((uint32_t) 0, micros);
+
+  emulator.advanceTicks(16384);
+  assertEqual((acetime_t) 100000, clock.getNowMillis(&millis));
+  assertEqual(500, millis);
+  assertEqual((acetime_t) 100000, clock.getNowMicros(&micros));
+  assertEqual((uint32_t) 500000, micros);
+  assertEqual((acetime_t) 100000, clock.readResponseMillis(&millis));
+  assertEqual(500, millis);
+
+  emulator.advanceTicks(16383);
+  assertEqual((acetime_t) 100000, clock.getNowMillis(&millis));
+  assertEqual(999, millis);
+  assertEqual((acetime_t) 100000, clock.getNowMicros(&micros));
+  assertEqual((uint32_t) 999969, micros);
+
+  emulator.advanceTicks(1);
+  assertEqual((acetime_t) 100001, clock.getNowMillis(&millis));
+  assertEqual(0, millis);
+}
+
+//---------------------------------------------------------------------------
+
+void setup() {
+#if ! defined(EPOXY_DUINO)
+  delay(1000); // wait to prevent garbage on SERIAL_PORT_MONITOR
+#endif
+  SERIAL_PORT_MONITOR.begin(115200);
+  while (!SERIAL_PORT_MONITOR); // Leonardo/Micro
+}
+
+void loop() {
+  TestRunner::run();
+}
@@ -0,0 +1,126 @@
+#line 2 "SystemClockCompactTest.ino"
+
+// Verify the public API of the compact memory layout of the SystemClock. This
+// must be defined before including AceTimeClock.h.
+#define ACE_TIME_CLOCK_COMPACT 1
+
+#include <AUnitVerbose.h>
+#include <AceRoutine.h> // enable SystemClockCoroutine
+#include <AceTimeClock.h>
+#include <ace_time/testing/FakeClock.h>
+#include <ace_time/testing/TestableSystemClockLoop.h>
+#include <ace_time/testing/TestableSystemClockCoroutine.h>
+
+using namespace aunit;
+using namespace ace_time;
+using namespace ace_time::clock;
+using namespace ace_time::testing;
+
+//---------------------------------------------------------------------------
+
+test(SystemClockCompactTest, init) {
+  TestableClockInterface::setMillis(0);
+  TestableSystemClockLoop systemClock(nullptr, nullptr);
+  assertFalse(systemClock.isInit());
+  assertEqual(LocalTime::kInvalidSeconds, systemClock.getNow());
+  assertEqual(SystemClock::kSyncStatusUnknown,
+      systemClock.getSyncStatusCode());
+
+  systemClock.setNow(100);
+  assertTrue(systemClock.isInit());
+  assertEqual((acetime_t) 100, systemClock.getNow());
+  assertEqual(SystemClock::kSyncStatusUnknown,
+      systemClock.getSyncStatusCode());
+}
+
+// The packed status code must round trip all values, including
+// kSyncStatusUnknown (128) which does not fit in 2 bits.
+test(SystemClockCompactTest, syncStatusCode) {
+  TestableClockInterface::setMillis(0);
+  FakeClock referenceClock;
+  TestableSystemClockLoop systemClock(&referenceClock, nullptr);
+
+  // Request times out.
+  for (unsigned long ms = 0; ms <= 1000; ms += 500) {
+    TestableClockInterface::setMillis(ms);
+    systemClock.loop();
+  }
+  assertEqual(SystemClock::kSyncStatusTimedOut,
+      systemClock.getSyncStatusCode());
+  assertEqual((int32_t) 1, systemClock.getSecondsSinceSyncAttempt());
+  assertEqual((int32_t) 4, systemClock.getSecondsToSyncAttempt());
+
+  // Retry after 5 seconds returns an invalid response.
+  TestableClockInterface::setMillis(5000);
+  systemClock.loop();
+  systemClock.loop();
+  referenceClock.setNow(LocalTime::kInvalidSeconds);
+  referenceClock.isResponseReady(true);
+  systemClock.loop();
+  assertEqual(SystemClock::kSyncStatusError,
+      systemClock.getSyncStatusCode());
+  assertFalse(systemClock.isInit());
+
+  // Retry after another 10 seconds succeeds.
+  TestableClockInterface::setMillis(15000);
+  systemClock.loop();
+  systemClock.loop();
+  referenceClock.setNow(42);
+  systemClock.loop();
+  assertEqual(SystemClock::kSyncStatusOk, systemClock.getSyncStatusCode());
+  assertTrue(systemClock.isInit());
+  assertEqual((acetime_t) 42, systemClock.getNow());
+  assertEqual((acetime_t) 42, systemClock.getLastSyncTime());
+}
+
+test(SystemClockCompactTest, runCoroutine) {
+  TestableClockInterface::setMillis(0);
+  FakeClock referenceClock;
+  TestableSystemClockCoroutine systemClock(&referenceClock, nullptr);
+  assertEqual(SystemClock::kSyncStatusUnknown,
+      systemClock.getSyncStatusCode());
+
+  referenceClock.setNow(42);
+  referenceClock.isResponseReady(true);
+  systemClock.runCoroutine();
+  assertTrue(systemClock.isDelaying());
+  assertEqual(SystemClock::kSyncStatusOk, systemClock.getSyncStatusCode());
+  assertTrue(systemClock.isInit());
+  assertEqual((acetime_t) 42, systemClock.getNow());
+  assertEqual((int32_t) 3600, systemClock.getSecondsToSyncAttempt());
+}
+
+// Without ACE_TIME_CLOCK_EVENT_CAPTURE, the steps are not remembered, so the
+// captured ticks are always converted using the current time.
+test(SystemClockCompactTest, convertCapturedTicks) {
+  uint32_t micros;
+  TestableClockInterface::setMillis(1000);
+  TestableSystemClockLoop systemClock(nullptr, nullptr);
+  systemClock.setNow(100);
+
+  TestableClockInterface::setMillis(1500);
+  TestableSystemClockLoop::tick_t ticks = systemClock.captureTicks();
+  assertEqual((acetime_t) 100, systemClock.convertCapturedTicks(
+      ticks, &micros));
+  assertEqual((uint32_t) 500000, micros);
+
+  TestableClockInterface::setMillis(2200);
+  systemClock.setNow(200);
+  assertEqual((acetime_t) 199, systemClock.convertCapturedTicks(
+      ticks, &micros));
+  assertEqual((uint32_t) 300000, micros);
+}
+
+//---------------------------------------------------------------------------
+
+void setup() {
+#if ! defined(EPOXY_DUINO)
+  delay(1000); // wait to prevent garbage on SERIAL_PORT_MONITOR
+#endif
+  SERIAL_PORT_MONITOR.begin(115200);
+  while (!SERIAL_PORT_MONITOR); // Leonardo/Micro
+}
+
+void loop() {
+  TestRunner::run();
+}
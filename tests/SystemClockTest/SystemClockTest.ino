@@ -1,5 +1,11 @@
 #line 2 "SystemClockTest.ino"
 
+// Enable the optional features of the SystemClock which are verified below.
+// These must be defined before including AceTimeClock.h.
+#define ACE_TIME_CLOCK_EVENT_CAPTURE 1
+#define ACE_TIME_CLOCK_LEAP_SECONDS 1
+#define ACE_TIME_CLOCK_SYNC_JITTER 1
+
 #include <AUnitVerbose.h>
 #include <AceRoutine.h> // enable SystemClockCoroutine
 #include <AceTimeClock.h>
@@ -66,6 +72,27 @@ testF(SystemClockLoopTest, backupNow) {
   assertEqual((acetime_t) 100, backupAndReferenceClock.getNow());
 }
 
+test(SystemClockLoopTest, getNowMillis) {
+  uint16_t millis;
+  TestableClockInterface::setMillis(0);
+  TestableSystemClockLoop systemClock(nullptr, nullptr);
+  assertEqual(LocalTime::kInvalidSeconds, systemClock.getNowMillis(&millis));
+  assertEqual(0, millis);
+
+  TestableClockInterface::setMillis(1000);
+  systemClock.setNow(100);
+  assertEqual((acetime_t) 100, systemClock.getNowMillis(&millis));
+  assertEqual(0, millis);
+
+  TestableClockInterface::setMillis(1999);
+  assertEqual((acetime_t) 100, systemClock.getNowMillis(&millis));
+  assertEqual(999, millis);
+
+  TestableClockInterface::setMillis(3250);
+  assertEqual((acetime_t) 102, systemClock.getNowMillis(&millis));
+  assertEqual(250, millis);
+}
+
 testF(SystemClockLoopTest, syncNow) {
   assertEqual((acetime_t) 0, systemClock.getNow());
   assertEqual((acetime_t) 0, systemClock.getLastSyncTime());
@@ -87,6 +114,95 @@ testF(SystemClockLoopTest, syncNow) {
   assertEqual((int16_t) -100, systemClock.getClockSkew());
 }
 
+// Same as getNowMillis, using a ClockInterface with microsecond ticks.
+test(SystemClockLoopTest, getNowMicros) {
+  using MicrosSystemClockLoop =
+      SystemClockLoopTemplate<TestableMicrosClockInterface>;
+
+  uint16_t millis;
+  uint32_t micros;
+  TestableMicrosClockInterface::setMicros(0);
+  MicrosSystemClockLoop systemClock(nullptr, nullptr);
+  assertEqual(LocalTime::kInvalidSeconds, systemClock.getNowMicros(&micros));
+  assertEqual((uint32_t) 0, micros);
+
+  TestableMicrosClockInterface::setMicros(1000000);
+  systemClock.setNow(100);
+  TestableMicrosClockInterface::setMicros(1999999);
+  assertEqual((acetime_t) 100, systemClock.getNowMicros(&micros));
+  assertEqual((uint32_t) 999999, micros);
+  assertEqual((acetime_t) 100, systemClock.getNowMillis(&millis));
+  assertEqual(999, millis);
+
+  TestableMicrosClockInterface::setMicros(3250001);
+  assertEqual((acetime_t) 102, systemClock.getNowMicros(&micros));
+  assertEqual((uint32_t) 250001, micros);
+
+  // 32-bit micros roll over after 71.6 minutes, which is allowed as long as
+  // the clock is kept alive within that period.
+  TestableMicrosClockInterface::setMicros(UINT32_MAX);
+  systemClock.getNow();
+  TestableMicrosClockInterface::setMicros(UINT32_MAX + (uint32_t) 500000);
+  assertEqual((acetime_t) (100 + 4294), systemClock.getNowMicros(&micros));
+}
+
+test(SystemClockLoopTest, monotonicClockInterface) {
+  using MonotonicSystemClockLoop =
+      SystemClockLoopTemplate<ace_time::hw::MonotonicClockInterface>;
+
+  MonotonicSystemClockLoop systemClock(nullptr, nullptr);
+  systemClock.setNow(100);
+  delay(20);
+  uint32_t micros;
+  assertEqual((acetime_t) 100, systemClock.getNowMicros(&micros));
+  assertMoreOrEqual(micros, (uint32_t) 20000);
+  assertLess(micros, (uint32_t) 1000000);
+}
+
+testF(SystemClockLoopTest, syncNowMillis) {
+  uint16_t millis;
+  TestableClockInterface::setMillis(1000);
+  systemClock.syncNow(100, 250);
+  assertEqual((acetime_t) 100, systemClock.getNowMillis(&millis));
+  assertEqual(250, millis);
+  assertEqual((int16_t) -100, systemClock.getClockSkew());
+
+  // Same seconds, but a different phase, still updates the phase.
+  TestableClockInterface::setMillis(1500);
+  systemClock.syncNow(100, 900);
+  assertEqual((acetime_t) 100, systemClock.getNowMillis(&millis));
+  assertEqual(900, millis);
+  assertEqual((int16_t) 0, systemClock.getClockSkew());
+  TestableClockInterface::setMillis(1600);
+  assertEqual((acetime_t) 101, systemClock.getNowMillis(&millis));
+  assertEqual(0, millis);
+
+  // Unknown millis with the same seconds preserves the phase.
+  systemClock.syncNow(101);
+  assertEqual((acetime_t) 101, systemClock.getNowMillis(&millis));
+  assertEqual(0, millis);
+}
+
+testF(SystemClockLoopTest, loopSyncMillis) {
+  uint16_t millis;
+  TestableClockInterface::setMillis(1000);
+  backupAndReferenceClock.setNow(100);
+  backupAndReferenceClock.setMillis(400);
+  backupAndReferenceClock.isResponseReady(true);
+
+  // Send request, then read the response.
+  systemClock.loop();
+  TestableClockInterface::setMillis(1010);
+  systemClock.loop();
+  assertEqual(SystemClock::kSyncStatusOk, systemClock.getSyncStatusCode());
+  assertEqual((acetime_t) 100, systemClock.getNowMillis(&millis));
+  assertEqual(400, millis);
+
+  TestableClockInterface::setMillis(1610);
+  assertEqual((acetime_t) 101, systemClock.getNowMillis(&millis));
+  assertEqual(0, millis);
+}
+
 testF(SystemClockLoopTest, getNow) {
   unsigned long nowMillis = 1;
 
@@ -121,7 +237,8 @@ testF(SystemClockLoopTest, getNow) {
 testF(SystemClockLoopTest, loop) {
   unsigned long millis = 0;
   backupAndReferenceClock.isResponseReady(false);
-  assertEqual(SystemClockLoop::kStatusReady, systemClock.mRequestStatus);
+  assertEqual(SystemClockLoop::kStatusReady,
+      systemClock.getRequestStatusCode());
   assertEqual(SystemClock::kSyncStatusUnknown, systemClock.getSyncStatusCode());
 
   // retry with exponential backoff, doubling the delay on each
@@ -138,7 +255,8 @@ testF(SystemClockLoopTest, loop) {
 
     // t = 0, make a request and waits for response
     systemClock.loop();
-    assertEqual(SystemClockLoop::kStatusSent, systemClock.mRequestStatus);
+    assertEqual(SystemClockLoop::kStatusSent,
+        systemClock.getRequestStatusCode());
     assertEqual((int32_t) 0, systemClock.getSecondsSinceSyncAttempt());
     assertEqual((int32_t) expectedDelaySeconds,
         systemClock.getSecondsToSyncAttempt());
@@ -155,7 +273,7 @@ testF(SystemClockLoopTest, loop) {
       TestableClockInterface::setMillis(millis);
       systemClock.loop();
       assertEqual(SystemClockLoop::kStatusWaitForRetry,
-          systemClock.mRequestStatus);
+          systemClock.getRequestStatusCode());
       assertEqual((int32_t) i, systemClock.getSecondsSinceSyncAttempt());
       assertEqual((int32_t) expectedDelaySeconds - i,
           systemClock.getSecondsToSyncAttempt());
@@ -168,7 +286,8 @@ testF(SystemClockLoopTest, loop) {
     millis += 1000;
     TestableClockInterface::setMillis(millis);
     systemClock.loop();
-    assertEqual(SystemClockLoop::kStatusReady, systemClock.mRequestStatus);
+    assertEqual(SystemClockLoop::kStatusReady,
+        systemClock.getRequestStatusCode());
     assertEqual((int32_t) expectedDelaySeconds,
         systemClock.getSecondsSinceSyncAttempt());
     assertEqual(0, systemClock.getSecondsToSyncAttempt());
@@ -179,7 +298,7 @@ testF(SystemClockLoopTest, loop) {
 
   // Last iteration. Make a request.
   systemClock.loop();
-  assertEqual(SystemClockLoop::kStatusSent, systemClock.mRequestStatus);
+  assertEqual(SystemClockLoop::kStatusSent, systemClock.getRequestStatusCode());
   assertEqual(0, systemClock.getSecondsSinceSyncAttempt());
   assertEqual(systemClock.mCurrentSyncPeriodSeconds,
       systemClock.getSecondsToSyncAttempt());
@@ -191,7 +310,8 @@ testF(SystemClockLoopTest, loop) {
   millis += 1000;
   TestableClockInterface::setMillis(millis);
   systemClock.loop();
-  assertEqual(SystemClockLoop::kStatusWaitForRetry, systemClock.mRequestStatus);
+  assertEqual(SystemClockLoop::kStatusWaitForRetry,
+      systemClock.getRequestStatusCode());
   assertEqual(
       SystemClock::kSyncStatusTimedOut,
       systemClock.getSyncStatusCode());
@@ -204,7 +324,7 @@ testF(SystemClockLoopTest, loop) {
     TestableClockInterface::setMillis(millis);
     systemClock.loop();
     assertEqual(SystemClockLoop::kStatusWaitForRetry,
-        systemClock.mRequestStatus);
+        systemClock.getRequestStatusCode());
     assertEqual(
         SystemClock::kSyncStatusTimedOut,
         systemClock.getSyncStatusCode());
@@ -214,7 +334,8 @@ testF(SystemClockLoopTest, loop) {
   millis += 1000;
   TestableClockInterface::setMillis(millis);
   systemClock.loop();
-  assertEqual(SystemClockLoop::kStatusReady, systemClock.mRequestStatus);
+  assertEqual(SystemClockLoop::kStatusReady,
+      systemClock.getRequestStatusCode());
   assertEqual(
       SystemClock::kSyncStatusTimedOut,
       systemClock.getSyncStatusCode());
@@ -223,7 +344,7 @@ testF(SystemClockLoopTest, loop) {
   millis += 1000;
   TestableClockInterface::setMillis(millis);
   systemClock.loop();
-  assertEqual(SystemClockLoop::kStatusSent, systemClock.mRequestStatus);
+  assertEqual(SystemClockLoop::kStatusSent, systemClock.getRequestStatusCode());
   assertEqual(0, systemClock.getSecondsSinceSyncAttempt());
   assertEqual(systemClock.mCurrentSyncPeriodSeconds,
       systemClock.getSecondsToSyncAttempt());
@@ -237,7 +358,7 @@ testF(SystemClockLoopTest, loop) {
   millis += 1;
   TestableClockInterface::setMillis(millis);
   systemClock.loop();
-  assertEqual(SystemClockLoop::kStatusOk, systemClock.mRequestStatus);
+  assertEqual(SystemClockLoop::kStatusOk, systemClock.getRequestStatusCode());
   assertEqual((acetime_t) 42, systemClock.getNow());
   assertEqual((acetime_t) 42, systemClock.getLastSyncTime());
   assertTrue(systemClock.isInit());
@@ -268,7 +389,8 @@ class SystemClockCoroutineTest: public TestOnce {
 testF(SystemClockCoroutineTest, runCoroutine) {
   unsigned long millis = 0;
   backupAndReferenceClock.isResponseReady(false);
-  assertEqual(SystemClockCoroutine::kStatusUnknown, systemClock.mRequestStatus);
+  assertEqual(SystemClockCoroutine::kStatusUnknown,
+      systemClock.getRequestStatusCode());
   assertEqual(
       SystemClock::kSyncStatusUnknown,
       systemClock.getSyncStatusCode());
@@ -320,7 +442,8 @@ testF(SystemClockCoroutineTest, runCoroutine) {
   // Make one final request
   systemClock.runCoroutine();
   assertTrue(systemClock.isYielding());
-  assertEqual(SystemClockCoroutine::kStatusSent, systemClock.mRequestStatus);
+  assertEqual(SystemClockCoroutine::kStatusSent,
+      systemClock.getRequestStatusCode());
   assertEqual(0, systemClock.getSecondsSinceSyncAttempt());
   assertEqual(systemClock.mCurrentSyncPeriodSeconds,
       systemClock.getSecondsToSyncAttempt());
@@ -349,7 +472,8 @@ testF(SystemClockCoroutineTest, runCoroutine) {
   // verify successful request
   systemClock.runCoroutine();
   assertTrue(systemClock.isDelaying());
-  assertEqual(systemClock.mRequestStatus, SystemClockCoroutine::kStatusOk);
+  assertEqual(systemClock.getRequestStatusCode(),
+      SystemClockCoroutine::kStatusOk);
   assertEqual((acetime_t) 42, systemClock.getNow());
   assertEqual((acetime_t) 42, systemClock.getLastSyncTime());
   assertTrue(systemClock.isInit());
@@ -361,6 +485,1197 @@ testF(SystemClockCoroutineTest, runCoroutine) {
 
 //---------------------------------------------------------------------------
 
+using StaticTestableSystemClockLoop = SystemClockLoopTemplate<
+    TestableClockInterface, SystemClockNoInstrumentation, FakeClock, FakeClock>;
+
+using NullTestableSystemClockLoop = SystemClockLoopTemplate<
+    TestableClockInterface, SystemClockNoInstrumentation, NullClock, NullClock>;
+
+// The reference and backup clocks are called through their static types.
+test(StaticSystemClockLoopTest, syncAndBackup) {
+  TestableClockInterface::setMillis(0);
+  FakeClock referenceClock;
+  FakeClock backupClock;
+  backupClock.setNow(50);
+  StaticTestableSystemClockLoop systemClock(&referenceClock, &backupClock);
+
+  // setup() restores from the backupClock, which sets the referenceClock.
+  systemClock.setup();
+  assertEqual((acetime_t) 50, systemClock.getNow());
+  assertEqual((acetime_t) 50, referenceClock.getNow());
+
+  // Sync with the referenceClock, which is saved into the backupClock.
+  referenceClock.setNow(100);
+  referenceClock.isResponseReady(true);
+  systemClock.loop();
+  TestableClockInterface::setMillis(10);
+  systemClock.loop();
+  assertEqual(SystemClock::kSyncStatusOk, systemClock.getSyncStatusCode());
+  assertEqual((acetime_t) 100, systemClock.getNow());
+  assertEqual((acetime_t) 100, backupClock.getNow());
+}
+
+// A NullClock as the reference and backup clock is removed at compile time.
+test(StaticSystemClockLoopTest, nullClock) {
+  TestableClockInterface::setMillis(0);
+  NullTestableSystemClockLoop systemClock(nullptr, nullptr);
+  systemClock.setup();
+  assertEqual(LocalTime::kInvalidSeconds, systemClock.getNow());
+
+  systemClock.setNow(100);
+  systemClock.loop();
+  systemClock.forceSync();
+  assertEqual((acetime_t) 100, systemClock.getNow());
+  assertEqual(SystemClock::kSyncStatusUnknown,
+      systemClock.getSyncStatusCode());
+
+  // NullClock stores no pointers.
+  assertLess(sizeof(NullTestableSystemClockLoop),
+      sizeof(TestableSystemClockLoop));
+  assertEqual(sizeof(StaticTestableSystemClockLoop),
+      sizeof(TestableSystemClockLoop));
+}
+
+//---------------------------------------------------------------------------
+
+#if ! ACE_TIME_CLOCK_COMPACT
+
+// Verify that exactly one latency sample is recorded per request, however many
+// times loop() or runCoroutine() is called while waiting for the response.
+test(SystemClockLatencyTest, loop) {
+  TestableClockInterface::setMillis(0);
+  FakeClock referenceClock;
+  LatencyHistogram histogram;
+  TestableSystemClockLoop systemClock(
+      &referenceClock, nullptr, 3600, 5, 1000, &histogram);
+
+  // Request times out after 1000 ms, with 4 iterations while waiting.
+  for (unsigned long ms = 0; ms <= 1000; ms += 250) {
+    TestableClockInterface::setMillis(ms);
+    systemClock.loop();
+  }
+  assertEqual((uint32_t) 1,
+      histogram.getCount(LatencyHistogram::kOutcomeTimeout));
+  assertEqual(1000,
+      histogram.getMaxMillis(LatencyHistogram::kOutcomeTimeout));
+
+  // Retry after 5 seconds, response arrives after 30 ms.
+  TestableClockInterface::setMillis(5000);
+  systemClock.loop();
+  systemClock.loop();
+  TestableClockInterface::setMillis(5010);
+  systemClock.loop();
+  referenceClock.setNow(100);
+  referenceClock.isResponseReady(true);
+  TestableClockInterface::setMillis(5030);
+  systemClock.loop();
+  assertEqual((uint32_t) 1, histogram.getCount(LatencyHistogram::kOutcomeOk));
+  assertEqual(30, histogram.getMaxMillis(LatencyHistogram::kOutcomeOk));
+  assertEqual((uint32_t) 1,
+      histogram.getCount(LatencyHistogram::kOutcomeTimeout));
+  assertEqual((uint32_t) 0,
+      histogram.getCount(LatencyHistogram::kOutcomeError));
+}
+
+test(SystemClockLatencyTest, runCoroutine) {
+  TestableClockInterface::setMillis(0);
+  FakeClock referenceClock;
+  LatencyHistogram histogram;
+  TestableSystemClockCoroutine systemClock(
+      &referenceClock, nullptr, 3600, 5, 1000, &histogram);
+
+  // Request times out after 1000 ms.
+  for (unsigned long ms = 0; ms <= 1000; ms += 250) {
+    TestableClockInterface::setMillis(ms);
+    systemClock.runCoroutine();
+  }
+  assertTrue(systemClock.isDelaying());
+  assertEqual((uint32_t) 1,
+      histogram.getCount(LatencyHistogram::kOutcomeTimeout));
+  assertEqual(1000,
+      histogram.getMaxMillis(LatencyHistogram::kOutcomeTimeout));
+
+  // Retry after 5 seconds returns an invalid response after 20 ms.
+  for (unsigned long ms = 2000; ms <= 6000; ms += 1000) {
+    TestableClockInterface::setMillis(ms);
+    systemClock.runCoroutine();
+  }
+  assertTrue(systemClock.isYielding());
+  referenceClock.setNow(LocalTime::kInvalidSeconds);
+  referenceClock.isResponseReady(true);
+  TestableClockInterface::setMillis(6020);
+  systemClock.runCoroutine();
+  assertEqual((uint32_t) 1,
+      histogram.getCount(LatencyHistogram::kOutcomeError));
+  assertEqual(20, histogram.getMaxMillis(LatencyHistogram::kOutcomeError));
+  assertEqual((uint32_t) 0, histogram.getCount(LatencyHistogram::kOutcomeOk));
+}
+
+#endif
+
+//---------------------------------------------------------------------------
+
+#if ! ACE_TIME_CLOCK_COMPACT
+
+test(SystemClockMonotonicTest, getMonotonicMillis) {
+  TestableClockInterface::setMillis(1000);
+  TestableSystemClockLoop systemClock(nullptr, nullptr);
+  assertEqual((uint64_t) 1000, systemClock.getMonotonicMillis());
+
+  // The 32-bit millis() rolls over after 49.7 days.
+  TestableClockInterface::setMillis((uint32_t) 0xFFFFFF00);
+  systemClock.loop();
+  assertEqual((uint64_t) 0xFFFFFF00, systemClock.getMonotonicMillis());
+  TestableClockInterface::setMillis(0x100);
+  systemClock.loop();
+  assertEqual((uint64_t) 0x100000100, systemClock.getMonotonicMillis());
+  TestableClockInterface::setMillis((uint32_t) 0xFFFFFFFF);
+  assertEqual((uint64_t) 0x1FFFFFFFF, systemClock.getMonotonicMillis());
+  TestableClockInterface::setMillis(0);
+  assertEqual((uint64_t) 0x200000000, systemClock.getMonotonicMillis());
+}
+
+// The reference clock is stepped backwards and forwards. The monotonic millis
+// never decrease, and intervals measured with them are not affected.
+test(SystemClockMonotonicTest, syncSteps) {
+  uint16_t millis;
+  TestableClockInterface::setMillis(0);
+  FakeClock referenceClock;
+  TestableSystemClockLoop systemClock(&referenceClock, nullptr);
+  assertEqual(LocalTime::kInvalidSeconds,
+      systemClock.convertMonotonicMillis(0, &millis));
+  assertEqual(SystemClock::kInvalidMonotonicMillis,
+      systemClock.convertEpochSecondsToMonotonicMillis(100));
+
+  referenceClock.setNow(1000);
+  systemClock.forceSync();
+  uint64_t start = systemClock.getMonotonicMillis();
+  assertEqual((acetime_t) 1000, systemClock.convertMonotonicMillis(
+      start, &millis));
+  assertEqual(0, millis);
+
+  // Step back by 100 seconds after 10 seconds.
+  TestableClockInterface::setMillis(10000);
+  uint64_t prev = systemClock.getMonotonicMillis();
+  referenceClock.setNow(910);
+  systemClock.forceSync();
+  assertEqual((acetime_t) 910, systemClock.getNow());
+  uint64_t now = systemClock.getMonotonicMillis();
+  assertMoreOrEqual(now, prev);
+  assertEqual((uint64_t) 10000, now - start);
+
+  // Step forward by 1000 seconds after another 5.5 seconds.
+  TestableClockInterface::setMillis(15500);
+  prev = systemClock.getMonotonicMillis();
+  referenceClock.setNow(1915);
+  systemClock.forceSync();
+  now = systemClock.getMonotonicMillis();
+  assertMoreOrEqual(now, prev);
+  assertEqual((uint64_t) 15500, now - start);
+
+  // The conversions use the mapping after the last step.
+  assertEqual((acetime_t) 1915, systemClock.convertMonotonicMillis(
+      now, &millis));
+  assertEqual(0, millis);
+  assertEqual((acetime_t) 1899, systemClock.convertMonotonicMillis(
+      start, &millis));
+  assertEqual(500, millis);
+  assertEqual(now + 2250,
+      systemClock.convertEpochSecondsToMonotonicMillis(1917, 250));
+
+  // Times before boot are clamped to 0.
+  assertEqual((uint64_t) 0,
+      systemClock.convertEpochSecondsToMonotonicMillis(1800));
+}
+
+#endif
+
+//---------------------------------------------------------------------------
+
+// Sync a SystemClockLoop to its referenceClock at 1000, force a sync to a
+// referenceClock which is 2 seconds slower 10 seconds later, then save its
+// snapshot.
+static void saveSyncedSnapshot(SystemClockSnapshot* snapshot) {
+  TestableClockInterface::setMillis(0);
+  FakeClock referenceClock;
+  referenceClock.setNow(1000);
+  referenceClock.isResponseReady(true);
+  TestableSystemClockLoop systemClock(&referenceClock, nullptr);
+  systemClock.loop();
+  systemClock.loop();
+  TestableClockInterface::setMillis(10000);
+  systemClock.loop();
+  referenceClock.setNow(1008);
+  systemClock.forceSync();
+  systemClock.saveSnapshot(snapshot);
+}
+
+test(SystemClockSnapshotTest, save) {
+  SystemClockSnapshot snapshot;
+  saveSyncedSnapshot(&snapshot);
+  assertTrue(snapshot.isValid());
+  assertEqual(SystemClockSnapshot::kVersion, snapshot.version);
+  assertEqual(SystemClock::kSyncStatusOk, snapshot.syncStatusCode);
+  assertEqual(3600, snapshot.syncPeriodSeconds);
+  assertEqual(2, snapshot.clockSkew);
+  assertEqual((acetime_t) 1008, snapshot.lastSyncTime);
+  assertEqual((acetime_t) 4598, snapshot.nextSyncTime);
+
+  // Corrupted or incompatible snapshots are rejected.
+  snapshot.clockSkew++;
+  assertFalse(snapshot.isValid());
+  snapshot.clockSkew--;
+  snapshot.version++;
+  snapshot.checksum = snapshot.computeChecksum();
+  assertFalse(snapshot.isValid());
+  memset(&snapshot, 0, sizeof(snapshot));
+  assertFalse(snapshot.isValid());
+}
+
+test(SystemClockSnapshotTest, restoreLoop) {
+  SystemClockSnapshot snapshot;
+  saveSyncedSnapshot(&snapshot);
+
+  // Reboot 90 seconds later, with the time restored from the backupClock.
+  TestableClockInterface::setMillis(0);
+  FakeClock referenceClock;
+  referenceClock.isResponseReady(true);
+  FakeClock backupClock;
+  backupClock.setNow(1100);
+  TestableSystemClockLoop systemClock(&referenceClock, &backupClock);
+  systemClock.setup();
+  referenceClock.setNow(2000);
+  assertTrue(systemClock.restoreSnapshot(snapshot));
+  assertEqual(SystemClock::kSyncStatusOk, systemClock.getSyncStatusCode());
+  assertEqual((acetime_t) 1008, systemClock.getLastSyncTime());
+  assertEqual(2, systemClock.getClockSkew());
+  assertEqual(3498, systemClock.getSecondsToSyncAttempt());
+
+  // No request until the saved time of the next sync attempt.
+  unsigned long millis = 0;
+  for (; millis < 3498000; millis += 1000) {
+    TestableClockInterface::setMillis(millis);
+    systemClock.loop();
+    assertEqual((acetime_t) 1008, systemClock.getLastSyncTime());
+  }
+  TestableClockInterface::setMillis(millis);
+  systemClock.loop();
+  systemClock.loop();
+  systemClock.loop();
+  assertEqual((acetime_t) 2000, systemClock.getLastSyncTime());
+  assertEqual(3600, systemClock.getSecondsToSyncAttempt());
+}
+
+test(SystemClockSnapshotTest, restoreWithoutTime) {
+  SystemClockSnapshot snapshot;
+  saveSyncedSnapshot(&snapshot);
+
+  // Without the time, the sync is attempted immediately.
+  TestableClockInterface::setMillis(0);
+  FakeClock referenceClock;
+  TestableSystemClockLoop systemClock(&referenceClock, nullptr);
+  assertTrue(systemClock.restoreSnapshot(snapshot));
+  assertEqual(0, systemClock.getSecondsToSyncAttempt());
+  systemClock.loop();
+  assertEqual(3600, systemClock.getSecondsToSyncAttempt());
+
+  // An invalid snapshot changes nothing.
+  TestableSystemClockLoop otherClock(&referenceClock, nullptr);
+  snapshot.checksum++;
+  assertFalse(otherClock.restoreSnapshot(snapshot));
+  assertEqual(SystemClock::kSyncStatusUnknown, otherClock.getSyncStatusCode());
+  assertEqual(LocalTime::kInvalidSeconds, otherClock.getLastSyncTime());
+}
+
+test(SystemClockSnapshotTest, restoreCoroutine) {
+  SystemClockSnapshot snapshot;
+  saveSyncedSnapshot(&snapshot);
+
+  TestableClockInterface::setMillis(0);
+  FakeClock referenceClock;
+  referenceClock.isResponseReady(true);
+  FakeClock backupClock;
+  backupClock.setNow(4588);
+  TestableSystemClockCoroutine systemClock(&referenceClock, &backupClock);
+  systemClock.setup();
+  referenceClock.setNow(2000);
+  assertTrue(systemClock.restoreSnapshot(snapshot));
+  assertEqual(10, systemClock.getSecondsToSyncAttempt());
+
+  unsigned long millis = 0;
+  for (; millis < 10000; millis += 1000) {
+    TestableClockInterface::setMillis(millis);
+    systemClock.runCoroutine();
+    assertTrue(systemClock.isDelaying());
+    assertEqual((acetime_t) 1008, systemClock.getLastSyncTime());
+  }
+  TestableClockInterface::setMillis(millis);
+  systemClock.runCoroutine();
+  assertEqual((acetime_t) 2000, systemClock.getLastSyncTime());
+  assertEqual(3600, systemClock.getSecondsToSyncAttempt());
+}
+
+//---------------------------------------------------------------------------
+
+// A FakeClock which counts the requests sent to it.
+class CountingClock: public FakeClock {
+  public:
+    void sendRequest() const override { mNumRequests++; }
+
+    uint16_t getNumRequests() const { return mNumRequests; }
+
+  private:
+    mutable uint16_t mNumRequests = 0;
+};
+
+#if ACE_TIME_CLOCK_SYNC_JITTER
+
+// A device of a fleet which boots at the same time, all syncing to the same
+// referenceClock. Final, so that it can be deleted without a virtual
+// destructor.
+class FleetClock final: public TestableSystemClockLoop {
+  public:
+    explicit FleetClock(Clock* referenceClock):
+        TestableSystemClockLoop(referenceClock, nullptr) {}
+};
+
+static const uint8_t kNumFleetClocks = 16;
+
+// Create the fleet, with the jitter enabled if `jitterPercent` > 0.
+static void createFleet(FleetClock* fleet[], Clock* referenceClock,
+    uint8_t jitterPercent) {
+  TestableClockInterface::setMillis(0);
+  for (uint8_t i = 0; i < kNumFleetClocks; i++) {
+    fleet[i] = new FleetClock(referenceClock);
+    fleet[i]->setup();
+    if (jitterPercent > 0) fleet[i]->setSyncJitter(1000 + i, jitterPercent);
+  }
+}
+
+static void deleteFleet(FleetClock* fleet[]) {
+  for (uint8_t i = 0; i < kNumFleetClocks; i++) delete fleet[i];
+}
+
+// Advance the millis() from `startMillis` to `endMillis` in steps of
+// `stepMillis`, calling loop() of every clock in the fleet, and return the
+// maximum number of requests sent to `referenceClock` in a single step.
+static uint16_t runFleet(FleetClock* fleet[],
+    const CountingClock& referenceClock,
+    unsigned long startMillis, unsigned long endMillis,
+    unsigned long stepMillis) {
+  uint16_t maxRequests = 0;
+  for (unsigned long t = startMillis; t <= endMillis; t += stepMillis) {
+    TestableClockInterface::setMillis(t);
+    uint16_t prevRequests = referenceClock.getNumRequests();
+    for (uint8_t i = 0; i < kNumFleetClocks; i++) fleet[i]->loop();
+    uint16_t requests = referenceClock.getNumRequests() - prevRequests;
+    if (requests > maxRequests) maxRequests = requests;
+  }
+  return maxRequests;
+}
+
+test(SystemClockJitterTest, setSyncJitter) {
+  TestableClockInterface::setMillis(0);
+  CountingClock referenceClock;
+  TestableSystemClockLoop systemClock(&referenceClock, nullptr, 3600, 60);
+  assertEqual(0, systemClock.getSyncJitterPercent());
+  systemClock.setSyncJitter(42, 80);
+  assertEqual(SystemClock::kMaxSyncJitterPercent,
+      systemClock.getSyncJitterPercent());
+
+  // The phase offset depends only on the deviceId.
+  int32_t phaseSeconds = systemClock.getSecondsToSyncAttempt();
+  assertLess(phaseSeconds, (int32_t) 60);
+  TestableSystemClockLoop otherClock(&referenceClock, nullptr, 3600, 60);
+  otherClock.setSyncJitter(42, 0);
+  assertEqual(phaseSeconds, otherClock.getSecondsToSyncAttempt());
+  assertEqual(0, otherClock.getSyncJitterPercent());
+
+  // The first request is delayed by the phase offset.
+  systemClock.loop();
+  assertEqual(0, referenceClock.getNumRequests());
+  TestableClockInterface::setMillis((phaseSeconds + 1) * (uint32_t) 1000);
+  systemClock.loop();
+  systemClock.loop();
+  assertEqual(1, referenceClock.getNumRequests());
+}
+
+test(SystemClockJitterTest, initialSync) {
+  FleetClock* fleet[kNumFleetClocks];
+  CountingClock referenceClock;
+
+  // Without jitter, the whole fleet sends its first request at once.
+  createFleet(fleet, &referenceClock, 0);
+  assertEqual(kNumFleetClocks, runFleet(fleet, referenceClock, 0, 0, 100));
+  deleteFleet(fleet);
+
+  // With jitter, the first requests are spread over the initial sync period
+  // of 5 seconds, and the retries with exponential backoff drift apart.
+  createFleet(fleet, &referenceClock, 25);
+  uint16_t prevRequests = referenceClock.getNumRequests();
+  assertLessOrEqual(runFleet(fleet, referenceClock, 0, 4900, 100), 2);
+  assertEqual(kNumFleetClocks, referenceClock.getNumRequests() - prevRequests);
+  assertLessOrEqual(runFleet(fleet, referenceClock, 5000, 600000, 100), 2);
+  deleteFleet(fleet);
+}
+
+test(SystemClockJitterTest, steadyState) {
+  FleetClock* fleet[kNumFleetClocks];
+  CountingClock referenceClock;
+  referenceClock.setNow(1000);
+  referenceClock.isResponseReady(true);
+
+  // Without jitter, devices which synced in the same second keep syncing in
+  // the same second.
+  createFleet(fleet, &referenceClock, 0);
+  runFleet(fleet, referenceClock, 0, 3599000, 1000);
+  assertEqual(kNumFleetClocks,
+      runFleet(fleet, referenceClock, 3600000, 3700000, 1000));
+  deleteFleet(fleet);
+
+  // With jitter, each sync period is 3600 s +/- 10%, so the syncs spread
+  // out, while the average sync period is unchanged: about 9 syncs per device
+  // in the next 9 hours.
+  createFleet(fleet, &referenceClock, 10);
+  runFleet(fleet, referenceClock, 0, 3599000, 1000);
+  uint16_t prevRequests = referenceClock.getNumRequests();
+  assertLessOrEqual(
+      runFleet(fleet, referenceClock, 3600000, 36000000, 1000), 2);
+  uint16_t requests = referenceClock.getNumRequests() - prevRequests;
+  assertMoreOrEqual(requests, kNumFleetClocks * 8);
+  assertLessOrEqual(requests, kNumFleetClocks * 10);
+  for (uint8_t i = 0; i < kNumFleetClocks; i++) {
+    int32_t secondsToSync = fleet[i]->getSecondsToSyncAttempt();
+    assertLessOrEqual(secondsToSync, (int32_t) 3960);
+  }
+  deleteFleet(fleet);
+}
+
+test(SystemClockJitterTest, runCoroutine) {
+  TestableClockInterface::setMillis(0);
+  CountingClock referenceClock;
+  TestableSystemClockLoop loopClock(&referenceClock, nullptr, 3600, 60);
+  loopClock.setSyncJitter(42, 10);
+  TestableSystemClockCoroutine systemClock(&referenceClock, nullptr, 3600, 60);
+  systemClock.setSyncJitter(42, 10);
+
+  // The first request is delayed by the same phase offset as the
+  // SystemClockLoop with the same deviceId.
+  int32_t phaseSeconds = systemClock.getSecondsToSyncAttempt();
+  assertEqual(loopClock.getSecondsToSyncAttempt(), phaseSeconds);
+  unsigned long t = 0;
+  for (; referenceClock.getNumRequests() == 0; t += 100) {
+    TestableClockInterface::setMillis(t);
+    systemClock.runCoroutine();
+  }
+  assertMoreOrEqual(t, phaseSeconds * (unsigned long) 1000);
+  assertLessOrEqual(t, (phaseSeconds + 1) * (unsigned long) 1000);
+}
+
+test(SystemClockJitterTest, runCoroutineKeepsDeadline) {
+  TestableClockInterface::setMillis(0);
+  CountingClock referenceClock;
+  referenceClock.setNow(1000);
+  referenceClock.isResponseReady(true);
+  TestableSystemClockCoroutine systemClock(&referenceClock, nullptr, 3600, 60);
+  systemClock.setSyncJitter(42, 10);
+
+  // Run until the first sync, then send the second request.
+  unsigned long t = 0;
+  for (; referenceClock.getNumRequests() == 0; t += 1000) {
+    TestableClockInterface::setMillis(t);
+    systemClock.runCoroutine();
+  }
+  referenceClock.isResponseReady(false);
+  for (; referenceClock.getNumRequests() == 1; t += 1000) {
+    TestableClockInterface::setMillis(t);
+    systemClock.runCoroutine();
+  }
+  int32_t secondsToSync = systemClock.getSecondsToSyncAttempt();
+  assertMoreOrEqual(secondsToSync, (int32_t) 3240);
+  assertLessOrEqual(secondsToSync, (int32_t) 3960);
+
+  // The response does not draw another jittered sync period.
+  referenceClock.isResponseReady(true);
+  systemClock.runCoroutine();
+  assertEqual(SystemClock::kSyncStatusOk, systemClock.getSyncStatusCode());
+  assertEqual(secondsToSync, systemClock.getSecondsToSyncAttempt());
+}
+
+#endif
+
+//---------------------------------------------------------------------------
+
+test(SystemClockDeadlineTest, getMillisToKeepAlive) {
+  TestableClockInterface::setMillis(1000);
+  TestableSystemClockLoop systemClock(nullptr, nullptr);
+  assertEqual(SystemClock::kMaxMillisToKeepAlive,
+      systemClock.getMillisToKeepAlive());
+
+  // One second less than the rollover of the 16-bit millis ticks.
+  systemClock.setNow(100);
+  assertEqual((uint32_t) 64535, systemClock.getMillisToKeepAlive());
+  assertEqual((uint32_t) 64535, systemClock.getMillisToNextRun());
+  TestableClockInterface::setMillis(1250);
+  assertEqual((uint32_t) 64285, systemClock.getMillisToKeepAlive());
+  TestableClockInterface::setMillis(5250);
+  systemClock.loop();
+  assertEqual((uint32_t) 64285, systemClock.getMillisToKeepAlive());
+  TestableClockInterface::setMillis(5250 + 64285);
+  assertEqual((uint32_t) 0, systemClock.getMillisToKeepAlive());
+
+  // One second less than the rollover of the 32-bit micros ticks.
+  using MicrosSystemClockLoop =
+      SystemClockLoopTemplate<TestableMicrosClockInterface>;
+  TestableMicrosClockInterface::setMicros(0);
+  MicrosSystemClockLoop microsClock(nullptr, nullptr);
+  microsClock.setNow(100);
+  assertEqual((uint32_t) 4293967, microsClock.getMillisToKeepAlive());
+
+  // The 64-bit micros ticks do not roll over.
+  using MonotonicSystemClockLoop =
+      SystemClockLoopTemplate<ace_time::hw::MonotonicClockInterface>;
+  MonotonicSystemClockLoop monotonicClock(nullptr, nullptr);
+  monotonicClock.setNow(100);
+  assertEqual(SystemClock::kMaxMillisToKeepAlive,
+      monotonicClock.getMillisToKeepAlive());
+}
+
+test(SystemClockDeadlineTest, loop) {
+  TestableClockInterface::setMillis(0);
+  FakeClock referenceClock;
+  TestableSystemClockLoop systemClock(&referenceClock, nullptr, 3600, 5, 1000);
+
+  // Ready to send the request.
+  assertEqual((uint32_t) 0, systemClock.getMillisToNextRun());
+
+  // Poll for the response until the request times out.
+  systemClock.loop();
+  assertEqual((uint32_t) SystemClock::kResponsePollMillis,
+      systemClock.getMillisToNextRun());
+  TestableClockInterface::setMillis(995);
+  assertEqual((uint32_t) 5, systemClock.getMillisToNextRun());
+  TestableClockInterface::setMillis(1000);
+  assertEqual((uint32_t) 0, systemClock.getMillisToNextRun());
+
+  // Wait for the retry.
+  systemClock.loop();
+  assertEqual((uint32_t) 4000, systemClock.getMillisToNextRun());
+  TestableClockInterface::setMillis(5000);
+  assertEqual((uint32_t) 0, systemClock.getMillisToNextRun());
+
+  // After a successful sync, wait for the next sync, but at most until the
+  // next keepAlive().
+  referenceClock.setNow(100);
+  referenceClock.isResponseReady(true);
+  systemClock.loop();
+  systemClock.loop();
+  systemClock.loop();
+  assertEqual(SystemClock::kSyncStatusOk, systemClock.getSyncStatusCode());
+  assertEqual((uint32_t) 64535, systemClock.getMillisToNextRun());
+  TestableClockInterface::setMillis(5000 + 3600000 - 100);
+  systemClock.loop();
+  assertEqual((uint32_t) 100, systemClock.getMillisToNextRun());
+}
+
+test(SystemClockDeadlineTest, runCoroutine) {
+  TestableClockInterface::setMillis(0);
+  FakeClock referenceClock;
+  TestableSystemClockCoroutine systemClock(
+      &referenceClock, nullptr, 3600, 5, 1000);
+  assertEqual((uint32_t) 0, systemClock.getMillisToNextRun());
+
+  // Poll for the response until the request times out.
+  systemClock.runCoroutine();
+  assertEqual((uint32_t) SystemClock::kResponsePollMillis,
+      systemClock.getMillisToNextRun());
+  TestableClockInterface::setMillis(995);
+  assertEqual((uint32_t) 5, systemClock.getMillisToNextRun());
+
+  // Wait for the retry, 5 seconds after the timeout.
+  TestableClockInterface::setMillis(1000);
+  systemClock.runCoroutine();
+  assertTrue(systemClock.isDelaying());
+  assertEqual((uint32_t) 5000, systemClock.getMillisToNextRun());
+  TestableClockInterface::setMillis(6000);
+  assertEqual((uint32_t) 0, systemClock.getMillisToNextRun());
+}
+
+// A tickless loop which sleeps until getMillisToNextRun() wakes up about once
+// a minute to keep the clock alive, and still syncs once an hour.
+test(SystemClockDeadlineTest, ticklessLoop) {
+  TestableClockInterface::setMillis(0);
+  CountingClock referenceClock;
+  referenceClock.setNow(100);
+  referenceClock.isResponseReady(true);
+  TestableSystemClockLoop systemClock(&referenceClock, nullptr);
+
+  uint16_t wakeups = 0;
+  for (unsigned long t = 0; t < 7200000; wakeups++) {
+    TestableClockInterface::setMillis(t);
+    systemClock.loop();
+    t += systemClock.getMillisToNextRun();
+  }
+  assertLessOrEqual(wakeups, 2 * 60);
+  assertEqual(2, referenceClock.getNumRequests());
+  assertEqual(SystemClock::kSyncStatusOk, systemClock.getSyncStatusCode());
+
+  // The reference clock is fixed at 100, so the clock was last synced to 100
+  // at the start of the second hour, and kept alive since then.
+  acetime_t now = systemClock.getNow();
+  assertMoreOrEqual(now, (acetime_t) (100 + 3500));
+  assertLessOrEqual(now, (acetime_t) (100 + 3600));
+}
+
+//---------------------------------------------------------------------------
+
+// A TestableSystemClockCoroutine which tells whether the next runCoroutine()
+// resumes its body, instead of only checking its COROUTINE_DELAY().
+class ResumeCountingCoroutine: public TestableSystemClockCoroutine {
+  public:
+    explicit ResumeCountingCoroutine(Clock* referenceClock):
+        TestableSystemClockCoroutine(referenceClock, nullptr) {}
+
+    bool willResume() const {
+      return ! this->isDelaying() || this->isDelayExpired();
+    }
+};
+
+// The coroutine waits for the sync period in delays of about 32.8 seconds,
+// instead of resuming every second. A scheduler which calls runCoroutine()
+// only when it resumes keeps the clock alive, and getSecondsToSyncAttempt()
+// remains accurate.
+test(SystemClockCoroutineDelayTest, longDelay) {
+  TestableClockInterface::setMillis(0);
+  CountingClock referenceClock;
+  referenceClock.setNow(100);
+  referenceClock.isResponseReady(true);
+  ResumeCountingCoroutine systemClock(&referenceClock);
+
+  uint16_t resumes = 0;
+  for (unsigned long t = 0; t < 3600000; t += 100) {
+    TestableClockInterface::setMillis(t);
+    if (systemClock.willResume()) {
+      systemClock.runCoroutine();
+      resumes++;
+    }
+    assertTrue(systemClock.isDelaying());
+    assertEqual((int32_t) ((3600000 - t) / 1000),
+        systemClock.getSecondsToSyncAttempt());
+  }
+  assertLessOrEqual(resumes, 3600 / 32 + 2);
+  assertEqual(1, referenceClock.getNumRequests());
+  assertEqual((acetime_t) (100 + 3599), systemClock.getNow());
+
+  // Next sync attempt after exactly one sync period.
+  TestableClockInterface::setMillis(3600000);
+  assertTrue(systemClock.willResume());
+  systemClock.runCoroutine();
+  assertEqual(2, referenceClock.getNumRequests());
+}
+
+//---------------------------------------------------------------------------
+
+// The steps are remembered only with ACE_TIME_CLOCK_EVENT_CAPTURE, see
+// SystemClockCompactTest for the conversion without it.
+#if ACE_TIME_CLOCK_EVENT_CAPTURE
+
+test(SystemClockCaptureTest, convertCapturedTicks) {
+  uint32_t micros;
+  TestableClockInterface::setMillis(500);
+  TestableSystemClockLoop systemClock(nullptr, nullptr);
+
+  // Captured before the clock was initialized.
+  TestableSystemClockLoop::tick_t beforeInit = systemClock.captureTicks();
+  assertEqual(LocalTime::kInvalidSeconds,
+      systemClock.convertCapturedTicks(beforeInit, &micros));
+  assertEqual((uint32_t) 0, micros);
+
+  TestableClockInterface::setMillis(1000);
+  systemClock.setNow(100);
+  assertEqual(LocalTime::kInvalidSeconds,
+      systemClock.convertCapturedTicks(beforeInit, &micros));
+
+  TestableClockInterface::setMillis(1250);
+  TestableSystemClockLoop::tick_t ticks = systemClock.captureTicks();
+  assertEqual((acetime_t) 100, systemClock.convertCapturedTicks(
+      ticks, &micros));
+  assertEqual((uint32_t) 250000, micros);
+
+  // Converted after the clock advanced a few seconds.
+  TestableClockInterface::setMillis(5100);
+  assertEqual((acetime_t) 104, systemClock.getNow());
+  assertEqual((acetime_t) 100, systemClock.convertCapturedTicks(
+      ticks, &micros));
+  assertEqual((uint32_t) 250000, micros);
+
+  // Captured after the last update of the clock.
+  TestableClockInterface::setMillis(7300);
+  ticks = systemClock.captureTicks();
+  assertEqual((acetime_t) 106, systemClock.convertCapturedTicks(
+      ticks, &micros));
+  assertEqual((uint32_t) 300000, micros);
+}
+
+test(SystemClockCaptureTest, stepBetweenCaptureAndConvert) {
+  uint32_t micros;
+  TestableClockInterface::setMillis(1000);
+  TestableSystemClockLoop systemClock(nullptr, nullptr);
+  systemClock.setNow(100);
+
+  TestableClockInterface::setMillis(1500);
+  TestableSystemClockLoop::tick_t beforeStep = systemClock.captureTicks();
+
+  // Step forward by 100 seconds, with a new sub-second phase.
+  TestableClockInterface::setMillis(2200);
+  systemClock.setNow(200);
+  TestableClockInterface::setMillis(2700);
+  TestableSystemClockLoop::tick_t afterStep = systemClock.captureTicks();
+
+  // The event before the step is converted using the time before the step.
+  assertEqual((acetime_t) 100, systemClock.convertCapturedTicks(
+      beforeStep, &micros));
+  assertEqual((uint32_t) 500000, micros);
+  assertEqual((acetime_t) 200, systemClock.convertCapturedTicks(
+      afterStep, &micros));
+  assertEqual((uint32_t) 500000, micros);
+
+  // The step is forgotten by loop() after half of the rollover period of the
+  // 16-bit ticks, then the old event is converted using the current time.
+  TestableClockInterface::setMillis(40000);
+  systemClock.loop();
+  assertEqual((acetime_t) 199, systemClock.convertCapturedTicks(
+      beforeStep, &micros));
+  assertEqual((uint32_t) 300000, micros);
+}
+
+test(SystemClockCaptureTest, eventRingBuffer) {
+  uint32_t micros;
+  TestableClockInterface::setMillis(1000);
+  TestableSystemClockLoop systemClock(nullptr, nullptr);
+  systemClock.setNow(100);
+  EventRingBuffer<TestableSystemClockLoop::tick_t, 4> events;
+
+  // Simulate 3 interrupts, with a sync step in between.
+  TestableClockInterface::setMillis(1100);
+  assertTrue(events.push(TestableSystemClockLoop::captureTicks()));
+  TestableClockInterface::setMillis(1900);
+  assertTrue(events.push(TestableSystemClockLoop::captureTicks()));
+  TestableClockInterface::setMillis(1950);
+  systemClock.setNow(50);
+  TestableClockInterface::setMillis(2000);
+  assertTrue(events.push(TestableSystemClockLoop::captureTicks()));
+
+  TestableSystemClockLoop::tick_t ticks;
+  assertTrue(events.pop(ticks));
+  assertEqual((acetime_t) 100, systemClock.convertCapturedTicks(
+      ticks, &micros));
+  assertEqual((uint32_t) 100000, micros);
+  assertTrue(events.pop(ticks));
+  assertEqual((acetime_t) 100, systemClock.convertCapturedTicks(
+      ticks, &micros));
+  assertEqual((uint32_t) 900000, micros);
+  assertTrue(events.pop(ticks));
+  assertEqual((acetime_t) 50, systemClock.convertCapturedTicks(
+      ticks, &micros));
+  assertEqual((uint32_t) 50000, micros);
+  assertFalse(events.pop(ticks));
+}
+
+#endif
+
+//---------------------------------------------------------------------------
+
+#if ACE_TIME_CLOCK_LEAP_SECONDS
+
+// Start of the UTC month after the simulated leap second.
+static acetime_t leapBoundary() {
+  return LocalDateTime::forComponents(2050, 7, 1, 0, 0, 0).toEpochSeconds();
+}
+
+// Advance the millis() to `endMillis` in steps of `stepMillis`, calling
+// loop() at each step, and verify that the time returned by getNowMillis()
+// advances by `expectedMillis` at each step.
+static void advanceSmoothly(TestableSystemClockLoop& systemClock,
+    unsigned long startMillis, unsigned long endMillis,
+    unsigned long stepMillis, int32_t expectedMillis) {
+  uint16_t millis;
+  TestableClockInterface::setMillis(startMillis);
+  int64_t prev = (int64_t) systemClock.getNowMillis(&millis) * 1000 + millis;
+  for (unsigned long t = startMillis + stepMillis; t <= endMillis;
+      t += stepMillis) {
+    TestableClockInterface::setMillis(t);
+    systemClock.loop();
+    int64_t now = (int64_t) systemClock.getNowMillis(&millis) * 1000 + millis;
+    assertEqual(expectedMillis, (int32_t) (now - prev));
+    prev = now;
+  }
+}
+
+test(SystemClockLeapTest, ignoredByDefault) {
+  int8_t direction;
+  acetime_t boundary = leapBoundary();
+  TestableClockInterface::setMillis(0);
+  TestableSystemClockLoop systemClock(nullptr, nullptr);
+  assertEqual(SystemClock::kLeapModeIgnore, systemClock.getLeapMode());
+  systemClock.setNow(boundary - 1);
+  systemClock.setLeapSecond(boundary, 1);
+  assertEqual(LocalTime::kInvalidSeconds,
+      systemClock.getPendingLeapSecond(&direction));
+  assertEqual(0, direction);
+
+  TestableClockInterface::setMillis(1000);
+  assertEqual(boundary, systemClock.getNow());
+}
+
+test(SystemClockLeapTest, stepInsert) {
+  uint16_t millis;
+  int8_t direction;
+  acetime_t boundary = leapBoundary();
+  TestableClockInterface::setMillis(0);
+  TestableSystemClockLoop systemClock(nullptr, nullptr);
+  systemClock.setLeapMode(SystemClock::kLeapModeStep);
+  systemClock.setNow(boundary - 2);
+  systemClock.setLeapSecond(boundary, 1);
+  assertEqual(boundary, systemClock.getPendingLeapSecond(&direction));
+  assertEqual(1, direction);
+
+  // 23:59:59 is repeated.
+  TestableClockInterface::setMillis(1999);
+  assertEqual(boundary - 1, systemClock.getNowMillis(&millis));
+  assertEqual(999, millis);
+  TestableSystemClockLoop::tick_t ticks = systemClock.captureTicks();
+  TestableClockInterface::setMillis(2000);
+  assertEqual(boundary - 1, systemClock.getNowMillis(&millis));
+  assertEqual(0, millis);
+
+  // An event captured before the leap second keeps its time.
+  uint32_t micros;
+  TestableClockInterface::setMillis(2500);
+  assertEqual(boundary - 1, systemClock.convertCapturedTicks(ticks, &micros));
+  assertEqual((uint32_t) 999000, micros);
+  TestableClockInterface::setMillis(3000);
+  assertEqual(boundary, systemClock.getNow());
+
+  // The leap second is folded a minute later, without changing the time.
+  TestableClockInterface::setMillis(61000);
+  systemClock.loop();
+  assertEqual(boundary, systemClock.getPendingLeapSecond(&direction));
+  TestableClockInterface::setMillis(62000);
+  systemClock.loop();
+  assertEqual(LocalTime::kInvalidSeconds,
+      systemClock.getPendingLeapSecond(&direction));
+  assertEqual(boundary + 59, systemClock.getNow());
+}
+
+test(SystemClockLeapTest, stepDelete) {
+  acetime_t boundary = leapBoundary();
+  TestableClockInterface::setMillis(0);
+  TestableSystemClockLoop systemClock(nullptr, nullptr);
+  systemClock.setLeapMode(SystemClock::kLeapModeStep);
+  systemClock.setNow(boundary - 2);
+  systemClock.setLeapSecond(boundary, -1);
+
+  // 23:59:59 is skipped.
+  TestableClockInterface::setMillis(999);
+  assertEqual(boundary - 2, systemClock.getNow());
+  TestableClockInterface::setMillis(1000);
+  assertEqual(boundary, systemClock.getNow());
+  TestableClockInterface::setMillis(62000);
+  systemClock.loop();
+  assertEqual(boundary + 61, systemClock.getNow());
+}
+
+test(SystemClockLeapTest, smearInsert) {
+  uint16_t millis;
+  int8_t direction;
+  acetime_t boundary = leapBoundary();
+  TestableClockInterface::setMillis(0);
+  TestableSystemClockLoop systemClock(nullptr, nullptr);
+  systemClock.setLeapMode(SystemClock::kLeapModeSmear, 1000);
+  systemClock.setNow(boundary - 510);
+  systemClock.setLeapSecond(boundary, 1);
+
+  // Normal rate before the window, which starts 500 seconds before the
+  // boundary.
+  advanceSmoothly(systemClock, 0, 10000, 1000, 1000);
+
+  // The clock runs slower by 1 ms per second inside the window. Halfway
+  // through the window, the correction is half a second.
+  advanceSmoothly(systemClock, 10000, 510000, 10000, 9990);
+  assertEqual(boundary - 1, systemClock.getNowMillis(&millis));
+  assertEqual(500, millis);
+  advanceSmoothly(systemClock, 510000, 1010000, 10000, 9990);
+  assertEqual(boundary + 499, systemClock.getNowMillis(&millis));
+  assertEqual(0, millis);
+
+  // Normal rate after the window, across the fold of the leap second.
+  advanceSmoothly(systemClock, 1010000, 1080000, 1000, 1000);
+  assertEqual(LocalTime::kInvalidSeconds,
+      systemClock.getPendingLeapSecond(&direction));
+  assertEqual(boundary + 569, systemClock.getNow());
+}
+
+test(SystemClockLeapTest, smearDelete) {
+  uint16_t millis;
+  acetime_t boundary = leapBoundary();
+  TestableClockInterface::setMillis(0);
+  TestableSystemClockLoop systemClock(nullptr, nullptr);
+  systemClock.setLeapMode(SystemClock::kLeapModeSmear, 100);
+  systemClock.setNow(boundary - 51);
+  systemClock.setLeapSecond(boundary, -1);
+
+  // The window of a deleted second is centered on 23:59:59.
+  advanceSmoothly(systemClock, 0, 100000, 1000, 1010);
+  assertEqual(boundary + 50, systemClock.getNowMillis(&millis));
+  assertEqual(0, millis);
+  advanceSmoothly(systemClock, 100000, 200000, 1000, 1000);
+}
+
+test(SystemClockLeapTest, announcedByReferenceClock) {
+  uint16_t millis;
+  int8_t direction;
+  acetime_t boundary = leapBoundary();
+  TestableClockInterface::setMillis(0);
+  FakeClock referenceClock;
+  TestableSystemClockLoop systemClock(&referenceClock, nullptr);
+  systemClock.setLeapMode(SystemClock::kLeapModeSmear, 1000);
+
+  // The leap second is scheduled at the end of the current month.
+  referenceClock.setNow(boundary - 3600);
+  referenceClock.setLeapIndicator(Clock::kLeapIndicatorInsert);
+  systemClock.forceSync();
+  assertEqual(boundary, systemClock.getPendingLeapSecond(&direction));
+  assertEqual(1, direction);
+
+  // The announcement is withdrawn before the window starts.
+  referenceClock.setLeapIndicator(Clock::kLeapIndicatorNone);
+  systemClock.forceSync();
+  assertEqual(LocalTime::kInvalidSeconds,
+      systemClock.getPendingLeapSecond(&direction));
+
+  // Sync in the middle of the window, during the repeated 23:59:59 of the
+  // stepped UTC reported by the referenceClock. The time does not change.
+  referenceClock.setLeapIndicator(Clock::kLeapIndicatorInsert);
+  systemClock.forceSync();
+  advanceSmoothly(systemClock, 0, 3100000, 10000, 10000);
+  advanceSmoothly(systemClock, 3100000, 3600000, 10000, 9990);
+  assertEqual(boundary - 1, systemClock.getNowMillis(&millis));
+  assertEqual(500, millis);
+  referenceClock.setNow(boundary - 1);
+  referenceClock.setMillis(0);
+  referenceClock.setLeapIndicator(Clock::kLeapIndicatorNone);
+  systemClock.forceSync();
+  assertEqual(0, systemClock.getClockSkew());
+  assertEqual(boundary - 1, systemClock.getNowMillis(&millis));
+  assertEqual(500, millis);
+  assertEqual(boundary, systemClock.getPendingLeapSecond(&direction));
+
+  // Sync after the window to the time which includes the leap second.
+  advanceSmoothly(systemClock, 3600000, 4100000, 10000, 9990);
+  advanceSmoothly(systemClock, 4100000, 4110000, 1000, 1000);
+  assertEqual(boundary + 509, systemClock.getNowMillis(&millis));
+  assertEqual(0, millis);
+  referenceClock.setNow(boundary + 509);
+  referenceClock.setMillis(0);
+  systemClock.forceSync();
+  assertEqual(0, systemClock.getClockSkew());
+  assertEqual(boundary + 509, systemClock.getNowMillis(&millis));
+  assertEqual(0, millis);
+}
+
+test(SystemClockLeapTest, syncInsideSmearWindow) {
+  uint16_t millis;
+  acetime_t boundary = leapBoundary();
+  TestableClockInterface::setMillis(0);
+  FakeClock referenceClock;
+  TestableSystemClockLoop systemClock(&referenceClock, nullptr);
+  systemClock.setLeapMode(SystemClock::kLeapModeSmear, 1000);
+  referenceClock.setNow(boundary - 510);
+  systemClock.forceSync();
+  systemClock.setLeapSecond(boundary, 1);
+
+  // Sync to the unsmeared time before the middle of the window. The smeared
+  // time does not step.
+  advanceSmoothly(systemClock, 0, 10000, 1000, 1000);
+  advanceSmoothly(systemClock, 10000, 210000, 10000, 9990);
+  assertEqual(boundary - 301, systemClock.getNowMillis(&millis));
+  assertEqual(800, millis);
+  referenceClock.setNow(boundary - 300);
+  referenceClock.setMillis(0);
+  systemClock.forceSync();
+  assertEqual(0, systemClock.getClockSkew());
+  assertEqual(boundary - 301, systemClock.getNowMillis(&millis));
+  assertEqual(800, millis);
+
+  // Same after the middle of the window, where the stepped time includes the
+  // leap second.
+  advanceSmoothly(systemClock, 210000, 810000, 10000, 9990);
+  assertEqual(boundary + 299, systemClock.getNowMillis(&millis));
+  assertEqual(200, millis);
+  referenceClock.setNow(boundary + 299);
+  referenceClock.setMillis(0);
+  systemClock.forceSync();
+  assertEqual(0, systemClock.getClockSkew());
+  assertEqual(boundary + 299, systemClock.getNowMillis(&millis));
+  assertEqual(200, millis);
+}
+
+test(SystemClockLeapTest, syncAroundStep) {
+  uint16_t millis;
+  acetime_t boundary = leapBoundary();
+  TestableClockInterface::setMillis(0);
+  FakeClock referenceClock;
+  TestableSystemClockLoop systemClock(&referenceClock, nullptr);
+  systemClock.setLeapMode(SystemClock::kLeapModeStep);
+  referenceClock.setNow(boundary - 3);
+  systemClock.forceSync();
+  systemClock.setLeapSecond(boundary, 1);
+
+  // Sync during the first 23:59:59. The clock is not moved forward.
+  TestableClockInterface::setMillis(2000);
+  referenceClock.setNow(boundary - 1);
+  referenceClock.setMillis(0);
+  systemClock.forceSync();
+  assertEqual(0, systemClock.getClockSkew());
+  TestableClockInterface::setMillis(2999);
+  assertEqual(boundary - 1, systemClock.getNowMillis(&millis));
+  assertEqual(999, millis);
+
+  // Sync during the repeated 23:59:59. The clock is not moved backward.
+  TestableClockInterface::setMillis(3000);
+  systemClock.forceSync();
+  assertEqual(0, systemClock.getClockSkew());
+  assertEqual(boundary - 1, systemClock.getNowMillis(&millis));
+  assertEqual(0, millis);
+
+  // Sync after the step.
+  TestableClockInterface::setMillis(4000);
+  systemClock.loop();
+  referenceClock.setNow(boundary);
+  systemClock.forceSync();
+  assertEqual(0, systemClock.getClockSkew());
+  assertEqual(boundary, systemClock.getNowMillis(&millis));
+  assertEqual(0, millis);
+}
+
+#endif
+
+//---------------------------------------------------------------------------
+
+// A ClockInterface for the instrumentation timings which advances by 10 ticks
+// on every call, so that each iteration of the state machine takes 10 ticks.
+class SteppingClockInterface {
+  public:
+    static uint32_t ticks() { return sTicks += 10; }
+    static uint32_t sTicks;
+};
+
+uint32_t SteppingClockInterface::sTicks = 0;
+
+using InstrumentedSystemClockLoop = SystemClockLoopTemplate<
+    TestableClockInterface,
+    SystemClockStatsInstrumentation<SteppingClockInterface>
+>;
+
+using InstrumentedSystemClockCoroutine = SystemClockCoroutineTemplate<
+    TestableClockInterface,
+    TestableClockInterface,
+    SystemClockStatsInstrumentation<SteppingClockInterface>
+>;
+
+test(SystemClockInstrumentationTest, loop) {
+  TestableClockInterface::setMillis(0);
+  FakeClock referenceClock;
+  InstrumentedSystemClockLoop systemClock(&referenceClock, nullptr, 10, 5);
+  const SystemClockStats& stats = systemClock.getInstrumentation().getStats();
+
+  // Request times out, then wait 5 seconds for the retry.
+  systemClock.loop();
+  TestableClockInterface::setMillis(1000);
+  systemClock.loop();
+  TestableClockInterface::setMillis(6000);
+  systemClock.loop();
+  assertEqual((uint32_t) 1, stats.requestCount);
+  assertEqual((uint32_t) 1, stats.timeoutCount);
+
+  // Request succeeds.
+  referenceClock.setNow(100);
+  referenceClock.isResponseReady(true);
+  systemClock.loop();
+  TestableClockInterface::setMillis(6010);
+  systemClock.loop();
+  assertEqual((uint32_t) 2, stats.requestCount);
+  assertEqual((uint32_t) 1, stats.syncCount);
+  assertEqual((uint32_t) 0, stats.catchUpCount);
+
+  // getNow() not called for 5 seconds.
+  TestableClockInterface::setMillis(11010);
+  assertEqual((acetime_t) 105, systemClock.getNow());
+  assertEqual((uint32_t) 1, stats.catchUpCount);
+  assertEqual((uint32_t) 5, stats.catchUpSeconds);
+
+  // Next request after 10 seconds returns an invalid response.
+  referenceClock.setNow(LocalTime::kInvalidSeconds);
+  TestableClockInterface::setMillis(16000);
+  systemClock.loop();
+  systemClock.loop();
+  TestableClockInterface::setMillis(16010);
+  systemClock.loop();
+  assertEqual((uint32_t) 3, stats.requestCount);
+  assertEqual((uint32_t) 1, stats.syncCount);
+  assertEqual((uint32_t) 1, stats.errorCount);
+  assertEqual((uint32_t) 2, stats.catchUpCount);
+  assertEqual((uint32_t) 9, stats.catchUpSeconds);
+  assertEqual((uint32_t) 5, stats.maxCatchUpSeconds);
+  assertEqual((uint32_t) 9, stats.getNowCount);
+
+  assertEqual((uint32_t) 3,
+      stats.stateCounts[InstrumentedSystemClockLoop::kStatusReady]);
+  assertEqual((uint32_t) 3,
+      stats.stateCounts[InstrumentedSystemClockLoop::kStatusSent]);
+  assertEqual((uint32_t) 1,
+      stats.stateCounts[InstrumentedSystemClockLoop::kStatusOk]);
+  assertEqual((uint32_t) 1,
+      stats.stateCounts[InstrumentedSystemClockLoop::kStatusWaitForRetry]);
+  assertEqual((uint32_t) 30,
+      stats.stateTicks[InstrumentedSystemClockLoop::kStatusReady]);
+  assertEqual((uint32_t) 10,
+      stats.maxStateTicks[InstrumentedSystemClockLoop::kStatusWaitForRetry]);
+
+  systemClock.getInstrumentation().reset();
+  assertEqual((uint32_t) 0, stats.requestCount);
+  assertEqual((uint32_t) 0,
+      stats.stateCounts[InstrumentedSystemClockLoop::kStatusReady]);
+}
+
+test(SystemClockInstrumentationTest, runCoroutine) {
+  TestableClockInterface::setMillis(0);
+  FakeClock referenceClock;
+  referenceClock.setNow(42);
+  referenceClock.isResponseReady(true);
+  InstrumentedSystemClockCoroutine systemClock(&referenceClock, nullptr);
+  const SystemClockStats& stats = systemClock.getInstrumentation().getStats();
+
+  // Send the request, sync, then start delaying.
+  systemClock.runCoroutine();
+  assertTrue(systemClock.isDelaying());
+  assertEqual((uint32_t) 1, stats.requestCount);
+  assertEqual((uint32_t) 1, stats.syncCount);
+
+  // The delay iterations are recorded in the kStatusOk state.
+  TestableClockInterface::setMillis(1000);
+  systemClock.runCoroutine();
+  assertEqual((uint32_t) 1,
+      stats.stateCounts[InstrumentedSystemClockCoroutine::kStatusUnknown]);
+  assertEqual((uint32_t) 1,
+      stats.stateCounts[InstrumentedSystemClockCoroutine::kStatusOk]);
+  assertEqual((uint32_t) 10,
+      stats.stateTicks[InstrumentedSystemClockCoroutine::kStatusOk]);
+}
+
+//---------------------------------------------------------------------------
+
 void setup() {
 #if ! defined(EPOXY_DUINO)
   delay(1000); // wait to prevent garbage on SERIAL_PORT_MONITOR
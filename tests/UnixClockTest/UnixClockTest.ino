@@ -0,0 +1,62 @@
+#line 2 "UnixClockTest.ino"
+
+#include <time.h>
+#include <AUnit.h>
+#include <AceTimeClock.h>
+
+using namespace aunit;
+using ace_time::acetime_t;
+using ace_time::Epoch;
+using ace_time::clock::UnixClock;
+
+test(UnixClockTest, getNow) {
+  UnixClock unixClock;
+  acetime_t expected =
+      time(nullptr) - Epoch::secondsToCurrentEpochFromUnixEpoch64();
+  acetime_t now = unixClock.getNow();
+  // Allow for the second rolling over between the 2 calls.
+  assertLessOrEqual(expected, now);
+  assertLessOrEqual(now, expected + 1);
+}
+
+test(UnixClockTest, getNowMillisAndMicros) {
+  UnixClock unixClock;
+
+  uint16_t millis;
+  acetime_t now = unixClock.getNowMillis(&millis);
+  assertLess(millis, 1000);
+  assertLessOrEqual(now, unixClock.getNow());
+
+  uint32_t micros;
+  now = unixClock.getNowMicros(&micros);
+  assertLess(micros, (uint32_t) 1000000);
+  assertLessOrEqual(now, unixClock.getNow());
+
+  now = unixClock.readResponseMillis(&millis);
+  assertLess(millis, 1000);
+}
+
+test(UnixClockTest, monotonic) {
+  uint64_t startMillis = UnixClock::monotonicMillis();
+  uint64_t startMicros = UnixClock::monotonicMicros();
+  delay(20);
+  uint64_t elapsedMillis = UnixClock::monotonicMillis() - startMillis;
+  uint64_t elapsedMicros = UnixClock::monotonicMicros() - startMicros;
+  assertMoreOrEqual((uint32_t) elapsedMillis, (uint32_t) 20);
+  assertMoreOrEqual((uint32_t) elapsedMicros, (uint32_t) 20000);
+  assertLess((uint32_t) elapsedMillis, (uint32_t) 1000);
+}
+
+//---------------------------------------------------------------------------
+
+void setup() {
+#if ! defined(EPOXY_DUINO)
+  delay(1000); // wait to prevent garbage on SERIAL_PORT_MONITOR
+#endif
+  SERIAL_PORT_MONITOR.begin(115200);
+  while (!SERIAL_PORT_MONITOR); // Leonardo/Micro
+}
+
+void loop() {
+  TestRunner::run();
+}